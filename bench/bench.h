@@ -0,0 +1,209 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "rmlib/time.h"
+#include "rmlib/metrics.h"
+
+namespace bench {
+
+   /**************************************************************************\
+   * options_t
+   * command line settings shared by every benchmark. Work is sized by fixed
+   * iteration counts scaled by scale, never by wall clock, so two runs do the
+   * same work and their results compare
+   \**************************************************************************/
+   struct options_t
+   {
+      std::string filter{};         // run benchmarks whose name contains filter
+      std::string output{};         // JSON file, stdout when empty
+      std::string directory{ "." }; // scratch files of the file benchmarks
+      double scale{ 1.0 };          // multiplies iteration counts and file sizes
+      size_t repeat{ 1 };           // repetitions of each benchmark
+      bool list{ false };
+   };
+
+   // one measurement, a JSON object in the "benchmarks" array
+   struct result_t
+   {
+      std::string name{};
+      size_t repetition{};
+      size_t threads{ 1 };
+      uint64_t iterations{};        // operations timed
+      uint64_t bytes{};             // payload moved by the operations
+      int64_t nsecs{};              // wall clock of all operations
+      bool has_latency{ false };
+      rmlib::histogram_snapshot_t latency{};   // per operation, nanoseconds
+      std::string error{};          // set when the benchmark could not run
+
+      double seconds() const noexcept
+      {
+         return static_cast<double>(nsecs) / 1e9;
+      }
+
+      double ops_per_sec() const noexcept
+      {
+         return nsecs > 0 ? static_cast<double>(iterations) / seconds() : 0.0;
+      }
+
+      double mib_per_sec() const noexcept
+      {
+         return nsecs > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds() : 0.0;
+      }
+   };
+
+   class context_t
+   {
+      const options_t& options_;
+      std::vector<result_t>& results_;
+      std::string name_{};
+      size_t repetition_{};
+
+   public:
+      context_t(const options_t& options, std::vector<result_t>& results, const std::string& name, size_t repetition) noexcept
+         : options_{ options }
+         , results_{ results }
+         , name_{ name }
+         , repetition_{ repetition }
+      {}
+
+      const options_t& options() const noexcept
+      {
+         return options_;
+      }
+
+      // iteration count or size scaled by --scale, at least one
+      uint64_t scaled(uint64_t count) const noexcept
+      {
+         return std::max<uint64_t>(static_cast<uint64_t>(static_cast<double>(count) * options_.scale), 1);
+      }
+
+      // variant is appended to the benchmark name, for example "/1024"
+      void report(result_t result, const std::string& variant = {}) noexcept
+      {
+         result.name = name_ + variant;
+         result.repetition = repetition_;
+         try
+         {
+            results_.push_back(std::move(result));
+         }
+         catch (...) {}
+      }
+
+      void fail(const std::string& variant, const std::string& error) noexcept
+      {
+         result_t result;
+         result.error = error;
+         report(std::move(result), variant);
+      }
+   };
+
+   using function_t = void (*)(context_t&);
+
+   struct benchmark_t
+   {
+      const char* name;
+      function_t function;
+   };
+
+   inline std::vector<benchmark_t>& registry() noexcept
+   {
+      static std::vector<benchmark_t> benchmarks;
+      return benchmarks;
+   }
+
+   // file scope registrar_t objects add each benchmark before main() runs
+   struct registrar_t
+   {
+      registrar_t(const char* name, function_t function) noexcept
+      {
+         try
+         {
+            registry().push_back(benchmark_t{ name, function });
+         }
+         catch (...) {}
+      }
+   };
+
+   // wall clock of a block of operations
+   class stopwatch_t
+   {
+      int64_t start_{ rmlib::steady_clock_t::now() };
+
+   public:
+      void restart() noexcept
+      {
+         start_ = rmlib::steady_clock_t::now();
+      }
+
+      int64_t elapsed() const noexcept
+      {
+         return rmlib::steady_clock_t::now() - start_;
+      }
+   };
+
+   // deterministic payload so runs compare byte for byte
+   inline std::string payload(size_t size) noexcept
+   {
+      std::string data;
+      try
+      {
+         data.resize(size);
+      }
+      catch (...)
+      {
+         return data;
+      }
+      for (size_t i = 0; i < size; ++i) data[i] = static_cast<char>('a' + (i % 26));
+      return data;
+   }
+
+   // keep the optimizer from dropping the work that computed value. Nothing
+   // is stored, so benchmark threads do not share a cache line
+   template <typename T>
+   inline void do_not_optimize(const T& value) noexcept
+   {
+#if defined(XPLAT_CC_MSVC)
+      volatile T sink = value;
+      (void)sink;
+#else
+      asm volatile("" : : "g"(value) : "memory");
+#endif
+   }
+
+} // namespace bench
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCHMARK(name, function) static const bench::registrar_t BENCH_CONCAT(bench_registrar_, __LINE__){ name, function }
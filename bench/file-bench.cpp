@@ -0,0 +1,282 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "rmlib/fstream.h"
+#include "rmlib/llfio.h"
+#include "rmlib/mmap.h"
+#include "bench.h"
+
+using namespace bench;
+using namespace rmlib;
+
+/*****************************************************************************\
+*  file benchmarks write one file sequentially in FILE_BLOCK_SIZE blocks, then
+*  read it back sequentially and in FILE_PAGE_SIZE blocks at random offsets.
+*  The file was just written, so reads measure the page cache path, not the
+*  device. Random offsets come from a fixed seed and repeat run to run
+\*****************************************************************************/
+namespace {
+
+   constexpr size_t FILE_BLOCK_SIZE = 64 * 1024;
+   constexpr size_t FILE_PAGE_SIZE = 4096;
+   constexpr uint64_t FILE_RANDOM_SEED = 42;
+
+   std::string scratch_file(const context_t& context) noexcept
+   {
+      return context.options().directory + "/rmlib-bench-file.bin";
+   }
+
+   uint64_t file_size(const context_t& context) noexcept
+   {
+      // whole blocks, so sequential passes never end on a short block
+      return std::max<uint64_t>(context.scaled(64ull << 20) / FILE_BLOCK_SIZE, 1) * FILE_BLOCK_SIZE;
+   }
+
+   std::vector<off64_t> random_offsets(const context_t& context, uint64_t size) noexcept
+   {
+      std::vector<off64_t> offsets;
+      std::mt19937_64 random(FILE_RANDOM_SEED);
+      std::uniform_int_distribution<uint64_t> page(0, size / FILE_PAGE_SIZE - 1);
+      const uint64_t count = context.scaled(50000);
+      try
+      {
+         offsets.reserve(count);
+         for (uint64_t i = 0; i < count; ++i) offsets.push_back(static_cast<off64_t>(page(random) * FILE_PAGE_SIZE));
+      }
+      catch (...) {}
+      return offsets;
+   }
+
+   void report(context_t& context, const std::string& variant, uint64_t iterations, uint64_t bytes, int64_t nsecs) noexcept
+   {
+      result_t result;
+      result.iterations = iterations;
+      result.bytes = bytes;
+      result.nsecs = nsecs;
+      context.report(std::move(result), variant);
+   }
+
+   // buffered FILE* streams, sequential I/O through the stdio buffer and
+   // random I/O through read_at and write_at
+   void fstream_io(context_t& context) noexcept
+   {
+      const std::string filename = scratch_file(context);
+      const uint64_t size = file_size(context);
+      const uint64_t blocks = size / FILE_BLOCK_SIZE;
+      std::string block = payload(FILE_BLOCK_SIZE);
+      size_t bytes{};
+      {
+         fstream_t file;
+         if (file.open(filename, fstream_t::mode_t::create_always, fstream_t::access_t::write).nok())
+         {
+            context.fail("", "cannot create " + filename);
+            return;
+         }
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (uint64_t i = 0; ok && i < blocks; ++i) ok = file.write(block.data(), block.size(), bytes).ok();
+         ok = ok && file.close().ok();
+         if (!ok)
+         {
+            context.fail("/write/sequential", "write failed");
+            return;
+         }
+         report(context, "/write/sequential", blocks, size, stopwatch.elapsed());
+      }
+      fstream_t file;
+      if (file.open(filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read_write).nok())
+      {
+         context.fail("", "cannot open " + filename);
+         return;
+      }
+      {
+         stopwatch_t stopwatch;
+         uint64_t total{};
+         while (file.read(block.data(), block.size(), bytes).ok() && bytes > 0) total += bytes;
+         if (total != size) context.fail("/read/sequential", "short read");
+         else report(context, "/read/sequential", blocks, total, stopwatch.elapsed());
+      }
+      const std::vector<off64_t> offsets = random_offsets(context, size);
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (size_t i = 0; ok && i < offsets.size(); ++i) ok = file.read_at(block.data(), FILE_PAGE_SIZE, offsets[i], bytes).ok() && bytes == FILE_PAGE_SIZE;
+         if (!ok) context.fail("/read/random", "read failed");
+         else report(context, "/read/random", offsets.size(), offsets.size() * FILE_PAGE_SIZE, stopwatch.elapsed());
+      }
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (size_t i = 0; ok && i < offsets.size(); ++i) ok = file.write_at(block.data(), FILE_PAGE_SIZE, offsets[i], bytes).ok();
+         if (!ok) context.fail("/write/random", "write failed");
+         else report(context, "/write/random", offsets.size(), offsets.size() * FILE_PAGE_SIZE, stopwatch.elapsed());
+      }
+      file.close();
+      std::remove(filename.c_str());
+   }
+
+   // unbuffered positional I/O, each call is one system call. With direct
+   // set the file bypasses the page cache, where the file system allows it
+   void run_llfio(context_t& context, unsigned flags) noexcept
+   {
+      const std::string filename = scratch_file(context);
+      const uint64_t size = file_size(context);
+      const uint64_t blocks = size / FILE_BLOCK_SIZE;
+      aligned_buffer_t block(FILE_BLOCK_SIZE);
+      const std::string data = payload(FILE_BLOCK_SIZE);
+      if (block.empty())
+      {
+         context.fail("", "out of memory");
+         return;
+      }
+      std::memcpy(block.data(), data.data(), FILE_BLOCK_SIZE);
+      llfio_t file;
+      if (status_t status = file.open(filename, llfio_t::mode_t::create_always, llfio_t::access_t::read_write, flags); status.nok())
+      {
+         // direct I/O is not available on every file system, tmpfs refuses it
+         if (flags & llfio_t::direct) std::fprintf(stderr, "  skipped, direct I/O not supported in %s\n", context.options().directory.c_str());
+         else context.fail("", "cannot create " + filename);
+         return;
+      }
+      size_t bytes{};
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (uint64_t i = 0; ok && i < blocks; ++i) ok = file.write_at(block.data(), FILE_BLOCK_SIZE, static_cast<off64_t>(i * FILE_BLOCK_SIZE), bytes).ok();
+         if (!ok) context.fail("/write/sequential", "write failed");
+         else report(context, "/write/sequential", blocks, size, stopwatch.elapsed());
+      }
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (uint64_t i = 0; ok && i < blocks; ++i) ok = file.read_at(block.data(), FILE_BLOCK_SIZE, static_cast<off64_t>(i * FILE_BLOCK_SIZE), bytes).ok() && bytes == FILE_BLOCK_SIZE;
+         if (!ok) context.fail("/read/sequential", "read failed");
+         else report(context, "/read/sequential", blocks, size, stopwatch.elapsed());
+      }
+      const std::vector<off64_t> offsets = random_offsets(context, size);
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (size_t i = 0; ok && i < offsets.size(); ++i) ok = file.read_at(block.data(), FILE_PAGE_SIZE, offsets[i], bytes).ok() && bytes == FILE_PAGE_SIZE;
+         if (!ok) context.fail("/read/random", "read failed");
+         else report(context, "/read/random", offsets.size(), offsets.size() * FILE_PAGE_SIZE, stopwatch.elapsed());
+      }
+      {
+         stopwatch_t stopwatch;
+         bool ok{ true };
+         for (size_t i = 0; ok && i < offsets.size(); ++i) ok = file.write_at(block.data(), FILE_PAGE_SIZE, offsets[i], bytes).ok();
+         if (!ok) context.fail("/write/random", "write failed");
+         else report(context, "/write/random", offsets.size(), offsets.size() * FILE_PAGE_SIZE, stopwatch.elapsed());
+      }
+      file.close();
+      std::remove(filename.c_str());
+   }
+
+   void llfio_io(context_t& context) noexcept
+   {
+      run_llfio(context, llfio_t::none);
+   }
+
+   void llfio_direct_io(context_t& context) noexcept
+   {
+      run_llfio(context, llfio_t::direct);
+   }
+
+   // copies out of a read only mapping, the first pass also faults the pages in
+   void mmap_io(context_t& context) noexcept
+   {
+      const std::string filename = scratch_file(context);
+      const uint64_t size = file_size(context);
+      const uint64_t blocks = size / FILE_BLOCK_SIZE;
+      const std::string block = payload(FILE_BLOCK_SIZE);
+      {
+         llfio_t file;
+         bool ok = file.open(filename, llfio_t::mode_t::create_always).ok();
+         size_t bytes{};
+         for (uint64_t i = 0; ok && i < blocks; ++i) ok = file.write_at(block.data(), FILE_BLOCK_SIZE, static_cast<off64_t>(i * FILE_BLOCK_SIZE), bytes).ok();
+         if (!ok)
+         {
+            context.fail("", "cannot create " + filename);
+            return;
+         }
+      }
+      std::string buffer(FILE_BLOCK_SIZE, '\0');
+      {
+         stopwatch_t stopwatch;
+         mapped_file_t map;
+         if (map.map(filename).nok() || map.size() != size)
+         {
+            context.fail("", "cannot map " + filename);
+            std::remove(filename.c_str());
+            return;
+         }
+         map.advise(advice_t::sequential);
+         std::span<const std::byte> data = map.data();
+         unsigned checksum{};
+         for (uint64_t i = 0; i < blocks; ++i)
+         {
+            std::memcpy(buffer.data(), data.data() + i * FILE_BLOCK_SIZE, FILE_BLOCK_SIZE);
+            checksum += static_cast<unsigned char>(buffer[FILE_BLOCK_SIZE - 1]);
+         }
+         do_not_optimize(checksum);
+         report(context, "/read/sequential", blocks, size, stopwatch.elapsed());
+      }
+      {
+         mapped_file_t map;
+         if (map.map(filename).nok())
+         {
+            context.fail("/read/random", "cannot map " + filename);
+            std::remove(filename.c_str());
+            return;
+         }
+         map.advise(advice_t::random);
+         const std::vector<off64_t> offsets = random_offsets(context, size);
+         std::span<const std::byte> data = map.data();
+         stopwatch_t stopwatch;
+         unsigned checksum{};
+         for (off64_t offset : offsets)
+         {
+            std::memcpy(buffer.data(), data.data() + offset, FILE_PAGE_SIZE);
+            checksum += static_cast<unsigned char>(buffer[FILE_PAGE_SIZE - 1]);
+         }
+         do_not_optimize(checksum);
+         report(context, "/read/random", offsets.size(), offsets.size() * FILE_PAGE_SIZE, stopwatch.elapsed());
+      }
+      std::remove(filename.c_str());
+   }
+
+} // namespace
+
+BENCHMARK("file/fstream", fstream_io);
+BENCHMARK("file/llfio", llfio_io);
+BENCHMARK("file/llfio_direct", llfio_direct_io);
+BENCHMARK("file/mmap", mmap_io);
@@ -0,0 +1,172 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <string>
+#include <string_view>
+#include <cstring>
+
+#include "rmlib/framing.h"
+#include "bench.h"
+
+using namespace bench;
+using namespace rmlib;
+
+/*****************************************************************************\
+*  framing benchmarks split an in memory stream, replayed in recv sized
+*  chunks, into frames. framing/lines_erase is the byte at a time loop with
+*  std::string::erase that framed_reader_t replaces
+\*****************************************************************************/
+namespace {
+
+   constexpr size_t FRAMING_CHUNK = 16 * 1024;
+
+   // replays data in FRAMING_CHUNK pieces, again and again
+   struct replay_source_t
+   {
+      const std::string& data;
+      size_t position{};
+
+      socket::status_t recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      {
+         if (position == data.size()) position = 0;
+         bytes_received = std::min({ len, FRAMING_CHUNK, data.size() - position });
+         std::memcpy(buffer, data.data() + position, bytes_received);
+         position += bytes_received;
+         return socket::status_t{};
+      }
+   };
+
+   std::string make_lines(size_t lines, size_t width) noexcept
+   {
+      std::string text = payload(width);
+      for (char& c : text) if (c == '\n' || c == '\r') c = ' ';
+      std::string stream;
+      for (size_t i = 0; i < lines; ++i) stream += text.substr(0, width - 2 - i % 8) + "\r\n";
+      return stream;
+   }
+
+   void report_frames(context_t& context, const std::string& variant, uint64_t frames, uint64_t bytes, int64_t nsecs) noexcept
+   {
+      result_t result;
+      result.iterations = frames;
+      result.bytes = bytes;
+      result.nsecs = nsecs;
+      context.report(std::move(result), variant);
+   }
+
+   void lines(context_t& context) noexcept
+   {
+      for (size_t width : { 64, 1024 })
+      {
+         const std::string stream = make_lines(1024, width);
+         const uint64_t frames = context.scaled(2'000'000);
+         framed_reader_t reader(frame_options_t{ .format = frame_format_t::crlf });
+         replay_source_t source{ stream };
+         std::string_view frame;
+         uint64_t bytes{};
+         stopwatch_t stopwatch;
+         for (uint64_t n = 0; n < frames; ++n)
+         {
+            if (reader.read(source, frame).nok())
+            {
+               context.fail("/" + std::to_string(width), "read failed");
+               return;
+            }
+            bytes += frame.size() + 2;
+            do_not_optimize(frame.data());
+         }
+         report_frames(context, "/" + std::to_string(width), frames, bytes, stopwatch.elapsed());
+      }
+   }
+
+   // baseline
+   void lines_erase(context_t& context) noexcept
+   {
+      for (size_t width : { 64, 1024 })
+      {
+         const std::string stream = make_lines(1024, width);
+         const uint64_t frames = context.scaled(2'000'000);
+         replay_source_t source{ stream };
+         std::string pending;
+         std::string frame;
+         char chunk[FRAMING_CHUNK];
+         uint64_t bytes{};
+         stopwatch_t stopwatch;
+         for (uint64_t n = 0; n < frames; )
+         {
+            size_t end{};
+            while (end + 1 < pending.size() && !(pending[end] == '\r' && pending[end + 1] == '\n')) ++end;
+            if (end + 1 < pending.size())
+            {
+               frame.assign(pending, 0, end);
+               pending.erase(0, end + 2);
+               bytes += frame.size() + 2;
+               do_not_optimize(frame.data());
+               ++n;
+               continue;
+            }
+            size_t received{};
+            (void)source.recv(chunk, sizeof(chunk), received);
+            pending.append(chunk, received);
+         }
+         report_frames(context, "/" + std::to_string(width), frames, bytes, stopwatch.elapsed());
+      }
+   }
+
+   void length_prefix(context_t& context) noexcept
+   {
+      std::string stream;
+      const std::string text = payload(1024);
+      for (size_t i = 0; i < 1024; ++i)
+      {
+         const uint32_t size = static_cast<uint32_t>(64 + i % 512);
+         for (int shift = 24; shift >= 0; shift -= 8) stream.push_back(static_cast<char>((size >> shift) & 0xff));
+         stream.append(text, 0, size);
+      }
+      const uint64_t frames = context.scaled(2'000'000);
+      framed_reader_t reader(frame_options_t{ .format = frame_format_t::length_prefix });
+      replay_source_t source{ stream };
+      std::string_view frame;
+      uint64_t bytes{};
+      stopwatch_t stopwatch;
+      for (uint64_t n = 0; n < frames; ++n)
+      {
+         if (reader.read(source, frame).nok())
+         {
+            context.fail({}, "read failed");
+            return;
+         }
+         bytes += frame.size() + 4;
+         do_not_optimize(frame.data());
+      }
+      report_frames(context, {}, frames, bytes, stopwatch.elapsed());
+   }
+
+} // namespace
+
+BENCHMARK("framing/lines", lines);
+BENCHMARK("framing/lines_erase", lines_erase);
+BENCHMARK("framing/length_prefix", length_prefix);
@@ -0,0 +1,127 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <array>
+
+#include "rmlib/utility.h"
+#include "bench.h"
+
+using namespace bench;
+using namespace rmlib;
+
+/*****************************************************************************\
+*  lock benchmarks share a fixed number of lock, increment, unlock rounds
+*  between 1 to 8 threads, so the time per operation shows how each lock
+*  scales with contention. Threads start together on a release flag
+\*****************************************************************************/
+namespace {
+
+   constexpr std::array<size_t, 4> LOCK_THREADS{ 1, 2, 4, 8 };
+
+   template <typename Lock>
+   void run_lock(context_t& context) noexcept
+   {
+      for (size_t threads : LOCK_THREADS)
+      {
+         const std::string variant = "/" + std::to_string(threads);
+         const uint64_t rounds = context.scaled(2'000'000) / threads;
+         Lock lock;
+         uint64_t counter{};
+         std::atomic<bool> go{ false };
+         std::atomic<size_t> ready{ 0 };
+         std::vector<std::thread> workers;
+         try
+         {
+            for (size_t i = 0; i < threads; ++i)
+            {
+               workers.emplace_back([&]() {
+                  ready.fetch_add(1);
+                  while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                  for (uint64_t n = 0; n < rounds; ++n)
+                  {
+                     std::lock_guard<Lock> guard(lock);
+                     ++counter;
+                  }
+               });
+            }
+         }
+         catch (...)
+         {
+            go = true;
+            for (auto& worker : workers) worker.join();
+            context.fail(variant, "cannot start threads");
+            continue;
+         }
+         while (ready.load() < threads) std::this_thread::yield();
+         stopwatch_t stopwatch;
+         go.store(true, std::memory_order_release);
+         for (auto& worker : workers) worker.join();
+         const int64_t nsecs = stopwatch.elapsed();
+         if (counter != rounds * threads)
+         {
+            context.fail(variant, "lost updates");
+            continue;
+         }
+         result_t result;
+         result.threads = threads;
+         result.iterations = counter;
+         result.nsecs = nsecs;
+         context.report(std::move(result), variant);
+      }
+   }
+
+   void spin_lock(context_t& context) noexcept
+   {
+      run_lock<spin_lock_t>(context);
+   }
+
+   void ticket_lock(context_t& context) noexcept
+   {
+      run_lock<ticket_lock_t>(context);
+   }
+
+   void rw_spin_lock(context_t& context) noexcept
+   {
+      run_lock<rw_spin_lock_t>(context);
+   }
+
+   // baseline
+   void mutex_lock(context_t& context) noexcept
+   {
+      run_lock<std::mutex>(context);
+   }
+
+} // namespace
+
+BENCHMARK("lock/spin_lock", spin_lock);
+BENCHMARK("lock/ticket_lock", ticket_lock);
+BENCHMARK("lock/rw_spin_lock", rw_spin_lock);
+BENCHMARK("lock/std_mutex", mutex_lock);
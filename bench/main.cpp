@@ -0,0 +1,217 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <thread>
+#include <csignal>
+
+#include "rmlib/xplat.h"
+#include <openssl/opensslv.h>
+#include "bench.h"
+
+/*****************************************************************************\
+*  rmlib-bench [--filter text] [--output file.json] [--scale factor]
+*              [--repeat count] [--dir directory] [--list]
+*  runs the registered benchmarks in name order and writes one JSON document
+*  with an object per benchmark and repetition
+\*****************************************************************************/
+namespace {
+
+   void usage() noexcept
+   {
+      std::fprintf(stderr, "usage: rmlib-bench [--filter text] [--output file.json] [--scale factor] [--repeat count] [--dir directory] [--list]\n");
+   }
+
+   bool parse(int argc, char* argv[], bench::options_t& options) noexcept
+   {
+      for (int i = 1; i < argc; ++i)
+      {
+         const char* arg = argv[i];
+         const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+         if (std::strcmp(arg, "--list") == 0)
+         {
+            options.list = true;
+            continue;
+         }
+         if (!value) return false;
+         if (std::strcmp(arg, "--filter") == 0) options.filter = value;
+         else if (std::strcmp(arg, "--output") == 0) options.output = value;
+         else if (std::strcmp(arg, "--dir") == 0) options.directory = value;
+         else if (std::strcmp(arg, "--scale") == 0) options.scale = std::strtod(value, nullptr);
+         else if (std::strcmp(arg, "--repeat") == 0) options.repeat = std::strtoul(value, nullptr, 10);
+         else return false;
+         ++i;
+      }
+      return options.scale > 0.0 && options.repeat > 0;
+   }
+
+   std::string escape(const std::string& text) noexcept
+   {
+      std::string escaped;
+      for (char c : text)
+      {
+         switch (c)
+         {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+               if (static_cast<unsigned char>(c) < 0x20)
+               {
+                  char code[8];
+                  std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+                  escaped += code;
+               }
+               else escaped += c;
+         }
+      }
+      return escaped;
+   }
+
+   const char* os_name() noexcept
+   {
+#if defined(XPLAT_OS_WINDOWS)
+      return "windows";
+#elif defined(XPLAT_OS_LINUX)
+      return "linux";
+#elif defined(XPLAT_OS_MACOS)
+      return "macos";
+#else
+      return "unknown";
+#endif
+   }
+
+   const char* compiler() noexcept
+   {
+#if defined(__clang__)
+      return "clang " __clang_version__;
+#elif defined(__GNUC__)
+      return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+      return "msvc";
+#else
+      return "unknown";
+#endif
+   }
+
+   void write_json(FILE* out, const bench::options_t& options, const std::vector<bench::result_t>& results) noexcept
+   {
+      std::fprintf(out, "{\n");
+      std::fprintf(out, "  \"context\": {\n");
+      std::fprintf(out, "    \"library\": \"rmlib\",\n");
+      std::fprintf(out, "    \"date\": %lld,\n", static_cast<long long>(std::time(nullptr)));
+      std::fprintf(out, "    \"os\": \"%s\",\n", os_name());
+      std::fprintf(out, "    \"compiler\": \"%s\",\n", escape(compiler()).c_str());
+      std::fprintf(out, "    \"openssl\": \"%s\",\n", escape(OPENSSL_VERSION_TEXT).c_str());
+      std::fprintf(out, "    \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+      std::fprintf(out, "    \"scale\": %g,\n", options.scale);
+      std::fprintf(out, "    \"repeat\": %zu\n", options.repeat);
+      std::fprintf(out, "  },\n");
+      std::fprintf(out, "  \"benchmarks\": [");
+      for (size_t i = 0; i < results.size(); ++i)
+      {
+         const bench::result_t& result = results[i];
+         std::fprintf(out, "%s\n    {\n", i == 0 ? "" : ",");
+         std::fprintf(out, "      \"name\": \"%s\",\n", escape(result.name).c_str());
+         std::fprintf(out, "      \"repetition\": %zu,\n", result.repetition);
+         if (!result.error.empty())
+         {
+            std::fprintf(out, "      \"error\": \"%s\"\n    }", escape(result.error).c_str());
+            continue;
+         }
+         std::fprintf(out, "      \"threads\": %zu,\n", result.threads);
+         std::fprintf(out, "      \"iterations\": %llu,\n", static_cast<unsigned long long>(result.iterations));
+         std::fprintf(out, "      \"bytes\": %llu,\n", static_cast<unsigned long long>(result.bytes));
+         std::fprintf(out, "      \"nsecs\": %lld,\n", static_cast<long long>(result.nsecs));
+         std::fprintf(out, "      \"ops_per_sec\": %.3f,\n", result.ops_per_sec());
+         std::fprintf(out, "      \"mib_per_sec\": %.3f", result.mib_per_sec());
+         if (result.has_latency)
+         {
+            const rmlib::histogram_snapshot_t& latency = result.latency;
+            std::fprintf(out, ",\n      \"latency_ns\": { \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu }",
+               latency.mean(),
+               static_cast<unsigned long long>(latency.percentile(50)),
+               static_cast<unsigned long long>(latency.percentile(90)),
+               static_cast<unsigned long long>(latency.percentile(99)),
+               static_cast<unsigned long long>(latency.percentile(99.9)),
+               static_cast<unsigned long long>(latency.max));
+         }
+         std::fprintf(out, "\n    }");
+      }
+      std::fprintf(out, "\n  ]\n}\n");
+   }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+   bench::options_t options;
+   if (!parse(argc, argv, options))
+   {
+      usage();
+      return 2;
+   }
+#if !defined(XPLAT_OS_WINDOWS)
+   // a peer closing mid send must surface as an error, not kill the run
+   std::signal(SIGPIPE, SIG_IGN);
+#endif
+   std::vector<bench::benchmark_t> benchmarks = bench::registry();
+   std::sort(benchmarks.begin(), benchmarks.end(), [](const auto& a, const auto& b) { return std::strcmp(a.name, b.name) < 0; });
+   std::vector<bench::result_t> results;
+   for (const bench::benchmark_t& benchmark : benchmarks)
+   {
+      if (!options.filter.empty() && std::string(benchmark.name).find(options.filter) == std::string::npos) continue;
+      if (options.list)
+      {
+         std::printf("%s\n", benchmark.name);
+         continue;
+      }
+      for (size_t repetition = 0; repetition < options.repeat; ++repetition)
+      {
+         std::fprintf(stderr, "%s [%zu/%zu]\n", benchmark.name, repetition + 1, options.repeat);
+         bench::context_t context(options, results, benchmark.name, repetition);
+         benchmark.function(context);
+      }
+   }
+   if (options.list) return 0;
+
+   FILE* out = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+   if (!out)
+   {
+      std::fprintf(stderr, "rmlib-bench: cannot open %s\n", options.output.c_str());
+      return 1;
+   }
+   write_json(out, options, results);
+   if (out != stdout) std::fclose(out);
+   bool failed = std::any_of(results.begin(), results.end(), [](const auto& result) { return !result.error.empty(); });
+   return failed ? 1 : 0;
+}
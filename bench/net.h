@@ -0,0 +1,156 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include "rmlib/socket.h"
+#include "bench.h"
+
+namespace bench {
+
+   using namespace rmlib;
+
+   // helpers give up after this long so a broken peer cannot hang a run
+   constexpr wait_timeout_t NET_WAIT_MS = 10000;
+
+   inline ip::address_t loopback() noexcept
+   {
+      ip::address_list_t list;
+      if (socket::status_t status = ip::address_resolution("127.0.0.1", "0", list, ip::resolution_type_t::passive); status.ok() && !list.empty())
+      {
+         return list[0];
+      }
+      return ip::address_t{};
+   }
+
+   // send all of buffer, also on a nonblocking socket
+   inline bool send_all(socket_t& socket, const char* buffer, size_t size) noexcept
+   {
+      size_t index{};
+      size_t bytes{};
+      while (index < size)
+      {
+         socket::status_t status = socket.send(buffer, size, index, bytes);
+         if (status.would_block())
+         {
+            if (socket.wait_event(socket_event_t::send_ready, NET_WAIT_MS).nok()) return false;
+            continue;
+         }
+         if (status.nok()) return false;
+      }
+      return true;
+   }
+
+   // receive exactly size bytes, false if the peer closes first
+   inline bool recv_exact(socket_t& socket, char* buffer, size_t size) noexcept
+   {
+      size_t index{};
+      while (index < size)
+      {
+         size_t bytes{};
+         socket::status_t status = socket.recv(buffer + index, size - index, bytes);
+         if (status.would_block())
+         {
+            if (socket.wait_event(socket_event_t::recv_ready, NET_WAIT_MS).nok()) return false;
+            continue;
+         }
+         if (status.nok() || bytes == 0) return false;
+         index += bytes;
+      }
+      return true;
+   }
+
+   inline bool accept_one(socket_t& listener, socket_t& peer) noexcept
+   {
+      if (listener.wait_event(socket_event_t::accept_ready, NET_WAIT_MS).nok()) return false;
+      return listener.accept(peer).ok();
+   }
+
+   // read until the peer closes, then close
+   inline void drain(socket_t& peer) noexcept
+   {
+      char buffer[1024];
+      size_t bytes{};
+      while (peer.recv(buffer, sizeof(buffer), bytes).ok() && bytes > 0) {}
+      peer.disconnect();
+   }
+
+   /**************************************************************************\
+   * stream benchmark
+   * the client sends total bytes in messages of one size and the server
+   * answers with a single byte once all arrived, so the time measured covers
+   * delivery and not only the copy into the send buffer
+   \**************************************************************************/
+   inline void sink_server(socket_t& listener, uint64_t total, std::atomic<bool>& ok) noexcept
+   {
+      socket_t peer;
+      if (!accept_one(listener, peer)) return;
+      std::string buffer(256 * 1024, '\0');
+      uint64_t received{};
+      while (received < total)
+      {
+         size_t bytes{};
+         if (peer.recv(buffer.data(), static_cast<size_t>(std::min<uint64_t>(buffer.size(), total - received)), bytes).nok() || bytes == 0) return;
+         received += bytes;
+      }
+      const char ack{ 'k' };
+      ok = send_all(peer, &ack, 1);
+      drain(peer);
+   }
+
+   inline bool stream_client(socket_t& client, const std::string& message, uint64_t total, int64_t& nsecs) noexcept
+   {
+      stopwatch_t stopwatch;
+      for (uint64_t sent = 0; sent < total; sent += message.size())
+      {
+         if (!send_all(client, message.data(), static_cast<size_t>(std::min<uint64_t>(message.size(), total - sent)))) return false;
+      }
+      char ack{};
+      if (!recv_exact(client, &ack, 1)) return false;
+      nsecs = stopwatch.elapsed();
+      return true;
+   }
+
+   inline void report_stream(context_t& context, const std::string& variant, uint64_t total, const std::string& message, bool ok, int64_t nsecs) noexcept
+   {
+      if (!ok)
+      {
+         context.fail(variant, "stream failed");
+         return;
+      }
+      result_t result;
+      result.iterations = (total + message.size() - 1) / message.size();
+      result.bytes = total;
+      result.nsecs = nsecs;
+      context.report(std::move(result), variant);
+   }
+
+} // namespace bench
@@ -0,0 +1,197 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <array>
+
+#include "net.h"
+
+using namespace bench;
+
+namespace {
+
+   constexpr std::array<size_t, 4> STREAM_SIZES{ 64, 1024, 16384, 65536 };
+   constexpr std::array<size_t, 3> PING_PONG_SIZES{ 64, 1024, 16384 };
+
+   const char* mode_name(socket_mode_t mode) noexcept
+   {
+      return mode == socket_mode_t::blocking ? "blocking" : "nonblocking";
+   }
+
+   // loopback TCP throughput, one connection per message size
+   void tcp_stream(context_t& context) noexcept
+   {
+      for (socket_mode_t mode : { socket_mode_t::blocking, socket_mode_t::nonblocking })
+      {
+         for (size_t size : STREAM_SIZES)
+         {
+            const std::string variant = std::string("/") + mode_name(mode) + "/" + std::to_string(size);
+            const uint64_t total = context.scaled(64ull << 20);
+            const std::string message = payload(size);
+            socket_t listener;
+            if (listener.listen(loopback()).nok())
+            {
+               context.fail(variant, "listen failed");
+               continue;
+            }
+            std::atomic<bool> ok{ false };
+            std::thread server(sink_server, std::ref(listener), total, std::ref(ok));
+            socket_t client;
+            int64_t nsecs{};
+            bool sent = client.connect(listener.local_address(), mode).ok() && stream_client(client, message, total, nsecs);
+            client.disconnect();
+            server.join();
+            report_stream(context, variant, total, message, sent && ok, nsecs);
+         }
+      }
+   }
+
+   void echo_server(socket_t& listener, size_t size) noexcept
+   {
+      socket_t peer;
+      if (!accept_one(listener, peer)) return;
+      std::string buffer(size, '\0');
+      while (recv_exact(peer, buffer.data(), size) && send_all(peer, buffer.data(), size)) {}
+      peer.disconnect();
+   }
+
+   // round trip latency of one message echoed by the peer
+   void tcp_ping_pong(context_t& context) noexcept
+   {
+      for (socket_mode_t mode : { socket_mode_t::blocking, socket_mode_t::nonblocking })
+      {
+         for (size_t size : PING_PONG_SIZES)
+         {
+            const std::string variant = std::string("/") + mode_name(mode) + "/" + std::to_string(size);
+            const uint64_t iterations = context.scaled(20000);
+            socket_t listener;
+            if (listener.listen(loopback()).nok())
+            {
+               context.fail(variant, "listen failed");
+               continue;
+            }
+            std::thread server(echo_server, std::ref(listener), size);
+            socket_t client;
+            histogram_t latency;
+            std::string message = payload(size);
+            std::string reply(size, '\0');
+            bool ok = client.connect(listener.local_address(), mode, socket_options_t::low_latency()).ok();
+            stopwatch_t total;
+            for (uint64_t i = 0; ok && i < iterations; ++i)
+            {
+               stopwatch_t stopwatch;
+               ok = send_all(client, message.data(), size) && recv_exact(client, reply.data(), size);
+               latency.record(static_cast<uint64_t>(stopwatch.elapsed()));
+            }
+            const int64_t nsecs = total.elapsed();
+            client.disconnect();
+            server.join();
+            if (!ok)
+            {
+               context.fail(variant, "echo failed");
+               continue;
+            }
+            result_t result;
+            result.iterations = iterations;
+            result.bytes = iterations * size * 2;
+            result.nsecs = nsecs;
+            result.has_latency = true;
+            latency.snapshot(result.latency);
+            context.report(std::move(result), variant);
+         }
+      }
+   }
+
+   // server side of the accept benchmarks, counts the connections accepted
+   void accept_server(socket_t& listener, uint64_t connections, bool many, std::atomic<uint64_t>& accepted) noexcept
+   {
+      std::vector<socket_t> clients(many ? 64 : 1);
+      while (accepted < connections)
+      {
+         if (listener.wait_event(socket_event_t::accept_ready, NET_WAIT_MS).nok()) return;
+         size_t count{};
+         socket::status_t status = many ? listener.accept_many(clients, count) : listener.accept(clients[0], socket_mode_t::nonblocking);
+         if (status.would_block()) continue;
+         if (status.nok()) return;
+         if (!many) count = 1;
+         for (size_t i = 0; i < count; ++i) clients[i].disconnect();
+         accepted += count;
+      }
+   }
+
+   // connections accepted per second, the clients connect from one thread
+   void run_accept(context_t& context, bool many) noexcept
+   {
+      const uint64_t connections = context.scaled(2000);
+      socket_t listener;
+      if (listener.listen(loopback(), socket_mode_t::nonblocking).nok())
+      {
+         context.fail("", "listen failed");
+         return;
+      }
+      const ip::address_t address = listener.local_address();
+      std::atomic<uint64_t> accepted{ 0 };
+      stopwatch_t stopwatch;
+      std::thread server(accept_server, std::ref(listener), connections, many, std::ref(accepted));
+      bool ok{ true };
+      for (uint64_t i = 0; ok && i < connections; ++i)
+      {
+         socket_t client;
+         ok = client.connect(address).ok();
+         client.disconnect();
+      }
+      server.join();
+      const int64_t nsecs = stopwatch.elapsed();
+      if (!ok || accepted < connections)
+      {
+         context.fail("", "accept failed");
+         return;
+      }
+      result_t result;
+      result.iterations = connections;
+      result.nsecs = nsecs;
+      context.report(std::move(result));
+   }
+
+   void tcp_accept(context_t& context) noexcept
+   {
+      run_accept(context, false);
+   }
+
+   void tcp_accept_many(context_t& context) noexcept
+   {
+      run_accept(context, true);
+   }
+
+} // namespace
+
+BENCHMARK("tcp/stream", tcp_stream);
+BENCHMARK("tcp/ping_pong", tcp_ping_pong);
+BENCHMARK("tcp/accept", tcp_accept);
+BENCHMARK("tcp/accept_many", tcp_accept_many);
@@ -0,0 +1,222 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <array>
+
+#include "net.h"
+
+using namespace bench;
+
+namespace {
+
+   constexpr std::array<size_t, 3> TLS_STREAM_SIZES{ 1024, 4096, SOCKET_TLS_MAX_RECORD_SIZE };
+
+   std::string certificate_file(const options_t& options) noexcept
+   {
+      return options.directory + "/rmlib-bench-cert.pem";
+   }
+
+   std::string key_file(const options_t& options) noexcept
+   {
+      return options.directory + "/rmlib-bench-key.pem";
+   }
+
+   // self-signed P-256 certificate, the handshake cost is dominated by ECDHE
+   // and ECDSA as with most production certificates
+   bool make_certificate(const options_t& options) noexcept
+   {
+      bool ok{ false };
+      EVP_PKEY* pkey{ nullptr };
+      X509* cert{ nullptr };
+      if (EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr); pctx)
+      {
+         if (EVP_PKEY_keygen_init(pctx) == 1 && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) == 1)
+         {
+            EVP_PKEY_keygen(pctx, &pkey);
+         }
+         EVP_PKEY_CTX_free(pctx);
+      }
+      if (pkey && (cert = X509_new()) != nullptr)
+      {
+         X509_set_version(cert, 2);
+         ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+         X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+         X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+         X509_set_pubkey(cert, pkey);
+         X509_NAME* name = X509_get_subject_name(cert);
+         X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+         X509_set_issuer_name(cert, name);
+         if (X509_sign(cert, pkey, EVP_sha256()) > 0)
+         {
+            FILE* cert_file = std::fopen(certificate_file(options).c_str(), "wb");
+            FILE* key_out = std::fopen(key_file(options).c_str(), "wb");
+            ok = cert_file && key_out && PEM_write_X509(cert_file, cert) == 1 && PEM_write_PrivateKey(key_out, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+            if (cert_file) std::fclose(cert_file);
+            if (key_out) std::fclose(key_out);
+         }
+      }
+      X509_free(cert);
+      EVP_PKEY_free(pkey);
+      return ok;
+   }
+
+   void remove_certificate(const options_t& options) noexcept
+   {
+      std::remove(certificate_file(options).c_str());
+      std::remove(key_file(options).c_str());
+   }
+
+   // TLS records and handshake flights are small writes that Nagle would
+   // hold back for the peer's delayed ack, all TLS sockets set no_delay
+
+   // accept connections, send one byte so the client reads the session
+   // tickets that follow the handshake, then wait for the client to close
+   void handshake_server(socket_t& listener, uint64_t connections) noexcept
+   {
+      for (uint64_t i = 0; i < connections; ++i)
+      {
+         socket_t peer;
+         if (!accept_one(listener, peer)) return;
+         const char hello{ 'h' };
+         if (!send_all(peer, &hello, 1)) continue;
+         drain(peer);
+      }
+   }
+
+   // full handshakes, or abbreviated ones when the client caches sessions
+   void run_handshake(context_t& context, bool resume) noexcept
+   {
+      if (!make_certificate(context.options()))
+      {
+         context.fail("", "cannot create certificate");
+         return;
+      }
+      tls::context_t server_ctx(tls::context_type_t::server, certificate_file(context.options()).c_str(), key_file(context.options()).c_str());
+      tls::context_t client_ctx(tls::context_type_t::client);
+      remove_certificate(context.options());
+      if (server_ctx.status().nok() || client_ctx.status().nok() || (resume && client_ctx.enable_session_cache().nok()))
+      {
+         context.fail("", "cannot create TLS contexts");
+         return;
+      }
+      socket_t listener(server_ctx);
+      if (listener.listen(loopback(), socket_mode_t::blocking, SOCKET_DEFAULT_LISTEN_BACKLOG, socket_options_t::low_latency()).nok())
+      {
+         context.fail("", "listen failed");
+         return;
+      }
+      const uint64_t connections = context.scaled(500);
+      const ip::address_t address = listener.local_address();
+      std::thread server(handshake_server, std::ref(listener), connections);
+      histogram_t latency;
+      uint64_t resumed{};
+      bool ok{ true };
+      stopwatch_t total;
+      for (uint64_t i = 0; ok && i < connections; ++i)
+      {
+         socket_t client(client_ctx);
+         stopwatch_t stopwatch;
+         ok = client.connect(address, socket_mode_t::blocking, socket_options_t::low_latency()).ok();
+         latency.record(static_cast<uint64_t>(stopwatch.elapsed()));
+         if (client.is_resumed()) ++resumed;
+         char hello{};
+         ok = ok && recv_exact(client, &hello, 1);
+         client.disconnect();
+      }
+      const int64_t nsecs = total.elapsed();
+      server.join();
+      // all but the first connection should resume
+      if (!ok || (resume && resumed + 1 < connections))
+      {
+         context.fail("", ok ? "sessions not resumed" : "handshake failed");
+         return;
+      }
+      result_t result;
+      result.iterations = connections;
+      result.nsecs = nsecs;
+      result.has_latency = true;
+      latency.snapshot(result.latency);
+      context.report(std::move(result));
+   }
+
+   void tls_handshake_full(context_t& context) noexcept
+   {
+      run_handshake(context, false);
+   }
+
+   void tls_handshake_resumed(context_t& context) noexcept
+   {
+      run_handshake(context, true);
+   }
+
+   // encrypt and decrypt throughput over one connection, each send is one
+   // TLS record up to SOCKET_TLS_MAX_RECORD_SIZE bytes
+   void tls_stream(context_t& context) noexcept
+   {
+      if (!make_certificate(context.options()))
+      {
+         context.fail("", "cannot create certificate");
+         return;
+      }
+      tls::context_t server_ctx(tls::context_type_t::server, certificate_file(context.options()).c_str(), key_file(context.options()).c_str());
+      tls::context_t client_ctx(tls::context_type_t::client);
+      remove_certificate(context.options());
+      if (server_ctx.status().nok() || client_ctx.status().nok())
+      {
+         context.fail("", "cannot create TLS contexts");
+         return;
+      }
+      for (size_t size : TLS_STREAM_SIZES)
+      {
+         const std::string variant = "/" + std::to_string(size);
+         const uint64_t total = context.scaled(64ull << 20);
+         const std::string message = payload(size);
+         socket_t listener(server_ctx);
+         if (listener.listen(loopback(), socket_mode_t::blocking, SOCKET_DEFAULT_LISTEN_BACKLOG, socket_options_t::low_latency()).nok())
+         {
+            context.fail(variant, "listen failed");
+            continue;
+         }
+         std::atomic<bool> ok{ false };
+         std::thread server(sink_server, std::ref(listener), total, std::ref(ok));
+         socket_t client(client_ctx);
+         int64_t nsecs{};
+         bool sent = client.connect(listener.local_address(), socket_mode_t::blocking, socket_options_t::low_latency()).ok() && stream_client(client, message, total, nsecs);
+         client.disconnect();
+         server.join();
+         report_stream(context, variant, total, message, sent && ok, nsecs);
+      }
+   }
+
+} // namespace
+
+BENCHMARK("tls/handshake/full", tls_handshake_full);
+BENCHMARK("tls/handshake/resumed", tls_handshake_resumed);
+BENCHMARK("tls/stream", tls_stream);
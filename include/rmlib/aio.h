@@ -0,0 +1,819 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <span>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "rmlib/xplat.h"
+#include "rmlib/status.h"
+#include "rmlib/utility.h"
+#include "rmlib/llfio.h"
+
+#if defined(XPLAT_OS_LINUX) && __has_include(<linux/io_uring.h>)
+   #include <sys/mman.h>
+   #include <sys/syscall.h>
+   #include <sys/uio.h>
+   #include <linux/io_uring.h>
+   #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+      #define XPLAT_IO_URING
+   #endif
+#endif
+
+namespace rmlib
+{
+   constexpr unsigned AIO_DEFAULT_QUEUE_DEPTH = 256;
+   constexpr size_t AIO_DEFAULT_THREAD_POOL_SIZE = 4;
+
+   namespace aio
+   {
+      enum class op_t { read, write, fsync, datasync };
+
+      enum class backend_t { automatic, io_uring, iocp, thread_pool };
+
+      /**************************************************************************\
+      * request_t
+      * one asynchronous read, write or flush. The buffer must stay valid until
+      * the completion with the same user_data is reaped. buffer_index selects a
+      * buffer registered with queue_t::register_buffers() and file_index a file
+      * registered with queue_t::register_files(), in which case handle is ignored
+      \**************************************************************************/
+      struct request_t
+      {
+         op_t op{ op_t::read };
+         HANDLE handle{ llfio_t::invalid_handle() };
+         void* buffer{ nullptr };
+         size_t size{};
+         off64_t offset{};
+         uint64_t user_data{};
+         int buffer_index{ -1 };
+         int file_index{ -1 };
+      };
+
+      // completions are reported in any order, match them back with user_data.
+      // Short reads at the end of file complete with ok status and fewer bytes
+      struct completion_t
+      {
+         uint64_t user_data{};
+         status_t status{};
+         size_t bytes{};
+      };
+
+      inline request_t read(const llfio_t& file, void* buffer, size_t size, off64_t offset, uint64_t user_data) noexcept
+      {
+         return request_t{ op_t::read, file.handle(), buffer, size, offset, user_data };
+      }
+
+      inline request_t write(const llfio_t& file, const void* buffer, size_t size, off64_t offset, uint64_t user_data) noexcept
+      {
+         return request_t{ op_t::write, file.handle(), const_cast<void*>(buffer), size, offset, user_data };
+      }
+
+      inline request_t fsync(const llfio_t& file, uint64_t user_data) noexcept
+      {
+         return request_t{ op_t::fsync, file.handle(), nullptr, 0, 0, user_data };
+      }
+
+      inline request_t datasync(const llfio_t& file, uint64_t user_data) noexcept
+      {
+         return request_t{ op_t::datasync, file.handle(), nullptr, 0, 0, user_data };
+      }
+
+#if defined(XPLAT_IO_URING)
+      /**************************************************************************\
+      * uring_t
+      * io_uring driven through the raw system calls, no liburing dependency.
+      * Requests are copied straight into the submission ring and user_data is
+      * carried by the kernel, so submit and reap never allocate
+      \**************************************************************************/
+      class uring_t
+      {
+         int fd_{ -1 };
+         void* sq_ring_{ MAP_FAILED };
+         size_t sq_ring_size_{};
+         void* cq_ring_{ MAP_FAILED };
+         size_t cq_ring_size_{};
+         io_uring_sqe* sqes_{ static_cast<io_uring_sqe*>(MAP_FAILED) };
+         size_t sqes_size_{};
+         unsigned* sq_head_{ nullptr };
+         unsigned* sq_tail_{ nullptr };
+         unsigned* sq_array_{ nullptr };
+         unsigned sq_mask_{};
+         unsigned sq_entries_{};
+         unsigned* cq_head_{ nullptr };
+         unsigned* cq_tail_{ nullptr };
+         io_uring_cqe* cqes_{ nullptr };
+         unsigned cq_mask_{};
+         unsigned cq_entries_{};
+         unsigned unsubmitted_{};
+         size_t in_flight_{};
+
+      public:
+         uring_t() = default;
+         uring_t(const uring_t&) = delete;
+         uring_t(uring_t&&) = delete;
+         uring_t& operator=(const uring_t&) = delete;
+         uring_t& operator=(uring_t&&) = delete;
+
+         ~uring_t() noexcept
+         {
+            close();
+         }
+
+         status_t setup(unsigned entries) noexcept
+         {
+            io_uring_params params{};
+            int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0) return status_t(errno);
+            fd_ = fd;
+            sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+               sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            }
+            sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            if (sq_ring_ == MAP_FAILED) return fail(errno);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+               cq_ring_ = sq_ring_;
+            }
+            else
+            {
+               cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+               if (cq_ring_ == MAP_FAILED) return fail(errno);
+            }
+            sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+            if (sqes_ == MAP_FAILED) return fail(errno);
+
+            char* sq = static_cast<char*>(sq_ring_);
+            sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_entries_ = params.sq_entries;
+            char* cq = static_cast<char*>(cq_ring_);
+            cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cq_entries_ = params.cq_entries;
+            return status_t{};
+         }
+
+         void close() noexcept
+         {
+            if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_size_);
+            if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+            if (sq_ring_ != MAP_FAILED) ::munmap(sq_ring_, sq_ring_size_);
+            if (fd_ != -1) ::close(fd_);
+            fd_ = -1;
+            sq_ring_ = cq_ring_ = MAP_FAILED;
+            sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+            unsubmitted_ = 0;
+            in_flight_ = 0;
+         }
+
+         size_t in_flight() const noexcept
+         {
+            return in_flight_;
+         }
+
+         status_t register_buffers(std::span<const std::span<char>> buffers) noexcept
+         {
+            std::vector<iovec> iov(buffers.size());
+            for (size_t i = 0; i < buffers.size(); ++i)
+            {
+               iov[i].iov_base = buffers[i].data();
+               iov[i].iov_len = buffers[i].size();
+            }
+            ::syscall(__NR_io_uring_register, fd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+            if (iov.empty()) return status_t{};
+            if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(iov.size())) < 0) return status_t(errno);
+            return status_t{};
+         }
+
+         status_t register_files(std::span<const HANDLE> files) noexcept
+         {
+            ::syscall(__NR_io_uring_register, fd_, IORING_UNREGISTER_FILES, nullptr, 0);
+            if (files.empty()) return status_t{};
+            if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_FILES, files.data(), static_cast<unsigned>(files.size())) < 0) return status_t(errno);
+            return status_t{};
+         }
+
+         // submitted is the number of requests accepted into the ring. Requests the
+         // kernel could not take yet stay in the ring and go with the next enter
+         status_t submit(std::span<const request_t> requests, size_t& submitted) noexcept
+         {
+            submitted = 0;
+            unsigned tail = *sq_tail_;
+            unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+            size_t space = std::min<size_t>(sq_entries_ - (tail - head), cq_entries_ - in_flight_);
+            size_t count = std::min(requests.size(), space);
+            for (size_t i = 0; i < count; ++i)
+            {
+               unsigned index = tail & sq_mask_;
+               prepare(sqes_[index], requests[i]);
+               sq_array_[index] = index;
+               ++tail;
+            }
+            std::atomic_ref<unsigned>(*sq_tail_).store(tail, std::memory_order_release);
+            submitted = count;
+            in_flight_ += count;
+            unsubmitted_ += static_cast<unsigned>(count);
+            if (count == 0 && !requests.empty()) return status_t(EAGAIN);
+            return enter(0);
+         }
+
+         status_t reap(std::span<completion_t> completions, size_t min_complete, size_t& count) noexcept
+         {
+            count = 0;
+            min_complete = std::min({ min_complete, in_flight_, completions.size() });
+            if (unsubmitted_ > 0 || ready() < min_complete)
+            {
+               if (status_t status = enter(static_cast<unsigned>(min_complete)); status.nok()) return status;
+            }
+            unsigned head = *cq_head_;
+            unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+            while (head != tail && count < completions.size())
+            {
+               const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+               completion_t& completion = completions[count++];
+               completion.user_data = cqe.user_data;
+               completion.status = cqe.res < 0 ? status_t(-cqe.res) : status_t{};
+               completion.bytes = cqe.res < 0 ? 0 : static_cast<size_t>(cqe.res);
+               ++head;
+            }
+            std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+            in_flight_ -= count;
+            return status_t{};
+         }
+
+      private:
+         status_t fail(int error) noexcept
+         {
+            close();
+            return status_t(error);
+         }
+
+         unsigned ready() const noexcept
+         {
+            return std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire) - *cq_head_;
+         }
+
+         status_t enter(unsigned min_complete) noexcept
+         {
+            unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+            while (unsubmitted_ > 0 || min_complete > 0)
+            {
+               int ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, unsubmitted_, min_complete, flags, nullptr, 0));
+               if (ret < 0)
+               {
+                  // EAGAIN and EBUSY mean the kernel is short of resources or the
+                  // completion ring is full, the entries stay queued until reaped
+                  if (errno == EINTR) continue;
+                  if (errno == EAGAIN || errno == EBUSY) return status_t{};
+                  return status_t(errno);
+               }
+               unsubmitted_ -= std::min<unsigned>(unsubmitted_, static_cast<unsigned>(ret));
+               break;
+            }
+            return status_t{};
+         }
+
+         static void prepare(io_uring_sqe& sqe, const request_t& request) noexcept
+         {
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.fd = request.file_index >= 0 ? request.file_index : request.handle;
+            sqe.flags = request.file_index >= 0 ? IOSQE_FIXED_FILE : 0;
+            sqe.user_data = request.user_data;
+            switch (request.op)
+            {
+               case op_t::read:
+               case op_t::write:
+                  if (request.buffer_index >= 0)
+                  {
+                     sqe.opcode = request.op == op_t::read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                     sqe.buf_index = static_cast<uint16_t>(request.buffer_index);
+                  }
+                  else
+                  {
+                     sqe.opcode = request.op == op_t::read ? IORING_OP_READ : IORING_OP_WRITE;
+                  }
+                  sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+                  sqe.len = static_cast<uint32_t>(request.size);
+                  sqe.off = static_cast<uint64_t>(request.offset);
+                  break;
+               case op_t::fsync:
+               case op_t::datasync:
+                  sqe.opcode = IORING_OP_FSYNC;
+                  sqe.fsync_flags = request.op == op_t::datasync ? IORING_FSYNC_DATASYNC : 0;
+                  break;
+            }
+         }
+      }; // class uring_t
+#endif
+
+#if defined(XPLAT_OS_WINDOWS)
+      /**************************************************************************\
+      * iocp_t
+      * overlapped file I/O completed through an I/O completion port. Files must
+      * be opened with llfio_t::async. Each request takes an operation slot from
+      * a fixed table sized to the queue depth, so submit and reap never allocate.
+      * Windows has no overlapped flush, fsync and datasync run inline and post
+      * their completion to the port
+      \**************************************************************************/
+      class iocp_t
+      {
+         struct operation_t
+         {
+            OVERLAPPED overlapped{};
+            HANDLE handle{ INVALID_HANDLE_VALUE };
+            uint64_t user_data{};
+            DWORD error{};
+         };
+
+         HANDLE port_{ nullptr };
+         std::vector<operation_t> operations_{};
+         std::vector<operation_t*> free_{};
+         std::vector<OVERLAPPED_ENTRY> entries_{};
+         std::vector<HANDLE> files_{};
+         size_t in_flight_{};
+
+      public:
+         iocp_t() = default;
+         iocp_t(const iocp_t&) = delete;
+         iocp_t(iocp_t&&) = delete;
+         iocp_t& operator=(const iocp_t&) = delete;
+         iocp_t& operator=(iocp_t&&) = delete;
+
+         ~iocp_t() noexcept
+         {
+            close();
+         }
+
+         status_t setup(unsigned entries) noexcept
+         {
+            port_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+            if (!port_) return status_t(xlate_windows_error_code(::GetLastError()));
+            operations_.resize(entries);
+            entries_.resize(entries);
+            free_.reserve(entries);
+            for (operation_t& operation : operations_) free_.push_back(&operation);
+            return status_t{};
+         }
+
+         void close() noexcept
+         {
+            if (port_) ::CloseHandle(port_);
+            port_ = nullptr;
+            in_flight_ = 0;
+         }
+
+         size_t in_flight() const noexcept
+         {
+            return in_flight_;
+         }
+
+         // the kernel already maps user buffers for overlapped I/O, nothing to pin
+         status_t register_buffers(std::span<const std::span<char>>) noexcept
+         {
+            return status_t{};
+         }
+
+         status_t register_files(std::span<const HANDLE> files) noexcept
+         {
+            files_.assign(files.begin(), files.end());
+            for (HANDLE handle : files_) associate(handle);
+            return status_t{};
+         }
+
+         status_t submit(std::span<const request_t> requests, size_t& submitted) noexcept
+         {
+            submitted = 0;
+            for (const request_t& request : requests)
+            {
+               if (free_.empty()) break;
+               HANDLE handle = request.file_index >= 0 ? files_[request.file_index] : request.handle;
+               if (request.file_index < 0) associate(handle);
+               operation_t* operation = free_.back();
+               free_.pop_back();
+               *operation = operation_t{};
+               operation->handle = handle;
+               operation->user_data = request.user_data;
+               operation->overlapped.Offset = low32(static_cast<uint64_t>(request.offset));
+               operation->overlapped.OffsetHigh = high32(static_cast<uint64_t>(request.offset));
+               BOOL ret{ TRUE };
+               switch (request.op)
+               {
+                  case op_t::read:
+                     ret = ::ReadFile(handle, request.buffer, static_cast<DWORD>(request.size), nullptr, &operation->overlapped);
+                     break;
+                  case op_t::write:
+                     ret = ::WriteFile(handle, request.buffer, static_cast<DWORD>(request.size), nullptr, &operation->overlapped);
+                     break;
+                  case op_t::fsync:
+                  case op_t::datasync:
+                     if (!::FlushFileBuffers(handle)) operation->error = ::GetLastError();
+                     ::PostQueuedCompletionStatus(port_, 0, 0, &operation->overlapped);
+                     break;
+               }
+               if (!ret && ::GetLastError() != ERROR_IO_PENDING)
+               {
+                  operation->error = ::GetLastError();
+                  ::PostQueuedCompletionStatus(port_, 0, 0, &operation->overlapped);
+               }
+               ++submitted;
+               ++in_flight_;
+            }
+            if (submitted == 0 && !requests.empty()) return status_t(EAGAIN);
+            return status_t{};
+         }
+
+         status_t reap(std::span<completion_t> completions, size_t min_complete, size_t& count) noexcept
+         {
+            count = 0;
+            min_complete = std::min({ min_complete, in_flight_, completions.size() });
+            while (count < completions.size())
+            {
+               ULONG removed{};
+               ULONG max = static_cast<ULONG>(std::min(entries_.size(), completions.size() - count));
+               DWORD timeout = count < min_complete ? INFINITE : 0;
+               if (!::GetQueuedCompletionStatusEx(port_, entries_.data(), max, &removed, timeout, FALSE))
+               {
+                  DWORD error = ::GetLastError();
+                  if (error == WAIT_TIMEOUT) break;
+                  return status_t(xlate_windows_error_code(error));
+               }
+               for (ULONG i = 0; i < removed; ++i)
+               {
+                  operation_t* operation = CONTAINING_RECORD(entries_[i].lpOverlapped, operation_t, overlapped);
+                  completion_t& completion = completions[count++];
+                  completion.user_data = operation->user_data;
+                  completion.bytes = entries_[i].dwNumberOfBytesTransferred;
+                  DWORD error = operation->error;
+                  DWORD bytes{};
+                  if (!error && !::GetOverlappedResult(operation->handle, &operation->overlapped, &bytes, FALSE)) error = ::GetLastError();
+                  if (error == ERROR_HANDLE_EOF) error = 0;
+                  completion.status = error ? status_t(xlate_windows_error_code(error)) : status_t{};
+                  free_.push_back(operation);
+                  --in_flight_;
+               }
+               if (count >= min_complete) break;
+            }
+            return status_t{};
+         }
+
+      private:
+         // associating a handle twice fails harmlessly, the first association stands
+         void associate(HANDLE handle) noexcept
+         {
+            ::CreateIoCompletionPort(handle, port_, 0, 0);
+         }
+      }; // class iocp_t
+#endif
+
+      /**************************************************************************\
+      * thread_pool_t
+      * portable fallback, a few worker threads running positional llfio_t
+      * calls. Used where io_uring is not available or is blocked by policy
+      \**************************************************************************/
+      class thread_pool_t
+      {
+         std::vector<std::thread> threads_{};
+         std::deque<request_t> requests_{};
+         std::deque<completion_t> completions_{};
+         std::vector<HANDLE> files_{};
+         std::mutex mutex_{};
+         std::condition_variable request_cv_{};
+         std::condition_variable completion_cv_{};
+         size_t in_flight_{};
+         bool stop_{ false };
+
+      public:
+         thread_pool_t() = default;
+         thread_pool_t(const thread_pool_t&) = delete;
+         thread_pool_t(thread_pool_t&&) = delete;
+         thread_pool_t& operator=(const thread_pool_t&) = delete;
+         thread_pool_t& operator=(thread_pool_t&&) = delete;
+
+         ~thread_pool_t() noexcept
+         {
+            close();
+         }
+
+         status_t setup(size_t threads) noexcept
+         {
+            try
+            {
+               for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+               {
+                  threads_.emplace_back([this]() { run(); });
+               }
+            }
+            catch (...)
+            {
+               close();
+               return status_t(EAGAIN);
+            }
+            return status_t{};
+         }
+
+         void close() noexcept
+         {
+            {
+               std::lock_guard<std::mutex> lock(mutex_);
+               stop_ = true;
+            }
+            request_cv_.notify_all();
+            for (std::thread& thread : threads_)
+            {
+               if (thread.joinable()) thread.join();
+            }
+            threads_.clear();
+            requests_.clear();
+            completions_.clear();
+            in_flight_ = 0;
+            stop_ = false;
+         }
+
+         size_t in_flight() noexcept
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return in_flight_;
+         }
+
+         status_t register_buffers(std::span<const std::span<char>>) noexcept
+         {
+            return status_t{};
+         }
+
+         status_t register_files(std::span<const HANDLE> files) noexcept
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            files_.assign(files.begin(), files.end());
+            return status_t{};
+         }
+
+         status_t submit(std::span<const request_t> requests, size_t& submitted) noexcept
+         {
+            {
+               std::lock_guard<std::mutex> lock(mutex_);
+               requests_.insert(requests_.end(), requests.begin(), requests.end());
+               in_flight_ += requests.size();
+            }
+            submitted = requests.size();
+            if (submitted > 1) request_cv_.notify_all();
+            else request_cv_.notify_one();
+            return status_t{};
+         }
+
+         status_t reap(std::span<completion_t> completions, size_t min_complete, size_t& count) noexcept
+         {
+            count = 0;
+            std::unique_lock<std::mutex> lock(mutex_);
+            min_complete = std::min({ min_complete, in_flight_, completions.size() });
+            completion_cv_.wait(lock, [&]() { return completions_.size() >= min_complete; });
+            while (!completions_.empty() && count < completions.size())
+            {
+               completions[count++] = std::move(completions_.front());
+               completions_.pop_front();
+            }
+            in_flight_ -= count;
+            return status_t{};
+         }
+
+      private:
+         void run() noexcept
+         {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+               request_cv_.wait(lock, [this]() { return stop_ || !requests_.empty(); });
+               if (stop_) break;
+               request_t request = requests_.front();
+               requests_.pop_front();
+               if (request.file_index >= 0) request.handle = files_[request.file_index];
+               lock.unlock();
+               completion_t completion = execute(request);
+               lock.lock();
+               completions_.push_back(std::move(completion));
+               completion_cv_.notify_all();
+            }
+         }
+
+         static completion_t execute(const request_t& request) noexcept
+         {
+            completion_t completion{ request.user_data };
+            switch (request.op)
+            {
+               case op_t::read:
+                  completion.status = llfio_t::read_at(request.handle, request.buffer, request.size, request.offset, completion.bytes);
+                  break;
+               case op_t::write:
+                  completion.status = llfio_t::write_at(request.handle, request.buffer, request.size, request.offset, completion.bytes);
+                  break;
+               case op_t::fsync:
+                  completion.status = llfio_t::sync(request.handle);
+                  break;
+               case op_t::datasync:
+                  completion.status = llfio_t::datasync(request.handle);
+                  break;
+            }
+            return completion;
+         }
+      }; // class thread_pool_t
+
+      /**************************************************************************\
+      * queue_t
+      * batched asynchronous file I/O. Submit any number of requests with one
+      * call and reap completions in batches. The native backend is io_uring on
+      * Linux and IOCP on Windows; when it cannot be set up queue_t falls back
+      * to the thread pool. A queue_t must be driven by one thread at a time
+      \**************************************************************************/
+      class queue_t
+      {
+         backend_t backend_{ backend_t::thread_pool };
+         status_t status_{};
+#if defined(XPLAT_IO_URING)
+         uring_t uring_{};
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+         iocp_t iocp_{};
+#endif
+         thread_pool_t pool_{};
+
+      public:
+         explicit queue_t(unsigned depth = AIO_DEFAULT_QUEUE_DEPTH, backend_t backend = backend_t::automatic, size_t threads = AIO_DEFAULT_THREAD_POOL_SIZE) noexcept
+         {
+#if defined(XPLAT_IO_URING)
+            if ((backend == backend_t::automatic || backend == backend_t::io_uring) && uring_.setup(depth).ok())
+            {
+               backend_ = backend_t::io_uring;
+               return;
+            }
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+            if ((backend == backend_t::automatic || backend == backend_t::iocp) && iocp_.setup(depth).ok())
+            {
+               backend_ = backend_t::iocp;
+               return;
+            }
+#endif
+            if (backend != backend_t::automatic && backend != backend_t::thread_pool)
+            {
+               status_ = status_t(ENOTSUP);
+               return;
+            }
+            backend_ = backend_t::thread_pool;
+            status_ = pool_.setup(threads);
+         }
+
+         queue_t(const queue_t&) = delete;
+         queue_t(queue_t&&) = delete;
+         queue_t& operator=(const queue_t&) = delete;
+         queue_t& operator=(queue_t&&) = delete;
+         ~queue_t() = default;
+
+         status_t status() const noexcept
+         {
+            return status_;
+         }
+
+         backend_t backend() const noexcept
+         {
+            return backend_;
+         }
+
+         // number of submitted requests whose completions have not been reaped
+         size_t in_flight() noexcept
+         {
+            switch (backend_)
+            {
+#if defined(XPLAT_IO_URING)
+               case backend_t::io_uring: return uring_.in_flight();
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+               case backend_t::iocp: return iocp_.in_flight();
+#endif
+               default: return pool_.in_flight();
+            }
+         }
+
+         // pin buffers once so io_uring skips the per request page mapping. A
+         // request refers to one with buffer_index and must lie inside it.
+         // Registering replaces any previous set, an empty span unregisters.
+         // Other backends accept and ignore the registration
+         status_t register_buffers(std::span<const std::span<char>> buffers) noexcept
+         {
+            if (status_.nok()) return status_;
+            switch (backend_)
+            {
+#if defined(XPLAT_IO_URING)
+               case backend_t::io_uring: return uring_.register_buffers(buffers);
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+               case backend_t::iocp: return iocp_.register_buffers(buffers);
+#endif
+               default: return pool_.register_buffers(buffers);
+            }
+         }
+
+         // register file handles, requests refer to them with file_index. Saves
+         // io_uring a file table lookup and reference count per request
+         status_t register_files(std::span<const HANDLE> files) noexcept
+         {
+            if (status_.nok()) return status_;
+            switch (backend_)
+            {
+#if defined(XPLAT_IO_URING)
+               case backend_t::io_uring: return uring_.register_files(files);
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+               case backend_t::iocp: return iocp_.register_files(files);
+#endif
+               default: return pool_.register_files(files);
+            }
+         }
+
+         // submit a batch of requests. submitted may be less than requests.size()
+         // when the queue is full, reap completions and submit the remainder.
+         // Returns EAGAIN when not a single request could be queued
+         status_t submit(std::span<const request_t> requests, size_t& submitted) noexcept
+         {
+            submitted = 0;
+            if (status_.nok()) return status_;
+            switch (backend_)
+            {
+#if defined(XPLAT_IO_URING)
+               case backend_t::io_uring: return uring_.submit(requests, submitted);
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+               case backend_t::iocp: return iocp_.submit(requests, submitted);
+#endif
+               default: return pool_.submit(requests, submitted);
+            }
+         }
+
+         status_t submit(const request_t& request) noexcept
+         {
+            size_t submitted{};
+            return submit(std::span<const request_t>(&request, 1), submitted);
+         }
+
+         // copy up to completions.size() completions, waiting until at least
+         // min_complete are available. min_complete is capped to the number of
+         // requests in flight, so reap never waits for work that was not submitted
+         status_t reap(std::span<completion_t> completions, size_t min_complete, size_t& count) noexcept
+         {
+            count = 0;
+            if (status_.nok()) return status_;
+            switch (backend_)
+            {
+#if defined(XPLAT_IO_URING)
+               case backend_t::io_uring: return uring_.reap(completions, min_complete, count);
+#endif
+#if defined(XPLAT_OS_WINDOWS)
+               case backend_t::iocp: return iocp_.reap(completions, min_complete, count);
+#endif
+               default: return pool_.reap(completions, min_complete, count);
+            }
+         }
+      }; // class queue_t
+
+   } // namespace aio
+
+} // namespace rmlib
@@ -0,0 +1,469 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <span>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+
+#include "rmlib/xplat.h"
+#include "rmlib/utility.h"
+
+namespace rmlib {
+
+   // block sizes of the pool, smallest first. A request is served from the
+   // smallest class that fits it
+   constexpr std::array<size_t, 4> BUFFER_POOL_SIZE_CLASSES{ 1024, 4 * 1024, 16 * 1024, 64 * 1024 };
+
+   // every slab is one page aligned allocation cut into blocks of one class
+   constexpr size_t BUFFER_POOL_SLAB_SIZE = 256 * 1024;
+   constexpr size_t BUFFER_POOL_SLAB_ALIGNMENT = 4096;
+
+   // free lists are split in this many cache line padded shards, threads pick
+   // one by thread_ordinal() so they rarely contend for the same lock
+   constexpr size_t BUFFER_POOL_SHARDS = 8;
+
+   class buffer_pool_t;
+
+   struct buffer_block_t
+   {
+      std::atomic<uint32_t> refs{ 0 };
+      uint32_t size_class{};
+      uint32_t slab{};
+      char* data{ nullptr };
+      buffer_block_t* next{ nullptr };
+      buffer_pool_t* pool{ nullptr };
+   };
+
+   /**************************************************************************\
+   * buffer_t
+   * reference counted slice of a pooled block. Copies and slice() share the
+   * block, which goes back to its pool when the last reference is dropped,
+   * from any thread. size() is the part in use and capacity() how far it can
+   * grow, so a receive appends to the free tail and resize() commits it.
+   * A slice cannot grow, its tail would overwrite bytes other references hold.
+   * data() and size() make it a DataSizeContainer for socket_t::send(). The
+   * pool must outlive its buffers
+   \**************************************************************************/
+   class buffer_t
+   {
+      buffer_block_t* block_{ nullptr };
+      size_t offset_{};
+      size_t size_{};
+      size_t capacity_{};
+
+   public:
+      using value_type = char;
+
+      buffer_t() = default;
+
+      buffer_t(buffer_block_t* block, size_t offset, size_t size, size_t capacity) noexcept
+         : block_{ block }
+         , offset_{ offset }
+         , size_{ size }
+         , capacity_{ capacity }
+      {}
+
+      // a copy shares the bytes but not the free tail, only the original
+      // may append
+      buffer_t(const buffer_t& other) noexcept
+         : block_{ other.block_ }
+         , offset_{ other.offset_ }
+         , size_{ other.size_ }
+         , capacity_{ other.size_ }
+      {
+         if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      buffer_t(buffer_t&& other) noexcept
+         : block_{ std::exchange(other.block_, nullptr) }
+         , offset_{ std::exchange(other.offset_, 0) }
+         , size_{ std::exchange(other.size_, 0) }
+         , capacity_{ std::exchange(other.capacity_, 0) }
+      {}
+
+      buffer_t& operator=(const buffer_t& other) noexcept
+      {
+         if (this != &other)
+         {
+            buffer_t copy(other);
+            swap(copy);
+         }
+         return *this;
+      }
+
+      buffer_t& operator=(buffer_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            reset();
+            swap(other);
+         }
+         return *this;
+      }
+
+      ~buffer_t() noexcept
+      {
+         reset();
+      }
+
+      void swap(buffer_t& other) noexcept
+      {
+         std::swap(block_, other.block_);
+         std::swap(offset_, other.offset_);
+         std::swap(size_, other.size_);
+         std::swap(capacity_, other.capacity_);
+      }
+
+      // drop this reference, the block is released with the last one
+      inline void reset() noexcept;
+
+      explicit operator bool() const noexcept
+      {
+         return block_ != nullptr;
+      }
+
+      // the block is shared, data() of a const buffer is still writable like std::span
+      char* data() const noexcept
+      {
+         return block_ ? block_->data + offset_ : nullptr;
+      }
+
+      size_t size() const noexcept
+      {
+         return size_;
+      }
+
+      bool empty() const noexcept
+      {
+         return size_ == 0;
+      }
+
+      size_t capacity() const noexcept
+      {
+         return capacity_;
+      }
+
+      // free space after size()
+      size_t available() const noexcept
+      {
+         return capacity() - size_;
+      }
+
+      // clamped to capacity()
+      void resize(size_t size) noexcept
+      {
+         size_ = std::min(size, capacity());
+      }
+
+      void clear() noexcept
+      {
+         size_ = 0;
+      }
+
+      std::span<char> span() const noexcept
+      {
+         return { data(), size_ };
+      }
+
+      // the free tail, to receive into before resize()
+      std::span<char> tail() const noexcept
+      {
+         return { data() + size_, available() };
+      }
+
+      // share part of this buffer, offset and length are clamped to size().
+      // The capacity of a slice is its length, so it has no free tail
+      buffer_t slice(size_t offset, size_t length = SIZE_MAX) const noexcept
+      {
+         if (!block_) return buffer_t{};
+         offset = std::min(offset, size_);
+         length = std::min(length, size_ - offset);
+         block_->refs.fetch_add(1, std::memory_order_relaxed);
+         return buffer_t(block_, offset_ + offset, length, length);
+      }
+
+      size_t use_count() const noexcept
+      {
+         return block_ ? block_->refs.load(std::memory_order_relaxed) : 0;
+      }
+
+      // index of the slab holding the block, which is its buffer_index when
+      // the slabs were registered with aio::queue_t::register_buffers(), see
+      // buffer_pool_t::slabs(). -1 for an empty buffer
+      int slab_index() const noexcept
+      {
+         return block_ ? static_cast<int>(block_->slab) : -1;
+      }
+   }; // class buffer_t
+
+   /**************************************************************************\
+   * buffer_pool_t
+   * slab allocator for socket and file buffers with the size classes of
+   * BUFFER_POOL_SIZE_CLASSES. acquire() pops a block from the free list of
+   * the calling thread's shard, takes one from another shard when it is
+   * empty and only then cuts a new slab. Released blocks go to the shard of
+   * the releasing thread. Slabs are kept until the pool is destroyed, so
+   * their memory can be registered once for io_uring fixed buffers
+   \**************************************************************************/
+   class buffer_pool_t
+   {
+      static constexpr size_t CLASSES = BUFFER_POOL_SIZE_CLASSES.size();
+
+      struct alignas(CACHE_LINE_SIZE) shard_t
+      {
+         spin_lock_t lock{};
+         std::array<buffer_block_t*, CLASSES> free{};
+         std::array<size_t, CLASSES> available{};
+         int64_t in_use{};
+      };
+
+      struct slab_t
+      {
+         char* memory{ nullptr };
+         size_t size{};
+         std::unique_ptr<buffer_block_t[]> blocks{};
+      };
+
+      std::array<shard_t, BUFFER_POOL_SHARDS> shards_{};
+      mutable spin_lock_t slabs_lock_{};
+      std::vector<slab_t> slabs_{};
+
+   public:
+      buffer_pool_t() = default;
+      buffer_pool_t(const buffer_pool_t&) = delete;
+      buffer_pool_t(buffer_pool_t&&) = delete;
+      buffer_pool_t& operator=(const buffer_pool_t&) = delete;
+      buffer_pool_t& operator=(buffer_pool_t&&) = delete;
+
+      ~buffer_pool_t() noexcept
+      {
+         for (slab_t& slab : slabs_) ::operator delete(slab.memory, std::align_val_t{ BUFFER_POOL_SLAB_ALIGNMENT });
+      }
+
+      // smallest class index that holds size bytes, CLASSES when none does
+      static size_t size_class(size_t size) noexcept
+      {
+         return static_cast<size_t>(std::lower_bound(BUFFER_POOL_SIZE_CLASSES.begin(), BUFFER_POOL_SIZE_CLASSES.end(), size) - BUFFER_POOL_SIZE_CLASSES.begin());
+      }
+
+      static constexpr size_t max_size() noexcept
+      {
+         return BUFFER_POOL_SIZE_CLASSES.back();
+      }
+
+      // empty buffer of capacity of at least size bytes. The buffer is not
+      // valid when size is larger than max_size() or memory is exhausted
+      buffer_t acquire(size_t size) noexcept
+      {
+         const size_t cls = size_class(size);
+         if (cls >= CLASSES) return buffer_t{};
+         const size_t home = thread_ordinal() % BUFFER_POOL_SHARDS;
+         for (size_t i = 0; i < BUFFER_POOL_SHARDS; ++i)
+         {
+            if (buffer_block_t* block = pop(shards_[(home + i) % BUFFER_POOL_SHARDS], cls, shards_[home]); block)
+            {
+               return buffer_t(block, 0, 0, BUFFER_POOL_SIZE_CLASSES[cls]);
+            }
+         }
+         buffer_block_t* block{ nullptr };
+         return grow(cls, shards_[home], &block) ? buffer_t(block, 0, 0, BUFFER_POOL_SIZE_CLASSES[cls]) : buffer_t{};
+      }
+
+      // cut slabs up front until count blocks of the class holding size are free
+      bool reserve(size_t size, size_t count) noexcept
+      {
+         const size_t cls = size_class(size);
+         if (cls >= CLASSES) return false;
+         shard_t& home = shards_[thread_ordinal() % BUFFER_POOL_SHARDS];
+         while (available(cls) < count)
+         {
+            if (!grow(cls, home)) return false;
+         }
+         return true;
+      }
+
+      // memory of every slab, in slab_index() order. Register it with
+      // aio::queue_t::register_buffers() after reserve(); blocks of slabs cut
+      // later have a slab_index() past the registered ones
+      std::vector<std::span<char>> slabs() const noexcept
+      {
+         std::vector<std::span<char>> spans;
+         std::lock_guard<spin_lock_t> guard(slabs_lock_);
+         try
+         {
+            spans.reserve(slabs_.size());
+            for (const slab_t& slab : slabs_) spans.emplace_back(slab.memory, slab.size);
+         }
+         catch (...)
+         {
+            spans.clear();
+         }
+         return spans;
+      }
+
+      // bytes held by the pool, in use or free
+      size_t reserved_bytes() const noexcept
+      {
+         std::lock_guard<spin_lock_t> guard(slabs_lock_);
+         return slabs_.size() * BUFFER_POOL_SLAB_SIZE;
+      }
+
+      // blocks handed out and not yet released, a snapshot
+      size_t in_use() noexcept
+      {
+         int64_t total{};
+         for (shard_t& shard : shards_)
+         {
+            std::lock_guard<spin_lock_t> guard(shard.lock);
+            total += shard.in_use;
+         }
+         return static_cast<size_t>(std::max<int64_t>(total, 0));
+      }
+
+      // free blocks of a size class, a snapshot
+      size_t available(size_t cls) noexcept
+      {
+         if (cls >= CLASSES) return 0;
+         size_t total{};
+         for (shard_t& shard : shards_)
+         {
+            std::lock_guard<spin_lock_t> guard(shard.lock);
+            total += shard.available[cls];
+         }
+         return total;
+      }
+
+      // called by buffer_t when the last reference goes
+      void release(buffer_block_t* block) noexcept
+      {
+         shard_t& shard = shards_[thread_ordinal() % BUFFER_POOL_SHARDS];
+         std::lock_guard<spin_lock_t> guard(shard.lock);
+         block->next = shard.free[block->size_class];
+         shard.free[block->size_class] = block;
+         ++shard.available[block->size_class];
+         --shard.in_use;
+      }
+
+   private:
+      // the block is counted as in use by home, whichever shard it came from
+      static buffer_block_t* pop(shard_t& shard, size_t cls, shard_t& home) noexcept
+      {
+         buffer_block_t* block{ nullptr };
+         {
+            std::lock_guard<spin_lock_t> guard(shard.lock);
+            block = shard.free[cls];
+            if (!block) return nullptr;
+            shard.free[cls] = block->next;
+            --shard.available[cls];
+            if (&shard == &home) ++shard.in_use;
+         }
+         if (&shard != &home)
+         {
+            std::lock_guard<spin_lock_t> guard(home.lock);
+            ++home.in_use;
+         }
+         block->next = nullptr;
+         block->refs.store(1, std::memory_order_relaxed);
+         return block;
+      }
+
+      // cut a new slab of class cls and put its blocks on the free list of
+      // home. With taken the first block is handed out instead
+      bool grow(size_t cls, shard_t& home, buffer_block_t** taken = nullptr) noexcept
+      {
+         const size_t block_size = BUFFER_POOL_SIZE_CLASSES[cls];
+         const size_t count = BUFFER_POOL_SLAB_SIZE / block_size;
+         slab_t slab;
+         slab.size = BUFFER_POOL_SLAB_SIZE;
+         slab.memory = static_cast<char*>(::operator new(slab.size, std::align_val_t{ BUFFER_POOL_SLAB_ALIGNMENT }, std::nothrow));
+         slab.blocks.reset(new (std::nothrow) buffer_block_t[count]);
+         if (!slab.memory || !slab.blocks)
+         {
+            ::operator delete(slab.memory, std::align_val_t{ BUFFER_POOL_SLAB_ALIGNMENT });
+            return false;
+         }
+         char* memory = slab.memory;
+         buffer_block_t* blocks = slab.blocks.get();
+         uint32_t index{};
+         {
+            std::lock_guard<spin_lock_t> guard(slabs_lock_);
+            index = static_cast<uint32_t>(slabs_.size());
+            try
+            {
+               slabs_.push_back(std::move(slab));
+            }
+            catch (...)
+            {
+               ::operator delete(memory, std::align_val_t{ BUFFER_POOL_SLAB_ALIGNMENT });
+               return false;
+            }
+         }
+         for (size_t i = 0; i < count; ++i)
+         {
+            blocks[i].size_class = static_cast<uint32_t>(cls);
+            blocks[i].slab = index;
+            blocks[i].data = memory + i * block_size;
+            blocks[i].pool = this;
+         }
+         const size_t first = taken ? 1 : 0;
+         std::lock_guard<spin_lock_t> guard(home.lock);
+         for (size_t i = first; i < count; ++i)
+         {
+            blocks[i].next = home.free[cls];
+            home.free[cls] = &blocks[i];
+         }
+         home.available[cls] += count - first;
+         if (taken)
+         {
+            ++home.in_use;
+            blocks[0].refs.store(1, std::memory_order_relaxed);
+            *taken = &blocks[0];
+         }
+         return true;
+      }
+   }; // class buffer_pool_t
+
+   inline void buffer_t::reset() noexcept
+   {
+      if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) block_->pool->release(block_);
+      block_ = nullptr;
+      offset_ = 0;
+      size_ = 0;
+      capacity_ = 0;
+   }
+
+
+} // namespace rmlib
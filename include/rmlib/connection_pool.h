@@ -0,0 +1,309 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+
+#include "rmlib/socket.h"
+
+namespace rmlib {
+
+   constexpr size_t CONNECTION_POOL_DEFAULT_MAX_CONNECTIONS = 8;
+   constexpr int64_t CONNECTION_POOL_DEFAULT_IDLE_TIMEOUT_MS = 60'000;
+
+   // limits apply to each endpoint
+   struct connection_pool_options_t
+   {
+      size_t min_idle{};                  // idle connections evict_idle() keeps
+      size_t max_connections{ CONNECTION_POOL_DEFAULT_MAX_CONNECTIONS };   // idle plus leased
+      int64_t idle_timeout_ms{ CONNECTION_POOL_DEFAULT_IDLE_TIMEOUT_MS };
+      bool health_check{ true };          // probe idle connections on acquire
+      socket_mode_t mode{ socket_mode_t::blocking };
+      socket_options_t socket{};          // applied to every new connection
+   };
+
+   /**************************************************************************\
+   *
+   *  connection_pool_t
+   *  Client connections kept open between requests, per server address.
+   *  acquire() hands out the most recently released idle connection, so
+   *  the TCP and TLS setup is only paid when no idle connection is left.
+   *  Idle time is the time since the last send or receive on the socket, as
+   *  recorded by the socket_t timers. Connections are opened, probed and
+   *  closed outside the pool lock. Thread safe
+   *
+   \**************************************************************************/
+   class connection_pool_t
+   {
+      struct endpoint_t
+      {
+         std::vector<socket_t> idle;
+         size_t leased{};
+      };
+
+      tls::context_t* ctx_{};
+      connection_pool_options_t options_;
+      std::unordered_map<ip::address_t, endpoint_t, ip::address_hash_t> endpoints_;
+      mutable std::mutex mutex_;
+
+   public:
+      // TCP connections
+      explicit connection_pool_t(const connection_pool_options_t& options = connection_pool_options_t{}) noexcept
+         : options_{ options }
+      {
+         options_.max_connections = std::max<size_t>(options_.max_connections, 1);
+      }
+
+      // TLS connections, ctx must outlive the pool
+      explicit connection_pool_t(tls::context_t& ctx, const connection_pool_options_t& options = connection_pool_options_t{}) noexcept
+         : connection_pool_t(options)
+      {
+         ctx_ = &ctx;
+      }
+
+      connection_pool_t(const connection_pool_t&) = delete;
+      connection_pool_t(connection_pool_t&&) = delete;
+      connection_pool_t& operator=(const connection_pool_t&) = delete;
+      connection_pool_t& operator=(connection_pool_t&&) = delete;
+
+      ~connection_pool_t() noexcept
+      {
+         clear();
+      }
+
+      const connection_pool_options_t& options() const noexcept
+      {
+         return options_;
+      }
+
+      // hand out an idle connection to server or open a new one. Stale idle
+      // connections met on the way are closed. Returns WSAENOBUFS when server
+      // already has max_connections leased. The health check probes the
+      // socket, so it runs outside the pool lock on a connection already
+      // taken out of the idle list
+      socket::status_t acquire(const ip::address_t& server, socket_t& connection) noexcept
+      {
+         for (;;)
+         {
+            socket_t candidate;
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               endpoint_t* endpoint = find_or_create(server);
+               if (!endpoint) return socket::status_t{ WSAENOBUFS };
+               if (endpoint->idle.empty() && endpoint->leased >= options_.max_connections) return socket::status_t{ WSAENOBUFS };
+               if (!endpoint->idle.empty())
+               {
+                  candidate = std::move(endpoint->idle.back());
+                  endpoint->idle.pop_back();
+               }
+               ++endpoint->leased;
+            }
+            // no idle connection was left, open a new one
+            if (candidate.state() != socket_state_t::connected) break;
+            if (!is_expired(candidate) && (!options_.health_check || candidate.is_reusable()))
+            {
+               connection = std::move(candidate);
+               return socket::status_t{};
+            }
+            close(candidate);
+            unlease(server);
+         }
+         socket::status_t status = open(server, connection);
+         if (status.nok()) unlease(server);
+         return status;
+      }
+
+      // give a connection acquired from server back to the pool. Connections
+      // the caller marks as not reusable, for example after a protocol error,
+      // or that no longer fit in the pool are closed, with a shutdown only
+      // when the peer is still there
+      void release(const ip::address_t& server, socket_t&& connection, bool reusable = true) noexcept
+      {
+         socket_t closing;
+         {
+            std::lock_guard<std::mutex> guard(mutex_);
+            auto it = endpoints_.find(server);
+            if (it == endpoints_.end())
+            {
+               closing = std::move(connection);
+            }
+            else
+            {
+               endpoint_t& endpoint = it->second;
+               if (endpoint.leased > 0) --endpoint.leased;
+               if (!reusable || connection.state() != socket_state_t::connected || endpoint.idle.size() + endpoint.leased >= options_.max_connections || !push(endpoint.idle, std::move(connection)))
+               {
+                  closing = std::move(connection);
+               }
+            }
+         }
+         close(closing);
+      }
+
+      // open idle connections to server until it has count connections, or
+      // min_idle when count is zero, without going over max_connections
+      socket::status_t prewarm(const ip::address_t& server, size_t count = 0) noexcept
+      {
+         const size_t target = std::min(count > 0 ? count : options_.min_idle, options_.max_connections);
+         socket::status_t status;
+         while (status.ok())
+         {
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               endpoint_t* endpoint = find_or_create(server);
+               if (!endpoint) return socket::status_t{ WSAENOBUFS };
+               if (endpoint->idle.size() + endpoint->leased >= target) break;
+               ++endpoint->leased;
+            }
+            socket_t connection;
+            status = open(server, connection);
+            release(server, std::move(connection), status.ok());
+         }
+         return status;
+      }
+
+      // close idle connections that exceeded idle_timeout_ms, keeping the
+      // min_idle most recently used of each endpoint. Returns the number of
+      // connections closed. Call it periodically, for example from a poller
+      // timer
+      size_t evict_idle() noexcept
+      {
+         std::vector<socket_t> stale;
+         {
+            std::lock_guard<std::mutex> guard(mutex_);
+            for (auto& [server, endpoint] : endpoints_)
+            {
+               // idle is ordered by release time, oldest first
+               auto& idle = endpoint.idle;
+               size_t evictable = idle.size() > options_.min_idle ? idle.size() - options_.min_idle : 0;
+               size_t count{};
+               while (count < evictable && is_expired(idle[count])) ++count;
+               for (size_t i = 0; i < count; ++i) push(stale, std::move(idle[i]));
+               idle.erase(idle.begin(), idle.begin() + count);
+            }
+         }
+         const size_t count = stale.size();
+         close_all(stale);
+         return count;
+      }
+
+      // close all idle connections. Leased connections are closed when released
+      void clear() noexcept
+      {
+         std::vector<socket_t> stale;
+         {
+            std::lock_guard<std::mutex> guard(mutex_);
+            for (auto& [server, endpoint] : endpoints_)
+            {
+               for (auto& connection : endpoint.idle) push(stale, std::move(connection));
+               endpoint.idle.clear();
+            }
+         }
+         close_all(stale);
+      }
+
+      size_t idle_count(const ip::address_t& server) const noexcept
+      {
+         std::lock_guard<std::mutex> guard(mutex_);
+         auto it = endpoints_.find(server);
+         return it != endpoints_.end() ? it->second.idle.size() : 0;
+      }
+
+      size_t leased_count(const ip::address_t& server) const noexcept
+      {
+         std::lock_guard<std::mutex> guard(mutex_);
+         auto it = endpoints_.find(server);
+         return it != endpoints_.end() ? it->second.leased : 0;
+      }
+
+   private:
+      socket::status_t open(const ip::address_t& server, socket_t& connection) const noexcept
+      {
+         connection = ctx_ ? socket_t(*ctx_) : socket_t();
+         return connection.connect(server, options_.mode, options_.socket);
+      }
+
+      void unlease(const ip::address_t& server) noexcept
+      {
+         std::lock_guard<std::mutex> guard(mutex_);
+         if (auto it = endpoints_.find(server); it != endpoints_.end() && it->second.leased > 0) --it->second.leased;
+      }
+
+      bool is_expired(const socket_t& connection) const noexcept
+      {
+         const long long idle_usecs = std::min(connection.send_elapsed_usecs(), connection.recv_elapsed_usecs());
+         return idle_usecs >= options_.idle_timeout_ms * 1000;
+      }
+
+      // called with mutex_ held
+      endpoint_t* find_or_create(const ip::address_t& server) noexcept
+      {
+         try
+         {
+            return &endpoints_[server];
+         }
+         catch (...)
+         {
+            return nullptr;
+         }
+      }
+
+      static bool push(std::vector<socket_t>& connections, socket_t&& connection) noexcept
+      {
+         try
+         {
+            connections.push_back(std::move(connection));
+            return true;
+         }
+         catch (...)
+         {
+            return false;
+         }
+      }
+
+      // shutdowns can block on TLS, never call with mutex_ held. Connections
+      // the peer already closed are dropped without a shutdown, writing a TLS
+      // close_notify to them would fail with EPIPE
+      static void close(socket_t& connection) noexcept
+      {
+         if (connection.is_reusable()) connection.disconnect();
+         connection = socket_t{};
+      }
+
+      static void close_all(std::vector<socket_t>& connections) noexcept
+      {
+         for (auto& connection : connections) close(connection);
+         connections.clear();
+      }
+   }; // class connection_pool_t
+
+} // namespace rmlib
@@ -0,0 +1,407 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <coroutine>
+#include <exception>
+#include <unordered_map>
+#include <vector>
+
+#include "rmlib/socket.h"
+
+namespace rmlib {
+
+   /**************************************************************************\
+   * socket_task_t
+   * return type of a detached coroutine. The coroutine starts running when
+   * it is called and its frame is freed when it returns, nobody awaits it.
+   * Exceptions escaping the coroutine terminate the program
+   \**************************************************************************/
+   struct socket_task_t
+   {
+      struct promise_type
+      {
+         socket_task_t get_return_object() noexcept
+         {
+            return socket_task_t{};
+         }
+
+         std::suspend_never initial_suspend() noexcept
+         {
+            return {};
+         }
+
+         std::suspend_never final_suspend() noexcept
+         {
+            return {};
+         }
+
+         void return_void() noexcept {}
+
+         void unhandled_exception() noexcept
+         {
+            std::terminate();
+         }
+      };
+   };
+
+   // a suspended operation, owned by the awaiting coroutine frame. notify()
+   // runs when the socket becomes ready, or timed out, and either resumes
+   // the coroutine or waits again
+   struct socket_waiter_t
+   {
+      void (*notify)(socket_waiter_t& waiter, bool timed_out) noexcept { nullptr };
+   };
+
+   /**************************************************************************\
+   * socket_reactor_t
+   * resumes coroutines suspended on socket_t operations from one
+   * socket_poller_t. Sockets are registered on their first suspension with
+   * edge triggered recv and send interest and stay registered until
+   * detach(), so suspending costs no system call. Each socket holds at most
+   * one waiter per direction, one coroutine receiving and one sending.
+   * Detach a socket before closing it. A reactor is driven by one thread
+   \**************************************************************************/
+   class socket_reactor_t
+   {
+      struct entry_t
+      {
+         SOCKET handle{ INVALID_SOCKET };
+         socket_waiter_t* recv{ nullptr };
+         socket_waiter_t* send{ nullptr };
+      };
+
+      socket_poller_t poller_;
+      std::unordered_map<uid_t, entry_t> entries_{};
+      std::vector<socket_ready_t> ready_{};
+      size_t waiting_{};
+
+   public:
+      explicit socket_reactor_t(size_t max_events = SOCKET_DEFAULT_POLLER_MAX_EVENTS, int64_t timer_tick_ms = TIMER_WHEEL_DEFAULT_TICK_MS) noexcept
+         : poller_{ max_events, timer_tick_ms }
+      {}
+
+      socket_reactor_t(const socket_reactor_t&) = delete;
+      socket_reactor_t& operator=(const socket_reactor_t&) = delete;
+      socket_reactor_t(socket_reactor_t&&) = delete;
+      socket_reactor_t& operator=(socket_reactor_t&&) = delete;
+      ~socket_reactor_t() = default;
+
+      socket::status_t status() const noexcept
+      {
+         return poller_.status();
+      }
+
+      // operations suspended, the reactor has work while it is not zero
+      size_t waiting() const noexcept
+      {
+         return waiting_;
+      }
+
+      // sockets registered
+      size_t size() const noexcept
+      {
+         return entries_.size();
+      }
+
+      bool contains(const socket_t& socket) const noexcept
+      {
+         return entries_.find(socket.uid()) != entries_.end();
+      }
+
+      socket::status_t attach(const socket_t& socket) noexcept
+      {
+         if (socket.handle() == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         if (contains(socket)) return socket::status_t{};
+         if (socket::status_t status = poller_.add(socket, interest(), trigger()); status.nok()) return status;
+         try
+         {
+            entries_.emplace(socket.uid(), entry_t{ socket.handle() });
+         }
+         catch (...)
+         {
+            poller_.remove(socket);
+            return socket::status_t{ WSAENOBUFS };
+         }
+         return socket::status_t{};
+      }
+
+      // fails with WSAEALREADY while a coroutine waits on socket
+      socket::status_t detach(const socket_t& socket) noexcept
+      {
+         auto it = entries_.find(socket.uid());
+         if (it == entries_.end()) return socket::status_t{};
+         if (it->second.recv || it->second.send) return socket::status_t{ WSAEALREADY };
+         entries_.erase(it);
+         return poller_.remove(socket);
+      }
+
+      // when the timeout expires the operations waiting on socket complete
+      // with WSAETIMEDOUT. One timeout per socket, see socket_poller_t
+      bool schedule_timeout(const socket_t& socket, int64_t timeout_ms) noexcept
+      {
+         return poller_.schedule_timeout(socket, timeout_ms, timer_kind_t::user);
+      }
+
+      bool cancel_timeout(const socket_t& socket) noexcept
+      {
+         return poller_.cancel_timeout(socket);
+      }
+
+      // wait once for ready sockets and resume their waiters, the timeout
+      // semantics are those of socket_poller_t::wait
+      socket::status_t run_once(wait_timeout_t timeout_ms = SOCKET_DEFAULT_EPOLL_WAIT_TIMEOUT_MS) noexcept
+      {
+         socket::status_t status = poller_.wait(ready_, timeout_ms);
+         if (status.nok()) return status;
+         for (const socket_ready_t& ready : ready_)
+         {
+            if (ready.timeout())
+            {
+               dispatch(ready.uid, true, true, true);
+               continue;
+            }
+            dispatch(ready.uid, ready.recv_ready(), ready.send_ready(), false);
+         }
+         return status;
+      }
+
+      // run until no operation is suspended or the reactor fails
+      socket::status_t run(wait_timeout_t timeout_ms = SOCKET_DEFAULT_EPOLL_WAIT_TIMEOUT_MS) noexcept
+      {
+         while (waiting_ > 0)
+         {
+            if (socket::status_t status = run_once(timeout_ms); status.nok() && !status.would_block()) return status;
+         }
+         return socket::status_t{};
+      }
+
+      socket_poller_t& poller() noexcept
+      {
+         return poller_;
+      }
+
+      // park waiter until socket is ready in the direction asked by status,
+      // registering socket on first use
+      socket::status_t suspend(const socket_t& socket, const socket::status_t& status, socket_waiter_t& waiter) noexcept
+      {
+         if (socket::status_t attached = attach(socket); attached.nok()) return attached;
+         entry_t& entry = entries_.find(socket.uid())->second;
+         socket_waiter_t*& slot = status.want_write() ? entry.send : entry.recv;
+         if (slot && slot != &waiter) return socket::status_t{ WSAEALREADY };
+         if (!slot) ++waiting_;
+         slot = &waiter;
+         return rearm(socket.uid(), entry);
+      }
+
+   private:
+      // wepoll has no edge triggered mode, a level triggered socket is armed
+      // only in the directions somebody waits on, or it would report ready
+      // on every wait
+#if defined(XPLAT_OS_WINDOWS)
+      static constexpr socket_trigger_t trigger() noexcept
+      {
+         return socket_trigger_t::level;
+      }
+
+      static constexpr socket_interest_t interest() noexcept
+      {
+         return socket_interest_t::none;
+      }
+
+      socket::status_t rearm(uid_t uid, const entry_t& entry) noexcept
+      {
+         socket_interest_t wanted{ socket_interest_t::none };
+         if (entry.recv) wanted = wanted | socket_interest_t::recv;
+         if (entry.send) wanted = wanted | socket_interest_t::send;
+         return poller_.modify(entry.handle, uid, wanted, trigger());
+      }
+#else
+      static constexpr socket_trigger_t trigger() noexcept
+      {
+         return socket_trigger_t::edge;
+      }
+
+      static constexpr socket_interest_t interest() noexcept
+      {
+         return socket_interest_t::both;
+      }
+
+      socket::status_t rearm(uid_t, const entry_t&) noexcept
+      {
+         return socket::status_t{};
+      }
+#endif
+
+      // take the waiter out of its slot before notifying it, notify may
+      // suspend again or resume a coroutine that attaches and detaches
+      // sockets, so the entry is looked up again for the second direction
+      void dispatch(uid_t uid, bool recv, bool send, bool timed_out) noexcept
+      {
+         if (recv) notify(uid, &entry_t::recv, timed_out);
+         if (send) notify(uid, &entry_t::send, timed_out);
+      }
+
+      void notify(uid_t uid, socket_waiter_t* entry_t::*direction, bool timed_out) noexcept
+      {
+         auto it = entries_.find(uid);
+         if (it == entries_.end() || !(it->second.*direction)) return;
+         socket_waiter_t* waiter = std::exchange(it->second.*direction, nullptr);
+         --waiting_;
+         rearm(uid, it->second);
+         waiter->notify(*waiter, timed_out);
+      }
+   }; // class socket_reactor_t
+
+   /**************************************************************************\
+   * socket_awaitable_t
+   * co_await result of the async_ functions. Op is tried when awaited and
+   * again each time its socket is ready, until it stops returning
+   * would_block(). Op(socket_t*& target) returns the operation status and
+   * may change target, the socket to wait on. want_read() and want_write()
+   * pick the direction, so a TLS read that must write or a TLS write that
+   * must read waits for the right readiness. co_await returns the final
+   * status. The awaitable lives in the coroutine frame, no operation
+   * allocates
+   \**************************************************************************/
+   template <typename Op>
+   class [[nodiscard]] socket_awaitable_t : private socket_waiter_t
+   {
+      socket_reactor_t& reactor_;
+      socket_t* target_;
+      Op op_;
+      socket::status_t status_{};
+      std::coroutine_handle<> coroutine_{};
+
+   public:
+      socket_awaitable_t(socket_reactor_t& reactor, socket_t& target, Op op) noexcept
+         : socket_waiter_t{ &socket_awaitable_t::ready }
+         , reactor_{ reactor }
+         , target_{ &target }
+         , op_{ op }
+      {}
+
+      bool await_ready() noexcept
+      {
+         status_ = op_(target_);
+         return !status_.would_block();
+      }
+
+      bool await_suspend(std::coroutine_handle<> coroutine) noexcept
+      {
+         coroutine_ = coroutine;
+         if (socket::status_t status = reactor_.suspend(*target_, status_, *this); status.nok())
+         {
+            status_ = status;
+            return false;
+         }
+         return true;
+      }
+
+      socket::status_t await_resume() const noexcept
+      {
+         return status_;
+      }
+
+   private:
+      static void ready(socket_waiter_t& waiter, bool timed_out) noexcept
+      {
+         auto& self = static_cast<socket_awaitable_t&>(waiter);
+         if (timed_out)
+         {
+            self.status_ = socket::status_t{ WSAETIMEDOUT };
+         }
+         else if (self.status_ = self.op_(self.target_); self.status_.would_block())
+         {
+            socket::status_t status = self.reactor_.suspend(*self.target_, self.status_, self);
+            if (status.ok()) return;
+            self.status_ = status;
+         }
+         self.coroutine_.resume();
+      }
+   };
+
+   // connect without blocking, including the TLS handshake
+   inline auto async_connect(socket_reactor_t& reactor, socket_t& socket, const ip::address_t& server, const socket_options_t& options = socket_options_t{}) noexcept
+   {
+      return socket_awaitable_t(reactor, socket, [&socket, &server, &options](socket_t*&) noexcept {
+         return socket.is_handshaking() ? socket.handshake() : socket.begin_connect(server, options);
+      });
+   }
+
+   // accept one TCP connection into client and leave client nonblocking.
+   // listener must be nonblocking. A TLS client is returned still
+   // handshaking; its session awaits async_handshake(), so one slow client
+   // never holds up the accepts behind it
+   inline auto async_accept(socket_reactor_t& reactor, socket_t& listener, socket_t& client, const socket_options_t& options = socket_options_t{}) noexcept
+   {
+      return socket_awaitable_t(reactor, listener, [&listener, &client, &options](socket_t*&) noexcept {
+         return listener.begin_accept(client, socket_mode_t::nonblocking, options);
+      });
+   }
+
+   // finish the TLS handshake of an accepted client or a connecting socket,
+   // ok() straight away for TCP sockets and connected TLS sockets
+   inline auto async_handshake(socket_reactor_t& reactor, socket_t& socket) noexcept
+   {
+      return socket_awaitable_t(reactor, socket, [&socket](socket_t*&) noexcept {
+         return socket.handshake();
+      });
+   }
+
+   // send all len bytes from buffer, bytes_sent is the total sent even when
+   // the send fails part way. socket must be nonblocking
+   inline auto async_send(socket_reactor_t& reactor, socket_t& socket, const char* buffer, size_t len, size_t& bytes_sent) noexcept
+   {
+      bytes_sent = 0;
+      return socket_awaitable_t(reactor, socket, [&socket, buffer, len, &bytes_sent](socket_t*&) noexcept {
+         socket::status_t status;
+         size_t sent{};
+         while (bytes_sent < len && (status = socket.send(buffer, len, bytes_sent, sent)).ok()) {}
+         return status;
+      });
+   }
+
+   template <DataSizeContainer T>
+   inline auto async_send(socket_reactor_t& reactor, socket_t& socket, const T& buffer, size_t& bytes_sent) noexcept
+   {
+      return async_send(reactor, socket, buffer.data(), buffer.size(), bytes_sent);
+   }
+
+   // receive what is available, up to len bytes. As with socket_t::recv, a
+   // status with code() status_code_t::closing means the peer closed the
+   // connection
+   inline auto async_recv(socket_reactor_t& reactor, socket_t& socket, char* buffer, size_t len, size_t& bytes_received) noexcept
+   {
+      return socket_awaitable_t(reactor, socket, [&socket, buffer, len, &bytes_received](socket_t*&) noexcept {
+         return socket.recv(buffer, len, bytes_received);
+      });
+   }
+
+} // namespace rmlib
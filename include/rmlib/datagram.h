@@ -0,0 +1,574 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <span>
+#include <algorithm>
+
+#include "rmlib/xplat.h"
+#include "rmlib/socket.h"
+
+#if defined(XPLAT_OS_LINUX)
+   #include <netinet/udp.h>
+   // recvmmsg and sendmmsg, one system call for a batch of datagrams
+   #define XPLAT_MMSG
+   #if !defined(UDP_SEGMENT)
+      #define UDP_SEGMENT 103
+   #endif
+   #if !defined(UDP_GRO)
+      #define UDP_GRO 104
+   #endif
+#endif
+
+namespace rmlib {
+
+   // datagrams moved by one recvmmsg or sendmmsg call
+   constexpr size_t DATAGRAM_MAX_BATCH = 64;
+
+   // kernel limit of segments in one UDP_SEGMENT send
+   constexpr size_t DATAGRAM_MAX_SEGMENTS = 64;
+
+   // largest UDP payload over IPv4, and the buffer size that holds any GRO
+   // coalesced receive
+   constexpr size_t DATAGRAM_MAX_PAYLOAD = 65507;
+   constexpr size_t DATAGRAM_GRO_BUFFER_SIZE = 65536;
+
+   struct datagram_options_t
+   {
+      int send_buffer{};            // SO_SNDBUF bytes, 0 leaves the system default
+      int recv_buffer{};            // SO_RCVBUF bytes, 0 leaves the system default
+      bool reuse_address{ false };  // SO_REUSEADDR, set before bind
+      bool reuse_port{ false };     // SO_REUSEPORT, one socket per thread on the same port
+      bool gro{ false };            // UDP_GRO, coalesce received datagrams of one flow
+
+      bool is_default() const noexcept
+      {
+         return send_buffer == 0 && recv_buffer == 0 && !reuse_address && !reuse_port && !gro;
+      }
+   };
+
+   /**************************************************************************\
+   * datagram_t
+   * one message of recv_many() or send_many(). For a receive buffer is the
+   * space to receive into and recv_many() sets size, address, truncated and,
+   * with GRO, segment_size: the datagram then is several datagrams of the
+   * same source coalesced, each segment_size bytes but the last. For a send
+   * all of buffer is sent to address, or to the connected peer when address
+   * is empty. A segment_size smaller than the buffer sends it as datagrams
+   * of segment_size bytes, in one UDP_SEGMENT (GSO) call on Linux
+   \**************************************************************************/
+   struct datagram_t
+   {
+      std::span<char> buffer{};
+      size_t size{};
+      ip::address_t address{};
+      size_t segment_size{};
+      bool truncated{ false };
+   };
+
+   /**************************************************************************\
+   * datagram_socket_t
+   * UDP socket. Blocking or nonblocking like socket_t, with the same status
+   * codes: a nonblocking call with nothing to do is would_block(). Batches
+   * go through recvmmsg and sendmmsg on Linux and a loop of recvfrom and
+   * sendto elsewhere. handle() and uid() make it a PollableSocket, so it
+   * shares a socket_poller_t with TCP sockets
+   \**************************************************************************/
+   class datagram_socket_t
+   {
+      SOCKET handle_{ INVALID_SOCKET };
+      uid_t uid_{};
+      socket_mode_t mode_{ socket_mode_t::blocking };
+      bool connected_{ false };
+      bool gro_{ false };
+      [[no_unique_address]] io_metrics_policy_t::counters_t counters_{};
+
+   public:
+      datagram_socket_t() noexcept = default;
+
+      ~datagram_socket_t() noexcept
+      {
+         close();
+      }
+
+      datagram_socket_t(const datagram_socket_t&) = delete;
+      datagram_socket_t& operator=(const datagram_socket_t&) = delete;
+
+      datagram_socket_t(datagram_socket_t&& other) noexcept
+         : handle_{ std::exchange(other.handle_, INVALID_SOCKET) }
+         , uid_{ std::exchange(other.uid_, 0) }
+         , mode_{ std::exchange(other.mode_, socket_mode_t::blocking) }
+         , connected_{ std::exchange(other.connected_, false) }
+         , gro_{ std::exchange(other.gro_, false) }
+         , counters_{ other.counters_ }
+      {}
+
+      datagram_socket_t& operator=(datagram_socket_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            close();
+            handle_ = std::exchange(other.handle_, INVALID_SOCKET);
+            uid_ = std::exchange(other.uid_, 0);
+            mode_ = std::exchange(other.mode_, socket_mode_t::blocking);
+            connected_ = std::exchange(other.connected_, false);
+            gro_ = std::exchange(other.gro_, false);
+            counters_ = other.counters_;
+         }
+         return *this;
+      }
+
+      SOCKET handle() const noexcept
+      {
+         return handle_;
+      }
+
+      uid_t uid() const noexcept
+      {
+         return uid_;
+      }
+
+      socket_mode_t mode() const noexcept
+      {
+         return mode_;
+      }
+
+      bool is_open() const noexcept
+      {
+         return handle_ != INVALID_SOCKET;
+      }
+
+      bool is_connected() const noexcept
+      {
+         return connected_;
+      }
+
+      // true when received datagrams may be coalesced, see datagram_t
+      bool is_gro() const noexcept
+      {
+         return gro_;
+      }
+
+      // per socket I/O counters, an empty struct unless RMLIB_IO_METRICS
+      // enables a metrics policy
+      const io_metrics_policy_t::counters_t& counters() const noexcept
+      {
+         return counters_;
+      }
+
+      // unbound socket of family, AF_INET or AF_INET6. The system picks the
+      // local port on the first send
+      socket::status_t open(int family, socket_mode_t mode = socket_mode_t::blocking, const datagram_options_t& options = datagram_options_t{}) noexcept
+      {
+         close();
+         handle_ = ::socket(family, SOCK_DGRAM, IPPROTO_UDP);
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ last_error() };
+         uid_ = next_socket_uid();
+         socket::status_t status;
+         if (mode == socket_mode_t::nonblocking) status = set_blocking(mode);
+         if (status.ok() && !options.is_default()) status = set_options(options);
+         if (status.nok()) close();
+         return status;
+      }
+
+      // open and bind to a local address, port 0 picks a free port
+      socket::status_t bind(const ip::address_t& local, socket_mode_t mode = socket_mode_t::blocking, const datagram_options_t& options = datagram_options_t{}) noexcept
+      {
+         socket::status_t status = open(local.family(), mode, options);
+         if (status.nok()) return status;
+         if (status = socket::status_t{ ::bind(handle_, local.address(), local.length()) }; status.nok()) close();
+         return status;
+      }
+
+      // fix the peer: send() goes to it and only its datagrams are received.
+      // Opens the socket first if needed
+      socket::status_t connect(const ip::address_t& peer, socket_mode_t mode = socket_mode_t::blocking) noexcept
+      {
+         socket::status_t status;
+         if (!is_open() && (status = open(peer.family(), mode)).nok()) return status;
+         if (status = socket::status_t{ ::connect(handle_, peer.address(), peer.length()) }; status.ok()) connected_ = true;
+         return status;
+      }
+
+      socket::status_t close() noexcept
+      {
+         socket::status_t status;
+         if (handle_ != INVALID_SOCKET)
+         {
+            status = socket::status_t{ ::closesocket(handle_) };
+            handle_ = INVALID_SOCKET;
+         }
+         uid_ = 0;
+         mode_ = socket_mode_t::blocking;
+         connected_ = false;
+         gro_ = false;
+         return status;
+      }
+
+      ip::address_t local_address() const noexcept
+      {
+         sockaddr_storage name{};
+         socklen_t namelen{ sizeof(name) };
+         if (::getsockname(handle_, reinterpret_cast<sockaddr*>(&name), &namelen) == 0) return ip::address_t(name, namelen);
+         return ip::address_t{};
+      }
+
+      // reuse_address and reuse_port only take effect before bind(). gro is
+      // WSAEOPNOTSUPP where the system has no UDP_GRO
+      socket::status_t set_options(const datagram_options_t& options) noexcept
+      {
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         socket::status_t status;
+         if (options.reuse_address && (status = set_option(SOL_SOCKET, SO_REUSEADDR, 1)).nok()) return status;
+#if defined(SO_REUSEPORT)
+         if (options.reuse_port && (status = set_option(SOL_SOCKET, SO_REUSEPORT, 1)).nok()) return status;
+#endif
+         if (options.send_buffer > 0 && (status = set_option(SOL_SOCKET, SO_SNDBUF, options.send_buffer)).nok()) return status;
+         if (options.recv_buffer > 0 && (status = set_option(SOL_SOCKET, SO_RCVBUF, options.recv_buffer)).nok()) return status;
+         if (options.gro)
+         {
+#if defined(XPLAT_MMSG)
+            if ((status = set_option(IPPROTO_UDP, UDP_GRO, 1)).nok()) return status;
+            gro_ = true;
+#else
+            return socket::status_t{ WSAEOPNOTSUPP };
+#endif
+         }
+         return status;
+      }
+
+      // wait until a datagram can be received, recv_ready, or sent,
+      // send_ready. timeout_ms and the status are those of socket_t::wait_event()
+      socket::status_t wait_event(socket_event_t event, wait_timeout_t timeout_ms = SOCKET_WAIT_NEVER) noexcept
+      {
+         const bool send = event == socket_event_t::send_ready || event == socket_event_t::connect_ready;
+         const status_code_t code = send ? status_code_t::want_write : status_code_t::want_read;
+         WSAPOLLFD fdset{};
+         fdset.fd = handle_;
+         fdset.events = send ? POLLWRNORM : POLLRDNORM;
+         int ret = WSAPoll(&fdset, 1, timeout_ms);
+         if (ret == 0) return socket::status_t{ WSAEWOULDBLOCK, code };
+         if (ret == SOCKET_ERROR) return socket::status_t{ last_error(), code };
+         return socket::status_t{};
+      }
+
+      // one datagram to the connected peer
+      socket::status_t send(const char* buffer, size_t len, size_t& bytes_sent) noexcept
+      {
+         if (!connected_) return socket::status_t{ WSAENOTCONN };
+         return send_to(buffer, len, ip::address_t{}, bytes_sent);
+      }
+
+      // one datagram to address, or to the connected peer when address is empty
+      socket::status_t send_to(const char* buffer, size_t len, const ip::address_t& address, size_t& bytes_sent) noexcept
+      {
+         bytes_sent = 0;
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         return measure(io_op_t::udp_send, len, bytes_sent, [&]() noexcept { return send_one(buffer, len, address, bytes_sent); });
+      }
+
+      // one datagram from any source, or from the connected peer
+      socket::status_t recv_from(char* buffer, size_t len, ip::address_t& address, size_t& bytes_received) noexcept
+      {
+         bytes_received = 0;
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         return measure(io_op_t::udp_recv, 0, bytes_received, [&]() noexcept { return recv_one(buffer, len, address, bytes_received); });
+      }
+
+      socket::status_t recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      {
+         ip::address_t address;
+         return recv_from(buffer, len, address, bytes_received);
+      }
+
+      // receive up to messages.size() datagrams, at most DATAGRAM_MAX_BATCH
+      // with one system call. A blocking socket waits for the first datagram
+      // only. count is the number of messages filled
+      socket::status_t recv_many(std::span<datagram_t> messages, size_t& count) noexcept
+      {
+         count = 0;
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         if (messages.empty()) return socket::status_t{};
+         size_t bytes{};
+         return measure(io_op_t::udp_recv, 0, bytes, [&]() noexcept { return recv_batch(messages, count, bytes); });
+      }
+
+      // send the leading messages, at most DATAGRAM_MAX_BATCH with one system
+      // call. count is the number of messages sent, a message is sent whole
+      // or not at all. Resume with the messages after count. A message over
+      // DATAGRAM_MAX_PAYLOAD bytes or DATAGRAM_MAX_SEGMENTS segments ends the
+      // batch, it fails with WSAEMSGSIZE when it leads
+      socket::status_t send_many(std::span<const datagram_t> messages, size_t& count) noexcept
+      {
+         count = 0;
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         if (messages.empty()) return socket::status_t{};
+         size_t requested{}, bytes{}, batch{};
+         for (const datagram_t& message : messages.first(std::min(messages.size(), DATAGRAM_MAX_BATCH)))
+         {
+            if (!sendable(message)) break;
+            requested += message.buffer.size();
+            ++batch;
+         }
+         if (batch == 0) return socket::status_t{ WSAEMSGSIZE };
+         return measure(io_op_t::udp_send, requested, bytes, [&]() noexcept { return send_batch(messages.first(batch), count, bytes); });
+      }
+
+   private:
+      static int last_error() noexcept
+      {
+         return ::WSAGetLastError();
+      }
+
+      // a datagram, or a UDP_SEGMENT buffer, holds at most DATAGRAM_MAX_PAYLOAD
+      // bytes and the kernel cuts at most DATAGRAM_MAX_SEGMENTS segments. The
+      // loop fallback applies the same limits
+      static bool sendable(const datagram_t& message) noexcept
+      {
+         const size_t size = message.buffer.size();
+         if (size > DATAGRAM_MAX_PAYLOAD) return false;
+         if (message.segment_size == 0 || message.segment_size >= size) return true;
+         return (size + message.segment_size - 1) / message.segment_size <= DATAGRAM_MAX_SEGMENTS;
+      }
+
+      socket::status_t set_option(int level, int name, int value) noexcept
+      {
+         return socket::status_t{ ::setsockopt(handle_, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) };
+      }
+
+      socket::status_t set_blocking(socket_mode_t mode) noexcept
+      {
+         u_long um = (mode == socket_mode_t::nonblocking) ? 1 : 0;
+         socket::status_t status{ ioctlsocket(handle_, FIONBIO, &um) };
+         mode_ = status.ok() ? mode : mode_;
+         return status;
+      }
+
+      template <typename F>
+      socket::status_t measure(io_op_t op, size_t requested, const size_t& transferred, F&& io) noexcept
+      {
+         if constexpr (io_metrics_policy_t::enabled)
+         {
+            const int64_t start = io_metrics_policy_t::start();
+            socket::status_t status = io();
+            io_metrics_policy_t::record(counters_, op, transferred, io_result(status, requested, transferred), start);
+            return status;
+         }
+         else
+         {
+            return io();
+         }
+      }
+
+      socket::status_t send_one(const char* buffer, size_t len, const ip::address_t& address, size_t& bytes_sent) noexcept
+      {
+         const sockaddr* to = address.length() > 0 ? address.address() : nullptr;
+         int ret = ::sendto(handle_, buffer, static_cast<int>(len), 0, to, address.length());
+         if (ret == SOCKET_ERROR) return socket::status_t{ last_error(), status_code_t::want_write };
+         bytes_sent = static_cast<size_t>(ret);
+         return socket::status_t{};
+      }
+
+      socket::status_t recv_one(char* buffer, size_t len, ip::address_t& address, size_t& bytes_received, bool* truncated = nullptr) noexcept
+      {
+         sockaddr_storage name{};
+         socklen_t namelen{ sizeof(name) };
+#if defined(XPLAT_WINSOCK)
+         int ret = ::recvfrom(handle_, buffer, static_cast<int>(len), 0, reinterpret_cast<sockaddr*>(&name), &namelen);
+         // winsock fails a datagram that did not fit, after filling buffer
+         if (ret == SOCKET_ERROR && last_error() == WSAEMSGSIZE)
+         {
+            if (truncated) *truncated = true;
+            ret = static_cast<int>(len);
+         }
+#else
+         iovec iov{ buffer, len };
+         msghdr header{};
+         header.msg_name = &name;
+         header.msg_namelen = namelen;
+         header.msg_iov = &iov;
+         header.msg_iovlen = 1;
+         ssize_t ret = ::recvmsg(handle_, &header, 0);
+         namelen = header.msg_namelen;
+         if (truncated) *truncated = (header.msg_flags & MSG_TRUNC) != 0;
+#endif
+         if (ret == SOCKET_ERROR) return socket::status_t{ last_error(), status_code_t::want_read };
+         address = ip::address_t(name, namelen);
+         bytes_received = static_cast<size_t>(ret);
+         return socket::status_t{};
+      }
+
+#if defined(XPLAT_MMSG)
+      // room for one UDP_SEGMENT or UDP_GRO control message
+      struct alignas(cmsghdr) control_t
+      {
+         char data[CMSG_SPACE(sizeof(int))];
+      };
+
+      socket::status_t recv_batch(std::span<datagram_t> messages, size_t& count, size_t& bytes) noexcept
+      {
+         const size_t batch = std::min(messages.size(), DATAGRAM_MAX_BATCH);
+         std::array<mmsghdr, DATAGRAM_MAX_BATCH> headers;
+         std::array<iovec, DATAGRAM_MAX_BATCH> iov;
+         std::array<sockaddr_storage, DATAGRAM_MAX_BATCH> names;
+         std::array<control_t, DATAGRAM_MAX_BATCH> controls;
+         for (size_t i = 0; i < batch; ++i)
+         {
+            iov[i] = iovec{ messages[i].buffer.data(), messages[i].buffer.size() };
+            headers[i] = mmsghdr{};
+            headers[i].msg_hdr.msg_name = &names[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            headers[i].msg_hdr.msg_iov = &iov[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            if (gro_)
+            {
+               headers[i].msg_hdr.msg_control = controls[i].data;
+               headers[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+            }
+         }
+         int ret = ::recvmmsg(handle_, headers.data(), static_cast<unsigned>(batch), MSG_WAITFORONE, nullptr);
+         if (ret == SOCKET_ERROR) return socket::status_t{ last_error(), status_code_t::want_read };
+         count = static_cast<size_t>(ret);
+         for (size_t i = 0; i < count; ++i)
+         {
+            datagram_t& message = messages[i];
+            const msghdr& header = headers[i].msg_hdr;
+            message.size = headers[i].msg_len;
+            message.address = ip::address_t(names[i], header.msg_namelen);
+            message.truncated = (header.msg_flags & MSG_TRUNC) != 0;
+            message.segment_size = 0;
+            if (gro_)
+            {
+               for (const cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&header), const_cast<cmsghdr*>(cmsg)))
+               {
+                  if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+                  {
+                     int segment{};
+                     std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+                     if (static_cast<size_t>(segment) < message.size) message.segment_size = static_cast<size_t>(segment);
+                  }
+               }
+            }
+            bytes += message.size;
+         }
+         return socket::status_t{};
+      }
+
+      socket::status_t send_batch(std::span<const datagram_t> messages, size_t& count, size_t& bytes) noexcept
+      {
+         const size_t batch = std::min(messages.size(), DATAGRAM_MAX_BATCH);
+         std::array<mmsghdr, DATAGRAM_MAX_BATCH> headers;
+         std::array<iovec, DATAGRAM_MAX_BATCH> iov;
+         std::array<control_t, DATAGRAM_MAX_BATCH> controls;
+         for (size_t i = 0; i < batch; ++i)
+         {
+            const datagram_t& message = messages[i];
+            iov[i] = iovec{ message.buffer.data(), message.buffer.size() };
+            headers[i] = mmsghdr{};
+            msghdr& header = headers[i].msg_hdr;
+            if (message.address.length() > 0)
+            {
+               header.msg_name = const_cast<sockaddr*>(message.address.address());
+               header.msg_namelen = message.address.length();
+            }
+            header.msg_iov = &iov[i];
+            header.msg_iovlen = 1;
+            if (message.segment_size > 0 && message.segment_size < message.buffer.size())
+            {
+               // generic segmentation offload: the kernel, or the NIC, cuts
+               // the buffer into datagrams of segment_size
+               header.msg_control = controls[i].data;
+               header.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+               cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+               cmsg->cmsg_level = IPPROTO_UDP;
+               cmsg->cmsg_type = UDP_SEGMENT;
+               cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+               const uint16_t segment = static_cast<uint16_t>(message.segment_size);
+               std::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+            }
+         }
+         int ret = ::sendmmsg(handle_, headers.data(), static_cast<unsigned>(batch), 0);
+         if (ret == SOCKET_ERROR) return socket::status_t{ last_error(), status_code_t::want_write };
+         count = static_cast<size_t>(ret);
+         for (size_t i = 0; i < count; ++i) bytes += headers[i].msg_len;
+         return socket::status_t{};
+      }
+#else
+      // a batch is a loop of single datagrams. An error after the first
+      // datagram ends the batch and is reported by the next call
+      socket::status_t recv_batch(std::span<datagram_t> messages, size_t& count, size_t& bytes) noexcept
+      {
+         const size_t batch = std::min(messages.size(), DATAGRAM_MAX_BATCH);
+         while (count < batch)
+         {
+            datagram_t& message = messages[count];
+            message.truncated = false;
+            message.segment_size = 0;
+            socket::status_t status = recv_one(message.buffer.data(), message.buffer.size(), message.address, message.size, &message.truncated);
+            if (status.nok()) return count > 0 ? socket::status_t{} : status;
+            bytes += message.size;
+            ++count;
+            // a blocking socket only waits for the first datagram
+            if (mode_ == socket_mode_t::blocking) break;
+         }
+         return socket::status_t{};
+      }
+
+      socket::status_t send_batch(std::span<const datagram_t> messages, size_t& count, size_t& bytes) noexcept
+      {
+         const size_t batch = std::min(messages.size(), DATAGRAM_MAX_BATCH);
+         for (; count < batch; ++count)
+         {
+            const datagram_t& message = messages[count];
+            const size_t segment = message.segment_size > 0 ? message.segment_size : message.buffer.size();
+            size_t offset{};
+            do
+            {
+               size_t sent{};
+               const size_t len = std::min(segment, message.buffer.size() - offset);
+               socket::status_t status = send_one(message.buffer.data() + offset, len, message.address, sent);
+               if (status.nok() && offset == 0) return count > 0 ? socket::status_t{} : status;
+               // segments already sent cannot be taken back, the message counts as sent
+               if (status.nok())
+               {
+                  ++count;
+                  return socket::status_t{};
+               }
+               offset += sent;
+               bytes += sent;
+            } while (offset < message.buffer.size());
+         }
+         return socket::status_t{};
+      }
+#endif
+   }; // class datagram_socket_t
+
+} // namespace rmlib
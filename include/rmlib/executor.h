@@ -0,0 +1,576 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <new>
+#include <vector>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <bit>
+
+#include "rmlib/xplat.h"
+#include "rmlib/status.h"
+#include "rmlib/utility.h"
+
+namespace rmlib {
+
+   // initial capacity of a worker deque, it doubles when full
+   constexpr size_t WORK_STEALING_DEQUE_DEFAULT_CAPACITY = 1024;
+
+   // rounds of stealing an idle worker makes before it sleeps or polls
+   constexpr size_t EXECUTOR_DEFAULT_SPIN = 64;
+
+   // longest an idle worker blocks in the poll hook
+   constexpr int64_t EXECUTOR_DEFAULT_POLL_TIMEOUT_MS = 1;
+
+   // a busy worker with a poll hook polls once every this many tasks, so I/O
+   // readiness is not starved by a long run of posted work
+   constexpr size_t EXECUTOR_POLL_INTERVAL = 61;
+
+   /**************************************************************************\
+   * work_stealing_deque_t
+   * Chase-Lev deque, with the memory orders of Le, Pop, Cohen and Zappa
+   * Nardelli (PPoPP 2013). The owner thread pushes and pops at the bottom,
+   * any other thread steals from the top, so the owner works on its most
+   * recent items while thieves take the oldest. push() grows the buffer when
+   * full; replaced buffers are kept until the deque is destroyed because a
+   * thief may still read them
+   \**************************************************************************/
+   template <typename T>
+      requires std::is_trivially_copyable_v<T>
+   class work_stealing_deque_t
+   {
+      struct buffer_t
+      {
+         int64_t mask;
+         std::unique_ptr<std::atomic<T>[]> items;
+
+         explicit buffer_t(int64_t capacity) noexcept
+            : mask{ capacity - 1 }
+            , items{ new (std::nothrow) std::atomic<T>[static_cast<size_t>(capacity)] }
+         {}
+
+         int64_t capacity() const noexcept
+         {
+            return mask + 1;
+         }
+
+         T get(int64_t index) const noexcept
+         {
+            return items[static_cast<size_t>(index & mask)].load(std::memory_order_relaxed);
+         }
+
+         void put(int64_t index, T item) noexcept
+         {
+            items[static_cast<size_t>(index & mask)].store(item, std::memory_order_relaxed);
+         }
+      };
+
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> top_{ 0 };
+      alignas(CACHE_LINE_SIZE) std::atomic<int64_t> bottom_{ 0 };
+      std::atomic<buffer_t*> buffer_{ nullptr };
+      std::vector<std::unique_ptr<buffer_t>> buffers_{};
+
+   public:
+      explicit work_stealing_deque_t(size_t capacity = WORK_STEALING_DEQUE_DEFAULT_CAPACITY) noexcept
+      {
+         grow(std::bit_ceil(std::max<size_t>(capacity, 2)));
+      }
+
+      work_stealing_deque_t(const work_stealing_deque_t&) = delete;
+      work_stealing_deque_t(work_stealing_deque_t&&) = delete;
+      work_stealing_deque_t& operator=(const work_stealing_deque_t&) = delete;
+      work_stealing_deque_t& operator=(work_stealing_deque_t&&) = delete;
+      ~work_stealing_deque_t() = default;
+
+      // owner only. False when the buffer could not grow
+      bool push(T item) noexcept
+      {
+         const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+         const int64_t top = top_.load(std::memory_order_acquire);
+         buffer_t* buffer = buffer_.load(std::memory_order_relaxed);
+         if (bottom - top > buffer->capacity() - 1)
+         {
+            if (buffer = grow(static_cast<size_t>(buffer->capacity()) * 2, top, bottom); !buffer) return false;
+         }
+         buffer->put(bottom, item);
+         std::atomic_thread_fence(std::memory_order_release);
+         bottom_.store(bottom + 1, std::memory_order_relaxed);
+         return true;
+      }
+
+      // owner only, most recently pushed item first
+      bool pop(T& item) noexcept
+      {
+         const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+         buffer_t* buffer = buffer_.load(std::memory_order_relaxed);
+         bottom_.store(bottom, std::memory_order_relaxed);
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         int64_t top = top_.load(std::memory_order_relaxed);
+         if (top > bottom)
+         {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+         }
+         item = buffer->get(bottom);
+         if (top == bottom)
+         {
+            // last item, race the thieves for it
+            const bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+         }
+         return true;
+      }
+
+      // any thread, oldest item first. False when empty or another thread
+      // took the item first
+      bool steal(T& item) noexcept
+      {
+         int64_t top = top_.load(std::memory_order_acquire);
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         const int64_t bottom = bottom_.load(std::memory_order_acquire);
+         if (top >= bottom) return false;
+         buffer_t* buffer = buffer_.load(std::memory_order_acquire);
+         item = buffer->get(top);
+         return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      }
+
+      // a snapshot, exact only when no other thread uses the deque
+      size_t size() const noexcept
+      {
+         const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+         const int64_t top = top_.load(std::memory_order_relaxed);
+         return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+      }
+
+      bool empty() const noexcept
+      {
+         return size() == 0;
+      }
+
+      size_t capacity() const noexcept
+      {
+         return static_cast<size_t>(buffer_.load(std::memory_order_relaxed)->capacity());
+      }
+
+   private:
+      buffer_t* grow(size_t capacity, int64_t top = 0, int64_t bottom = 0) noexcept
+      {
+         buffer_t* current = buffer_.load(std::memory_order_relaxed);
+         try
+         {
+            buffers_.reserve(buffers_.size() + 1);
+            auto buffer = std::make_unique<buffer_t>(static_cast<int64_t>(capacity));
+            if (!buffer->items) return nullptr;
+            for (int64_t i = top; i < bottom; ++i) buffer->put(i, current->get(i));
+            buffer_.store(buffer.get(), std::memory_order_release);
+            buffers_.push_back(std::move(buffer));
+         }
+         catch (...)
+         {
+            return nullptr;
+         }
+         return buffer_.load(std::memory_order_relaxed);
+      }
+   }; // class work_stealing_deque_t
+
+   /**************************************************************************\
+   * executor_work_t
+   * intrusive unit of work. The poster owns the storage, which must stay
+   * valid until execute runs, so posting a work item never allocates. Embed
+   * it in a connection or request object and recover the object in execute
+   \**************************************************************************/
+   struct executor_work_t
+   {
+      void (*execute)(executor_work_t& work) noexcept { nullptr };
+      executor_work_t* next{ nullptr };   // link in a worker inbox while queued
+   };
+
+   // workers run poll(worker, timeout_ms) when set, see executor_t
+   using executor_poll_t = std::function<void(size_t worker, int64_t timeout_ms)>;
+
+   struct executor_options_t
+   {
+      size_t threads{};                                  // 0 for one per hardware thread
+      bool pin_threads{ false };                         // pin worker i to cpu first_cpu + i
+      unsigned first_cpu{};
+      size_t spin{ EXECUTOR_DEFAULT_SPIN };
+      executor_poll_t poll{};                            // per worker I/O hook
+      int64_t poll_timeout_ms{ EXECUTOR_DEFAULT_POLL_TIMEOUT_MS };
+   };
+
+   /**************************************************************************\
+   * executor_t
+   * work stealing thread pool. Each worker owns a work_stealing_deque_t and
+   * an inbox. Work posted by a worker goes to its own deque and runs on the
+   * same core while its data is cache-hot, unless an idle worker steals it.
+   * Work posted by other threads, such as a reactor thread, goes to the inbox
+   * of a worker: post_to(worker_for(uid)) sends every event of a connection
+   * to the same worker.
+   *
+   * Without a poll hook idle workers sleep until work arrives. With one,
+   * every worker owns an I/O source: an idle worker blocks in
+   * poll(worker, poll_timeout_ms) instead of sleeping, and a busy one calls
+   * poll(worker, 0) every EXECUTOR_POLL_INTERVAL tasks. The hook typically
+   * runs a per worker socket_reactor_t::run_once() or reaps an
+   * aio::queue_t, so completions are handled on the worker that owns the
+   * socket or file. Posts to a polling worker are noticed on its next poll
+   * timeout at the latest.
+   *
+   * shutdown() stops external posts, runs the work already queued, including
+   * work posted meanwhile by workers, and joins the threads
+   \**************************************************************************/
+   class executor_t
+   {
+      struct alignas(CACHE_LINE_SIZE) worker_t
+      {
+         work_stealing_deque_t<executor_work_t*> deque{};
+         std::atomic<executor_work_t*> inbox{ nullptr };
+         std::atomic<uint32_t> epoch{ 0 };
+         std::atomic<bool> sleeping{ false };
+         uint64_t random{};
+         std::thread thread{};
+      };
+
+      template <typename F>
+      struct function_work_t : executor_work_t
+      {
+         F function;
+
+         explicit function_work_t(F&& f) noexcept(std::is_nothrow_move_constructible_v<F>)
+            : executor_work_t{ &function_work_t::run }
+            , function{ std::move(f) }
+         {}
+
+         static void run(executor_work_t& work) noexcept
+         {
+            auto* self = static_cast<function_work_t*>(&work);
+            self->function();
+            delete self;
+         }
+      };
+
+      struct current_t
+      {
+         const executor_t* executor{ nullptr };
+         size_t worker{};
+      };
+
+      executor_options_t options_;
+      std::unique_ptr<worker_t[]> workers_{};
+      size_t size_{};
+      std::atomic<size_t> next_{ 0 };
+      std::atomic<size_t> sleepers_{ 0 };
+      std::atomic<size_t> external_{ 0 };
+      std::atomic<bool> stop_{ false };
+      status_t status_{};
+
+   public:
+      explicit executor_t(const executor_options_t& options = executor_options_t{}) noexcept
+         : options_{ options }
+      {
+         size_ = options_.threads > 0 ? options_.threads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+         workers_.reset(new (std::nothrow) worker_t[size_]);
+         if (!workers_)
+         {
+            size_ = 0;
+            status_ = status_t(ENOMEM);
+            return;
+         }
+         for (size_t i = 0; i < size_; ++i) workers_[i].random = 0x9E3779B97F4A7C15ull * (i + 1);
+         try
+         {
+            for (size_t i = 0; i < size_; ++i)
+            {
+               workers_[i].thread = std::thread([this, i]() { run(i); });
+            }
+         }
+         catch (...)
+         {
+            status_ = status_t(EAGAIN);
+            shutdown();
+         }
+      }
+
+      executor_t(const executor_t&) = delete;
+      executor_t(executor_t&&) = delete;
+      executor_t& operator=(const executor_t&) = delete;
+      executor_t& operator=(executor_t&&) = delete;
+
+      ~executor_t() noexcept
+      {
+         shutdown();
+      }
+
+      status_t status() const noexcept
+      {
+         return status_;
+      }
+
+      // number of workers
+      size_t size() const noexcept
+      {
+         return size_;
+      }
+
+      // index of the calling worker of this executor, or size() when called
+      // from any other thread
+      size_t current_worker() const noexcept
+      {
+         const current_t& current = this_worker();
+         return current.executor == this ? current.worker : size_;
+      }
+
+      // stable worker for a key such as socket_t::uid(), spread with a
+      // multiplicative hash so sequential uids land on different workers
+      size_t worker_for(uint64_t key) const noexcept
+      {
+         if (size_ == 0) return 0;
+         return static_cast<size_t>(((key * 0x9E3779B97F4A7C15ull) >> 32) % size_);
+      }
+
+      // from a worker the work goes to its own deque, from any other thread
+      // to the inbox of the next worker in turn
+      bool post(executor_work_t& work) noexcept
+      {
+         if (size_t worker = current_worker(); worker < size_) return push_local(worker, work);
+         return post_to(next_.fetch_add(1, std::memory_order_relaxed) % std::max<size_t>(size_, 1), work);
+      }
+
+      // run work on worker, unless another worker steals it first. False after
+      // shutdown() or when worker is out of range
+      bool post_to(size_t worker, executor_work_t& work) noexcept
+      {
+         if (worker >= size_) return false;
+         const size_t self = current_worker();
+         if (self == worker) return push_local(worker, work);
+         external_.fetch_add(1, std::memory_order_seq_cst);
+         if (stop_.load(std::memory_order_seq_cst))
+         {
+            external_.fetch_sub(1, std::memory_order_seq_cst);
+            // a worker posting while the pool drains keeps the work itself
+            return self < size_ && push_local(self, work);
+         }
+         worker_t& target = workers_[worker];
+         executor_work_t* head = target.inbox.load(std::memory_order_relaxed);
+         do
+         {
+            work.next = head;
+         } while (!target.inbox.compare_exchange_weak(head, &work, std::memory_order_release, std::memory_order_relaxed));
+         wake(target);
+         external_.fetch_sub(1, std::memory_order_seq_cst);
+         return true;
+      }
+
+      // type erased callable, allocates one node per call. Prefer an embedded
+      // executor_work_t on hot paths
+      template <typename F>
+         requires std::is_invocable_v<F&>
+      bool post(F&& function) noexcept
+      {
+         using work_t = function_work_t<std::decay_t<F>>;
+         work_t* work = new (std::nothrow) work_t(std::decay_t<F>(std::forward<F>(function)));
+         if (!work) return false;
+         if (!post(static_cast<executor_work_t&>(*work)))
+         {
+            delete work;
+            return false;
+         }
+         return true;
+      }
+
+      template <typename F>
+         requires std::is_invocable_v<F&>
+      bool post_to(size_t worker, F&& function) noexcept
+      {
+         using work_t = function_work_t<std::decay_t<F>>;
+         work_t* work = new (std::nothrow) work_t(std::decay_t<F>(std::forward<F>(function)));
+         if (!work) return false;
+         if (!post_to(worker, static_cast<executor_work_t&>(*work)))
+         {
+            delete work;
+            return false;
+         }
+         return true;
+      }
+
+      // idempotent. Must not be called from a worker
+      void shutdown() noexcept
+      {
+         stop_.store(true, std::memory_order_seq_cst);
+         for (size_t i = 0; i < size_; ++i) notify(workers_[i]);
+         for (size_t i = 0; i < size_; ++i)
+         {
+            if (workers_[i].thread.joinable()) workers_[i].thread.join();
+         }
+      }
+
+   private:
+      static current_t& this_worker() noexcept
+      {
+         static thread_local current_t current{};
+         return current;
+      }
+
+      bool push_local(size_t worker, executor_work_t& work) noexcept
+      {
+         if (!workers_[worker].deque.push(&work)) return false;
+         // let a sleeping worker steal it
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (sleepers_.load(std::memory_order_relaxed) > 0)
+         {
+            for (size_t i = 0; i < size_; ++i)
+            {
+               if (i != worker && workers_[i].sleeping.load(std::memory_order_relaxed))
+               {
+                  notify(workers_[i]);
+                  break;
+               }
+            }
+         }
+         return true;
+      }
+
+      void wake(worker_t& worker) noexcept
+      {
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (worker.sleeping.load(std::memory_order_relaxed)) notify(worker);
+      }
+
+      static void notify(worker_t& worker) noexcept
+      {
+         worker.epoch.fetch_add(1, std::memory_order_seq_cst);
+         worker.epoch.notify_one();
+      }
+
+      // own deque, then own inbox, then steal from the others starting at a
+      // random victim
+      executor_work_t* next(size_t index) noexcept
+      {
+         worker_t& worker = workers_[index];
+         executor_work_t* work{ nullptr };
+         if (worker.deque.pop(work)) return work;
+         if (executor_work_t* inbox = worker.inbox.exchange(nullptr, std::memory_order_acquire); inbox)
+         {
+            // the inbox is newest first, pushing it in that order pops the oldest first
+            work = inbox;
+            for (executor_work_t* item = inbox->next; item; )
+            {
+               executor_work_t* following = item->next;
+               if (!worker.deque.push(item)) item->execute(*item);
+               item = following;
+            }
+            return work;
+         }
+         worker.random ^= worker.random << 13;
+         worker.random ^= worker.random >> 7;
+         worker.random ^= worker.random << 17;
+         const size_t start = static_cast<size_t>(worker.random % size_);
+         for (size_t i = 0; i < size_; ++i)
+         {
+            const size_t victim = (start + i) % size_;
+            if (victim != index && workers_[victim].deque.steal(work)) return work;
+         }
+         return nullptr;
+      }
+
+      // during shutdown workers only post to themselves, so a worker is done
+      // once its own queues are empty and no external post is in flight
+      bool drained(size_t index) const noexcept
+      {
+         if (external_.load(std::memory_order_seq_cst) != 0) return false;
+         return workers_[index].deque.empty() && !workers_[index].inbox.load(std::memory_order_seq_cst);
+      }
+
+      void run(size_t index) noexcept
+      {
+         this_worker() = current_t{ this, index };
+         if (options_.pin_threads)
+         {
+            const unsigned cpus = std::max(std::thread::hardware_concurrency(), 1u);
+            set_thread_affinity(static_cast<unsigned>((options_.first_cpu + index) % cpus));
+         }
+         worker_t& worker = workers_[index];
+         size_t tasks{};
+         while (true)
+         {
+            executor_work_t* work{ nullptr };
+            for (size_t spin = 0; !work && spin <= options_.spin; ++spin)
+            {
+               if (work = next(index); !work && spin < options_.spin) std::this_thread::yield();
+            }
+            if (work)
+            {
+               do
+               {
+                  work->execute(*work);
+                  if (options_.poll && ++tasks % EXECUTOR_POLL_INTERVAL == 0) options_.poll(index, 0);
+               } while ((work = next(index)) != nullptr);
+            }
+            if (stop_.load(std::memory_order_seq_cst))
+            {
+               if (drained(index)) break;
+               continue;
+            }
+            if (options_.poll)
+            {
+               options_.poll(index, options_.poll_timeout_ms);
+               continue;
+            }
+            const uint32_t epoch = worker.epoch.load(std::memory_order_seq_cst);
+            worker.sleeping.store(true, std::memory_order_seq_cst);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            // pairs with the fence of the posting thread, one of the two sees the other
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!has_work(index) && !stop_.load(std::memory_order_seq_cst)) worker.epoch.wait(epoch, std::memory_order_seq_cst);
+            sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+            worker.sleeping.store(false, std::memory_order_relaxed);
+         }
+         this_worker() = current_t{};
+      }
+
+      // anything this worker could run or steal
+      bool has_work(size_t index) const noexcept
+      {
+         if (workers_[index].inbox.load(std::memory_order_seq_cst)) return true;
+         for (size_t i = 0; i < size_; ++i)
+         {
+            if (!workers_[i].deque.empty()) return true;
+         }
+         return false;
+      }
+   }; // class executor_t
+
+} // namespace rmlib
@@ -0,0 +1,384 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <bit>
+#include <algorithm>
+#include <concepts>
+
+#include "rmlib/xplat.h"
+#include "rmlib/utility.h"
+#include "rmlib/socket.h"
+
+#if defined(XPLAT_CPU_AMD64) || defined(XPLAT_CPU_IX32)
+   // SSE2 is baseline on x64, AVX2 is used when the compiler targets it
+   #if defined(XPLAT_CPU_AMD64) || defined(__SSE2__)
+      #define XPLAT_SIMD_SSE2
+   #endif
+   #if defined(__AVX2__)
+      #define XPLAT_SIMD_AVX2
+   #endif
+#elif defined(XPLAT_CPU_ARM64)
+   #if defined(XPLAT_CC_MSVC)
+      #include <arm64_neon.h>
+      #define XPLAT_SIMD_NEON
+   #elif defined(__ARM_NEON)
+      #include <arm_neon.h>
+      #define XPLAT_SIMD_NEON
+   #endif
+#endif
+
+namespace rmlib {
+
+   // framed_reader_t buffer and frame size limits
+   constexpr size_t FRAMED_READER_DEFAULT_BUFFER_SIZE = 64 * 1024;
+   constexpr size_t FRAMED_READER_DEFAULT_MAX_FRAME = 64 * 1024;
+
+   namespace framing {
+
+      inline size_t find_byte_scalar(const char* data, size_t size, char byte) noexcept
+      {
+         const void* found = std::memchr(data, byte, size);
+         return found ? static_cast<size_t>(static_cast<const char*>(found) - data) : size;
+      }
+
+#if defined(XPLAT_SIMD_SSE2)
+      inline size_t find_byte_sse2(const char* data, size_t size, char byte) noexcept
+      {
+         const __m128i needle = _mm_set1_epi8(byte);
+         size_t i{};
+         for (; i + 16 <= size; i += 16)
+         {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if (unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle))); mask != 0)
+            {
+               return i + static_cast<size_t>(std::countr_zero(mask));
+            }
+         }
+         for (; i < size; ++i)
+         {
+            if (data[i] == byte) return i;
+         }
+         return size;
+      }
+#endif
+
+#if defined(XPLAT_SIMD_AVX2)
+      inline size_t find_byte_avx2(const char* data, size_t size, char byte) noexcept
+      {
+         const __m256i needle = _mm256_set1_epi8(byte);
+         size_t i{};
+         for (; i + 32 <= size; i += 32)
+         {
+            const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            if (unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle))); mask != 0)
+            {
+               return i + static_cast<size_t>(std::countr_zero(mask));
+            }
+         }
+         return i + find_byte_sse2(data + i, size - i, byte);
+      }
+#endif
+
+#if defined(XPLAT_SIMD_NEON)
+      inline size_t find_byte_neon(const char* data, size_t size, char byte) noexcept
+      {
+         const uint8x16_t needle = vdupq_n_u8(static_cast<uint8_t>(byte));
+         size_t i{};
+         for (; i + 16 <= size; i += 16)
+         {
+            const uint8x16_t equal = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i)), needle);
+            // narrow every byte of the comparison to a nibble of a 64 bit mask
+            const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+            if (mask != 0) return i + static_cast<size_t>(std::countr_zero(mask) >> 2);
+         }
+         for (; i < size; ++i)
+         {
+            if (data[i] == byte) return i;
+         }
+         return size;
+      }
+#endif
+
+      // index of the first byte in data, size when there is none. Uses the
+      // widest kernel the target CPU macros allow
+      inline size_t find_byte(const char* data, size_t size, char byte) noexcept
+      {
+#if defined(XPLAT_SIMD_AVX2)
+         return find_byte_avx2(data, size, byte);
+#elif defined(XPLAT_SIMD_SSE2)
+         return find_byte_sse2(data, size, byte);
+#elif defined(XPLAT_SIMD_NEON)
+         return find_byte_neon(data, size, byte);
+#else
+         return find_byte_scalar(data, size, byte);
+#endif
+      }
+
+   } // namespace framing
+
+   enum class frame_format_t
+   {
+        delimiter       // frames end with frame_options_t::delimiter, '\n' by default
+      , crlf            // frames end with "\r\n", a bare '\n' belongs to the frame
+      , length_prefix   // frames start with an unsigned length of prefix_bytes
+   };
+
+   struct frame_options_t
+   {
+      frame_format_t format{ frame_format_t::delimiter };
+      char delimiter{ '\n' };
+      unsigned prefix_bytes{ 4 };      // 1, 2, 4 or 8
+      bool big_endian{ true };         // network byte order prefix
+      size_t max_frame{ FRAMED_READER_DEFAULT_MAX_FRAME };
+      size_t buffer_size{ FRAMED_READER_DEFAULT_BUFFER_SIZE };
+   };
+
+   // socket_t, datagram_socket_t or anything else with socket_t::recv()
+   template <typename S>
+   concept FrameSource = requires(S& source, char* buffer, size_t len, size_t& bytes_received)
+   {
+      { source.recv(buffer, len, bytes_received) } -> std::same_as<socket::status_t>;
+   };
+
+   /**************************************************************************\
+   * framed_reader_t
+   * splits a byte stream into frames. Data is received straight into the
+   * reader's buffer and frames are returned as views into it, without the
+   * delimiter or the length prefix. The delimiter search resumes where the
+   * previous one stopped, so a frame that arrives in many pieces is scanned
+   * once. Frames stay valid until the next fill() or read(); next() does
+   * not move the buffer, so all frames of one fill are valid together.
+   * A frame longer than max_frame fails with WSAEMSGSIZE and the reader
+   * must be reset()
+   \**************************************************************************/
+   class framed_reader_t
+   {
+      frame_options_t options_;
+      std::unique_ptr<char[]> buffer_{};
+      size_t capacity_{};
+      size_t begin_{};     // first byte of the next frame
+      size_t end_{};       // end of received data
+      size_t scan_{};      // delimiter search resumes here
+      bool overflow_{ false };
+
+   public:
+      explicit framed_reader_t(const frame_options_t& options = frame_options_t{}) noexcept
+         : options_{ options }
+      {
+         if (options_.format == frame_format_t::length_prefix)
+         {
+            options_.prefix_bytes = std::clamp(std::bit_ceil(options_.prefix_bytes), 1u, 8u);
+         }
+         capacity_ = std::max(options_.buffer_size, options_.max_frame + framing_size());
+         buffer_.reset(new (std::nothrow) char[capacity_]);
+         if (!buffer_) capacity_ = 0;
+      }
+
+      framed_reader_t(const framed_reader_t&) = delete;
+      // the moved from reader is left without a buffer and empty
+      framed_reader_t(framed_reader_t&& other) noexcept
+         : options_{ other.options_ }
+         , buffer_{ std::move(other.buffer_) }
+         , capacity_{ std::exchange(other.capacity_, 0) }
+         , begin_{ other.begin_ }
+         , end_{ other.end_ }
+         , scan_{ other.scan_ }
+         , overflow_{ other.overflow_ }
+      {
+         other.reset();
+      }
+
+      framed_reader_t& operator=(const framed_reader_t&) = delete;
+
+      framed_reader_t& operator=(framed_reader_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            options_ = other.options_;
+            buffer_ = std::move(other.buffer_);
+            capacity_ = std::exchange(other.capacity_, 0);
+            begin_ = other.begin_;
+            end_ = other.end_;
+            scan_ = other.scan_;
+            overflow_ = other.overflow_;
+            other.reset();
+         }
+         return *this;
+      }
+
+      ~framed_reader_t() = default;
+
+      const frame_options_t& options() const noexcept
+      {
+         return options_;
+      }
+
+      // received bytes not returned as frames yet
+      size_t pending() const noexcept
+      {
+         return end_ - begin_;
+      }
+
+      size_t capacity() const noexcept
+      {
+         return capacity_;
+      }
+
+      // drop buffered data, after an error or to switch streams
+      void reset() noexcept
+      {
+         begin_ = end_ = scan_ = 0;
+         overflow_ = false;
+      }
+
+      // the next buffered frame, no I/O. False when no complete frame is
+      // buffered
+      bool next(std::string_view& frame) noexcept
+      {
+         if (overflow_ || begin_ == end_) return false;
+         return options_.format == frame_format_t::length_prefix ? next_prefixed(frame) : next_delimited(frame);
+      }
+
+      // one recv from source into the free space of the buffer
+      template <FrameSource S>
+      socket::status_t fill(S& source) noexcept
+      {
+         if (overflow_) return socket::status_t{ WSAEMSGSIZE };
+         if (capacity_ == 0) return socket::status_t{ WSAENOBUFS };
+         compact();
+         if (end_ == capacity_)
+         {
+            // the buffer holds max_frame bytes and no frame ends in them
+            overflow_ = true;
+            return socket::status_t{ WSAEMSGSIZE };
+         }
+         size_t bytes{};
+         socket::status_t status = source.recv(buffer_.get() + end_, capacity_ - end_, bytes);
+         end_ += bytes;
+         return status;
+      }
+
+      // next frame, receiving from source until one is complete. A nonblocking
+      // source returns would_block() once it has nothing more
+      template <FrameSource S>
+      socket::status_t read(S& source, std::string_view& frame) noexcept
+      {
+         while (!next(frame))
+         {
+            if (overflow_) return socket::status_t{ WSAEMSGSIZE };
+            if (socket::status_t status = fill(source); status.nok()) return status;
+         }
+         return socket::status_t{};
+      }
+
+   private:
+      // bytes a frame takes besides its payload
+      size_t framing_size() const noexcept
+      {
+         switch (options_.format)
+         {
+            case frame_format_t::delimiter: return 1;
+            case frame_format_t::crlf: return 2;
+            case frame_format_t::length_prefix: return options_.prefix_bytes;
+         }
+         return 0;
+      }
+
+      // move a partial frame to the front so the rest of the buffer is free
+      void compact() noexcept
+      {
+         if (begin_ == 0) return;
+         const size_t size = end_ - begin_;
+         if (size > 0) std::memmove(buffer_.get(), buffer_.get() + begin_, size);
+         scan_ -= begin_;
+         begin_ = 0;
+         end_ = size;
+      }
+
+      void consume(size_t end) noexcept
+      {
+         begin_ = scan_ = end;
+         if (begin_ == end_) begin_ = end_ = scan_ = 0;
+      }
+
+      bool next_delimited(std::string_view& frame) noexcept
+      {
+         const char* data = buffer_.get();
+         const bool crlf = options_.format == frame_format_t::crlf;
+         const char delimiter = crlf ? '\n' : options_.delimiter;
+         scan_ = std::max(scan_, begin_);
+         while (scan_ < end_)
+         {
+            const size_t found = scan_ + framing::find_byte(data + scan_, end_ - scan_, delimiter);
+            if (found == end_) break;
+            if (!crlf || (found > begin_ && data[found - 1] == '\r'))
+            {
+               const size_t size = found - begin_ - (crlf ? 1 : 0);
+               if (size > options_.max_frame) break;
+               frame = std::string_view(data + begin_, size);
+               consume(found + 1);
+               return true;
+            }
+            scan_ = found + 1;
+         }
+         scan_ = end_;
+         if (end_ - begin_ > options_.max_frame + (crlf ? 1 : 0)) overflow_ = true;
+         return false;
+      }
+
+      bool next_prefixed(std::string_view& frame) noexcept
+      {
+         const size_t prefix = options_.prefix_bytes;
+         if (end_ - begin_ < prefix) return false;
+         const auto* bytes = reinterpret_cast<const uint8_t*>(buffer_.get() + begin_);
+         uint64_t size{};
+         for (size_t i = 0; i < prefix; ++i)
+         {
+            const size_t shift = 8 * (options_.big_endian ? prefix - 1 - i : i);
+            size |= static_cast<uint64_t>(bytes[i]) << shift;
+         }
+         if (size > options_.max_frame)
+         {
+            overflow_ = true;
+            return false;
+         }
+         if (end_ - begin_ - prefix < size) return false;
+         frame = std::string_view(buffer_.get() + begin_ + prefix, static_cast<size_t>(size));
+         consume(begin_ + prefix + static_cast<size_t>(size));
+         return true;
+      }
+   }; // class framed_reader_t
+
+} // namespace rmlib
@@ -28,47 +28,73 @@
 
 #define _FILE_OFFSET_BITS 64
 #include <stdio.h>
+#include <string>
+#include <memory>
+#include <new>
+#include <span>
+#include <algorithm>
 
 #include "rmlib/xplat.h"
 #include "rmlib/status.h"
 #include "rmlib/utility.h"
-
+#include "rmlib/llfio.h"
+#include "rmlib/metrics.h"
 
 #if defined(XPLAT_OS_WINDOWS)
    #include <windows.h>
    #include <io.h>
-
-   inline bool file_exists(const char* filepath) noexcept
-   {
-      if (!filepath) return false;
-      DWORD fileAttributes = GetFileAttributes(filepath);
-      return (fileAttributes != INVALID_FILE_ATTRIBUTES && !(fileAttributes & FILE_ATTRIBUTE_DIRECTORY));
-   }
 #else
    #include <unistd.h>
    #include <sys/types.h>
+   #include <sys/stat.h>
+   #include <fcntl.h>
    #define _ftelli64 ftell
    #define _fseeki64 fseek
-   #define remove(s) unlink(s)
 
    inline int fopen_s(FILE** file, const char* filename, const char* mode) noexcept
    {
       *file = fopen(filename, mode);
       return *file ? 0 : errno;
    }
-
-   inline bool file_exists(const char* filepath) noexcept
-   {
-      if (!filepath) return false;
-      return access(filepath, F_OK) != -1;
-   }
 #endif
 
 namespace rmlib {
 
+   // stdio buffering mode, see setvbuf()
+   enum class fstream_buffering_t { full, line, none };
+
+   /**************************************************************************\
+   * fstream_options_t
+   * buffering, access pattern and group commit settings for fstream_t::open.
+   * With flush_bytes set and full buffering, write() only reaches the OS
+   * once that many bytes have accumulated, so thousands of small writes
+   * become a few large ones. The stdio buffer is grown to flush_bytes for
+   * this; a caller supplied buffer must be at least that large itself
+   \**************************************************************************/
+   struct fstream_options_t
+   {
+      size_t buffer_size{};                                    // stdio buffer size, 0 keeps the libc default
+      std::span<char> buffer{};                                // caller supplied stdio buffer, overrides buffer_size
+      fstream_buffering_t buffering{ fstream_buffering_t::full };
+      advice_t advice{ advice_t::normal };                     // access pattern hint for the whole file
+      size_t flush_bytes{};                                    // group commit threshold, 0 leaves flushing to stdio
+      bool flush_sync{ false };                                // group commits also datasync to the device
+   };
+
    class fstream_t
    {
       FILE* handle_{};
+      bool writable_{ false };
+      std::unique_ptr<char[]> buffer_{};
+      size_t flush_bytes_{};
+      size_t pending_bytes_{};
+      bool flush_sync_{ false };
+      [[no_unique_address]] io_metrics_policy_t::counters_t counters_{};
+#if defined(XPLAT_OS_WINDOWS)
+      // positional I/O on the stream's own handle would move its file pointer,
+      // read_at and write_at go through an overlapped handle to the same file
+      HANDLE positional_{ INVALID_HANDLE_VALUE };
+#endif
 
    public:
       using file_handle_t = FILE*;
@@ -92,9 +118,22 @@ namespace rmlib {
 
       fstream_t() = default;
       fstream_t(const fstream_t&) = delete;
-      fstream_t(fstream_t&&) = default;
       fstream_t& operator=(const fstream_t&) = delete;
-      fstream_t& operator=(fstream_t&&) = default;
+
+      fstream_t(fstream_t&& other) noexcept
+      {
+         swap(other);
+      }
+
+      fstream_t& operator=(fstream_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            close();
+            swap(other);
+         }
+         return *this;
+      }
 
       ~fstream_t() noexcept
       {
@@ -106,6 +145,18 @@ namespace rmlib {
          return handle_;
       }
 
+      // native OS file handle of the open file, a file descriptor on POSIX systems
+      HANDLE native_handle() const noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         if (!handle_) return INVALID_HANDLE_VALUE;
+         return reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(handle_)));
+#else
+         if (!handle_) return -1;
+         return fileno(handle_);
+#endif
+      }
+
       bool is_eof() const noexcept
       {
          if (!handle_) return true;
@@ -115,6 +166,12 @@ namespace rmlib {
       // status_t is set to EINVAL if open_access_t is read and open_mode_t
       // is create_new or create_always
       status_t open(const char* filename, mode_t mode = mode_t::open_existing, access_t access = access_t::read_write) noexcept
+      {
+         return open(filename, mode, access, fstream_options_t{});
+      }
+
+      // a caller supplied options.buffer must outlive the open file
+      status_t open(const char* filename, mode_t mode, access_t access, const fstream_options_t& options) noexcept
       {
          const char* mode_str[4][3] =
          {
@@ -129,11 +186,36 @@ namespace rmlib {
             return status_t(EINVAL);
          }
          close();
-         status_t status = fopen_s(&handle_, filename, mode_str[static_cast<unsigned>(access)][static_cast<unsigned>(mode)]);
+         std::string open_mode{ mode_str[static_cast<unsigned>(access)][static_cast<unsigned>(mode)] };
+#if defined(XPLAT_OS_WINDOWS)
+         // FILE_FLAG_SEQUENTIAL_SCAN and FILE_FLAG_RANDOM_ACCESS can only be set at open
+         if (options.advice == advice_t::sequential) open_mode += 'S';
+         if (options.advice == advice_t::random) open_mode += 'R';
+#endif
+         status_t status = fopen_s(&handle_, filename, open_mode.c_str());
          if (status.nok())
          {
             handle_ = nullptr;
+            return status;
+         }
+         writable_ = access != access_t::read;
+         if (status = set_buffer(options); status.nok())
+         {
+            close();
+            return status;
+         }
+         flush_bytes_ = options.flush_bytes;
+         flush_sync_ = options.flush_sync;
+         if (options.advice != advice_t::normal) advise(options.advice);
+#if defined(XPLAT_OS_WINDOWS)
+         DWORD desired = access == access_t::append ? (GENERIC_READ | FILE_APPEND_DATA) : writable_ ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+         positional_ = ::ReOpenFile(native_handle(), desired, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, FILE_FLAG_OVERLAPPED);
+         if (positional_ == INVALID_HANDLE_VALUE)
+         {
+            status.reset(xlate_windows_error_code(::GetLastError()));
+            close();
          }
+#endif
          return status;
       }
 
@@ -142,13 +224,26 @@ namespace rmlib {
          return open(filename.c_str(), mode, access);
       }
 
+      status_t open(const std::string& filename, mode_t mode, access_t access, const fstream_options_t& options) noexcept
+      {
+         return open(filename.c_str(), mode, access, options);
+      }
+
       status_t close() noexcept
       {
+#if defined(XPLAT_OS_WINDOWS)
+         if (positional_ != INVALID_HANDLE_VALUE) ::CloseHandle(positional_);
+         positional_ = INVALID_HANDLE_VALUE;
+#endif
+         writable_ = false;
+         flush_bytes_ = pending_bytes_ = 0;
+         flush_sync_ = false;
          if (handle_)
          {
             fflush(handle_);
             int ret = fclose(handle_);
             handle_ = nullptr;
+            buffer_.reset();
             if (ret) return status_t(errno);
          }
          return status_t{};
@@ -156,11 +251,13 @@ namespace rmlib {
 
       status_t read(void* buffer, size_t size, size_t& bytes_read) noexcept
       {
-         status_t status;
          if (handle_ == nullptr) return status_t(EBADF);
-         bytes_read = fread(buffer, 1, size, handle_); 
-         if (ferror(handle_)) return status.reset(errno);
-         return status;
+         return measure(io_op_t::file_read, 0, bytes_read, [&]() noexcept {
+            status_t status;
+            bytes_read = fread(buffer, 1, size, handle_); 
+            if (ferror(handle_)) return status.reset(errno);
+            return status;
+         });
       }
 
       template <DataSizeResizeContainer T>
@@ -180,9 +277,12 @@ namespace rmlib {
       status_t write(const void* buffer, size_t size, size_t& bytes_written) noexcept
       {
          if (handle_ == nullptr) return status_t(EBADF);
-         bytes_written = fwrite(buffer, 1, size, handle_);
-         if (ferror(handle_)) return status_t(errno);
-         return status_t{};
+         return measure(io_op_t::file_write, size, bytes_written, [&]() noexcept {
+            bytes_written = fwrite(buffer, 1, size, handle_);
+            if (ferror(handle_)) return status_t(errno);
+            if (flush_bytes_ > 0 && (pending_bytes_ += bytes_written) >= flush_bytes_) return commit();
+            return status_t{};
+         });
       }
 
       status_t write(const char* buffer, size_t& bytes_written) noexcept
@@ -197,25 +297,109 @@ namespace rmlib {
          return write(buffer.data(), buffer.size(), bytes_written);
       }
 
+      // read at offset without moving the stream position, safe to call from
+      // several threads at once. Data still in the stream buffer from write()
+      // is not seen until flush()
+      status_t read_at(void* buffer, size_t size, off64_t offset, size_t& bytes_read) noexcept
+      {
+         bytes_read = 0;
+         if (handle_ == nullptr) return status_t(EBADF);
+         return measure(io_op_t::file_read, 0, bytes_read, [&]() noexcept {
+            return llfio_t::read_at(positional_handle(), buffer, size, offset, bytes_read);
+         });
+      }
+
+      template <DataSizeResizeContainer T>
+      status_t read_at(T& buffer, size_t size, off64_t offset, size_t& bytes_read) noexcept
+      {
+         if (handle_ == nullptr) return status_t(EBADF);
+         buffer.resize(size);
+         status_t status = read_at(buffer.data(), buffer.size(), offset, bytes_read);
+         buffer.resize(bytes_read);
+         return status;
+      }
+
+      // write at offset without moving the stream position. The write bypasses
+      // the stream buffer. Streams opened with access_t::append write at the end
+      status_t write_at(const void* buffer, size_t size, off64_t offset, size_t& bytes_written) noexcept
+      {
+         bytes_written = 0;
+         if (handle_ == nullptr) return status_t(EBADF);
+         if (!writable_) return status_t(EBADF);
+         return measure(io_op_t::file_write, size, bytes_written, [&]() noexcept {
+            return llfio_t::write_at(positional_handle(), buffer, size, offset, bytes_written);
+         });
+      }
+
+      template <DataSizeContainer T>
+      status_t write_at(const T& buffer, off64_t offset, size_t& bytes_written) noexcept
+      {
+         return write_at(buffer.data(), buffer.size(), offset, bytes_written);
+      }
+
       void flush() noexcept
       {
          if (handle_) fflush(handle_);
+         pending_bytes_ = 0;
       }
 
-      // return file size in bytes
-      size_t size() noexcept
+      // group commit: hand everything buffered to the OS in one write and, with
+      // fstream_options_t::flush_sync, make it durable
+      status_t commit() noexcept
       {
-         static spin_lock_t lock;
-         off64_t size{};
-         if (handle_)
+         if (!handle_) return status_t(EBADF);
+         pending_bytes_ = 0;
+         if (fflush(handle_)) return status_t(errno);
+         if (flush_sync_) return llfio_t::datasync(native_handle());
+         return status_t{};
+      }
+
+      // bytes written since the last flush or commit
+      size_t pending_bytes() const noexcept
+      {
+         return pending_bytes_;
+      }
+
+      // access pattern hint for a range of the file, length 0 means to the end.
+      // Windows only takes hints at open, see fstream_options_t::advice
+      status_t advise(advice_t advice, off64_t offset = 0, off64_t length = 0) noexcept
+      {
+         if (!handle_) return status_t(EBADF);
+#if defined(XPLAT_OS_WINDOWS) || !defined(POSIX_FADV_NORMAL)
+         (void)advice;
+         (void)offset;
+         (void)length;
+#else
+         int flag{ POSIX_FADV_NORMAL };
+         switch (advice)
          {
-            spin_guard_t lock_guard(lock);
-            off64_t current = _ftelli64(handle_);
-            _fseeki64(handle_, 0, SEEK_END);
-            size = _ftelli64(handle_);
-            _fseeki64(handle_, current, SEEK_SET);
+            case advice_t::normal: flag = POSIX_FADV_NORMAL; break;
+            case advice_t::sequential: flag = POSIX_FADV_SEQUENTIAL; break;
+            case advice_t::random: flag = POSIX_FADV_RANDOM; break;
+            case advice_t::willneed: flag = POSIX_FADV_WILLNEED; break;
+            case advice_t::dontneed: flag = POSIX_FADV_DONTNEED; break;
          }
-         return size;
+         if (int ret = ::posix_fadvise(fileno(handle_), offset, length, flag); ret != 0) return status_t(ret);
+#endif
+         return status_t{};
+      }
+
+      // return file size in bytes. Queries the file system instead of seeking the
+      // shared stream, so it does not disturb concurrent reads. Writable streams
+      // are flushed first so buffered writes are counted
+      size_t size() noexcept
+      {
+         if (!handle_) return 0;
+         if (writable_) fflush(handle_);
+#if defined(XPLAT_OS_WINDOWS)
+         LARGE_INTEGER size{};
+         if (!::GetFileSizeEx(native_handle(), &size)) return 0;
+         return static_cast<size_t>(size.QuadPart);
+#else
+         struct stat info{};
+         if (::fstat(fileno(handle_), &info) == -1) return 0;
+         return static_cast<size_t>(info.st_size);
+#endif
       }
 
       off64_t tell() noexcept
@@ -248,13 +432,85 @@ namespace rmlib {
 
       status_t remove(const char* filename) noexcept
       {
-         return status_t(remove(filename));
+         return status_t(::remove(filename));
       }
 
       status_t remove(const std::string& filename) noexcept
       {
          return remove(filename.c_str());
       }
+
+      void swap(fstream_t& other) noexcept
+      {
+         std::swap(handle_, other.handle_);
+         std::swap(writable_, other.writable_);
+         std::swap(buffer_, other.buffer_);
+         std::swap(flush_bytes_, other.flush_bytes_);
+         std::swap(pending_bytes_, other.pending_bytes_);
+         std::swap(flush_sync_, other.flush_sync_);
+         std::swap(counters_, other.counters_);
+#if defined(XPLAT_OS_WINDOWS)
+         std::swap(positional_, other.positional_);
+#endif
+      }
+
+      // per stream I/O counters, an empty struct unless RMLIB_IO_METRICS
+      // enables a metrics policy
+      const io_metrics_policy_t::counters_t& counters() const noexcept
+      {
+         return counters_;
+      }
+
+   private:
+      // run io, which moves transferred bytes, under the metrics policy
+      template <typename F>
+      status_t measure(io_op_t op, size_t requested, const size_t& transferred, F&& io) noexcept
+      {
+         if constexpr (io_metrics_policy_t::enabled)
+         {
+            const int64_t start = io_metrics_policy_t::start();
+            status_t status = io();
+            io_metrics_policy_t::record(counters_, op, transferred, io_result(status, requested, transferred), start);
+            return status;
+         }
+         else
+         {
+            return io();
+         }
+      }
+
+      // setvbuf must run before the first I/O on the stream
+      status_t set_buffer(const fstream_options_t& options) noexcept
+      {
+         int mode = options.buffering == fstream_buffering_t::none ? _IONBF : options.buffering == fstream_buffering_t::line ? _IOLBF : _IOFBF;
+         char* buffer{ nullptr };
+         size_t size = options.buffer_size;
+         // a stdio buffer smaller than the group commit would flush it early
+         if (options.flush_bytes > 0 && mode == _IOFBF) size = std::max(size, options.flush_bytes);
+         if (!options.buffer.empty())
+         {
+            buffer = options.buffer.data();
+            size = options.buffer.size();
+         }
+         else if (size > 0 && mode != _IONBF)
+         {
+            buffer_.reset(new (std::nothrow) char[size]);
+            if (!buffer_) return status_t(ENOMEM);
+            buffer = buffer_.get();
+         }
+         if (size == 0 && mode == _IOFBF) return status_t{};
+         if (setvbuf(handle_, buffer, mode, size > 0 ? size : BUFSIZ) != 0) return status_t(EINVAL);
+         return status_t{};
+      }
+
+      HANDLE positional_handle() const noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         return positional_;
+#else
+         return fileno(handle_);
+#endif
+      }
    }; // class fstream_t
       
 } // namespace rmlib::time
@@ -26,31 +26,526 @@
 \*****************************************************************************/
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <string_view>
 #include <span>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
 
 #include "rmlib/xplat.h"
+#include "rmlib/status.h"
 #include "rmlib/utility.h"
 
+#if defined(XPLAT_OS_WINDOWS)
+   #include <windows.h>
+#else
+   #include <unistd.h>
+   #include <fcntl.h>
+   #include <sys/types.h>
+   #include <sys/stat.h>
+#endif
+
 namespace rmlib
 {
+   // O_DIRECT and FILE_FLAG_NO_BUFFERING require buffers, offsets and sizes to be
+   // aligned to the logical block size of the device. 4096 is safe for all
+   // current devices
+   constexpr size_t LLFIO_DIRECT_ALIGNMENT = 4096;
+
+   /**************************************************************************\
+   *
+   *  aligned_buffer_t
+   *  Heap buffer aligned for direct I/O. size is rounded up to a multiple of
+   *  the alignment. Satisfies DataSizeContainer
+   *
+   \**************************************************************************/
+   class aligned_buffer_t
+   {
+      char* data_{};
+      size_t size_{};
+      size_t alignment_{ LLFIO_DIRECT_ALIGNMENT };
+
+   public:
+      using value_type = char;
+
+      aligned_buffer_t() = default;
+      aligned_buffer_t(const aligned_buffer_t&) = delete;
+      aligned_buffer_t& operator=(const aligned_buffer_t&) = delete;
+
+      explicit aligned_buffer_t(size_t size, size_t alignment = LLFIO_DIRECT_ALIGNMENT) noexcept
+         : alignment_{ alignment }
+      {
+         allocate(size);
+      }
+
+      aligned_buffer_t(aligned_buffer_t&& other) noexcept
+         : data_{ std::exchange(other.data_, nullptr) }
+         , size_{ std::exchange(other.size_, 0) }
+         , alignment_{ other.alignment_ }
+      {}
+
+      aligned_buffer_t& operator=(aligned_buffer_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            free();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            alignment_ = other.alignment_;
+         }
+         return *this;
+      }
+
+      ~aligned_buffer_t() noexcept
+      {
+         free();
+      }
+
+      char* data() noexcept
+      {
+         return data_;
+      }
+
+      const char* data() const noexcept
+      {
+         return data_;
+      }
+
+      size_t size() const noexcept
+      {
+         return size_;
+      }
 
+      size_t alignment() const noexcept
+      {
+         return alignment_;
+      }
+
+      bool empty() const noexcept
+      {
+         return size_ == 0;
+      }
+
+      static size_t align_up(size_t size, size_t alignment = LLFIO_DIRECT_ALIGNMENT) noexcept
+      {
+         return (size + alignment - 1) / alignment * alignment;
+      }
+
+   private:
+      void allocate(size_t size) noexcept
+      {
+         size_t aligned_size = align_up(size, alignment_);
+         if (aligned_size == 0) return;
+         data_ = static_cast<char*>(::operator new(aligned_size, std::align_val_t{ alignment_ }, std::nothrow));
+         size_ = data_ ? aligned_size : 0;
+         if (data_) std::memset(data_, 0, size_);
+      }
+
+      void free() noexcept
+      {
+         if (data_)
+         {
+            ::operator delete(data_, std::align_val_t{ alignment_ });
+            data_ = nullptr;
+            size_ = 0;
+         }
+      }
+   }; // class aligned_buffer_t
+
+   /**************************************************************************\
+   *
+   *  llfio_t
+   *  Low level, unbuffered file I/O on raw OS handles. Reads and writes are 
+   *  positional (pread/pwrite, ReadFile/WriteFile with an OVERLAPPED offset)
+   *  and do not use or change a file position, so many threads can share one
+   *  open llfio_t without seek races. Opening with flags_t::direct bypasses 
+   *  the page cache (O_DIRECT, F_NOCACHE, FILE_FLAG_NO_BUFFERING), in which
+   *  case buffers, offsets and sizes must be aligned, see aligned_buffer_t
+   *
+   \**************************************************************************/
    class llfio_t
    {
+#if defined(XPLAT_OS_WINDOWS)
+      HANDLE handle_{ INVALID_HANDLE_VALUE };
+#else
+      HANDLE handle_{ -1 };
+#endif
+      unsigned flags_{};
+
    public:
+      using file_handle_t = HANDLE;
+
+      enum class access_t : unsigned
+      {
+           read = 0           // only read operations allowed
+         , write              // only write operations allowed 
+         , read_write         // read and write operations allowed
+         , append             // write operations are appended to the end of the file
+      };
+
+      enum class mode_t : unsigned
+      {
+           open_existing = 0  // file must exist
+         , create_new         // file must not exist
+         , create_always      // file is created if new or truncated if it exsits
+      };
+
+      enum flags_t : unsigned
+      {
+           none = 0x00
+         , direct = 0x01      // bypass the page cache
+         , async = 0x02       // open for overlapped I/O on Windows, required by aio::queue_t IOCP
+      };
+
       llfio_t() = default;
       llfio_t(const llfio_t&) = delete;
-      llfio_t(llfio_t&&) noexcept = default;
       llfio_t& operator=(const llfio_t&) = delete;
-      llfio_t& operator=(llfio_t&&) noexcept = default;
+
+      llfio_t(llfio_t&& other) noexcept
+         : handle_{ std::exchange(other.handle_, invalid_handle()) }
+         , flags_{ std::exchange(other.flags_, 0u) }
+      {}
+
+      llfio_t& operator=(llfio_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            close();
+            handle_ = std::exchange(other.handle_, invalid_handle());
+            flags_ = std::exchange(other.flags_, 0u);
+         }
+         return *this;
+      }
    
       ~llfio_t() noexcept
-      {}
+      {
+         close();
+      }
+
+      static HANDLE invalid_handle() noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         return INVALID_HANDLE_VALUE;
+#else
+         return -1;
+#endif
+      }
+
+      file_handle_t handle() const noexcept
+      {
+         return handle_;
+      }
+
+      HANDLE native_handle() const noexcept
+      {
+         return handle_;
+      }
+
+      bool is_open() const noexcept
+      {
+         return handle_ != invalid_handle();
+      }
+
+      bool is_direct() const noexcept
+      {
+         return (flags_ & direct) != 0;
+      }
+
+      // status_t is set to EINVAL if access_t is read and mode_t
+      // is create_new or create_always
+      status_t open(const char* filename, mode_t mode = mode_t::open_existing, access_t access = access_t::read_write, unsigned flags = none) noexcept
+      {
+         if (!filename) return status_t(EINVAL);
+         if (access == access_t::read && mode != mode_t::open_existing) return status_t(EINVAL);
+         close();
+#if defined(XPLAT_OS_WINDOWS)
+         const DWORD access_flags[] = { GENERIC_READ, GENERIC_WRITE, GENERIC_READ | GENERIC_WRITE, GENERIC_READ | FILE_APPEND_DATA };
+         const DWORD disposition[] = { OPEN_EXISTING, CREATE_NEW, CREATE_ALWAYS };
+         DWORD attributes = FILE_ATTRIBUTE_NORMAL | ((flags & direct) ? (FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH) : 0);
+         attributes |= (flags & async) ? FILE_FLAG_OVERLAPPED : 0;
+         handle_ = ::CreateFileA(filename, access_flags[static_cast<unsigned>(access)], FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, disposition[static_cast<unsigned>(mode)], attributes, nullptr);
+         if (handle_ == INVALID_HANDLE_VALUE)
+         {
+            return status_t(xlate_windows_error_code(::GetLastError()));
+         }
+#else
+         const int access_flags[] = { O_RDONLY, O_WRONLY, O_RDWR, O_RDWR | O_APPEND };
+         const int mode_flags[] = { 0, O_CREAT | O_EXCL, O_CREAT | O_TRUNC };
+         int oflags = access_flags[static_cast<unsigned>(access)] | mode_flags[static_cast<unsigned>(mode)] | O_CLOEXEC;
+   #if defined(O_DIRECT)
+         if (flags & direct) oflags |= O_DIRECT;
+   #endif
+         handle_ = ::open(filename, oflags, 0666);
+         if (handle_ == -1)
+         {
+            return status_t(errno);
+         }
+   #if !defined(O_DIRECT) && defined(F_NOCACHE)
+         if ((flags & direct) && ::fcntl(handle_, F_NOCACHE, 1) == -1)
+         {
+            status_t status(errno);
+            close();
+            return status;
+         }
+   #endif
+#endif
+         flags_ = flags;
+         return status_t{};
+      }
+
+      status_t open(const std::string& filename, mode_t mode = mode_t::open_existing, access_t access = access_t::read_write, unsigned flags = none) noexcept
+      {
+         return open(filename.c_str(), mode, access, flags);
+      }
+
+      status_t close() noexcept
+      {
+         status_t status;
+         if (is_open())
+         {
+#if defined(XPLAT_OS_WINDOWS)
+            if (!::CloseHandle(handle_)) status.reset(xlate_windows_error_code(::GetLastError()));
+#else
+            if (::close(handle_) == -1) status.reset(errno);
+#endif
+            handle_ = invalid_handle();
+            flags_ = 0;
+         }
+         return status;
+      }
+
+      // read up to size bytes at offset. bytes_read is less than size only at the end of file
+      status_t read_at(void* buffer, size_t size, off64_t offset, size_t& bytes_read) noexcept
+      {
+         bytes_read = 0;
+         if (!is_open()) return status_t(EBADF);
+         return read_at(handle_, buffer, size, offset, bytes_read);
+      }
+
+      template <DataSizeResizeContainer T>
+      status_t read_at(T& buffer, size_t size, off64_t offset, size_t& bytes_read) noexcept
+      {
+         buffer.resize(size);
+         status_t status = read_at(buffer.data(), buffer.size(), offset, bytes_read);
+         buffer.resize(bytes_read);
+         return status;
+      }
+
+      // write all size bytes at offset. Files opened with access_t::append
+      // always write at the end of the file and offset is ignored
+      status_t write_at(const void* buffer, size_t size, off64_t offset, size_t& bytes_written) noexcept
+      {
+         bytes_written = 0;
+         if (!is_open()) return status_t(EBADF);
+         return write_at(handle_, buffer, size, offset, bytes_written);
+      }
+
+      template <DataSizeContainer T>
+      status_t write_at(const T& buffer, off64_t offset, size_t& bytes_written) noexcept
+      {
+         return write_at(buffer.data(), buffer.size(), offset, bytes_written);
+      }
+
+      // flush file data, and only the metadata needed to read it back, to the device
+      status_t datasync() noexcept
+      {
+         if (!is_open()) return status_t(EBADF);
+         return datasync(handle_);
+      }
+
+      // flush file data and all metadata to the device
+      status_t sync() noexcept
+      {
+         if (!is_open()) return status_t(EBADF);
+         return sync(handle_);
+      }
+
+      // positional I/O on a raw handle, shared with the aio::queue_t thread pool
+      static status_t read_at(HANDLE handle, void* buffer, size_t size, off64_t offset, size_t& bytes_read) noexcept
+      {
+         bytes_read = 0;
+         char* ptr = static_cast<char*>(buffer);
+         while (bytes_read < size)
+         {
+            size_t count{};
+            if (status_t status = pread(handle, ptr + bytes_read, size - bytes_read, offset + static_cast<off64_t>(bytes_read), count); status.nok())
+            {
+               return status;
+            }
+            if (count == 0) break;
+            bytes_read += count;
+         }
+         return status_t{};
+      }
+
+      static status_t write_at(HANDLE handle, const void* buffer, size_t size, off64_t offset, size_t& bytes_written) noexcept
+      {
+         bytes_written = 0;
+         const char* ptr = static_cast<const char*>(buffer);
+         while (bytes_written < size)
+         {
+            size_t count{};
+            if (status_t status = pwrite(handle, ptr + bytes_written, size - bytes_written, offset + static_cast<off64_t>(bytes_written), count); status.nok())
+            {
+               return status;
+            }
+            // a write that makes no progress would loop forever
+            if (count == 0) return status_t(EIO);
+            bytes_written += count;
+         }
+         return status_t{};
+      }
+
+      static status_t datasync(HANDLE handle) noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         if (!::FlushFileBuffers(handle)) return status_t(xlate_windows_error_code(::GetLastError()));
+#elif defined(XPLAT_OS_MACOS)
+         if (::fcntl(handle, F_FULLFSYNC) == -1) return status_t(errno);
+#else
+         if (::fdatasync(handle) == -1) return status_t(errno);
+#endif
+         return status_t{};
+      }
+
+      static status_t sync(HANDLE handle) noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         if (!::FlushFileBuffers(handle)) return status_t(xlate_windows_error_code(::GetLastError()));
+#elif defined(XPLAT_OS_MACOS)
+         if (::fcntl(handle, F_FULLFSYNC) == -1) return status_t(errno);
+#else
+         if (::fsync(handle) == -1) return status_t(errno);
+#endif
+         return status_t{};
+      }
+
+      status_t size(size_t& bytes) const noexcept
+      {
+         bytes = 0;
+         if (!is_open()) return status_t(EBADF);
+#if defined(XPLAT_OS_WINDOWS)
+         LARGE_INTEGER file_size{};
+         if (!::GetFileSizeEx(handle_, &file_size)) return status_t(xlate_windows_error_code(::GetLastError()));
+         bytes = static_cast<size_t>(file_size.QuadPart);
+#else
+         struct stat info{};
+         if (::fstat(handle_, &info) == -1) return status_t(errno);
+         bytes = static_cast<size_t>(info.st_size);
+#endif
+         return status_t{};
+      }
+
+      // return file size in bytes, or zero if the size cannot be retrieved
+      size_t size() const noexcept
+      {
+         size_t bytes{};
+         size(bytes);
+         return bytes;
+      }
+
+      status_t truncate(off64_t size) noexcept
+      {
+         if (!is_open()) return status_t(EBADF);
+#if defined(XPLAT_OS_WINDOWS)
+         FILE_END_OF_FILE_INFO info{};
+         info.EndOfFile.QuadPart = size;
+         if (!::SetFileInformationByHandle(handle_, FileEndOfFileInfo, &info, sizeof(info))) return status_t(xlate_windows_error_code(::GetLastError()));
+#else
+         if (::ftruncate(handle_, size) == -1) return status_t(errno);
+#endif
+         return status_t{};
+      }
+
+      // check if file exists.
+      bool exists(const char* filename) noexcept
+      {
+         return file_exists(filename);
+      }
+
+      bool exists(const std::string& filename) noexcept
+      {
+         return exists(filename.c_str());
+      }
+
+      status_t remove(const char* filename) noexcept
+      {
+         return status_t(::remove(filename));
+      }
+
+      status_t remove(const std::string& filename) noexcept
+      {
+         return remove(filename.c_str());
+      }
 
+   private:
+#if defined(XPLAT_OS_WINDOWS)
+      // handles opened with flags_t::async complete asynchronously, wait for them
+      static status_t overlapped_result(HANDLE handle, OVERLAPPED& overlapped, BOOL ret, DWORD& bytes) noexcept
+      {
+         if (!ret)
+         {
+            DWORD error = ::GetLastError();
+            if (error == ERROR_IO_PENDING && ::GetOverlappedResult(handle, &overlapped, &bytes, TRUE)) return status_t{};
+            if (error == ERROR_IO_PENDING) error = ::GetLastError();
+            if (error != ERROR_HANDLE_EOF) return status_t(xlate_windows_error_code(error));
+            bytes = 0;
+         }
+         return status_t{};
+      }
+#endif
 
+      static status_t pread(HANDLE handle, char* buffer, size_t size, off64_t offset, size_t& count) noexcept
+      {
+         count = 0;
+#if defined(XPLAT_OS_WINDOWS)
+         OVERLAPPED overlapped{};
+         overlapped.Offset = low32(static_cast<uint64_t>(offset));
+         overlapped.OffsetHigh = high32(static_cast<uint64_t>(offset));
+         DWORD bytes{};
+         BOOL ret = ::ReadFile(handle, buffer, static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)), &bytes, &overlapped);
+         if (status_t status = overlapped_result(handle, overlapped, ret, bytes); status.nok()) return status;
+         count = static_cast<size_t>(bytes);
+#else
+         ssize_t ret{};
+         do
+         {
+            ret = ::pread(handle, buffer, size, offset);
+         } while (ret == -1 && errno == EINTR);
+         if (ret == -1) return status_t(errno);
+         count = static_cast<size_t>(ret);
+#endif
+         return status_t{};
+      }
 
-   };
+      static status_t pwrite(HANDLE handle, const char* buffer, size_t size, off64_t offset, size_t& count) noexcept
+      {
+         count = 0;
+#if defined(XPLAT_OS_WINDOWS)
+         OVERLAPPED overlapped{};
+         overlapped.Offset = low32(static_cast<uint64_t>(offset));
+         overlapped.OffsetHigh = high32(static_cast<uint64_t>(offset));
+         DWORD bytes{};
+         BOOL ret = ::WriteFile(handle, buffer, static_cast<DWORD>(std::min<size_t>(size, MAXDWORD)), &bytes, &overlapped);
+         if (status_t status = overlapped_result(handle, overlapped, ret, bytes); status.nok()) return status;
+         count = static_cast<size_t>(bytes);
+#else
+         ssize_t ret{};
+         do
+         {
+            ret = ::pwrite(handle, buffer, size, offset);
+         } while (ret == -1 && errno == EINTR);
+         if (ret == -1) return status_t(errno);
+         count = static_cast<size_t>(ret);
+#endif
+         return status_t{};
+      }
+   }; // class llfio_t
 
 } // namespace rmlib
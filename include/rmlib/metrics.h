@@ -0,0 +1,490 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <algorithm>
+
+#include "rmlib/xplat.h"
+#include "rmlib/utility.h"
+#include "rmlib/time.h"
+
+/*****************************************************************************\
+*  I/O instrumentation policy of socket_t and fstream_t. The default
+*  rmlib::null_metrics_t compiles every hook away. Define RMLIB_IO_METRICS as
+*  rmlib::process_metrics_t, the same way in every translation unit, to count
+*  calls, bytes, partial transfers, would block returns and errors per
+*  object and per process, with latency histograms per operation
+\*****************************************************************************/
+#if !defined(RMLIB_IO_METRICS)
+   #define RMLIB_IO_METRICS rmlib::null_metrics_t
+#endif
+
+namespace rmlib {
+
+   // counters and histograms are split in this many cache line padded shards,
+   // threads pick one by arrival order so they rarely write the same line
+   constexpr size_t METRICS_SHARDS = 8;
+
+   inline size_t metrics_shard() noexcept
+   {
+      return thread_ordinal() % METRICS_SHARDS;
+   }
+
+   /**************************************************************************\
+   * sharded_counter_t
+   * monotonic counter, add() is one relaxed atomic add on the shard of the
+   * calling thread and value() sums the shards
+   \**************************************************************************/
+   class sharded_counter_t
+   {
+      struct alignas(CACHE_LINE_SIZE) slot_t
+      {
+         std::atomic<uint64_t> value{ 0 };
+      };
+
+      std::array<slot_t, METRICS_SHARDS> slots_{};
+
+   public:
+      void add(uint64_t count = 1) noexcept
+      {
+         slots_[metrics_shard()].value.fetch_add(count, std::memory_order_relaxed);
+      }
+
+      uint64_t value() const noexcept
+      {
+         uint64_t total{};
+         for (const auto& slot : slots_) total += slot.value.load(std::memory_order_relaxed);
+         return total;
+      }
+
+      void reset() noexcept
+      {
+         for (auto& slot : slots_) slot.value.store(0, std::memory_order_relaxed);
+      }
+   };
+
+   // log-linear buckets: values below 2^HISTOGRAM_SUB_BITS are exact, above
+   // that each power of two is split in 2^HISTOGRAM_SUB_BITS linear buckets,
+   // a relative error under 6.25%. Values are clamped to 2^HISTOGRAM_MAX_BITS - 1,
+   // about 18 minutes in nanoseconds
+   constexpr unsigned HISTOGRAM_SUB_BITS = 4;
+   constexpr unsigned HISTOGRAM_MAX_BITS = 40;
+   constexpr size_t HISTOGRAM_SUB_BUCKETS = size_t{ 1 } << HISTOGRAM_SUB_BITS;
+   constexpr size_t HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+   constexpr uint64_t HISTOGRAM_MAX_VALUE = (uint64_t{ 1 } << HISTOGRAM_MAX_BITS) - 1;
+
+   constexpr size_t histogram_bucket(uint64_t value) noexcept
+   {
+      value = std::min(value, HISTOGRAM_MAX_VALUE);
+      if (value < HISTOGRAM_SUB_BUCKETS) return static_cast<size_t>(value);
+      const unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - HISTOGRAM_SUB_BITS;
+      return (shift + 1) * HISTOGRAM_SUB_BUCKETS + static_cast<size_t>((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+   }
+
+   // smallest value that falls in bucket
+   constexpr uint64_t histogram_bucket_lower(size_t bucket) noexcept
+   {
+      if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+      const size_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+      return (HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+   }
+
+   // largest value that falls in bucket
+   constexpr uint64_t histogram_bucket_upper(size_t bucket) noexcept
+   {
+      if (bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+      const size_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+      return histogram_bucket_lower(bucket) + (uint64_t{ 1 } << shift) - 1;
+   }
+
+   struct histogram_snapshot_t
+   {
+      std::array<uint64_t, HISTOGRAM_BUCKETS> buckets{};
+      uint64_t count{};
+      uint64_t sum{};
+      uint64_t max{};
+
+      // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+      uint64_t percentile(double p) const noexcept
+      {
+         if (count == 0) return 0;
+         p = std::clamp(p, 0.0, 100.0);
+         const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(p / 100.0 * static_cast<double>(count) + 0.5), 1);
+         uint64_t seen{};
+         for (size_t i = 0; i < buckets.size(); ++i)
+         {
+            if ((seen += buckets[i]) >= rank) return std::min(histogram_bucket_upper(i), max);
+         }
+         return max;
+      }
+
+      double mean() const noexcept
+      {
+         return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+      }
+   };
+
+   /**************************************************************************\
+   * histogram_t
+   * lock free log-linear histogram, sharded like sharded_counter_t. record()
+   * touches one bucket and the sum of the calling thread's shard
+   \**************************************************************************/
+   class histogram_t
+   {
+      struct alignas(CACHE_LINE_SIZE) shard_t
+      {
+         std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{};
+         std::atomic<uint64_t> sum{ 0 };
+         std::atomic<uint64_t> max{ 0 };
+      };
+
+      std::array<shard_t, METRICS_SHARDS> shards_{};
+
+   public:
+      void record(uint64_t value) noexcept
+      {
+         shard_t& shard = shards_[metrics_shard()];
+         shard.buckets[histogram_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+         shard.sum.fetch_add(value, std::memory_order_relaxed);
+         // only the threads of this shard race on max
+         uint64_t max = shard.max.load(std::memory_order_relaxed);
+         while (value > max && !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+      }
+
+      // a snapshot taken while other threads record is not atomic as a whole,
+      // each bucket is
+      void snapshot(histogram_snapshot_t& snapshot) const noexcept
+      {
+         snapshot = histogram_snapshot_t{};
+         for (const auto& shard : shards_)
+         {
+            for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+            {
+               const uint64_t count = shard.buckets[i].load(std::memory_order_relaxed);
+               snapshot.buckets[i] += count;
+               snapshot.count += count;
+            }
+            snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+            snapshot.max = std::max(snapshot.max, shard.max.load(std::memory_order_relaxed));
+         }
+      }
+
+      void reset() noexcept
+      {
+         for (auto& shard : shards_)
+         {
+            for (auto& bucket : shard.buckets) bucket.store(0, std::memory_order_relaxed);
+            shard.sum.store(0, std::memory_order_relaxed);
+            shard.max.store(0, std::memory_order_relaxed);
+         }
+      }
+   };
+
+   enum class io_op_t : unsigned
+   {
+        tcp_send = 0
+      , tcp_recv
+      , tls_send
+      , tls_recv
+      , tls_handshake   // from the first SSL_accept/SSL_connect call to completion
+      , accept
+      , file_read
+      , file_write
+      , udp_send        // one call per send_to or sendmmsg batch
+      , udp_recv
+   };
+
+   constexpr size_t IO_OP_COUNT = 10;
+
+   inline const char* to_string(io_op_t op) noexcept
+   {
+      constexpr const char* names[IO_OP_COUNT]{ "tcp_send", "tcp_recv", "tls_send", "tls_recv", "tls_handshake", "accept", "file_read", "file_write", "udp_send", "udp_recv" };
+      return names[static_cast<unsigned>(op)];
+   }
+
+   enum class io_result_t { ok, partial, would_block, error };
+
+   // a transfer is partial when it moved less than requested, pass requested
+   // as zero where short transfers are normal, for example receives
+   template <typename S>
+   io_result_t io_result(const S& status, size_t requested, size_t transferred) noexcept
+   {
+      if (status.ok()) return transferred < requested ? io_result_t::partial : io_result_t::ok;
+      if constexpr (requires { status.would_block(); })
+      {
+         if (status.would_block()) return io_result_t::would_block;
+      }
+      return io_result_t::error;
+   }
+
+   struct io_op_snapshot_t
+   {
+      uint64_t calls{};
+      uint64_t bytes{};
+      uint64_t partial{};
+      uint64_t would_block{};
+      uint64_t errors{};
+      histogram_snapshot_t latency;   // nanoseconds, calls that did not would block
+   };
+
+   struct metrics_snapshot_t
+   {
+      std::array<io_op_snapshot_t, IO_OP_COUNT> ops{};
+
+      const io_op_snapshot_t& operator[](io_op_t op) const noexcept
+      {
+         return ops[static_cast<unsigned>(op)];
+      }
+   };
+
+   /**************************************************************************\
+   * io_metrics_t
+   * process wide counters and latency histogram of each io_op_t
+   \**************************************************************************/
+   class io_metrics_t
+   {
+      struct op_metrics_t
+      {
+         sharded_counter_t calls;
+         sharded_counter_t bytes;
+         sharded_counter_t partial;
+         sharded_counter_t would_block;
+         sharded_counter_t errors;
+         histogram_t latency;
+      };
+
+      std::array<op_metrics_t, IO_OP_COUNT> ops_{};
+
+   public:
+      static io_metrics_t& instance() noexcept
+      {
+         static io_metrics_t metrics;
+         return metrics;
+      }
+
+      void record(io_op_t op, size_t bytes, io_result_t result, int64_t nsecs) noexcept
+      {
+         op_metrics_t& metrics = ops_[static_cast<unsigned>(op)];
+         metrics.calls.add();
+         if (bytes > 0) metrics.bytes.add(bytes);
+         switch (result)
+         {
+            case io_result_t::ok: break;
+            case io_result_t::partial: metrics.partial.add(); break;
+            case io_result_t::would_block: metrics.would_block.add(); return;
+            case io_result_t::error: metrics.errors.add(); break;
+         }
+         metrics.latency.record(static_cast<uint64_t>(std::max<int64_t>(nsecs, 0)));
+      }
+
+      void snapshot(metrics_snapshot_t& snapshot) const noexcept
+      {
+         for (size_t i = 0; i < IO_OP_COUNT; ++i)
+         {
+            const op_metrics_t& metrics = ops_[i];
+            io_op_snapshot_t& op = snapshot.ops[i];
+            op.calls = metrics.calls.value();
+            op.bytes = metrics.bytes.value();
+            op.partial = metrics.partial.value();
+            op.would_block = metrics.would_block.value();
+            op.errors = metrics.errors.value();
+            metrics.latency.snapshot(op.latency);
+         }
+      }
+
+      void reset() noexcept
+      {
+         for (auto& metrics : ops_)
+         {
+            metrics.calls.reset();
+            metrics.bytes.reset();
+            metrics.partial.reset();
+            metrics.would_block.reset();
+            metrics.errors.reset();
+            metrics.latency.reset();
+         }
+      }
+   };
+
+   /**************************************************************************\
+   * io_counter_t
+   * one field of io_counters_t, a relaxed atomic so several threads may
+   * record into the same object, e.g. concurrent fstream_t::read_at calls.
+   * Copies take a snapshot of the value
+   \**************************************************************************/
+   template <typename T>
+   class io_counter_t
+   {
+      std::atomic<T> value_{ 0 };
+
+   public:
+      io_counter_t() noexcept = default;
+
+      io_counter_t(const io_counter_t& other) noexcept
+         : value_{ other.load() }
+      {}
+
+      io_counter_t& operator=(const io_counter_t& other) noexcept
+      {
+         store(other.load());
+         return *this;
+      }
+
+      io_counter_t& operator=(T value) noexcept
+      {
+         store(value);
+         return *this;
+      }
+
+      operator T() const noexcept
+      {
+         return load();
+      }
+
+      T load() const noexcept
+      {
+         return value_.load(std::memory_order_relaxed);
+      }
+
+      void store(T value) noexcept
+      {
+         value_.store(value, std::memory_order_relaxed);
+      }
+
+      void add(T count = 1) noexcept
+      {
+         value_.fetch_add(count, std::memory_order_relaxed);
+      }
+   };
+
+   // counters of one socket_t or fstream_t. Sends count as writes and
+   // receives as reads
+   struct io_counters_t
+   {
+      io_counter_t<uint64_t> writes{};
+      io_counter_t<uint64_t> bytes_written{};
+      io_counter_t<uint64_t> partial_writes{};
+      io_counter_t<uint64_t> write_would_block{};
+      io_counter_t<uint64_t> write_errors{};
+      io_counter_t<uint64_t> reads{};
+      io_counter_t<uint64_t> bytes_read{};
+      io_counter_t<uint64_t> read_would_block{};
+      io_counter_t<uint64_t> read_errors{};
+      io_counter_t<int64_t> handshake_start{};
+      io_counter_t<int64_t> handshake_nsecs{};
+   };
+
+   /**************************************************************************\
+   * metrics policies
+   * start() is called before an operation and record() after it, a TLS
+   * handshake is bracketed by handshake_started() and handshake_finished().
+   * Objects hold a policy counters_t member, an empty struct for
+   * null_metrics_t
+   \**************************************************************************/
+   struct null_metrics_t
+   {
+      static constexpr bool enabled = false;
+
+      struct counters_t {};
+
+      static int64_t start() noexcept
+      {
+         return 0;
+      }
+
+      static void record(counters_t&, io_op_t, size_t, io_result_t, int64_t) noexcept {}
+
+      static void handshake_started(counters_t&) noexcept {}
+
+      static void handshake_finished(counters_t&, io_result_t) noexcept {}
+   };
+
+   struct process_metrics_t
+   {
+      static constexpr bool enabled = true;
+
+      using counters_t = io_counters_t;
+
+      static int64_t start() noexcept
+      {
+         return steady_clock_t::now();
+      }
+
+      static void record(counters_t& counters, io_op_t op, size_t bytes, io_result_t result, int64_t start) noexcept
+      {
+         const int64_t nsecs = steady_clock_t::now() - start;
+         io_metrics_t::instance().record(op, bytes, result, nsecs);
+         switch (op)
+         {
+            case io_op_t::tcp_send:
+            case io_op_t::tls_send:
+            case io_op_t::file_write:
+            case io_op_t::udp_send:
+               counters.writes.add();
+               counters.bytes_written.add(bytes);
+               if (result == io_result_t::partial) counters.partial_writes.add();
+               else if (result == io_result_t::would_block) counters.write_would_block.add();
+               else if (result == io_result_t::error) counters.write_errors.add();
+               break;
+            case io_op_t::tcp_recv:
+            case io_op_t::tls_recv:
+            case io_op_t::file_read:
+            case io_op_t::udp_recv:
+               counters.reads.add();
+               counters.bytes_read.add(bytes);
+               if (result == io_result_t::would_block) counters.read_would_block.add();
+               else if (result == io_result_t::error) counters.read_errors.add();
+               break;
+            case io_op_t::tls_handshake:
+               counters.handshake_nsecs = nsecs;
+               break;
+            case io_op_t::accept:
+               break;
+         }
+      }
+
+      static void handshake_started(counters_t& counters) noexcept
+      {
+         if (counters.handshake_start == 0) counters.handshake_start = start();
+      }
+
+      static void handshake_finished(counters_t& counters, io_result_t result) noexcept
+      {
+         record(counters, io_op_t::tls_handshake, 0, result, counters.handshake_start);
+         // a socket_t that reconnects times its next handshake afresh
+         counters.handshake_start = 0;
+      }
+   };
+
+   using io_metrics_policy_t = RMLIB_IO_METRICS;
+
+} // namespace rmlib
@@ -0,0 +1,300 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <algorithm>
+
+#include "rmlib/xplat.h"
+#include "rmlib/status.h"
+#include "rmlib/utility.h"
+
+#include "mio.hpp"
+
+#if !defined(XPLAT_OS_WINDOWS)
+   #include <sys/mman.h>
+#endif
+
+namespace rmlib
+{
+   namespace mapping
+   {
+      inline status_t xlate_error(const std::error_code& error) noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         return status_t(xlate_windows_error_code(static_cast<DWORD>(error.value())));
+#else
+         return status_t(error.value());
+#endif
+      }
+
+      // madvise and msync want page aligned addresses, round the range out
+      inline std::pair<void*, size_t> page_range(const std::byte* address, size_t length) noexcept
+      {
+         uintptr_t page = static_cast<uintptr_t>(mio::page_size());
+         uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~(page - 1);
+         return { reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(address) + length - start };
+      }
+
+      inline status_t advise(const std::byte* address, size_t length, advice_t advice) noexcept
+      {
+         if (!address || length == 0) return status_t{};
+         auto [start, size] = page_range(address, length);
+#if defined(XPLAT_OS_WINDOWS)
+         // Windows only takes an explicit prefetch, the other hints are left to the cache manager
+         if (advice == advice_t::willneed)
+         {
+            WIN32_MEMORY_RANGE_ENTRY entry{ start, size };
+            if (!::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &entry, 0)) return status_t(xlate_windows_error_code(::GetLastError()));
+         }
+#else
+         int flag{ MADV_NORMAL };
+         switch (advice)
+         {
+            case advice_t::normal: flag = MADV_NORMAL; break;
+            case advice_t::sequential: flag = MADV_SEQUENTIAL; break;
+            case advice_t::random: flag = MADV_RANDOM; break;
+            case advice_t::willneed: flag = MADV_WILLNEED; break;
+            case advice_t::dontneed: flag = MADV_DONTNEED; break;
+         }
+         if (::madvise(start, size, flag) == -1) return status_t(errno);
+#endif
+         return status_t{};
+      }
+
+      inline status_t sync(const std::byte* address, size_t length) noexcept
+      {
+         if (!address || length == 0) return status_t{};
+         auto [start, size] = page_range(address, length);
+#if defined(XPLAT_OS_WINDOWS)
+         if (!::FlushViewOfFile(start, size)) return status_t(xlate_windows_error_code(::GetLastError()));
+#else
+         if (::msync(start, size, MS_SYNC) == -1) return status_t(errno);
+#endif
+         return status_t{};
+      }
+
+   } // namespace mapping
+
+   /**************************************************************************\
+   * mapped_view_t
+   * non owning view over part of a mapped_file_t. Valid only while the file
+   * stays mapped
+   \**************************************************************************/
+   class mapped_view_t
+   {
+      std::byte* data_{ nullptr };
+      size_t size_{};
+      bool writable_{ false };
+
+   public:
+      mapped_view_t() = default;
+
+      mapped_view_t(std::byte* data, size_t size, bool writable) noexcept
+         : data_{ data }
+         , size_{ size }
+         , writable_{ writable }
+      {}
+
+      std::span<const std::byte> data() const noexcept
+      {
+         return { data_, size_ };
+      }
+
+      // empty span when the view is read only
+      std::span<std::byte> writable_data() const noexcept
+      {
+         return writable_ ? std::span<std::byte>{ data_, size_ } : std::span<std::byte>{};
+      }
+
+      size_t size() const noexcept
+      {
+         return size_;
+      }
+
+      bool empty() const noexcept
+      {
+         return size_ == 0;
+      }
+
+      bool is_writable() const noexcept
+      {
+         return writable_;
+      }
+
+      // offset and length are clamped to the view
+      mapped_view_t subview(size_t offset, size_t length = SIZE_MAX) const noexcept
+      {
+         offset = std::min(offset, size_);
+         return mapped_view_t(data_ + offset, std::min(length, size_ - offset), writable_);
+      }
+
+      status_t advise(advice_t advice) const noexcept
+      {
+         return mapping::advise(data_, size_, advice);
+      }
+
+      // flush modified pages of this view to the file
+      status_t sync() const noexcept
+      {
+         if (!writable_) return status_t(EACCES);
+         return mapping::sync(data_, size_);
+      }
+   }; // class mapped_view_t
+
+   /**************************************************************************\
+   * mapped_file_t
+   * memory mapped file, or a sub-range of it, built on mio. Offsets need not
+   * be page aligned. The mapping never grows the file: size it with
+   * llfio_t::truncate() before mapping it for writing
+   \**************************************************************************/
+   class mapped_file_t
+   {
+   public:
+      enum class access_t { read, read_write };
+
+      static constexpr size_t entire_file = mio::map_entire_file;
+
+   private:
+      mio::basic_mmap_source<std::byte> source_{};
+      mio::basic_mmap_sink<std::byte> sink_{};
+      access_t access_{ access_t::read };
+
+   public:
+      mapped_file_t() = default;
+      mapped_file_t(const mapped_file_t&) = delete;
+      mapped_file_t(mapped_file_t&&) = default;
+      mapped_file_t& operator=(const mapped_file_t&) = delete;
+      mapped_file_t& operator=(mapped_file_t&&) = default;
+
+      ~mapped_file_t() noexcept
+      {
+         unmap();
+      }
+
+      status_t map(const std::string& filename, access_t access = access_t::read, size_t offset = 0, size_t length = entire_file) noexcept
+      {
+         unmap();
+         std::error_code error;
+         access_ = access;
+         if (access == access_t::read) source_.map(filename, offset, length, error);
+         else sink_.map(filename, offset, length, error);
+         if (error) return mapping::xlate_error(error);
+         return status_t{};
+      }
+
+      // map through an already open file. The handle is not closed by unmap()
+      status_t map(HANDLE handle, access_t access = access_t::read, size_t offset = 0, size_t length = entire_file) noexcept
+      {
+         unmap();
+         std::error_code error;
+         access_ = access;
+         if (access == access_t::read) source_.map(handle, offset, length, error);
+         else sink_.map(handle, offset, length, error);
+         if (error) return mapping::xlate_error(error);
+         return status_t{};
+      }
+
+      // llfio_t, fstream_t or anything else exposing native_handle(). Buffered
+      // writes must be flushed first for the mapping to see them
+      template <NativeFileHandle F>
+      status_t map(const F& file, access_t access = access_t::read, size_t offset = 0, size_t length = entire_file) noexcept
+      {
+         return map(file.native_handle(), access, offset, length);
+      }
+
+      // writable mappings are flushed to the file before they are unmapped
+      void unmap() noexcept
+      {
+         source_.unmap();
+         if (sink_.is_mapped())
+         {
+            std::error_code error;
+            sink_.sync(error);
+         }
+         sink_.unmap();
+      }
+
+      bool is_mapped() const noexcept
+      {
+         return access_ == access_t::read ? source_.is_mapped() : sink_.is_mapped();
+      }
+
+      bool is_writable() const noexcept
+      {
+         return access_ == access_t::read_write && sink_.is_mapped();
+      }
+
+      size_t size() const noexcept
+      {
+         return access_ == access_t::read ? source_.size() : sink_.size();
+      }
+
+      std::span<const std::byte> data() const noexcept
+      {
+         return view().data();
+      }
+
+      // empty span when the file is mapped read only
+      std::span<std::byte> writable_data() noexcept
+      {
+         return view().writable_data();
+      }
+
+      mapped_view_t view() const noexcept
+      {
+         if (access_ == access_t::read) return mapped_view_t(const_cast<std::byte*>(source_.data()), source_.size(), false);
+         return mapped_view_t(const_cast<std::byte*>(sink_.data()), sink_.size(), true);
+      }
+
+      mapped_view_t view(size_t offset, size_t length = SIZE_MAX) const noexcept
+      {
+         return view().subview(offset, length);
+      }
+
+      status_t advise(advice_t advice) const noexcept
+      {
+         return view().advise(advice);
+      }
+
+      // msync the whole mapping and, on Windows, flush the file buffers too
+      status_t sync() noexcept
+      {
+         if (!is_writable()) return status_t(EACCES);
+         std::error_code error;
+         sink_.sync(error);
+         if (error) return mapping::xlate_error(error);
+         return status_t{};
+      }
+   }; // class mapped_file_t
+
+} // namespace rmlib
@@ -0,0 +1,500 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <span>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "rmlib/socket.h"
+
+#if defined(XPLAT_OS_LINUX)
+   #include <sys/eventfd.h>
+#endif
+
+namespace rmlib {
+
+   namespace ip {
+
+      constexpr size_t RESOLVER_DEFAULT_CACHE_SIZE = 1024;
+      constexpr int64_t RESOLVER_DEFAULT_TTL_MS = 30'000;
+      constexpr int64_t RESOLVER_DEFAULT_NEGATIVE_TTL_MS = 5'000;
+      constexpr size_t RESOLVER_DEFAULT_THREADS = 2;
+
+      // getaddrinfo does not report record TTLs, every answer is kept for the
+      // configured time. A zero ttl disables caching of that kind of answer
+      struct resolver_options_t
+      {
+         size_t cache_size{ RESOLVER_DEFAULT_CACHE_SIZE };
+         int64_t ttl_ms{ RESOLVER_DEFAULT_TTL_MS };
+         int64_t negative_ttl_ms{ RESOLVER_DEFAULT_NEGATIVE_TTL_MS };
+         size_t threads{ RESOLVER_DEFAULT_THREADS };
+      };
+
+      // completion of resolver_t::resolve_async
+      struct resolution_t
+      {
+         uint64_t user_data{};
+         socket::status_t status;
+         address_list_t addresses;
+      };
+
+      // resolver errors that are answers, not failures to get one. Only these
+      // are cached as negative entries
+      inline bool is_negative_answer(const socket::status_t& status) noexcept
+      {
+         switch (status.error())
+         {
+            case EAI_NONAME:
+            case EAI_SERVICE:
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+            case EAI_NODATA:
+#endif
+               return true;
+            default:
+               return false;
+         }
+      }
+
+      /***********************************************************************\
+      *
+      *  basic_resolver_cache_t
+      *  LRU cache of name resolution results, positive and negative, each
+      *  with its own expiry. Expired entries are dropped when looked up or
+      *  when they reach the end of the LRU list. Thread safe
+      *
+      \***********************************************************************/
+      template <ClockPolicy Clock = coarse_clock_t>
+      class basic_resolver_cache_t
+      {
+         struct entry_t
+         {
+            std::string key;
+            address_list_t addresses;
+            socket::status_t status;
+            int64_t expires{};
+         };
+
+         using lru_list_t = std::list<entry_t>;
+
+         lru_list_t lru_;
+         std::unordered_map<std::string, typename lru_list_t::iterator> entries_;
+         size_t capacity_{ RESOLVER_DEFAULT_CACHE_SIZE };
+         mutable spin_lock_t lock_;
+
+      public:
+         basic_resolver_cache_t() = default;
+         basic_resolver_cache_t(const basic_resolver_cache_t&) = delete;
+         basic_resolver_cache_t(basic_resolver_cache_t&&) = delete;
+         basic_resolver_cache_t& operator=(const basic_resolver_cache_t&) = delete;
+         basic_resolver_cache_t& operator=(basic_resolver_cache_t&&) = delete;
+         ~basic_resolver_cache_t() = default;
+
+         explicit basic_resolver_cache_t(size_t capacity) noexcept
+            : capacity_{ capacity > 0 ? capacity : 1 }
+         {}
+
+         // build the cache key of a query
+         static std::string key(const std::string& host, const std::string& port, resolution_type_t type) noexcept
+         {
+            return host + ":" + port + (type == resolution_type_t::passive ? "/p" : "");
+         }
+
+         // returns true on a hit. status is the cached resolution status,
+         // addresses is only filled in for positive entries
+         bool find(const std::string& key, address_list_t& addresses, socket::status_t& status, int64_t now = Clock::now()) noexcept
+         {
+            spin_guard_t guard(lock_);
+            auto it = entries_.find(key);
+            if (it == entries_.end()) return false;
+            if (it->second->expires <= now)
+            {
+               lru_.erase(it->second);
+               entries_.erase(it);
+               return false;
+            }
+            lru_.splice(lru_.begin(), lru_, it->second);
+            status = it->second->status;
+            if (status.ok()) addresses = it->second->addresses;
+            return true;
+         }
+
+         void store(const std::string& key, const address_list_t& addresses, const socket::status_t& status, int64_t ttl_ms, int64_t now = Clock::now()) noexcept
+         {
+            if (key.empty() || ttl_ms <= 0) return;
+            const int64_t expires = now + ttl_ms * 1'000'000;
+            spin_guard_t guard(lock_);
+            try
+            {
+               if (auto it = entries_.find(key); it != entries_.end())
+               {
+                  it->second->addresses = addresses;
+                  it->second->status = status;
+                  it->second->expires = expires;
+                  lru_.splice(lru_.begin(), lru_, it->second);
+                  return;
+               }
+               if (entries_.size() >= capacity_)
+               {
+                  entries_.erase(lru_.back().key);
+                  lru_.pop_back();
+               }
+               lru_.push_front(entry_t{ key, addresses, status, expires });
+               entries_.emplace(key, lru_.begin());
+            }
+            catch (...)
+            {
+               // a failed insert only costs a future cache miss
+               if (!lru_.empty() && entries_.find(lru_.front().key) == entries_.end()) lru_.pop_front();
+            }
+         }
+
+         void remove(const std::string& key) noexcept
+         {
+            spin_guard_t guard(lock_);
+            if (auto it = entries_.find(key); it != entries_.end())
+            {
+               lru_.erase(it->second);
+               entries_.erase(it);
+            }
+         }
+
+         void clear() noexcept
+         {
+            spin_guard_t guard(lock_);
+            entries_.clear();
+            lru_.clear();
+         }
+
+         size_t size() const noexcept
+         {
+            spin_guard_t guard(lock_);
+            return entries_.size();
+         }
+
+         size_t capacity() const noexcept
+         {
+            return capacity_;
+         }
+      }; // class basic_resolver_cache_t
+
+      using resolver_cache_t = basic_resolver_cache_t<coarse_clock_t>;
+
+      /***********************************************************************\
+      *
+      *  basic_resolver_t
+      *  Caching front end to address_resolution. resolve() answers from the
+      *  cache or calls getaddrinfo on the calling thread. resolve_async()
+      *  hands cache misses to a small pool of resolver threads, started on
+      *  first use, and concurrent queries for the same name share one lookup.
+      *  Completions are collected by the event loop with poll(). On Linux
+      *  notify_handle() is an eventfd that becomes readable when completions
+      *  are queued and can be registered with socket_poller_t::add; elsewhere
+      *  poll() should be called on every turn of the event loop
+      *
+      \***********************************************************************/
+      template <typename T = ip::info_t, ClockPolicy Clock = coarse_clock_t>
+      class basic_resolver_t
+      {
+         struct query_t
+         {
+            std::string key;
+            std::string host;
+            std::string port;
+            resolution_type_t type{ resolution_type_t::normal };
+         };
+
+         resolver_options_t options_;
+         basic_resolver_cache_t<Clock> cache_;
+         std::mutex mutex_;
+         std::condition_variable cv_;
+         std::deque<query_t> queries_;
+         std::unordered_map<std::string, std::vector<uint64_t>> waiting_;
+         std::vector<resolution_t> completions_;
+         std::vector<std::thread> workers_;
+         size_t pending_{};
+         bool stop_{ false };
+         SOCKET notify_{ INVALID_SOCKET };
+
+      public:
+         explicit basic_resolver_t(const resolver_options_t& options = resolver_options_t{}) noexcept
+            : options_{ options }
+            , cache_{ options.cache_size }
+         {
+#if defined(XPLAT_OS_LINUX)
+            notify_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+         }
+
+         basic_resolver_t(const basic_resolver_t&) = delete;
+         basic_resolver_t(basic_resolver_t&&) = delete;
+         basic_resolver_t& operator=(const basic_resolver_t&) = delete;
+         basic_resolver_t& operator=(basic_resolver_t&&) = delete;
+
+         // queries still waiting for a resolver thread are dropped
+         ~basic_resolver_t() noexcept
+         {
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               stop_ = true;
+            }
+            cv_.notify_all();
+            for (auto& worker : workers_) worker.join();
+#if defined(XPLAT_OS_LINUX)
+            if (notify_ != INVALID_SOCKET) ::close(notify_);
+#endif
+         }
+
+         const resolver_options_t& options() const noexcept
+         {
+            return options_;
+         }
+
+         basic_resolver_cache_t<Clock>& cache() noexcept
+         {
+            return cache_;
+         }
+
+         // INVALID_SOCKET where no notification handle is available
+         SOCKET notify_handle() const noexcept
+         {
+            return notify_;
+         }
+
+         // number of resolve_async calls not yet collected by poll()
+         size_t pending() noexcept
+         {
+            std::lock_guard<std::mutex> guard(mutex_);
+            return pending_;
+         }
+
+         socket::status_t resolve(const std::string& host, const std::string& port, address_list_t& address_list, resolution_type_t type = resolution_type_t::normal) noexcept
+         {
+            const std::string key = basic_resolver_cache_t<Clock>::key(host, port, type);
+            socket::status_t status;
+            if (cache_.find(key, address_list, status)) return status;
+            return lookup(key, host, port, address_list, type);
+         }
+
+         // resolve IP name and port in the format hostname:port
+         socket::status_t resolve(const std::string& host_and_port, address_list_t& address_list, resolution_type_t type = resolution_type_t::normal) noexcept
+         {
+            auto separator_pos = host_and_port.find_first_of(':');
+            if (separator_pos != std::string::npos)
+            {
+               return resolve(host_and_port.substr(0, separator_pos), host_and_port.substr(separator_pos + 1), address_list, type);
+            }
+            return socket::status_t(WSAEINVAL);
+         }
+
+         // the result is delivered by poll() as a resolution_t carrying
+         // user_data. Cache hits are delivered by the next poll(), without a
+         // round trip through the resolver threads
+         socket::status_t resolve_async(const std::string& host, const std::string& port, uint64_t user_data, resolution_type_t type = resolution_type_t::normal) noexcept
+         {
+            const std::string key = basic_resolver_cache_t<Clock>::key(host, port, type);
+            resolution_t resolution{ user_data, {}, {} };
+            if (cache_.find(key, resolution.addresses, resolution.status))
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               ++pending_;
+               return complete(std::move(resolution));
+            }
+            bool inline_lookup{ false };
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               try
+               {
+                  if (auto it = waiting_.find(key); it != waiting_.end())
+                  {
+                     it->second.push_back(user_data);
+                     ++pending_;
+                     return socket::status_t{};
+                  }
+                  if (start_workers())
+                  {
+                     queries_.push_back(query_t{ key, host, port, type });
+                     waiting_[key].push_back(user_data);
+                     ++pending_;
+                  }
+                  else
+                  {
+                     inline_lookup = true;
+                  }
+               }
+               catch (...)
+               {
+                  return socket::status_t{ WSAENOBUFS };
+               }
+            }
+            if (inline_lookup)
+            {
+               // no resolver thread available, answer on this thread instead
+               resolution.status = lookup(key, host, port, resolution.addresses, type);
+               std::lock_guard<std::mutex> guard(mutex_);
+               ++pending_;
+               return complete(std::move(resolution));
+            }
+            cv_.notify_one();
+            return socket::status_t{};
+         }
+
+         socket::status_t resolve_async(const std::string& host_and_port, uint64_t user_data, resolution_type_t type = resolution_type_t::normal) noexcept
+         {
+            auto separator_pos = host_and_port.find_first_of(':');
+            if (separator_pos != std::string::npos)
+            {
+               return resolve_async(host_and_port.substr(0, separator_pos), host_and_port.substr(separator_pos + 1), user_data, type);
+            }
+            return socket::status_t(WSAEINVAL);
+         }
+
+         // move up to completions.size() finished resolutions into completions.
+         // count is the number moved. Never blocks
+         void poll(std::span<resolution_t> completions, size_t& count) noexcept
+         {
+            std::lock_guard<std::mutex> guard(mutex_);
+            count = std::min(completions.size(), completions_.size());
+            std::move(completions_.begin(), completions_.begin() + count, completions.begin());
+            completions_.erase(completions_.begin(), completions_.begin() + count);
+            pending_ -= count;
+#if defined(XPLAT_OS_LINUX)
+            // completions are queued and signalled under the lock, so the
+            // eventfd is only reset once everything queued has been taken
+            if (completions_.empty() && notify_ != INVALID_SOCKET)
+            {
+               uint64_t value{};
+               [[maybe_unused]] auto ret = ::read(notify_, &value, sizeof(value));
+            }
+#endif
+         }
+
+         // completions is resized to the number of finished resolutions
+         void poll(std::vector<resolution_t>& completions) noexcept
+         {
+            size_t count{};
+            {
+               std::lock_guard<std::mutex> guard(mutex_);
+               try
+               {
+                  completions.resize(completions_.size());
+               }
+               catch (...) {}
+            }
+            poll(std::span<resolution_t>{ completions }, count);
+            completions.resize(count);
+         }
+
+      private:
+         socket::status_t lookup(const std::string& key, const std::string& host, const std::string& port, address_list_t& address_list, resolution_type_t type) noexcept
+         {
+            socket::status_t status = address_resolution<T>(host, port, address_list, type);
+            if (status.ok()) cache_.store(key, address_list, status, options_.ttl_ms);
+            else if (is_negative_answer(status)) cache_.store(key, address_list_t{}, status, options_.negative_ttl_ms);
+            return status;
+         }
+
+         // called with mutex_ held
+         socket::status_t complete(resolution_t&& resolution) noexcept
+         {
+            try
+            {
+               completions_.push_back(std::move(resolution));
+            }
+            catch (...)
+            {
+               --pending_;
+               return socket::status_t{ WSAENOBUFS };
+            }
+            signal();
+            return socket::status_t{};
+         }
+
+         // called with mutex_ held
+         void signal() noexcept
+         {
+#if defined(XPLAT_OS_LINUX)
+            if (notify_ != INVALID_SOCKET)
+            {
+               uint64_t value{ 1 };
+               [[maybe_unused]] auto ret = ::write(notify_, &value, sizeof(value));
+            }
+#endif
+         }
+
+         // called with mutex_ held
+         bool start_workers() noexcept
+         {
+            if (!workers_.empty()) return true;
+            const size_t threads = options_.threads;
+            try
+            {
+               for (size_t i = 0; i < threads; ++i) workers_.emplace_back([this]() { run(); });
+            }
+            catch (...) {}
+            return !workers_.empty();
+         }
+
+         void run() noexcept
+         {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+               cv_.wait(lock, [this]() { return stop_ || !queries_.empty(); });
+               if (stop_) return;
+               query_t query = std::move(queries_.front());
+               queries_.pop_front();
+               lock.unlock();
+               address_list_t address_list;
+               socket::status_t status = lookup(query.key, query.host, query.port, address_list, query.type);
+               lock.lock();
+               if (auto it = waiting_.find(query.key); it != waiting_.end())
+               {
+                  std::vector<uint64_t> waiters = std::move(it->second);
+                  waiting_.erase(it);
+                  for (uint64_t user_data : waiters)
+                  {
+                     complete(resolution_t{ user_data, status, address_list });
+                  }
+               }
+            }
+         }
+      }; // class basic_resolver_t
+
+      using resolver_t = basic_resolver_t<ip::info_t, coarse_clock_t>;
+
+   } // namespace ip
+
+} // namespace rmlib
@@ -30,18 +30,38 @@
 #include <cstddef>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <array>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <span>
 #include <atomic>
+#include <new>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/crypto.h>
 #include <openssl/x509.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   #include <openssl/core_names.h>
+   #include <openssl/params.h>
+#else
+   #include <openssl/hmac.h>
+#endif
 
 #include "rmlib/xplat.h"
 #include "rmlib/utility.h"
 #include "rmlib/time.h"
+#include "rmlib/timer_wheel.h"
+#include "rmlib/metrics.h"
+#include "rmlib/buffer_pool.h"
 
 /*****************************************************************************\
 *
@@ -57,8 +77,18 @@
    #define WSAEAGAIN WSAEWOULDBLOCK
    constexpr HANDLE INVALID_EPOLL_HANDLE = nullptr;
 
-   // link with Ws2_32.lib
+   using socket_iovec_t = WSABUF;
+
+   inline socket_iovec_t make_socket_iovec(char* buffer, size_t len) noexcept
+   {
+      return WSABUF{ static_cast<ULONG>(len), buffer };
+   }
+
+   #include <mswsock.h>
+
+   // link with Ws2_32.lib and Mswsock.lib (TransmitFile)
    #pragma comment (lib, "Ws2_32.lib")
+   #pragma comment (lib, "Mswsock.lib")
 #endif
 
 /*****************************************************************************\
@@ -71,8 +101,17 @@
    #include <sys/socket.h>
    #include <sys/ioctl.h>
    #include <sys/epoll.h>
+   #include <sys/uio.h>
+   #if defined(XPLAT_OS_LINUX)
+      #include <sys/sendfile.h>
+   #endif
+   #if defined(XPLAT_OS_MACOS) || defined(XPLAT_OS_FREEBSD)
+      #define XPLAT_BSD_SENDFILE
+   #endif
    #include <arpa/inet.h>
    #include <netdb.h>
+   #include <netinet/in.h>
+   #include <netinet/tcp.h>
    #include <unistd.h>
    #include <fcntl.h>
    #include <poll.h>
@@ -84,6 +123,12 @@
    using ADDRINFOA = struct addrinfo;
    using PADDRINFOA = struct addrinfo*;
    using SOCKADDR = struct sockaddr;
+   using socket_iovec_t = struct iovec;
+
+   inline socket_iovec_t make_socket_iovec(char* buffer, size_t len) noexcept
+   {
+      return iovec{ buffer, len };
+   }
 
    inline int WSAGetLastError() noexcept { return errno; }
    inline int closesocket(SOCKET fd) noexcept { return ::close(fd); }
@@ -104,6 +149,13 @@
    #define WSAENOTSOCK     ENOTSOCK
    #define WSAEALREADY     EALREADY
    #define WSAENOTCONN     ENOTCONN
+   #define WSAEOPNOTSUPP   EOPNOTSUPP
+   #define WSAENOBUFS      ENOBUFS
+   #define WSAECONNABORTED ECONNABORTED
+   #define WSAECONNRESET   ECONNRESET
+   #define WSAEINPROGRESS  EINPROGRESS
+   #define WSAETIMEDOUT    ETIMEDOUT
+   #define WSAEMSGSIZE     EMSGSIZE
 
    #define SD_SEND      SHUT_WR
    #define SD_RECEIVE   SHUT_RD
@@ -128,23 +180,28 @@ namespace rmlib {
          status_t() noexcept = default;
 
          // construct socket errors
+         // hint is only applied when error is WSAEWOULDBLOCK (want_read or want_write) 
+         // or when error is zero and hint is closing. Any other error is an io error
          status_t(int error, status_code_t hint = status_code_t::io) noexcept
             : error_{ error }
-            , code_{ (error == 0) ? status_code_t::none : hint }
          {
+            using enum status_code_t;
             if (error_ == SOCKET_ERROR)
             {
-               code_ = status_code_t::io;
                error_ = WSAGetLastError();
             }
-            if (error_ == WSAEWOULDBLOCK && hint != status_code_t::io)
+            if (error_ == 0)
             {
-               code_ = hint;
+               code_ = (hint == closing) ? closing : none;
             }
-            if (error_ == 0 && hint == status_code_t::closing)
+            else if (error_ == WSAEWOULDBLOCK && (hint == want_read || hint == want_write))
             {
                code_ = hint;
             }
+            else
+            {
+               code_ = (hint == fatal) ? fatal : io;
+            }
          }
 
          // construct SSL errors
@@ -162,26 +219,31 @@ namespace rmlib {
             {
                if (ERR_peek_last_error() != 0)
                {
-                  status_t(fatal);
+                  *this = status_t(fatal);
+               }
+               else if (int error = WSAGetLastError(); error != 0)
+               {
+                  *this = status_t{ error };
                }
                else
                {
-                  status_t{ WSAGetLastError() };
+                  // peer closed the connection without a close_notify
+                  *this = status_t{ 0, closing };
                }
                break;
             }
-            default: status_t(fatal); break;
+            default: *this = status_t(fatal); break;
             }
          }
 
          // construct SSL CTX errors
          explicit status_t(status_code_t) noexcept
             : ctx_{ ERR_peek_last_error() }
+            , code_{ status_code_t::fatal }
          {
             if (ctx_ != 0)
             {
                error_ = ERR_GET_REASON(ctx_);
-               code_ = status_code_t::fatal;
             }
             ERR_clear_error();
          }
@@ -201,6 +263,12 @@ namespace rmlib {
             return code_;
          }
 
+         // native socket error, SSL_ERROR_* or the TLS reason code
+         int error() const noexcept
+         {
+            return error_;
+         }
+
          bool would_block() const noexcept
          {
             using enum status_code_t;
@@ -281,7 +349,8 @@ namespace rmlib {
 
       class address_t
       {
-         sockaddr addr_{};
+         // large enough for IPv6 addresses
+         sockaddr_storage addr_{};
          socklen_t len_{};
 
       public:
@@ -293,13 +362,17 @@ namespace rmlib {
          address_t& operator=(address_t&&) = default;
 
          address_t(const sockaddr* addr, socklen_t len) noexcept
-            : addr_{ addr ? *addr : sockaddr{} }
-            , len_{ len }
-         {}
+            : len_{ addr ? std::min<socklen_t>(len, static_cast<socklen_t>(sizeof(addr_))) : 0 }
+         {
+            if (len_ > 0) std::memcpy(&addr_, addr, len_);
+         }
 
          address_t(const sockaddr& addr, socklen_t len) noexcept
-            : addr_{ addr }
-            , len_{ len }
+            : address_t(&addr, len)
+         {}
+
+         address_t(const sockaddr_storage& addr, socklen_t len) noexcept
+            : address_t(reinterpret_cast<const sockaddr*>(&addr), len)
          {}
 
          friend void swap(address_t& lhs, address_t& rhs) noexcept
@@ -310,7 +383,7 @@ namespace rmlib {
 
          const sockaddr* address() const noexcept
          {
-            return &addr_;
+            return reinterpret_cast<const sockaddr*>(&addr_);
          }
 
          socklen_t length() const noexcept
@@ -320,7 +393,7 @@ namespace rmlib {
 
          int family() const noexcept
          {
-            return addr_.sa_family;
+            return addr_.ss_family;
          }
 
          unsigned port() const noexcept
@@ -340,20 +413,31 @@ namespace rmlib {
             return dot_notation() + ":" + std::to_string(port());
          }
 
+         // byte wise comparison of the socket address
+         friend bool operator==(const address_t& lhs, const address_t& rhs) noexcept
+         {
+            return lhs.len_ == rhs.len_ && std::memcmp(&lhs.addr_, &rhs.addr_, lhs.len_) == 0;
+         }
+
+         size_t hash() const noexcept
+         {
+            return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&addr_), len_));
+         }
+
       private:
          std::pair<uint16_t, std::string> notation_and_port() const noexcept
          {
             std::array<char, INET6_ADDRSTRLEN> ipStr{ "Unkown AF" };
             uint16_t port_num{};
 
-            if (addr_.sa_family == AF_INET) // IPv4
+            if (addr_.ss_family == AF_INET) // IPv4
             {
                auto addr_in = reinterpret_cast<const struct sockaddr_in*>(&addr_);
                inet_ntop(AF_INET, &(addr_in->sin_addr), ipStr.data(), ipStr.size());
                port_num = ntohs(addr_in->sin_port);
 
             }
-            else if (addr_.sa_family == AF_INET6) // IPv6
+            else if (addr_.ss_family == AF_INET6) // IPv6
             {
                auto addr_in6 = reinterpret_cast<const struct sockaddr_in6*>(&addr_);
                inet_ntop(AF_INET6, &(addr_in6->sin6_addr), ipStr.data(), ipStr.size());
@@ -363,6 +447,14 @@ namespace rmlib {
          }
       }; // class address_t
 
+      struct address_hash_t
+      {
+         size_t operator()(const address_t& address) const noexcept
+         {
+            return address.hash();
+         }
+      };
+
       /***********************************************************************\
       *
       *  Retrieve the peer name from ipaddress_t in the format "host:port".
@@ -463,17 +555,479 @@ namespace rmlib {
 
       enum class context_type_t { client, server };
 
+      // default maximum number of client sessions kept by session_cache_t
+      constexpr size_t TLS_DEFAULT_SESSION_CACHE_SIZE = 1024;
+
+      // default size of each ciphertext buffer of a memory BIO, room for
+      // four full TLS records
+      constexpr size_t TLS_DEFAULT_BIO_BUFFER_SIZE = 64 * 1024;
+
+      /***********************************************************************\
+      *
+      *  session_cache_t
+      *  Client side TLS session cache keyed by the numeric "host:port" of the 
+      *  server. New sessions, including TLS 1.3 tickets received after the
+      *  handshake, are stored by the OpenSSL new session callback and reused
+      *  by socket_t::connect() with SSL_set_session. When the cache is full 
+      *  the least recently used session is evicted
+      *
+      \***********************************************************************/
+      class session_cache_t
+      {
+         using lru_list_t = std::list<std::pair<std::string, SSL_SESSION*>>;
+
+         lru_list_t lru_;
+         std::unordered_map<std::string, lru_list_t::iterator> sessions_;
+         size_t capacity_{ TLS_DEFAULT_SESSION_CACHE_SIZE };
+         mutable spin_lock_t lock_;
+
+      public:
+         session_cache_t() = default;
+         session_cache_t(const session_cache_t&) = delete;
+         session_cache_t(session_cache_t&&) = delete;
+         session_cache_t& operator=(const session_cache_t&) = delete;
+         session_cache_t& operator=(session_cache_t&&) = delete;
+
+         explicit session_cache_t(size_t capacity) noexcept
+            : capacity_{ capacity > 0 ? capacity : 1 }
+         {}
+
+         ~session_cache_t() noexcept
+         {
+            clear();
+         }
+
+         // build the cache key of an address
+         static std::string key(const sockaddr* addr, socklen_t len) noexcept
+         {
+            std::array<char, NI_MAXHOST> host{};
+            std::array<char, NI_MAXSERV> port{};
+            if (!addr || ::getnameinfo(addr, len, host.data(), (socklen_t)host.size(), port.data(), (socklen_t)port.size(), (NI_NUMERICHOST | NI_NUMERICSERV)) != 0)
+            {
+               return std::string{};
+            }
+            return std::string(host.data()) + ":" + std::string(port.data());
+         }
+
+         // the cache takes ownership of the session reference
+         void store(const std::string& key, SSL_SESSION* session) noexcept
+         {
+            if (!session) return;
+            if (key.empty() || !SSL_SESSION_is_resumable(session))
+            {
+               SSL_SESSION_free(session);
+               return;
+            }
+            spin_guard_t guard(lock_);
+            if (auto it = sessions_.find(key); it != sessions_.end())
+            {
+               SSL_SESSION_free(it->second->second);
+               it->second->second = session;
+               lru_.splice(lru_.begin(), lru_, it->second);
+               return;
+            }
+            if (sessions_.size() >= capacity_)
+            {
+               SSL_SESSION_free(lru_.back().second);
+               sessions_.erase(lru_.back().first);
+               lru_.pop_back();
+            }
+            lru_.emplace_front(key, session);
+            sessions_.emplace(key, lru_.begin());
+         }
+
+         // returns a new reference to the session or nullptr. Caller must call
+         // SSL_SESSION_free on the returned session
+         SSL_SESSION* find(const std::string& key) noexcept
+         {
+            spin_guard_t guard(lock_);
+            if (auto it = sessions_.find(key); it != sessions_.end())
+            {
+               lru_.splice(lru_.begin(), lru_, it->second);
+               SSL_SESSION* session = it->second->second;
+               SSL_SESSION_up_ref(session);
+               return session;
+            }
+            return nullptr;
+         }
+
+         void remove(const std::string& key) noexcept
+         {
+            spin_guard_t guard(lock_);
+            if (auto it = sessions_.find(key); it != sessions_.end())
+            {
+               SSL_SESSION_free(it->second->second);
+               lru_.erase(it->second);
+               sessions_.erase(it);
+            }
+         }
+
+         void clear() noexcept
+         {
+            spin_guard_t guard(lock_);
+            for (auto& entry : lru_)
+            {
+               SSL_SESSION_free(entry.second);
+            }
+            lru_.clear();
+            sessions_.clear();
+         }
+
+         size_t size() const noexcept
+         {
+            spin_guard_t guard(lock_);
+            return sessions_.size();
+         }
+
+         size_t capacity() const noexcept
+         {
+            return capacity_;
+         }
+      }; // class session_cache_t
+
+      // server side session ticket encryption key
+      struct ticket_key_t
+      {
+         std::array<unsigned char, 16> name{};
+         std::array<unsigned char, 32> aes_key{};
+         std::array<unsigned char, 32> hmac_key{};
+
+         // generate a random ticket key
+         static socket::status_t generate(ticket_key_t& key) noexcept
+         {
+            if (RAND_bytes(key.name.data(), (int)key.name.size()) != 1 ||
+                RAND_bytes(key.aes_key.data(), (int)key.aes_key.size()) != 1 ||
+                RAND_bytes(key.hmac_key.data(), (int)key.hmac_key.size()) != 1)
+            {
+               return socket::status_t(status_code_t::fatal);
+            }
+            return socket::status_t{};
+         }
+      }; // struct ticket_key_t
+
+      /***********************************************************************\
+      *
+      *  ticket_keys_t
+      *  Current and previous session ticket keys. New tickets are encrypted 
+      *  with the current key. Tickets encrypted with the previous key are still
+      *  accepted and renewed, so a rotation does not force full handshakes
+      *
+      \***********************************************************************/
+      class ticket_keys_t
+      {
+         std::array<ticket_key_t, 2> keys_{};
+         size_t count_{};
+         mutable spin_lock_t lock_;
+
+      public:
+         void rotate(const ticket_key_t& key) noexcept
+         {
+            spin_guard_t guard(lock_);
+            keys_[1] = keys_[0];
+            keys_[0] = key;
+            count_ = std::min(count_ + 1, keys_.size());
+         }
+
+         bool current(ticket_key_t& key) const noexcept
+         {
+            spin_guard_t guard(lock_);
+            if (count_ == 0) return false;
+            key = keys_[0];
+            return true;
+         }
+
+         // returns 0 if no key matches, 1 for the current key and 2 for the previous key
+         int find(const unsigned char* name, ticket_key_t& key) const noexcept
+         {
+            spin_guard_t guard(lock_);
+            for (size_t i = 0; i < count_; ++i)
+            {
+               if (std::memcmp(keys_[i].name.data(), name, keys_[i].name.size()) == 0)
+               {
+                  key = keys_[i];
+                  return static_cast<int>(i + 1);
+               }
+            }
+            return 0;
+         }
+      }; // class ticket_keys_t
+
+      // optional state of a context, reachable from SSL_CTX ex_data in callbacks
+      struct context_data_t
+      {
+         std::unique_ptr<session_cache_t> sessions;
+         std::unique_ptr<ticket_keys_t> tickets;
+         size_t bio_buffer_size{};
+      }; // struct context_data_t
+
+      inline int context_data_index() noexcept
+      {
+         static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+         return index;
+      }
+
+      inline context_data_t* context_data(const SSL_CTX* ctx) noexcept
+      {
+         return ctx ? static_cast<context_data_t*>(SSL_CTX_get_ex_data(ctx, context_data_index())) : nullptr;
+      }
+
+      inline session_cache_t* session_cache(const SSL_CTX* ctx) noexcept
+      {
+         context_data_t* data = context_data(ctx);
+         return data ? data->sessions.get() : nullptr;
+      }
+
+      // ciphertext buffer size of sockets created from ctx, 0 unless the
+      // context enabled memory BIO mode
+      inline size_t memory_bio_size(const SSL_CTX* ctx) noexcept
+      {
+         context_data_t* data = context_data(ctx);
+         return data ? data->bio_buffer_size : 0;
+      }
+
+      /***********************************************************************\
+      *
+      *  bio_buffer_t
+      *  Linear ciphertext buffer of a memory BIO. Bytes are appended at the
+      *  tail and consumed from the head. The unread bytes are moved to the
+      *  front when the tail runs out of room, and the buffer only grows when
+      *  they fill it
+      *
+      \***********************************************************************/
+      class bio_buffer_t
+      {
+         std::unique_ptr<char[]> data_{};
+         size_t capacity_{};
+         size_t head_{};
+         size_t tail_{};
+
+      public:
+         explicit bio_buffer_t(size_t capacity = TLS_DEFAULT_BIO_BUFFER_SIZE) noexcept
+            : data_{ new (std::nothrow) char[capacity] }
+            , capacity_{ data_ ? capacity : 0 }
+         {}
+
+         size_t size() const noexcept
+         {
+            return tail_ - head_;
+         }
+
+         bool empty() const noexcept
+         {
+            return head_ == tail_;
+         }
+
+         size_t capacity() const noexcept
+         {
+            return capacity_;
+         }
+
+         // unread bytes
+         std::span<const char> data() const noexcept
+         {
+            return { data_.get() + head_, size() };
+         }
+
+         void consume(size_t count) noexcept
+         {
+            head_ += std::min(count, size());
+            if (head_ == tail_) head_ = tail_ = 0;
+         }
+
+         // free tail of at least min_size bytes, to be filled and then
+         // published with commit(). Empty if the buffer cannot grow
+         std::span<char> space(size_t min_size = 1) noexcept
+         {
+            if (capacity_ - tail_ < min_size && head_ > 0)
+            {
+               std::memmove(data_.get(), data_.get() + head_, size());
+               tail_ -= head_;
+               head_ = 0;
+            }
+            if (capacity_ - tail_ < min_size && !grow(tail_ + min_size)) return {};
+            return { data_.get() + tail_, capacity_ - tail_ };
+         }
+
+         void commit(size_t count) noexcept
+         {
+            tail_ += std::min(count, capacity_ - tail_);
+         }
+
+         bool write(const char* data, size_t len) noexcept
+         {
+            std::span<char> tail = space(len);
+            if (tail.size() < len) return false;
+            std::memcpy(tail.data(), data, len);
+            commit(len);
+            return true;
+         }
+
+         size_t read(char* data, size_t len) noexcept
+         {
+            len = std::min(len, size());
+            std::memcpy(data, data_.get() + head_, len);
+            consume(len);
+            return len;
+         }
+
+         void clear() noexcept
+         {
+            head_ = tail_ = 0;
+         }
+
+      private:
+         bool grow(size_t min_capacity) noexcept
+         {
+            size_t capacity = std::max(capacity_ * 2, min_capacity);
+            std::unique_ptr<char[]> data{ new (std::nothrow) char[capacity] };
+            if (!data) return false;
+            if (!empty()) std::memcpy(data.get(), data_.get() + head_, size());
+            tail_ -= head_;
+            head_ = 0;
+            data_ = std::move(data);
+            capacity_ = capacity;
+            return true;
+         }
+      }; // class bio_buffer_t
+
+      // the two ciphertext directions of one TLS connection. fd is only
+      // reported to OpenSSL, so SSL_get_fd() keeps working, no I/O is done
+      // on it by the BIO
+      struct bio_state_t
+      {
+         bio_buffer_t in;
+         bio_buffer_t out;
+         int fd{ -1 };
+         bool eof{ false };
+
+         explicit bio_state_t(size_t buffer_size = TLS_DEFAULT_BIO_BUFFER_SIZE, int descriptor = -1) noexcept
+            : in{ buffer_size }
+            , out{ buffer_size }
+            , fd{ descriptor }
+         {}
+      }; // struct bio_state_t
+
+      namespace bio {
+
+         inline bio_state_t* state(BIO* bio) noexcept
+         {
+            return static_cast<bio_state_t*>(BIO_get_data(bio));
+         }
+
+         // records produced by OpenSSL are appended to the outbound buffer,
+         // a write never blocks
+         inline int write(BIO* bio, const char* data, size_t len, size_t* bytes_written) noexcept
+         {
+            BIO_clear_retry_flags(bio);
+            if (!state(bio)->out.write(data, len)) return 0;
+            *bytes_written = len;
+            return 1;
+         }
+
+         // when the inbound buffer is empty OpenSSL is told to retry, which
+         // SSL_get_error() reports as SSL_ERROR_WANT_READ
+         inline int read(BIO* bio, char* data, size_t len, size_t* bytes_read) noexcept
+         {
+            BIO_clear_retry_flags(bio);
+            bio_state_t* s = state(bio);
+            if (s->in.empty())
+            {
+               if (!s->eof) BIO_set_retry_read(bio);
+               return 0;
+            }
+            *bytes_read = s->in.read(data, len);
+            return 1;
+         }
+
+         inline long ctrl(BIO* bio, int cmd, long, void* ptr) noexcept
+         {
+            bio_state_t* s = state(bio);
+            switch (cmd)
+            {
+               case BIO_CTRL_FLUSH: return 1;
+               case BIO_CTRL_PENDING: return static_cast<long>(s->in.size());
+               case BIO_CTRL_WPENDING: return static_cast<long>(s->out.size());
+               case BIO_CTRL_EOF: return s->eof && s->in.empty() ? 1 : 0;
+               case BIO_C_GET_FD:
+                  if (s->fd < 0) return -1;
+                  if (ptr) *static_cast<int*>(ptr) = s->fd;
+                  return s->fd;
+               default: return 0;
+            }
+         }
+
+         inline int create(BIO* bio) noexcept
+         {
+            BIO_set_init(bio, 1);
+            return 1;
+         }
+
+         // shared by every memory BIO and never freed, like the ex_data index.
+         // BIO_TYPE_DESCRIPTOR lets SSL_get_fd() find the descriptor
+         inline const BIO_METHOD* method() noexcept
+         {
+            static BIO_METHOD* const method = []() noexcept {
+               BIO_METHOD* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK | BIO_TYPE_DESCRIPTOR, "rmlib memory bio");
+               if (m)
+               {
+                  BIO_meth_set_write_ex(m, write);
+                  BIO_meth_set_read_ex(m, read);
+                  BIO_meth_set_ctrl(m, ctrl);
+                  BIO_meth_set_create(m, create);
+               }
+               return m;
+            }();
+            return method;
+         }
+
+         // route the ciphertext of ssl through state, which must outlive ssl
+         inline bool attach(SSL* ssl, bio_state_t* state) noexcept
+         {
+            const BIO_METHOD* m = method();
+            BIO* bio = m ? BIO_new(m) : nullptr;
+            if (!bio) return false;
+            BIO_set_data(bio, state);
+            // one reference is taken when the read and write BIO are the same
+            SSL_set_bio(ssl, bio, bio);
+            return true;
+         }
+
+      } // namespace bio
+
       class context_t
       {
          SSL_CTX* ctx_{ nullptr };
-        socket::status_t status_;
+         socket::status_t status_;
+         context_type_t type_{ context_type_t::client };
+         std::unique_ptr<context_data_t> data_;
 
       public:
          context_t() = default;
          context_t(const context_t&) = delete;
-         context_t(context_t&&) noexcept = default;
          context_t& operator=(const context_t&) = delete;
-         context_t& operator=(context_t&&) noexcept = default;
+
+         context_t(context_t&& other) noexcept
+            : ctx_{ other.ctx_ }
+            , status_{ other.status_ }
+            , type_{ other.type_ }
+            , data_{ std::move(other.data_) }
+         {
+            other.ctx_ = nullptr;
+         }
+
+         context_t& operator=(context_t&& other) noexcept
+         {
+            if (this != &other)
+            {
+               free_context();
+               ctx_ = other.ctx_;
+               status_ = other.status_;
+               type_ = other.type_;
+               data_ = std::move(other.data_);
+               other.ctx_ = nullptr;
+            }
+            return *this;
+         }
 
          explicit context_t(context_type_t type) noexcept
          {
@@ -502,13 +1056,100 @@ namespace rmlib {
             return status_;
          }
 
-         ~context_t() noexcept
+         // client contexts only. Enable the client session cache, so connections
+         // to a server already visited resume the previous session
+         socket::status_t enable_session_cache(size_t capacity = TLS_DEFAULT_SESSION_CACHE_SIZE) noexcept
          {
-            if (ctx_)
+            if (!ctx_ || type_ != context_type_t::client) return socket::status_t{ WSAEINVAL };
+            if (!data_ptr()) return socket::status_t{ ENOMEM };
+            data_->sessions.reset(new (std::nothrow) session_cache_t(capacity));
+            if (!data_->sessions) return socket::status_t{ ENOMEM };
+            SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx_, new_session_callback);
+            return socket::status_t{};
+         }
+
+         session_cache_t* session_cache() noexcept
+         {
+            return data_ ? data_->sessions.get() : nullptr;
+         }
+
+         // server contexts only. Set a new current session ticket key, the previous
+         // current key is still accepted to decrypt tickets until the next rotation
+         socket::status_t set_ticket_key(const ticket_key_t& key) noexcept
+         {
+            if (!ctx_ || type_ != context_type_t::server) return socket::status_t{ WSAEINVAL };
+            if (!data_ptr()) return socket::status_t{ ENOMEM };
+            if (!data_->tickets)
             {
-               SSL_CTX_free(ctx_);
-               ctx_ = nullptr;
+               data_->tickets.reset(new (std::nothrow) ticket_keys_t);
+               if (!data_->tickets) return socket::status_t{ ENOMEM };
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+               SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, ticket_key_callback);
+#else
+               SSL_CTX_set_tlsext_ticket_key_cb(ctx_, ticket_key_callback);
+#endif
+            }
+            data_->tickets->rotate(key);
+            return socket::status_t{};
+         }
+
+         // server contexts only. Rotate to a new random session ticket key
+         socket::status_t rotate_ticket_key() noexcept
+         {
+            ticket_key_t key;
+            if (socket::status_t status = ticket_key_t::generate(key); status.nok())
+            {
+               return status;
             }
+            return set_ticket_key(key);
+         }
+
+         // Enable kernel TLS. After the handshake the kernel encrypts and decrypts
+         // records, and socket_t::send_file() uses SSL_sendfile. kTLS requires 
+         // OpenSSL 3 built with kTLS, Linux with the tls module and a cipher the
+         // kernel supports. When these are not met, the connection silently uses
+         // user space TLS, see socket_t::ktls_send_active()
+         socket::status_t enable_ktls() noexcept
+         {
+            if (!ctx_) return socket::status_t{ WSAEINVAL };
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+            SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+            return socket::status_t{};
+#else
+            return socket::status_t{ ENOTSUP };
+#endif
+         }
+
+         // Memory BIO mode. SSL objects of sockets created afterwards are not
+         // bound to the socket: ciphertext goes through two user space buffers
+         // of buffer_size bytes that socket_t fills with one large recv and
+         // drains with one send, so several records share a syscall. kTLS does
+         // not apply to these sockets. buffer_size 0 restores direct binding
+         socket::status_t enable_memory_bio(size_t buffer_size = TLS_DEFAULT_BIO_BUFFER_SIZE) noexcept
+         {
+            if (!ctx_) return socket::status_t{ WSAEINVAL };
+            if (!data_ptr()) return socket::status_t{ ENOMEM };
+            data_->bio_buffer_size = buffer_size;
+            return socket::status_t{};
+         }
+
+         size_t memory_bio_size() const noexcept
+         {
+            return data_ ? data_->bio_buffer_size : 0;
+         }
+
+         // how long sessions and tickets are valid for, in seconds
+         socket::status_t set_session_timeout(long seconds) noexcept
+         {
+            if (!ctx_) return socket::status_t{ WSAEINVAL };
+            SSL_CTX_set_timeout(ctx_, seconds);
+            return socket::status_t{};
+         }
+
+         ~context_t() noexcept
+         {
+            free_context();
          }
 
          SSL_CTX* operator()() noexcept
@@ -521,10 +1162,16 @@ namespace rmlib {
             return status_;
          }
 
+         context_type_t type() const noexcept
+         {
+            return type_;
+         }
+
       private:
          void create(context_type_t type, const char* cert_pem_file, const char* key_pem_file) noexcept
          {
             status_.clear();
+            type_ = type;
             allocate_context(type);
             set_certificate(cert_pem_file);
             set_private_key(key_pem_file);
@@ -539,6 +1186,14 @@ namespace rmlib {
             if (ctx_ = SSL_CTX_new(type == context_type_t::client ? TLS_client_method() : TLS_server_method()); !ctx_)
             {
                status_ =socket::status_t(status_code_t::fatal);
+               return;
+            }
+            // vectored socket_t::send() retries a write from a different buffer
+            SSL_CTX_set_mode(ctx_, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+            if (type == context_type_t::server)
+            {
+               static const unsigned char session_id_context[] = "rmlib";
+               SSL_CTX_set_session_id_context(ctx_, session_id_context, sizeof(session_id_context) - 1);
             }
          }
 
@@ -546,16 +1201,79 @@ namespace rmlib {
          {
             if (ctx_)
             {
+               // SSL objects still alive may keep the SSL_CTX alive after the context_t
+               SSL_CTX_set_ex_data(ctx_, context_data_index(), nullptr);
                SSL_CTX_free(ctx_);
                ctx_ = nullptr;
             }
+            data_.reset();
          }
 
-         void set_certificate(const char* cert_pem_file) noexcept
+         context_data_t* data_ptr() noexcept
          {
-            if (status_.ok() && cert_pem_file && SSL_CTX_use_certificate_file(ctx_, cert_pem_file, SSL_FILETYPE_PEM) <= 0)
+            if (!data_)
             {
-               status_ =socket::status_t(status_code_t::fatal);
+               data_.reset(new (std::nothrow) context_data_t);
+               if (data_) SSL_CTX_set_ex_data(ctx_, context_data_index(), data_.get());
+            }
+            return data_.get();
+         }
+
+         static int new_session_callback(SSL* ssl, SSL_SESSION* session) noexcept
+         {
+            session_cache_t* cache = tls::session_cache(SSL_get_SSL_CTX(ssl));
+            if (!cache) return 0;
+            sockaddr_storage addr{};
+            socklen_t len{ sizeof(addr) };
+            if (::getpeername(SSL_get_fd(ssl), reinterpret_cast<sockaddr*>(&addr), &len) != 0) return 0;
+            cache->store(session_cache_t::key(reinterpret_cast<const sockaddr*>(&addr), len), session);
+            // returning 1 tells OpenSSL the cache took ownership of the session
+            return 1;
+         }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+         static int ticket_key_callback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* hmac, int enc) noexcept
+#else
+         static int ticket_key_callback(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher, HMAC_CTX* hmac, int enc) noexcept
+#endif
+         {
+            context_data_t* data = context_data(SSL_get_SSL_CTX(ssl));
+            if (!data || !data->tickets) return 0;
+            ticket_key_t key;
+            int ret{ 1 };
+            if (enc)
+            {
+               if (!data->tickets->current(key)) return 0;
+               std::memcpy(key_name, key.name.data(), key.name.size());
+               if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) return -1;
+               if (EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1) return -1;
+            }
+            else
+            {
+               // unknown key, perform a full handshake
+               if (ret = data->tickets->find(key_name, key); ret == 0) return 0;
+               if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key.data(), iv) != 1) return -1;
+            }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            OSSL_PARAM params[] =
+            {
+               OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key.data(), key.hmac_key.size()),
+               OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+               OSSL_PARAM_construct_end()
+            };
+            if (EVP_MAC_CTX_set_params(hmac, params) != 1) return -1;
+#else
+            if (HMAC_Init_ex(hmac, key.hmac_key.data(), (int)key.hmac_key.size(), EVP_sha256(), nullptr) != 1) return -1;
+#endif
+            // 2 tells OpenSSL to renew a ticket encrypted with the previous key
+            return ret;
+         }
+
+         void set_certificate(const char* cert_pem_file) noexcept
+         {
+            if (status_.ok() && cert_pem_file && SSL_CTX_use_certificate_file(ctx_, cert_pem_file, SSL_FILETYPE_PEM) <= 0)
+            {
+               status_ =socket::status_t(status_code_t::fatal);
             }
          }
 
@@ -569,6 +1287,166 @@ namespace rmlib {
 
       }; // class context_t
 
+      /***********************************************************************\
+      *
+      *  engine_t
+      *  TLS connection that does no I/O. Ciphertext received from the peer is
+      *  added with feed(), or received in place into inbound() and published
+      *  with commit(). Ciphertext for the peer is taken from outbound() and
+      *  released with consume() once sent. The caller decides how the bytes
+      *  move, so records can be batched over any transport, handed to an
+      *  asynchronous backend, or encrypted on another thread than the one
+      *  doing the I/O. want_read() means feed more ciphertext and call again.
+      *  Not thread safe, an engine belongs to one thread at a time
+      *
+      \***********************************************************************/
+      class engine_t
+      {
+         SSL* ssl_{};
+         std::unique_ptr<bio_state_t> bio_{};
+
+      public:
+         engine_t() = default;
+         engine_t(const engine_t&) = delete;
+         engine_t& operator=(const engine_t&) = delete;
+
+         engine_t(engine_t&& other) noexcept
+            : ssl_{ std::exchange(other.ssl_, nullptr) }
+            , bio_{ std::move(other.bio_) }
+         {}
+
+         engine_t& operator=(engine_t&& other) noexcept
+         {
+            if (this != &other)
+            {
+               close();
+               ssl_ = std::exchange(other.ssl_, nullptr);
+               bio_ = std::move(other.bio_);
+            }
+            return *this;
+         }
+
+         ~engine_t() noexcept
+         {
+            close();
+         }
+
+         // start a connection acting as the client or the server, according
+         // to the context type
+         socket::status_t open(context_t& ctx, size_t buffer_size = TLS_DEFAULT_BIO_BUFFER_SIZE) noexcept
+         {
+            close();
+            if (!ctx()) return socket::status_t{ WSAEINVAL };
+            bio_.reset(new (std::nothrow) bio_state_t(buffer_size));
+            if (!bio_) return socket::status_t{ ENOMEM };
+            if (ssl_ = SSL_new(ctx()); !ssl_ || !bio::attach(ssl_, bio_.get()))
+            {
+               close();
+               return socket::status_t(status_code_t::fatal);
+            }
+            if (ctx.type() == context_type_t::client) SSL_set_connect_state(ssl_);
+            else SSL_set_accept_state(ssl_);
+            return socket::status_t{};
+         }
+
+         void close() noexcept
+         {
+            if (ssl_)
+            {
+               SSL_free(ssl_);
+               ssl_ = nullptr;
+            }
+            bio_.reset();
+         }
+
+         bool is_open() const noexcept
+         {
+            return ssl_ != nullptr;
+         }
+
+         bool is_connected() const noexcept
+         {
+            return ssl_ && SSL_is_init_finished(ssl_) == 1;
+         }
+
+         SSL* ssl() noexcept
+         {
+            return ssl_;
+         }
+
+         // free space for ciphertext received from the peer, at least
+         // min_size bytes unless the engine is closed or out of memory
+         std::span<char> inbound(size_t min_size = 1) noexcept
+         {
+            return bio_ ? bio_->in.space(min_size) : std::span<char>{};
+         }
+
+         void commit(size_t count) noexcept
+         {
+            if (bio_) bio_->in.commit(count);
+         }
+
+         socket::status_t feed(std::span<const char> ciphertext) noexcept
+         {
+            if (!bio_) return socket::status_t{ WSAENOTCONN };
+            if (!bio_->in.write(ciphertext.data(), ciphertext.size())) return socket::status_t{ WSAENOBUFS };
+            return socket::status_t{};
+         }
+
+         // the peer closed the transport, reads fail once the ciphertext
+         // already fed is consumed
+         void set_eof() noexcept
+         {
+            if (bio_) bio_->eof = true;
+         }
+
+         std::span<const char> outbound() const noexcept
+         {
+            return bio_ ? bio_->out.data() : std::span<const char>{};
+         }
+
+         void consume(size_t count) noexcept
+         {
+            if (bio_) bio_->out.consume(count);
+         }
+
+         // drive the handshake. read() and write() also complete it
+         socket::status_t handshake() noexcept
+         {
+            if (!ssl_) return socket::status_t{ WSAENOTCONN };
+            return result(SSL_do_handshake(ssl_));
+         }
+
+         socket::status_t read(char* buffer, size_t len, size_t& bytes_read) noexcept
+         {
+            bytes_read = 0;
+            if (!ssl_) return socket::status_t{ WSAENOTCONN };
+            return result(SSL_read_ex(ssl_, buffer, len, &bytes_read));
+         }
+
+         // encrypt all of buffer into outbound(), as many records as needed
+         socket::status_t write(const char* buffer, size_t len, size_t& bytes_written) noexcept
+         {
+            bytes_written = 0;
+            if (!ssl_) return socket::status_t{ WSAENOTCONN };
+            return result(SSL_write_ex(ssl_, buffer, len, &bytes_written));
+         }
+
+         // queue a close_notify alert in outbound()
+         socket::status_t shutdown() noexcept
+         {
+            if (!ssl_) return socket::status_t{ WSAENOTCONN };
+            int ret = SSL_shutdown(ssl_);
+            return ret < 0 ? socket::status_t{ ssl_, ret } : socket::status_t{};
+         }
+
+      private:
+         socket::status_t result(int ret) const noexcept
+         {
+            return ret > 0 ? socket::status_t{} : socket::status_t{ ssl_, ret };
+         }
+      }; // class engine_t
+
    } // namespace tls
 
    constexpr size_t KBytes(size_t n) noexcept { return n * 1024; }
@@ -576,6 +1454,13 @@ namespace rmlib {
 
    using uid_t = uint64_t;
 
+   // uids are unique across every kind of socket, so they can share a poller
+   inline uid_t next_socket_uid() noexcept
+   {
+      static std::atomic_uint64_t counter{ 1 };
+      return counter.fetch_add(1, std::memory_order_relaxed);
+   }
+
    enum class socket_event_t { recv_ready, send_ready, connect_ready, accept_ready };
    enum class socket_mode_t { blocking, nonblocking };
    enum class socket_close_t : int { send = SD_SEND, recv = SD_RECEIVE, both = SD_BOTH };
@@ -583,6 +1468,7 @@ namespace rmlib {
    enum class socket_state_t { 
         idle         // socket_t object not connected or closed
       , created      // underlying SOCKET handle created
+      , opening      // nonblocking TCP connect in progress
       , connecting   // TLS handshake in progress for connect
       , connected    // socket_t connected
       , listening    // spocket_t is listening for connections
@@ -598,35 +1484,114 @@ namespace rmlib {
    // require more calls to ::recv to receive all data in sockets buffer
    constexpr size_t SOCKET_DEFAULT_RECV_SIZE = KBytes(16);
 
+   // maximum number of buffers passed to a single writev/readv or WSASend/WSARecv
+   // call by the vectored send() and recv(). Extra buffers are left for the next
+   // call, the same way as a partial send
+   constexpr size_t SOCKET_MAX_IOVEC = 64;
+
+   // vectored send() on a TLS socket coalesces buffers into a single TLS record
+   constexpr size_t SOCKET_TLS_MAX_RECORD_SIZE = KBytes(16);
+
    // define default listen() backlog size
    constexpr int SOCKET_DEFAULT_LISTEN_BACKLOG = 512;
 
    // define how long epoll should wait in milliseconds before returning
    constexpr int SOCKET_DEFAULT_EPOLL_WAIT_TIMEOUT_MS = 10;
 
+   // define the maximum number of ready events socket_poller_t::wait() 
+   // collects from a single call to epoll_wait
+   constexpr size_t SOCKET_DEFAULT_POLLER_MAX_EVENTS = 1024;
+
+   // clock policy of the socket_t send and receive activity timers. The coarse
+   // clock reads without a system call; define RMLIB_SOCKET_CLOCK as
+   // rmlib::cached_clock_t in programs driven by a socket_poller_t loop
+#if !defined(RMLIB_SOCKET_CLOCK)
+   #define RMLIB_SOCKET_CLOCK rmlib::coarse_clock_t
+#endif
+   using socket_timer_t = basic_timer_t<RMLIB_SOCKET_CLOCK>;
+
+   // TCP fast open queue of a listening socket, the number of pending
+   // connections whose SYN may carry data
+   constexpr int SOCKET_DEFAULT_FAST_OPEN_QUEUE = 256;
+
+   /**************************************************************************\
+   *
+   *  socket_options_t
+   *  Tuning profile applied by connect(), listen() and accept() when the
+   *  socket is created, before any traffic. Default values leave the system
+   *  settings alone. Options the platform lacks are ignored: quick_ack and
+   *  busy_poll_usecs are Linux only, fast_open works for listen() wherever
+   *  TCP_FASTOPEN is defined and for connect() on Linux only. Accepted
+   *  sockets inherit the buffer sizes of the listener
+   *
+   \**************************************************************************/
+   struct socket_options_t
+   {
+      bool no_delay{ false };          // TCP_NODELAY, send small writes at once
+      bool quick_ack{ false };         // TCP_QUICKACK, a hint the kernel may later drop
+      bool keep_alive{ false };        // SO_KEEPALIVE
+      bool fast_open{ false };         // TCP_FASTOPEN / TCP_FASTOPEN_CONNECT
+      int fast_open_queue{ SOCKET_DEFAULT_FAST_OPEN_QUEUE };
+      int send_buffer{};               // SO_SNDBUF bytes, 0 keeps the default
+      int recv_buffer{};               // SO_RCVBUF bytes, 0 keeps the default
+      int busy_poll_usecs{};           // SO_BUSY_POLL, raising it needs CAP_NET_ADMIN
+
+      bool is_default() const noexcept
+      {
+         return !no_delay && !quick_ack && !keep_alive && !fast_open && send_buffer <= 0 && recv_buffer <= 0 && busy_poll_usecs <= 0;
+      }
+
+      // request/response traffic made of small messages
+      static socket_options_t low_latency() noexcept
+      {
+         socket_options_t options;
+         options.no_delay = true;
+         options.quick_ack = true;
+         options.fast_open = true;
+         return options;
+      }
+
+      // long lived links that move large volumes
+      static socket_options_t bulk(int buffer_size = static_cast<int>(MBytes(4))) noexcept
+      {
+         socket_options_t options;
+         options.keep_alive = true;
+         options.send_buffer = buffer_size;
+         options.recv_buffer = buffer_size;
+         return options;
+      }
+   };
+
+   /**************************************************************************\
+   *
+   *  socket_t
+   *  socket_t is move only and owns its SOCKET handle and SSL object, so 
+   *  creating, accepting and moving a connection makes no heap allocation.
+   *  Use shared_socket_t when a connection is shared by more than one owner.
+   *  TLS sockets of a context with memory BIO mode enabled also own their
+   *  ciphertext buffers, see tls::context_t::enable_memory_bio()
+   *
+   \**************************************************************************/
    class socket_t
    {
       SOCKET handle_{ INVALID_SOCKET };
       SSL* ssl_{};
       SSL_CTX* ctx_{};
+      std::unique_ptr<tls::bio_state_t> bio_{};
       uid_t uid_{};
       socket_mode_t mode_{ socket_mode_t::blocking };
       socket_state_t state_{ socket_state_t::idle };
-      unsigned* ref_count_{};
-      timer_t send_timer_;
-      timer_t recv_timer_;
+      socket_timer_t send_timer_;
+      socket_timer_t recv_timer_;
+      [[no_unique_address]] io_metrics_policy_t::counters_t counters_{};
 
    public:
       // create a TCP socket
-      socket_t() noexcept
-         : ref_count_(new unsigned(1))
-      {}
-
+      socket_t() noexcept = default;
 
       // create a TLS or TCP socket
       explicit socket_t(tls::context_t& ctx) noexcept
          : ctx_{ ctx() }
-         , ref_count_(new unsigned(1))
       {}
 
       ~socket_t() noexcept
@@ -634,63 +1599,22 @@ namespace rmlib {
          close();
       }
 
-      socket_t(const socket_t& other) noexcept
-         : handle_{ other.handle_ }
-         , ssl_{ other.ssl_ }
-         , ctx_{ other.ctx_ }
-         , uid_{ other.uid_ }
-         , mode_{ other.mode_ }
-         , state_{ other.state_ }
-         , ref_count_{ other.ref_count_}
-         , send_timer_{ other.send_timer_ }
-         , recv_timer_{ other.recv_timer_ }
-      {
-         if (ref_count_)
-         {
-            ++(*ref_count_);
-         }
-      }
+      socket_t(const socket_t&) = delete;
+      socket_t& operator=(const socket_t&) = delete;
 
       socket_t(socket_t&& other) noexcept
          : handle_{ other.handle_ }
          , ssl_{ other.ssl_ }
          , ctx_{ other.ctx_ }
+         , bio_{ std::move(other.bio_) }
          , uid_{ other.uid_ }
          , mode_{ other.mode_ }
          , state_{ other.state_ }
-         , ref_count_{ other.ref_count_ }
          , send_timer_{ other.send_timer_ }
          , recv_timer_{ other.recv_timer_ }
+         , counters_{ other.counters_ }
       {
-         other.handle_ = INVALID_SOCKET;
-         other.ssl_ = nullptr;
-         other.ctx_ = nullptr;
-         other.uid_ = 0;
-         other.mode_ = socket_mode_t::blocking;
-         other.state_ = socket_state_t::idle;
-         other.ref_count_ = nullptr;
-      }
-
-      socket_t& operator=(const socket_t& other) noexcept
-      {
-         if (this != &other)
-         {
-            close();
-            handle_ = other.handle_;
-            ssl_ = other.ssl_;
-            ctx_ = other.ctx_;
-            uid_ = other.uid_;
-            mode_ = other.mode_;
-            state_ = other.state_;
-            ref_count_ = other.ref_count_;
-            send_timer_ = other.send_timer_;
-            recv_timer_ = other.recv_timer_;
-            if (ref_count_)
-            {
-               ++(*ref_count_);
-            }
-         }
-         return *this;
+         other.release();
       }
 
       socket_t& operator=(socket_t&& other) noexcept
@@ -703,20 +1627,15 @@ namespace rmlib {
             handle_ = other.handle_;
             ssl_ = other.ssl_;
             ctx_ = other.ctx_;
+            bio_ = std::move(other.bio_);
             uid_ = other.uid_;
             mode_ = other.mode_;
             state_ = other.state_;
-            ref_count_ = other.ref_count_;
             send_timer_ = other.send_timer_;
             recv_timer_ = other.recv_timer_;
+            counters_ = other.counters_;
             // invalidate other
-            other.handle_ = INVALID_SOCKET;
-            other.ssl_ = nullptr;
-            other.ctx_ = nullptr;
-            other.uid_ = 0;
-            other.mode_ = socket_mode_t::blocking;
-            other.state_ = socket_state_t::idle;
-            other.ref_count_ = nullptr;
+            other.release();
          }
          return *this;
       }
@@ -761,6 +1680,20 @@ namespace rmlib {
          recv_timer_.reset();
       }
 
+      // per socket I/O counters, an empty struct unless RMLIB_IO_METRICS
+      // enables a metrics policy
+      const io_metrics_policy_t::counters_t& counters() const noexcept
+      {
+         return counters_;
+      }
+
+      void reset_timers() noexcept
+      {
+         int64_t now = socket_timer_t::clock_t::now();
+         send_timer_.reset(now);
+         recv_timer_.reset(now);
+      }
+
       const SSL* ssl() const noexcept
       {
          return ssl_;
@@ -781,6 +1714,56 @@ namespace rmlib {
          return ctx_;
       }
 
+      // true if the TLS handshake resumed a previous session instead of performing a full handshake
+      bool is_resumed() const noexcept
+      {
+         return ssl_ && state_ == socket_state_t::connected && SSL_session_reused(ssl_) == 1;
+      }
+
+      // true if this TLS socket encrypts through user space ciphertext buffers
+      bool memory_bio_active() const noexcept
+      {
+         return bio_ != nullptr;
+      }
+
+      // bytes of ciphertext encrypted by send() but not yet taken by the
+      // kernel. Always zero unless memory BIO mode is active
+      size_t pending_send() const noexcept
+      {
+         return bio_ ? bio_->out.size() : 0;
+      }
+
+      // capacity of the outbound ciphertext buffer, zero unless memory BIO
+      // mode is active
+      size_t send_buffer_capacity() const noexcept
+      {
+         return bio_ ? bio_->out.capacity() : 0;
+      }
+
+      // send the ciphertext left over by a nonblocking send() in memory BIO
+      // mode. would_block() means wait for send_ready and call again. send()
+      // and recv() flush too, so this is only needed before the socket goes
+      // idle
+      socket::status_t flush() noexcept
+      {
+         if (!bio_ || bio_->out.empty()) return socket::status_t{};
+         socket::status_t status = bio_flush();
+         if (status.ok()) send_timer_.reset();
+         return status;
+      }
+
+      // true if the kernel encrypts records sent by this TLS socket
+      bool ktls_send_active() const noexcept
+      {
+         return ssl_ && BIO_get_ktls_send(SSL_get_wbio(ssl_)) == 1;
+      }
+
+      // true if the kernel decrypts records received by this TLS socket
+      bool ktls_recv_active() const noexcept
+      {
+         return ssl_ && BIO_get_ktls_recv(SSL_get_rbio(ssl_)) == 1;
+      }
+
       bool verify_peer_certificate() const noexcept
       {
          struct X509_deleter
@@ -803,9 +1786,9 @@ namespace rmlib {
          return false;
       }
 
-     socket::status_t connect(const ip::address_t& server, socket_mode_t mode = socket_mode_t::blocking) noexcept
+      socket::status_t connect(const ip::address_t& server, socket_mode_t mode = socket_mode_t::blocking, const socket_options_t& options = socket_options_t{}) noexcept
       {
-        socket::status_t status = tcp_connect(server, mode);
+         socket::status_t status = tcp_connect(server, mode, options);
          if (status.ok() && ssl_)
          {
             status = ssl_connect();
@@ -813,6 +1796,58 @@ namespace rmlib {
          return status;
       }
 
+      // connect without blocking, the socket is left nonblocking. connect()
+      // blocks until the TCP connection is established whatever the mode.
+      // would_block() means the TCP connect or the TLS handshake is in
+      // progress: wait for the readiness given by want_read() or want_write()
+      // and call handshake() to continue
+      socket::status_t begin_connect(const ip::address_t& server, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+         using enum socket_state_t;
+         if (state_ == opening || state_ == connecting) return handshake();
+         if (state_ != idle) return socket::status_t{ WSAEALREADY };
+         socket::status_t status;
+         if (status = create(server.family()); status.ok() && !options.is_default())
+         {
+            if (status = set_options(options); status.ok() && options.fast_open)
+            {
+#if defined(TCP_FASTOPEN_CONNECT)
+               status = set_option(IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+            }
+         }
+         if (status.ok()) status = set_blocking(socket_mode_t::nonblocking);
+         bool in_progress{ false };
+         if (status.ok())
+         {
+            if (::connect(handle_, server.address(), server.length()) == SOCKET_ERROR)
+            {
+               const int error = last_error();
+               in_progress = error == WSAEINPROGRESS || error == WSAEWOULDBLOCK;
+               if (!in_progress) status = socket::status_t{ error };
+            }
+         }
+         if (status.nok())
+         {
+            close();
+            return status;
+         }
+         generate_uid();
+         reset_timers();
+         if (ssl_)
+         {
+            attach_ssl();
+            resume_session(server);
+         }
+         if (in_progress)
+         {
+            state_ = opening;
+            return socket::status_t{ WSAEWOULDBLOCK, status_code_t::want_write };
+         }
+         state_ = ssl_ ? connecting : connected;
+         return ssl_ ? ssl_connect() : socket::status_t{};
+      }
+
       // if an error is returned, the connection is closed and resources released,
       // and the error condition only indicate a gracefull disconnection has not 
       // possible
@@ -828,6 +1863,8 @@ namespace rmlib {
                {
                   ssl_status = socket::status_t{ ssl_, ret };
                }
+               // the close_notify alert is still in the outbound buffer
+               if (bio_) bio_flush();
             }
             tcp_status = socket::status_t{ ::shutdown(handle_, static_cast<int>(how)) };
          }
@@ -836,12 +1873,116 @@ namespace rmlib {
          return tcp_status;
       }
 
-      socket::status_t listen(const ip::address_t& server, socket_mode_t mode = socket_mode_t::blocking, int backlog = SOCKET_DEFAULT_LISTEN_BACKLOG) noexcept
+      socket::status_t listen(const ip::address_t& server, socket_mode_t mode = socket_mode_t::blocking, int backlog = SOCKET_DEFAULT_LISTEN_BACKLOG, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+         return bind_and_listen(server, mode, backlog, options, false);
+      }
+
+      // listen with SO_REUSEPORT, so several sockets, normally one per reactor
+      // thread, listen on the same address and the kernel spreads incoming
+      // connections across them. See socket_listener_group_t. Returns
+      // WSAEOPNOTSUPP where SO_REUSEPORT does not balance connections (Windows)
+      socket::status_t listen_shared(const ip::address_t& server, socket_mode_t mode = socket_mode_t::blocking, int backlog = SOCKET_DEFAULT_LISTEN_BACKLOG, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+#if defined(SO_REUSEPORT)
+         return bind_and_listen(server, mode, backlog, options, true);
+#else
+         (void)server;
+         (void)mode;
+         (void)backlog;
+         (void)options;
+         return socket::status_t{ WSAEOPNOTSUPP };
+#endif
+      }
+
+      // ask the kernel to prefer this listening socket, among a SO_REUSEPORT
+      // group, for connections whose packets are processed on cpu. Linux only
+      socket::status_t set_incoming_cpu(int cpu) noexcept
+      {
+#if defined(SO_INCOMING_CPU)
+         return socket::status_t{ ::setsockopt(handle_, SOL_SOCKET, SO_INCOMING_CPU, reinterpret_cast<const char*>(&cpu), sizeof(cpu)) };
+#else
+         (void)cpu;
+         return socket::status_t{ WSAEOPNOTSUPP };
+#endif
+      }
+
+      // cpu that processed the packets of this connection, -1 if unknown
+      int incoming_cpu() const noexcept
+      {
+#if defined(SO_INCOMING_CPU)
+         int cpu{ -1 };
+         socklen_t len{ sizeof(cpu) };
+         if (::getsockopt(handle_, SOL_SOCKET, SO_INCOMING_CPU, reinterpret_cast<char*>(&cpu), &len) == 0) return cpu;
+#endif
+         return -1;
+      }
+
+      // address the socket is bound to, for example the port picked for port 0
+      ip::address_t local_address() const noexcept
+      {
+         sockaddr_storage name{};
+         socklen_t namelen{ sizeof(name) };
+         if (::getsockname(handle_, reinterpret_cast<sockaddr*>(&name), &namelen) == 0) return ip::address_t(name, namelen);
+         return ip::address_t{};
+      }
+
+      // apply the options that can change at any time. connect(), listen()
+      // and accept() call it for their options parameter; call it directly to
+      // retune a live connection
+      socket::status_t set_options(const socket_options_t& options) noexcept
+      {
+         if (handle_ == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         socket::status_t status;
+         if (options.no_delay && (status = set_option(IPPROTO_TCP, TCP_NODELAY, 1)).nok()) return status;
+         if (options.keep_alive && (status = set_option(SOL_SOCKET, SO_KEEPALIVE, 1)).nok()) return status;
+         if (options.send_buffer > 0 && (status = set_option(SOL_SOCKET, SO_SNDBUF, options.send_buffer)).nok()) return status;
+         if (options.recv_buffer > 0 && (status = set_option(SOL_SOCKET, SO_RCVBUF, options.recv_buffer)).nok()) return status;
+#if defined(TCP_QUICKACK)
+         if (options.quick_ack && (status = set_option(IPPROTO_TCP, TCP_QUICKACK, 1)).nok()) return status;
+#endif
+#if defined(SO_BUSY_POLL)
+         if (options.busy_poll_usecs > 0 && (status = set_option(SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_usecs)).nok()) return status;
+#endif
+         return status;
+      }
+
+   private:
+      socket::status_t set_option(int level, int name, int value) noexcept
+      {
+         return socket::status_t{ ::setsockopt(handle_, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) };
+      }
+
+      socket::status_t bind_and_listen(const ip::address_t& server, socket_mode_t mode, int backlog, const socket_options_t& options, bool reuse_port) noexcept
       {
          socket::status_t status;
          if (state_ != socket_state_t::idle) return socket::status_t{ WSAEALREADY };
-         if (status = create(server.family()); status.ok())
+         if (status = create(server.family()); status.nok())
+         {
+            return status;
+         }
+#if defined(SO_REUSEPORT)
+         if (reuse_port)
+         {
+            status = set_option(SOL_SOCKET, SO_REUSEPORT, 1);
+         }
+#else
+         (void)reuse_port;
+#endif
+         // buffer sizes set before listen() carry over to accepted sockets
+         if (status.ok() && !options.is_default())
+         {
+            status = set_options(options);
+         }
+#if defined(TCP_FASTOPEN) && !defined(XPLAT_WINSOCK)
+         if (status.ok() && options.fast_open)
+         {
+            status = set_option(IPPROTO_TCP, TCP_FASTOPEN, std::max(options.fast_open_queue, 1));
+         }
+#endif
+         if (status.nok())
          {
+            close();
             return status;
          }
          if (status = socket::status_t(::bind(handle_, server.address(), server.length())); status.ok())
@@ -862,29 +2003,84 @@ namespace rmlib {
          return status;
       }
 
-      socket::status_t accept(socket_t& client, socket_mode_t mode = socket_mode_t::blocking) noexcept
+   public:
+      // For TLS sockets the handshake is performed on client. If the handshake 
+      // would block, client is left in the accepting state and accept() should
+      // be called again with the same client, or client.handshake(), to
+      // continue the handshake
+      socket::status_t accept(socket_t& client, socket_mode_t mode = socket_mode_t::blocking, const socket_options_t& options = socket_options_t{}) noexcept
       {
-         socket::status_t status = tcp_accept(client, mode);
-         if (status.ok() && state_ == socket_state_t::accepting)
+         socket::status_t status;
+         if (client.state_ != socket_state_t::accepting)
          {
-            int ret{ SSL_accept(client.ssl_) };
-            if (ret <= 0)
+            if (status = measured_accept(client, mode, options); status.nok())
             {
-               if (status = socket::status_t{ client.ssl_, ret }; status.ok())
-               {
-                  client.state_ = socket_state_t::connected;
-               }
-               if (!status.ok() && !status.would_block())
-               {
-                  close();
-               }
-            }
-            else
-            {
-               state_ = socket_state_t::listening;
+               return status;
             }
          }
-         return status;
+         if (client.state_ == socket_state_t::accepting)
+         {
+            status = client.ssl_accept();
+         }
+         return status;
+      }
+
+      // accept the TCP connection only. A TLS client is left accepting, its
+      // handshake is driven by client.handshake(), so a slow client delays
+      // its own session and not the listener
+      socket::status_t begin_accept(socket_t& client, socket_mode_t mode = socket_mode_t::nonblocking, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+         if (state_ != socket_state_t::listening) return socket::status_t{ WSAEINVAL };
+         return measured_accept(client, mode, options);
+      }
+
+      // accept pending connections into clients until the backlog is drained
+      // or clients is full. The listener should be nonblocking, otherwise the
+      // drain blocks once the backlog is empty. accepted is the number of
+      // clients filled, from the front of the span. TLS clients start their
+      // handshake straight away; those that would block are left accepting,
+      // to be finished by handshake() when the poller reports them ready.
+      // Returns ok when at least one client was accepted, otherwise the
+      // accept error, would_block() when the backlog was empty
+      socket::status_t accept_many(std::span<socket_t> clients, size_t& accepted, socket_mode_t mode = socket_mode_t::nonblocking, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+         socket::status_t status;
+         accepted = 0;
+         if (state_ != socket_state_t::listening) return socket::status_t{ WSAEINVAL };
+         while (accepted < clients.size())
+         {
+            socket_t& client = clients[accepted];
+            if (status = measured_accept(client, mode, options); status.nok())
+            {
+               if (transient_accept_error(status)) continue;
+               break;
+            }
+            // a failed handshake closes the client, reuse its slot
+            if (client.state_ == socket_state_t::accepting && !client.ssl_accept().ok() && !client.is_handshaking()) continue;
+            ++accepted;
+         }
+         return accepted > 0 ? socket::status_t{} : status;
+      }
+
+      // continue a TLS handshake left in progress by a nonblocking accept()
+      // or connect(), or a connection started by begin_connect(). would_block()
+      // means wait for the readiness given by want_read() or want_write() and
+      // call again. Any other error closes the socket
+      socket::status_t handshake() noexcept
+      {
+         switch (state_)
+         {
+            case socket_state_t::opening: return finish_connect();
+            case socket_state_t::accepting: return ssl_accept();
+            case socket_state_t::connecting: return ssl_connect();
+            case socket_state_t::connected: return socket::status_t{};
+            default: return socket::status_t{ WSAENOTCONN };
+         }
+      }
+
+      bool is_handshaking() const noexcept
+      {
+         return state_ == socket_state_t::accepting || state_ == socket_state_t::connecting || state_ == socket_state_t::opening;
       }
 
       socket::status_t send(const char* buffer, size_t len, size_t& index, size_t& bytes_sent) noexcept
@@ -892,8 +2088,10 @@ namespace rmlib {
          socket::status_t status;
          bytes_sent = 0;
          if (index >= len) return status;
-         status = ssl_ ? ssl_send(buffer + index, (len - index), bytes_sent) 
-                       : tcp_send(buffer + index, (len - index), bytes_sent);
+         status = measure(ssl_ ? io_op_t::tls_send : io_op_t::tcp_send, len - index, bytes_sent, [&]() noexcept {
+            return ssl_ ? ssl_send(buffer + index, (len - index), bytes_sent) 
+                        : tcp_send(buffer + index, (len - index), bytes_sent);
+         });
          index += bytes_sent;
          return status;
       }
@@ -906,24 +2104,137 @@ namespace rmlib {
          return send(buffer.data(), buffer.size(), index, bytes_sent);
       }
 
+      // vectored send. index is the offset into the concatenation of all buffers
+      // and is advanced by bytes_sent, so a partial send is resumed by calling 
+      // send() again with the same buffers and index
+      socket::status_t send(std::span<const std::span<const char>> buffers, size_t& index, size_t& bytes_sent) noexcept
+      {
+         socket::status_t status;
+         bytes_sent = 0;
+         const size_t size = buffers_size(buffers);
+         if (index >= size) return status;
+         status = measure(ssl_ ? io_op_t::tls_send : io_op_t::tcp_send, size - index, bytes_sent, [&]() noexcept {
+            return ssl_ ? ssl_sendv(buffers, index, bytes_sent)
+                        : tcp_sendv(buffers, index, bytes_sent);
+         });
+         index += bytes_sent;
+         return status;
+      }
+
+      // send up to length bytes of file starting at offset, where file is a native
+      // file handle. TCP sockets send with sendfile, and TLS sockets with kernel
+      // TLS active send with SSL_sendfile, so the file is never copied to user
+      // space. Otherwise the file is read into a buffer and sent with send().
+      // bytes_sent is zero if offset is at or beyond the end of the file
+      socket::status_t send_file(HANDLE file, off64_t offset, size_t length, size_t& bytes_sent) noexcept
+      {
+         bytes_sent = 0;
+         if (length == 0) return socket::status_t{};
+         if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
+         if (ssl_)
+         {
+            if (!ktls_send_active()) return copy_send_file(file, offset, length, bytes_sent);
+            return measure(io_op_t::tls_send, 0, bytes_sent, [&]() noexcept { return ssl_send_file(file, offset, length, bytes_sent); });
+         }
+#if defined(XPLAT_OS_LINUX) || defined(XPLAT_BSD_SENDFILE)
+         return measure(io_op_t::tcp_send, 0, bytes_sent, [&]() noexcept { return tcp_send_file(file, offset, length, bytes_sent); });
+#else
+         // elsewhere the file may be copied through send(), which is measured already
+         return tcp_send_file(file, offset, length, bytes_sent);
+#endif
+      }
+
+      // send length bytes of an rmlib file object, such as fstream_t or llfio_t, 
+      // starting at offset. index is the number of bytes already sent and is
+      // advanced by bytes_sent, so a partial send is resumed by calling send_file()
+      // again with the same file, offset, length and index. Buffered writes of the
+      // file object are flushed first. status is WSAEINVAL if the file ends 
+      // before offset + length
+      template <NativeFileHandle F>
+      socket::status_t send_file(F& file, off64_t offset, size_t length, size_t& index, size_t& bytes_sent) noexcept
+      {
+         bytes_sent = 0;
+         if (index >= length) return socket::status_t{};
+         if constexpr (requires { file.flush(); })
+         {
+            file.flush();
+         }
+         socket::status_t status = send_file(file.native_handle(), offset + static_cast<off64_t>(index), length - index, bytes_sent);
+         if (status.ok() && bytes_sent == 0)
+         {
+            return socket::status_t{ WSAEINVAL };
+         }
+         index += bytes_sent;
+         return status;
+      }
+
       socket::status_t recv(char* buffer, size_t len, size_t& bytes_received) noexcept
       {
          bytes_received = 0;
-         return ssl_ ? ssl_recv(buffer, len, bytes_received)
-                     : tcp_recv(buffer, len, bytes_received);
+         return measure(ssl_ ? io_op_t::tls_recv : io_op_t::tcp_recv, 0, bytes_received, [&]() noexcept {
+            return ssl_ ? ssl_recv(buffer, len, bytes_received)
+                        : tcp_recv(buffer, len, bytes_received);
+         });
+      }
+
+      // vectored recv. buffers are filled in order and bytes_received is the
+      // total number of bytes received across all buffers
+      socket::status_t recv(std::span<const std::span<char>> buffers, size_t& bytes_received) noexcept
+      {
+         bytes_received = 0;
+         if (buffers_size(buffers) == 0) return socket::status_t{};
+         return measure(ssl_ ? io_op_t::tls_recv : io_op_t::tcp_recv, 0, bytes_received, [&]() noexcept {
+            return ssl_ ? ssl_recvv(buffers, bytes_received)
+                        : tcp_recvv(buffers, bytes_received);
+         });
+      }
+
+      // receive directly into caller owned memory, up to buffer.size() bytes
+      socket::status_t recv_into(std::span<char> buffer, size_t& bytes_received) noexcept
+      {
+         return recv(buffer.data(), buffer.size(), bytes_received);
+      }
+
+      // receive into the free tail of a pooled buffer and grow it by
+      // bytes_received. WSAENOBUFS when the buffer is full or not valid
+      socket::status_t recv(buffer_t& buffer, size_t& bytes_received) noexcept
+      {
+         bytes_received = 0;
+         if (buffer.available() == 0) return socket::status_t{ WSAENOBUFS };
+         socket::status_t status = recv(buffer.data() + buffer.size(), buffer.available(), bytes_received);
+         buffer.resize(buffer.size() + bytes_received);
+         return status;
+      }
+
+      // receive into buffer, acquiring a block of size bytes from pool when it
+      // is not valid. A buffer that is still empty afterwards goes back to the
+      // pool, so a connection holds buffer memory only while it has data
+      socket::status_t recv(buffer_pool_t& pool, buffer_t& buffer, size_t& bytes_received, size_t size = SOCKET_DEFAULT_RECV_SIZE) noexcept
+      {
+         bytes_received = 0;
+         if (!buffer)
+         {
+            buffer = pool.acquire(size);
+            if (!buffer) return socket::status_t{ WSAENOBUFS };
+         }
+         socket::status_t status = recv(buffer, bytes_received);
+         if (buffer.empty()) buffer.reset();
+         return status;
       }
 
       // T should be a containers with data(), size() and resize() methods 
-      // such as std::string and std::vector
+      // such as std::string and std::vector. Up to S bytes are received and
+      // appended to buffer. The tail of buffer is grown by S bytes before the
+      // call to recv and data is received in place, then buffer is shrunk to 
+      // the bytes actually received. Container capacity grows geometrically
+      // and is kept between calls, so no intermediate copy is made
       template <size_t S = SOCKET_DEFAULT_RECV_SIZE, DataSizeResizeContainer T>
       socket::status_t recv(T& buffer, size_t& bytes_received) noexcept
       {
-         std::array<typename T::value_type, S> temp;
-         socket::status_t status = recv(temp.data(), temp.size(), bytes_received);
-         if (bytes_received > 0)
-         {
-            std::copy(temp.begin(), temp.begin() + bytes_received, std::back_inserter(buffer));
-         }
+         size_t offset{ buffer.size() };
+         grow_tail(buffer, offset + S);
+         socket::status_t status = recv(reinterpret_cast<char*>(buffer.data()) + offset, S, bytes_received);
+         buffer.resize(offset + bytes_received);
          return status;
       }
 
@@ -960,11 +2271,32 @@ namespace rmlib {
          {
             return socket::status_t(WSAECONNREFUSED);
          }
-         if (event == connect_ready && fdset.events & POLLWRNORM)
+         if (event == connect_ready && fdset.revents & POLLWRNORM)
          {
             return socket::status_t{};
          }
-         return (fdset.events & (POLLHUP | POLLRDNORM | POLLWRNORM)) ? socket::status_t{} : socket::status_t{ WSAEWOULDBLOCK, get_code(event) };
+         return (fdset.revents & (POLLHUP | POLLRDNORM | POLLWRNORM)) ? socket::status_t{} : socket::status_t{ WSAEWOULDBLOCK, get_code(event) };
+      }
+
+      // true if an idle connection is still open and has nothing unread, so it
+      // can carry a new request. Never blocks and consumes no application
+      // data. TLS records without application data, such as session tickets
+      // sent after the handshake, are processed
+      bool is_reusable() noexcept
+      {
+         if (state_ != socket_state_t::connected) return false;
+         socket::status_t status = wait_event(socket_event_t::recv_ready, 0);
+         if (status.would_block()) return true;
+         if (status.nok()) return false;
+         // a readable TCP socket was either closed by the peer or holds data
+         // nobody asked for, neither can be reused
+         if (!ssl_) return false;
+         const socket_mode_t mode = mode_;
+         if (mode == socket_mode_t::blocking && set_blocking(socket_mode_t::nonblocking).nok()) return false;
+         char byte{};
+         bool reusable = ssl_call([&]() noexcept { return SSL_peek(ssl_, &byte, 1); }).would_block();
+         if (mode == socket_mode_t::blocking && set_blocking(mode).nok()) return false;
+         return reusable;
       }
 
    private:
@@ -986,10 +2318,70 @@ namespace rmlib {
          return status_code_t::want_read;
       }
 
+      template <typename T>
+      static size_t buffers_size(std::span<const std::span<T>> buffers) noexcept
+      {
+         size_t size{};
+         for (const auto& buffer : buffers) size += buffer.size();
+         return size;
+      }
+
+      // fill iov with buffers, skipping the first offset bytes and empty buffers
+      template <typename T>
+      static size_t make_iovec(std::span<const std::span<T>> buffers, size_t offset, std::span<socket_iovec_t> iov) noexcept
+      {
+         size_t count{};
+         for (const auto& buffer : buffers)
+         {
+            if (count == iov.size()) break;
+            if (offset >= buffer.size())
+            {
+               offset -= buffer.size();
+               continue;
+            }
+            iov[count++] = make_socket_iovec(const_cast<char*>(buffer.data()) + offset, buffer.size() - offset);
+            offset = 0;
+         }
+         return count;
+      }
+
+      // copy buffers, skipping the first offset bytes, into record
+      static size_t coalesce(std::span<const std::span<const char>> buffers, size_t offset, std::span<char> record) noexcept
+      {
+         size_t len{};
+         for (const auto& buffer : buffers)
+         {
+            if (len == record.size()) break;
+            if (offset >= buffer.size())
+            {
+               offset -= buffer.size();
+               continue;
+            }
+            size_t count = std::min(buffer.size() - offset, record.size() - len);
+            std::memcpy(record.data() + len, buffer.data() + offset, count);
+            len += count;
+            offset = 0;
+         }
+         return len;
+      }
+
+      template <DataSizeResizeContainer T>
+      static void grow_tail(T& buffer, size_t size) noexcept
+      {
+#if defined(__cpp_lib_string_resize_and_overwrite)
+         // avoid zero filling the tail for std::string
+         if constexpr (std::is_same_v<T, std::string>)
+         {
+            buffer.resize_and_overwrite(size, [](char*, size_t n) noexcept { return n; });
+            return;
+         }
+#endif
+         buffer.resize(size);
+      }
+
       void generate_uid() noexcept
       {
-         static std::atomic_uint64_t counter{ 1 };
-         uid_ = counter.fetch_add(1, std::memory_order_relaxed);
+         uid_ = next_socket_uid();
       }
 
       short set_events(socket_event_t event) const noexcept
@@ -1025,41 +2417,51 @@ namespace rmlib {
       socket::status_t close() noexcept
       {
          socket::status_t status;
-         if (ref_count_)
+         if (handle_ != INVALID_SOCKET)
          {
-            if (*ref_count_ == 1)
-            {
-               if (handle_ != INVALID_SOCKET)
-               {
-                  status = socket::status_t{ ::closesocket(handle_) };
-                  handle_ = INVALID_SOCKET;
-                  uid_ = 0;
-                  mode_ = socket_mode_t::blocking;
-                  state_ = socket_state_t::idle;
-               }
-               if (ssl_)
-               {
-                  SSL_free(ssl_);
-                  ssl_ = nullptr;
-               }
-               delete ref_count_;
-               ref_count_ = nullptr;
-            }
-            else
-            {
-               --(*ref_count_);
-            }
+            status = socket::status_t{ ::closesocket(handle_) };
+            handle_ = INVALID_SOCKET;
+            uid_ = 0;
+            mode_ = socket_mode_t::blocking;
+            state_ = socket_state_t::idle;
+         }
+         if (ssl_)
+         {
+            SSL_free(ssl_);
+            ssl_ = nullptr;
          }
+         // freed after the SSL object, its BIO points to the buffers
+         bio_.reset();
          return status;
       }
 
-      socket::status_t tcp_connect(const ip::address_t& server, socket_mode_t mode) noexcept
+      // forget resources that have been moved to another socket_t
+      void release() noexcept
+      {
+         handle_ = INVALID_SOCKET;
+         ssl_ = nullptr;
+         ctx_ = nullptr;
+         uid_ = 0;
+         mode_ = socket_mode_t::blocking;
+         state_ = socket_state_t::idle;
+      }
+
+      socket::status_t tcp_connect(const ip::address_t& server, socket_mode_t mode, const socket_options_t& options) noexcept
       {
          using enum socket_state_t;
          if (state_ == connecting) return socket::status_t{};
          if (state_ != idle) return socket::status_t{ WSAEALREADY };
          socket::status_t status;
-         if (create(server.family()); status.ok())
+         if (status = create(server.family()); status.ok() && !options.is_default())
+         {
+            if (status = set_options(options); status.ok() && options.fast_open)
+            {
+#if defined(TCP_FASTOPEN_CONNECT)
+               status = set_option(IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+            }
+         }
+         if (status.ok())
          {
             if (status = socket::status_t{ ::connect(handle_, server.address(), server.length()) }; status.ok())
             {
@@ -1075,65 +2477,314 @@ namespace rmlib {
          state_ = connected;
          if (ssl_)
          {
-            SSL_set_fd(ssl_, static_cast<int>(handle_));
+            attach_ssl();
+            resume_session(server);
             state_ = connecting;
          }
-         send_timer_.reset();
-         recv_timer_.reset();
+         reset_timers();
          return status;
       }
 
+      // complete a connect started by begin_connect() once the socket is writable
+      socket::status_t finish_connect() noexcept
+      {
+         socket::status_t status = wait_event(socket_event_t::connect_ready, SOCKET_WAIT_NEVER);
+         if (status.would_block()) return status;
+         int error{};
+         socklen_t length{ sizeof(error) };
+         if (::getsockopt(handle_, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) == SOCKET_ERROR) error = last_error();
+         if (error == 0 && status.nok()) error = status.error();
+         if (error != 0)
+         {
+            close();
+            return socket::status_t{ error };
+         }
+         state_ = ssl_ ? socket_state_t::connecting : socket_state_t::connected;
+         return ssl_ ? ssl_connect() : socket::status_t{};
+      }
+
+      // bind the SSL object to the socket, or to ciphertext buffers when the
+      // context enabled memory BIO mode. Without memory for the buffers the
+      // socket falls back to direct binding
+      void attach_ssl() noexcept
+      {
+         if (size_t size = tls::memory_bio_size(ctx_); size > 0)
+         {
+            bio_.reset(new (std::nothrow) tls::bio_state_t(size, static_cast<int>(handle_)));
+            if (bio_ && tls::bio::attach(ssl_, bio_.get()))
+            {
+#if defined(SSL_OP_IGNORE_UNEXPECTED_EOF)
+               // a peer closing without close_notify reads as closing, as it
+               // does with direct binding
+               SSL_set_options(ssl_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+               return;
+            }
+            bio_.reset();
+         }
+         SSL_set_fd(ssl_, static_cast<int>(handle_));
+      }
+
+      // run call, an SSL function returning 1 on success. In memory BIO mode
+      // the ciphertext it produced is sent afterwards and, while OpenSSL
+      // wants more input, the inbound buffer is refilled with one recv and
+      // call is retried. A nonblocking socket that cannot send the pending
+      // ciphertext reports want_write instead of waiting for a reply that
+      // cannot come
+      template <typename F>
+      socket::status_t ssl_call(F&& call) noexcept
+      {
+         for (;;)
+         {
+            int ret = call();
+            socket::status_t status = ret > 0 ? socket::status_t{} : socket::status_t{ ssl_, ret };
+            if (!bio_) return status;
+            if (socket::status_t flushed = bio_flush(); flushed.nok() && !flushed.would_block()) return flushed;
+            if (!status.want_read()) return status;
+            if (!bio_->out.empty()) return socket::status_t{ WSAEWOULDBLOCK, status_code_t::want_write };
+            if (socket::status_t filled = bio_fill(); filled.nok()) return filled;
+         }
+      }
+
+      // receive as much ciphertext as fits in the inbound buffer
+      socket::status_t bio_fill() noexcept
+      {
+         std::span<char> space = bio_->in.space(SOCKET_TLS_MAX_RECORD_SIZE);
+         if (space.empty()) return socket::status_t{ WSAENOBUFS };
+         int ret = ::recv(handle_, space.data(), static_cast<int>(space.size()), 0);
+         if (ret == SOCKET_ERROR)
+         {
+            return socket::status_t{ last_error(), status_code_t::want_read };
+         }
+         if (ret == 0)
+         {
+            bio_->eof = true;
+            return socket::status_t{ 0, status_code_t::closing };
+         }
+         bio_->in.commit(static_cast<size_t>(ret));
+         return socket::status_t{};
+      }
+
+      // send the outbound ciphertext. Blocking sockets send all of it, 
+      // nonblocking sockets keep what the kernel did not take
+      socket::status_t bio_flush() noexcept
+      {
+         while (!bio_->out.empty())
+         {
+            std::span<const char> data = bio_->out.data();
+            int ret = ::send(handle_, data.data(), static_cast<int>(data.size()), 0);
+            if (ret == SOCKET_ERROR)
+            {
+               return socket::status_t{ last_error(), status_code_t::want_write };
+            }
+            bio_->out.consume(static_cast<size_t>(ret));
+         }
+         return socket::status_t{};
+      }
+
+      // memory BIO mode does not encrypt more while earlier ciphertext is
+      // still waiting for the kernel, and bio_send() encrypts no more than
+      // fits, so the outbound buffer stays bounded
+      socket::status_t bio_ready_to_send() noexcept
+      {
+         if (bio_ && !bio_->out.empty())
+         {
+            if (socket::status_t status = bio_flush(); status.nok()) return status;
+         }
+         return socket::status_t{};
+      }
+
+      // plaintext bytes the next record may carry so that its ciphertext
+      // still fits in the outbound buffer. An empty buffer always takes one
+      // record, whatever its capacity
+      size_t bio_record_budget() const noexcept
+      {
+         const size_t used = bio_->out.size() + SSL3_RT_MAX_ENCRYPTED_OVERHEAD;
+         const size_t capacity = bio_->out.capacity();
+         if (used < capacity) return std::min(capacity - used, SOCKET_TLS_MAX_RECORD_SIZE);
+         return bio_->out.empty() ? SOCKET_TLS_MAX_RECORD_SIZE : 0;
+      }
+
+      // encrypt one record at a time into the outbound buffer while its
+      // ciphertext fits, then send the records together. next(offset, budget)
+      // returns up to budget bytes of plaintext starting at offset
+      template <typename F>
+      socket::status_t bio_send(size_t& bytes_sent, F&& next) noexcept
+      {
+         while (size_t budget = bio_record_budget())
+         {
+            std::span<const char> plaintext = next(bytes_sent, budget);
+            if (plaintext.empty()) break;
+            size_t count{};
+            if (int ret = SSL_write_ex(ssl_, plaintext.data(), plaintext.size(), &count); ret <= 0)
+            {
+               // report the records already encrypted, the error is reported by the next call
+               if (bytes_sent > 0) break;
+               return socket::status_t{ ssl_, ret };
+            }
+            bytes_sent += count;
+         }
+         if (socket::status_t status = bio_flush(); status.nok() && !status.would_block()) return status;
+         send_timer_.reset();
+         return socket::status_t();
+      }
+
+      // offer the cached session of server, if the context has a session cache
+      void resume_session(const ip::address_t& server) noexcept
+      {
+         if (tls::session_cache_t* cache = tls::session_cache(ctx_); cache)
+         {
+            if (SSL_SESSION* session = cache->find(tls::session_cache_t::key(server.address(), server.length())); session)
+            {
+               SSL_set_session(ssl_, session);
+               SSL_SESSION_free(session);
+            }
+         }
+      }
+
       socket::status_t ssl_connect() noexcept
       {
-         if (int ret{ SSL_connect(ssl_) }; ret <= 0)
+         handshake_started();
+         if (socket::status_t status = ssl_call([this]() noexcept { return SSL_connect(ssl_); }); status.nok())
+         {
+            if (!status.would_block())
+            {
+               handshake_finished(status);
+               close();
+            }
+            return status;
+         }
+         state_ = socket_state_t::connected;
+         handshake_finished(socket::status_t{});
+         return socket::status_t{};
+      }
+
+      socket::status_t ssl_accept() noexcept
+      {
+         handshake_started();
+         if (socket::status_t status = ssl_call([this]() noexcept { return SSL_accept(ssl_); }); status.nok())
          {
-            socket::status_t status{ ssl_, ret };
-            if (!status.ok() && !status.would_block())
+            if (!status.would_block())
             {
+               handshake_finished(status);
                close();
             }
             return status;
          }
          state_ = socket_state_t::connected;
+         handshake_finished(socket::status_t{});
          return socket::status_t{};
       }
 
-      socket::status_t tcp_accept(socket_t& client, socket_mode_t mode, ip::address_t& address) noexcept
+      // run io, which moves transferred bytes, under the metrics policy
+      template <typename F>
+      socket::status_t measure(io_op_t op, size_t requested, const size_t& transferred, F&& io) noexcept
+      {
+         if constexpr (io_metrics_policy_t::enabled)
+         {
+            const int64_t start = io_metrics_policy_t::start();
+            socket::status_t status = io();
+            io_metrics_policy_t::record(counters_, op, transferred, io_result(status, requested, transferred), start);
+            return status;
+         }
+         else
+         {
+            return io();
+         }
+      }
+
+      // a nonblocking handshake spans several calls, it is timed from the first
+      void handshake_started() noexcept
+      {
+         io_metrics_policy_t::handshake_started(counters_);
+      }
+
+      void handshake_finished(const socket::status_t& status) noexcept
+      {
+         io_metrics_policy_t::handshake_finished(counters_, io_result(status, 0, 0));
+      }
+
+      socket::status_t tcp_accept(socket_t& client, socket_mode_t mode, const socket_options_t& options, ip::address_t& address) noexcept
       {
          socket::status_t status;
-         if (state_ == socket_state_t::accepting) return status;
          socket_t socket;
-         sockaddr name{};
-         socklen_t namelen{};
-         if (socket.handle_ = ::accept(handle_, &name, &namelen); socket.handle_ == INVALID_SOCKET)
+         sockaddr_storage name{};
+         socklen_t namelen{ sizeof(name) };
+#if defined(XPLAT_OS_LINUX)
+         // accept4 sets the file flags in the same syscall
+         const int flags{ SOCK_CLOEXEC | (mode == socket_mode_t::nonblocking ? SOCK_NONBLOCK : 0) };
+         if (socket.handle_ = ::accept4(handle_, reinterpret_cast<sockaddr*>(&name), &namelen, flags); socket.handle_ == INVALID_SOCKET)
          {
-            return socket::status_t{ last_error() };
+            return socket::status_t{ last_error(), status_code_t::want_read };
          }
-         if (status = socket.set_blocking(mode); status.nok())
+#else
+         if (socket.handle_ = ::accept(handle_, reinterpret_cast<sockaddr*>(&name), &namelen); socket.handle_ == INVALID_SOCKET)
          {
-            socket.close();
-            return status;
+            return socket::status_t{ last_error(), status_code_t::want_read };
+         }
+         // the accepted socket inherits the blocking mode of the listener,
+         // only switch it when the caller asked for the other mode
+         if (mode != mode_)
+         {
+            if (status = socket.set_blocking(mode); status.nok())
+            {
+               socket.close();
+               return status;
+            }
+         }
+#endif
+         if (!options.is_default())
+         {
+            if (status = socket.set_options(options); status.nok())
+            {
+               socket.close();
+               return status;
+            }
          }
          socket.mode_ = mode;
          socket.state_ = socket_state_t::connected;
          socket.generate_uid();
          address = ip::address_t(name, namelen);
-         if (ssl_)
+         if (ctx_)
          {
             socket.ctx_ = ctx_;
             socket.ssl_ = SSL_new(ctx_);
-            SSL_set_fd(socket.ssl_, static_cast<int>(socket.handle_));
+            socket.attach_ssl();
+            socket.state_ = socket_state_t::accepting;
          }
-         client = socket;
-         client.send_timer_.reset();
-         client.recv_timer_.reset();
+         client = std::move(socket);
+         client.reset_timers();
          return status;
       }
 
-      socket::status_t tcp_accept(socket_t& client, socket_mode_t mode) noexcept
+      socket::status_t tcp_accept(socket_t& client, socket_mode_t mode, const socket_options_t& options) noexcept
       {
          ip::address_t address;
-         return tcp_accept(client, mode, address);
+         return tcp_accept(client, mode, options, address);
+      }
+
+      socket::status_t measured_accept(socket_t& client, socket_mode_t mode, const socket_options_t& options) noexcept
+      {
+         const size_t none{};
+         return measure(io_op_t::accept, 0, none, [&]() noexcept { return tcp_accept(client, mode, options); });
+      }
+
+      // errors reported by accept for a connection that died in the backlog,
+      // the listener itself is still fine
+      static bool transient_accept_error(const socket::status_t& status) noexcept
+      {
+         switch (status.error())
+         {
+            case WSAECONNABORTED:
+            case WSAECONNRESET:
+#if !defined(XPLAT_WINSOCK)
+            case EPROTO:
+            case EPERM:
+#endif
+               return true;
+            default:
+               return false;
+         }
       }
 
       socket::status_t tcp_send(const char* buffer, size_t len, size_t& bytes_sent) noexcept
@@ -1152,39 +2803,262 @@ namespace rmlib {
       socket::status_t ssl_send(const char* buffer, size_t len, size_t& bytes_sent) noexcept
       {
          if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
-         if (int ret = SSL_write_ex(ssl_, buffer, len, &bytes_sent); ret <= 0)
+         if (socket::status_t status = bio_ready_to_send(); status.nok()) return status;
+         if (bio_)
          {
-            return socket::status_t{ ssl_, ret };
+            return bio_send(bytes_sent, [&](size_t offset, size_t budget) noexcept {
+               return std::span<const char>{ buffer + offset, std::min(len - offset, budget) };
+            });
+         }
+         if (socket::status_t status = ssl_call([&]() noexcept { return SSL_write_ex(ssl_, buffer, len, &bytes_sent); }); status.nok())
+         {
+            return status;
          }
          send_timer_.reset();
          return socket::status_t();
       }
 
-      // if status_t::ok() == true and bytes_received == 0, then peer closing connection
-      socket::status_t tcp_recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      socket::status_t tcp_sendv(std::span<const std::span<const char>> buffers, size_t index, size_t& bytes_sent) noexcept
       {
          if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
-         int ret = ::recv(handle_, buffer, static_cast<int>(len), 0);
-         bytes_received = 0;
-         if (ret == SOCKET_ERROR)
+         std::array<socket_iovec_t, SOCKET_MAX_IOVEC> iov;
+         size_t count = make_iovec(buffers, index, iov);
+#if defined(XPLAT_WINSOCK)
+         DWORD sent{};
+         if (::WSASend(handle_, iov.data(), static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
          {
-            return socket::status_t{ last_error(), status_code_t::want_read };
+            return socket::status_t{ last_error(), status_code_t::want_write };
          }
-         else if (ret == 0)
+         bytes_sent = static_cast<size_t>(sent);
+#else
+         ssize_t ret = ::writev(handle_, iov.data(), static_cast<int>(count));
+         if (ret == SOCKET_ERROR)
          {
-            return socket::status_t{ 0, status_code_t::closing };
+            return socket::status_t{ last_error(), status_code_t::want_write };
          }
-         bytes_received = static_cast<size_t>(ret);
-         recv_timer_.reset();
+         bytes_sent = static_cast<size_t>(ret);
+#endif
+         send_timer_.reset();
          return socket::status_t();
       }
 
-      socket::status_t ssl_recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      // buffers are coalesced into a single TLS record. A send that would block 
+      // is retried from the same index, so the record has the same content and 
+      // length and SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER allows the new address.
+      // In memory BIO mode records are encrypted while their ciphertext fits
+      // in the outbound buffer and then sent together with one syscall
+      socket::status_t ssl_sendv(std::span<const std::span<const char>> buffers, size_t index, size_t& bytes_sent) noexcept
       {
          if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
-         if (int ret = SSL_read_ex(ssl_, buffer, len, &bytes_received); ret <= 0)
+         if (socket::status_t status = bio_ready_to_send(); status.nok()) return status;
+         std::array<char, SOCKET_TLS_MAX_RECORD_SIZE> record;
+         if (bio_)
          {
-            return socket::status_t{ ssl_, ret};
+            return bio_send(bytes_sent, [&](size_t offset, size_t budget) noexcept {
+               std::span<char> chunk{ record.data(), budget };
+               return std::span<const char>{ record.data(), coalesce(buffers, index + offset, chunk) };
+            });
+         }
+         size_t len = coalesce(buffers, index, record);
+         if (int ret = SSL_write_ex(ssl_, record.data(), len, &bytes_sent); ret <= 0)
+         {
+            return socket::status_t{ ssl_, ret };
+         }
+         send_timer_.reset();
+         return socket::status_t();
+      }
+
+      socket::status_t tcp_recvv(std::span<const std::span<char>> buffers, size_t& bytes_received) noexcept
+      {
+         if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
+         std::array<socket_iovec_t, SOCKET_MAX_IOVEC> iov;
+         size_t count = make_iovec(buffers, 0, iov);
+#if defined(XPLAT_WINSOCK)
+         DWORD received{};
+         DWORD flags{};
+         if (::WSARecv(handle_, iov.data(), static_cast<DWORD>(count), &received, &flags, nullptr, nullptr) == SOCKET_ERROR)
+         {
+            return socket::status_t{ last_error(), status_code_t::want_read };
+         }
+         size_t ret = static_cast<size_t>(received);
+#else
+         ssize_t ret = ::readv(handle_, iov.data(), static_cast<int>(count));
+         if (ret == SOCKET_ERROR)
+         {
+            return socket::status_t{ last_error(), status_code_t::want_read };
+         }
+#endif
+         if (ret == 0)
+         {
+            return socket::status_t{ 0, status_code_t::closing };
+         }
+         bytes_received = static_cast<size_t>(ret);
+         recv_timer_.reset();
+         return socket::status_t();
+      }
+
+      // fill buffers in order with TLS records. The first read may block, further 
+      // reads are only issued while OpenSSL or the inbound ciphertext buffer 
+      // has data buffered so no extra recv syscall is made
+      socket::status_t ssl_recvv(std::span<const std::span<char>> buffers, size_t& bytes_received) noexcept
+      {
+         if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
+         for (const auto& buffer : buffers)
+         {
+            size_t offset{};
+            while (offset < buffer.size())
+            {
+               if (bytes_received > 0 && SSL_pending(ssl_) == 0 && (!bio_ || bio_->in.empty())) break;
+               size_t count{};
+               if (bytes_received == 0)
+               {
+                  if (socket::status_t status = ssl_call([&]() noexcept { return SSL_read_ex(ssl_, buffer.data() + offset, buffer.size() - offset, &count); }); status.nok())
+                  {
+                     return status;
+                  }
+               }
+               else if (SSL_read_ex(ssl_, buffer.data() + offset, buffer.size() - offset, &count) <= 0)
+               {
+                  // report the bytes already received, the error is reported by the next call
+                  break;
+               }
+               offset += count;
+               bytes_received += count;
+            }
+            if (offset < buffer.size()) break;
+         }
+         recv_timer_.reset();
+         return socket::status_t();
+      }
+
+      static socket::status_t read_file(HANDLE file, off64_t offset, char* buffer, size_t len, size_t& bytes_read) noexcept
+      {
+         bytes_read = 0;
+#if defined(XPLAT_OS_WINDOWS)
+         OVERLAPPED overlapped{};
+         overlapped.Offset = low32(static_cast<uint64_t>(offset));
+         overlapped.OffsetHigh = high32(static_cast<uint64_t>(offset));
+         DWORD count{};
+         if (!::ReadFile(file, buffer, static_cast<DWORD>(len), &count, &overlapped) && ::GetLastError() != ERROR_HANDLE_EOF)
+         {
+            return socket::status_t{ xlate_windows_error_code(::GetLastError()) };
+         }
+         bytes_read = static_cast<size_t>(count);
+#else
+         ssize_t ret = ::pread(file, buffer, len, offset);
+         if (ret == -1)
+         {
+            return socket::status_t{ errno };
+         }
+         bytes_read = static_cast<size_t>(ret);
+#endif
+         return socket::status_t{};
+      }
+
+      // user space file transfer. A send that would block is retried from the same
+      // offset, so a TLS record is retried with the same content and length
+      socket::status_t copy_send_file(HANDLE file, off64_t offset, size_t length, size_t& bytes_sent) noexcept
+      {
+         std::array<char, SOCKET_TLS_MAX_RECORD_SIZE> chunk;
+         size_t count{};
+         if (socket::status_t status = read_file(file, offset, chunk.data(), std::min(length, chunk.size()), count); status.nok() || count == 0)
+         {
+            return status;
+         }
+         size_t index{};
+         return send(chunk.data(), count, index, bytes_sent);
+      }
+
+      socket::status_t tcp_send_file(HANDLE file, off64_t offset, size_t length, size_t& bytes_sent) noexcept
+      {
+#if defined(XPLAT_OS_LINUX)
+         off_t file_offset{ static_cast<off_t>(offset) };
+         ssize_t ret = ::sendfile(handle_, file, &file_offset, length);
+         if (ret == SOCKET_ERROR)
+         {
+            return socket::status_t{ last_error(), status_code_t::want_write };
+         }
+         bytes_sent = static_cast<size_t>(ret);
+#elif defined(XPLAT_BSD_SENDFILE)
+         // BSD sendfile reports partial progress together with EAGAIN
+   #if defined(XPLAT_OS_MACOS)
+         off_t sent{ static_cast<off_t>(length) };
+         int ret = ::sendfile(file, handle_, static_cast<off_t>(offset), &sent, nullptr, 0);
+   #else
+         off_t sent{};
+         int ret = ::sendfile(file, handle_, static_cast<off_t>(offset), length, nullptr, &sent, 0);
+   #endif
+         if (ret == SOCKET_ERROR && (sent == 0 || last_error() != EAGAIN))
+         {
+            return socket::status_t{ last_error(), status_code_t::want_write };
+         }
+         bytes_sent = static_cast<size_t>(sent);
+#elif defined(XPLAT_OS_WINDOWS)
+         // TransmitFile sends all or nothing and cannot report partial progress of
+         // a nonblocking socket without overlapped I/O, nonblocking sockets copy
+         if (mode_ == socket_mode_t::nonblocking || length > static_cast<size_t>(MAXDWORD - 1))
+         {
+            return copy_send_file(file, offset, length, bytes_sent);
+         }
+         LARGE_INTEGER position{};
+         position.QuadPart = offset;
+         if (!::SetFilePointerEx(file, position, nullptr, FILE_BEGIN))
+         {
+            return socket::status_t{ xlate_windows_error_code(::GetLastError()) };
+         }
+         if (!::TransmitFile(handle_, file, static_cast<DWORD>(length), 0, nullptr, nullptr, 0))
+         {
+            return socket::status_t{ last_error(), status_code_t::want_write };
+         }
+         bytes_sent = length;
+#else
+         return copy_send_file(file, offset, length, bytes_sent);
+#endif
+         send_timer_.reset();
+         return socket::status_t();
+      }
+
+      socket::status_t ssl_send_file(HANDLE file, off64_t offset, size_t length, size_t& bytes_sent) noexcept
+      {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(XPLAT_OS_WINDOWS)
+         ossl_ssize_t ret = SSL_sendfile(ssl_, file, static_cast<off_t>(offset), length, 0);
+         if (ret < 0)
+         {
+            return socket::status_t{ ssl_, static_cast<int>(ret) };
+         }
+         bytes_sent = static_cast<size_t>(ret);
+         send_timer_.reset();
+         return socket::status_t();
+#else
+         return copy_send_file(file, offset, length, bytes_sent);
+#endif
+      }
+
+      // if status_t::ok() == true and bytes_received == 0, then peer closing connection
+      socket::status_t tcp_recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      {
+         if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
+         int ret = ::recv(handle_, buffer, static_cast<int>(len), 0);
+         bytes_received = 0;
+         if (ret == SOCKET_ERROR)
+         {
+            return socket::status_t{ last_error(), status_code_t::want_read };
+         }
+         else if (ret == 0)
+         {
+            return socket::status_t{ 0, status_code_t::closing };
+         }
+         bytes_received = static_cast<size_t>(ret);
+         recv_timer_.reset();
+         return socket::status_t();
+      }
+
+      socket::status_t ssl_recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      {
+         if (state_ != socket_state_t::connected) return socket::status_t{ WSAENOTCONN };
+         if (socket::status_t status = ssl_call([&]() noexcept { return SSL_read_ex(ssl_, buffer, len, &bytes_received); }); status.nok())
+         {
+            return status;
          }
          recv_timer_.reset();
          return socket::status_t();
@@ -1192,6 +3066,611 @@ namespace rmlib {
 
    }; // class socket_t
 
+   using unique_socket_t = socket_t;
+
+   /**************************************************************************\
+   *
+   *  shared_socket_t
+   *  Shared ownership of a socket_t with an intrusive atomic reference count.
+   *  The reference count and the socket_t are allocated together, once, when 
+   *  the shared_socket_t is created from a socket_t. Copies only increment the
+   *  reference count and can be handed to other threads. The last owner closes
+   *  the socket. The socket_t itself is not synchronized: threads sharing a
+   *  socket must not use it concurrently, except one sending while another
+   *  receives on a TCP socket
+   *
+   \**************************************************************************/
+   class shared_socket_t
+   {
+      struct control_block_t
+      {
+         std::atomic<unsigned> count_{ 1 };
+         socket_t socket_;
+
+         explicit control_block_t(socket_t&& socket) noexcept
+            : socket_{ std::move(socket) }
+         {}
+      };
+
+      control_block_t* block_{};
+
+   public:
+      shared_socket_t() noexcept = default;
+
+      explicit shared_socket_t(socket_t&& socket) noexcept
+         : block_{ new (std::nothrow) control_block_t(std::move(socket)) }
+      {}
+
+      ~shared_socket_t() noexcept
+      {
+         reset();
+      }
+
+      shared_socket_t(const shared_socket_t& other) noexcept
+         : block_{ other.block_ }
+      {
+         if (block_)
+         {
+            block_->count_.fetch_add(1, std::memory_order_relaxed);
+         }
+      }
+
+      shared_socket_t(shared_socket_t&& other) noexcept
+         : block_{ other.block_ }
+      {
+         other.block_ = nullptr;
+      }
+
+      shared_socket_t& operator=(const shared_socket_t& other) noexcept
+      {
+         if (this != &other)
+         {
+            shared_socket_t temp{ other };
+            swap(*this, temp);
+         }
+         return *this;
+      }
+
+      shared_socket_t& operator=(shared_socket_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            reset();
+            block_ = other.block_;
+            other.block_ = nullptr;
+         }
+         return *this;
+      }
+
+      friend void swap(shared_socket_t& lhs, shared_socket_t& rhs) noexcept
+      {
+         std::swap(lhs.block_, rhs.block_);
+      }
+
+      // release this owner, the socket is closed when the last owner is released
+      void reset() noexcept
+      {
+         if (block_ && block_->count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+         {
+            delete block_;
+         }
+         block_ = nullptr;
+      }
+
+      socket_t* get() const noexcept
+      {
+         return block_ ? &block_->socket_ : nullptr;
+      }
+
+      socket_t& operator*() const noexcept
+      {
+         return block_->socket_;
+      }
+
+      socket_t* operator->() const noexcept
+      {
+         return &block_->socket_;
+      }
+
+      explicit operator bool() const noexcept
+      {
+         return block_ != nullptr;
+      }
+
+      unsigned use_count() const noexcept
+      {
+         return block_ ? block_->count_.load(std::memory_order_relaxed) : 0;
+      }
+   }; // class shared_socket_t
+
+   /**************************************************************************\
+   *
+   *  socket_listener_group_t
+   *  N listening sockets on one address so accepts scale across reactor
+   *  threads, each thread owning listener(i) in its own poller. Where
+   *  SO_REUSEPORT is available the kernel load balances new connections
+   *  across the sockets. Elsewhere, Windows in particular, the group holds a
+   *  single listening socket that every shard shares
+   *
+   \**************************************************************************/
+   class socket_listener_group_t
+   {
+      std::vector<socket_t> listeners_;
+      size_t shards_{};
+      ip::address_t address_;
+
+   public:
+      socket_listener_group_t() = default;
+      socket_listener_group_t(const socket_listener_group_t&) = delete;
+      socket_listener_group_t(socket_listener_group_t&&) noexcept = default;
+      socket_listener_group_t& operator=(const socket_listener_group_t&) = delete;
+      socket_listener_group_t& operator=(socket_listener_group_t&&) noexcept = default;
+
+      ~socket_listener_group_t() noexcept
+      {
+         close();
+      }
+
+      // port 0 picks a free port for the first listener and reuses it for the rest
+      socket::status_t listen(const ip::address_t& server, size_t shards, socket_mode_t mode = socket_mode_t::blocking, int backlog = SOCKET_DEFAULT_LISTEN_BACKLOG, const socket_options_t& options = socket_options_t{}) noexcept
+      {
+         if (!listeners_.empty()) return socket::status_t{ WSAEALREADY };
+         if (shards == 0) return socket::status_t{ WSAEINVAL };
+         shards_ = shards;
+#if defined(SO_REUSEPORT)
+         const size_t count = shards;
+#else
+         const size_t count = 1;
+#endif
+         try
+         {
+            listeners_.resize(count);
+         }
+         catch (...)
+         {
+            return socket::status_t{ WSAENOBUFS };
+         }
+         address_ = server;
+         for (size_t i = 0; i < count; ++i)
+         {
+#if defined(SO_REUSEPORT)
+            socket::status_t status = listeners_[i].listen_shared(address_, mode, backlog, options);
+#else
+            socket::status_t status = listeners_[i].listen(address_, mode, backlog, options);
+#endif
+            if (status.nok())
+            {
+               close();
+               return status;
+            }
+            if (i == 0) address_ = listeners_[0].local_address();
+         }
+         return socket::status_t{};
+      }
+
+      void close() noexcept
+      {
+         for (socket_t& listener : listeners_) listener.disconnect();
+         listeners_.clear();
+         shards_ = 0;
+      }
+
+      // number of shards, listener(i) is valid for i < size()
+      size_t size() const noexcept
+      {
+         return shards_;
+      }
+
+      bool empty() const noexcept
+      {
+         return shards_ == 0;
+      }
+
+      // true when every shard has its own listening socket
+      bool is_sharded() const noexcept
+      {
+         return listeners_.size() > 1 || shards_ == 1;
+      }
+
+      socket_t& listener(size_t shard) noexcept
+      {
+         return listeners_[shard % listeners_.size()];
+      }
+
+      socket_t& operator[](size_t shard) noexcept
+      {
+         return listener(shard);
+      }
+
+      // bound address, with the actual port when listening on port 0
+      const ip::address_t& address() const noexcept
+      {
+         return address_;
+      }
+
+      // pair shard i with cpus[i % cpus.size()]: the shard's listener prefers
+      // connections processed on that cpu. Pin the shard's reactor thread to the
+      // same cpu with set_thread_affinity() to keep a connection on one core
+      socket::status_t set_incoming_cpus(std::span<const int> cpus) noexcept
+      {
+         if (cpus.empty() || !is_sharded()) return socket::status_t{ WSAEINVAL };
+         for (size_t i = 0; i < listeners_.size(); ++i)
+         {
+            if (socket::status_t status = listeners_[i].set_incoming_cpu(cpus[i % cpus.size()]); status.nok()) return status;
+         }
+         return socket::status_t{};
+      }
+   }; // class socket_listener_group_t
+
+   /**************************************************************************\
+   *
+   *  socket_poller_t
+   *  epoll (Linux) or wepoll (Windows) reactor. Sockets are registered with
+   *  their SOCKET handle and uid(), and wait() returns the uid of every ready
+   *  socket from a single call to epoll_wait, so the cost of each loop is 
+   *  proportional to the number of active sockets, not registered sockets.
+   *
+   *  Edge triggered interest is the default. With edge triggered interest the
+   *  caller must send or recv until the operation would block before waiting
+   *  again. wepoll does not support EPOLLET, and on Windows sockets are always
+   *  polled with level triggered interest, which is a superset of edge.
+   *
+   *  socket_poller_t does not own the sockets. Remove a socket before closing
+   *  it. A socket_poller_t instance should be driven by a single thread
+   *
+   \**************************************************************************/
+   enum class socket_interest_t : unsigned { none = 0x00, recv = 0x01, send = 0x02, both = 0x03 };
+   enum class socket_trigger_t { level, edge };
+
+   constexpr socket_interest_t operator|(socket_interest_t lhs, socket_interest_t rhs) noexcept
+   {
+      return static_cast<socket_interest_t>(static_cast<unsigned>(lhs) | static_cast<unsigned>(rhs));
+   }
+
+   constexpr socket_interest_t operator&(socket_interest_t lhs, socket_interest_t rhs) noexcept
+   {
+      return static_cast<socket_interest_t>(static_cast<unsigned>(lhs) & static_cast<unsigned>(rhs));
+   }
+
+   // accept_ready is a recv interest and connect_ready is a send interest
+   constexpr socket_interest_t socket_interest(socket_event_t event) noexcept
+   {
+      using enum socket_event_t;
+      return (event == recv_ready || event == accept_ready) ? socket_interest_t::recv : socket_interest_t::send;
+   }
+
+   // the poller timer wheel reads the clock wait() refreshes on every wakeup
+   using socket_timer_wheel_t = basic_timer_wheel_t<cached_clock_t>;
+
+   struct socket_ready_t
+   {
+      uid_t uid{};
+      unsigned events{};
+      timer_kind_t timer{ timer_kind_t::none };
+
+      // a timeout scheduled with socket_poller_t::schedule_timeout() expired,
+      // events is 0 and timer tells which kind
+      bool timeout() const noexcept
+      {
+         return timer != timer_kind_t::none;
+      }
+
+      bool recv_ready() const noexcept
+      {
+         return (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+      }
+
+      bool send_ready() const noexcept
+      {
+         return (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+      }
+
+      bool accept_ready() const noexcept
+      {
+         return recv_ready();
+      }
+
+      bool connect_ready() const noexcept
+      {
+         return send_ready();
+      }
+
+      // peer closed its side of the connection or the connection was reset
+      bool closing() const noexcept
+      {
+         return (events & (EPOLLRDHUP | EPOLLHUP)) != 0;
+      }
+
+      // a connect_ready with error() == true means the connection failed
+      bool error() const noexcept
+      {
+         return (events & EPOLLERR) != 0;
+      }
+   }; // struct socket_ready_t
+
+   // socket_t, datagram_socket_t or any other type with a native handle and a uid
+   template <typename T>
+   concept PollableSocket = requires(const T& socket)
+   {
+      { socket.handle() } -> std::convertible_to<SOCKET>;
+      { socket.uid() } -> std::convertible_to<uid_t>;
+   };
+
+   class socket_poller_t
+   {
+      HANDLE handle_{ INVALID_EPOLL_HANDLE };
+      std::vector<epoll_event> events_;
+      std::vector<timer_expiry_t> expired_;
+      size_t size_{};
+      socket::status_t status_;
+      socket_timer_wheel_t timers_;
+
+   public:
+      explicit socket_poller_t(size_t max_events = SOCKET_DEFAULT_POLLER_MAX_EVENTS, int64_t timer_tick_ms = TIMER_WHEEL_DEFAULT_TICK_MS) noexcept
+         : handle_{ epoll_create1(0) }
+         , timers_{ timer_tick_ms }
+      {
+         if (handle_ == INVALID_EPOLL_HANDLE)
+         {
+            status_ = socket::status_t{ SOCKET_ERROR };
+            return;
+         }
+         events_.resize(max_events > 0 ? max_events : 1);
+         expired_.resize(events_.size());
+      }
+
+      socket_poller_t(const socket_poller_t&) = delete;
+      socket_poller_t& operator=(const socket_poller_t&) = delete;
+
+      socket_poller_t(socket_poller_t&& other) noexcept
+         : handle_{ other.handle_ }
+         , events_{ std::move(other.events_) }
+         , expired_{ std::move(other.expired_) }
+         , size_{ other.size_ }
+         , status_{ other.status_ }
+         , timers_{ std::move(other.timers_) }
+      {
+         other.handle_ = INVALID_EPOLL_HANDLE;
+         other.size_ = 0;
+      }
+
+      socket_poller_t& operator=(socket_poller_t&& other) noexcept
+      {
+         if (this != &other)
+         {
+            close();
+            handle_ = other.handle_;
+            events_ = std::move(other.events_);
+            expired_ = std::move(other.expired_);
+            size_ = other.size_;
+            status_ = other.status_;
+            timers_ = std::move(other.timers_);
+            other.handle_ = INVALID_EPOLL_HANDLE;
+            other.size_ = 0;
+         }
+         return *this;
+      }
+
+      ~socket_poller_t() noexcept
+      {
+         close();
+      }
+
+      HANDLE handle() const noexcept
+      {
+         return handle_;
+      }
+
+      socket::status_t status() const noexcept
+      {
+         return status_;
+      }
+
+      // number of sockets currently registered
+      size_t size() const noexcept
+      {
+         return size_;
+      }
+
+      bool empty() const noexcept
+      {
+         return size_ == 0;
+      }
+
+      socket::status_t add(SOCKET handle, uid_t uid, socket_interest_t interest, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         socket::status_t status = control(EPOLL_CTL_ADD, handle, uid, interest, trigger);
+         if (status.ok()) ++size_;
+         return status;
+      }
+
+      template <PollableSocket S>
+      socket::status_t add(const S& socket, socket_interest_t interest, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         return add(socket.handle(), socket.uid(), interest, trigger);
+      }
+
+      template <PollableSocket S>
+      socket::status_t add(const S& socket, socket_event_t event, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         return add(socket.handle(), socket.uid(), socket_interest(event), trigger);
+      }
+
+      socket::status_t modify(SOCKET handle, uid_t uid, socket_interest_t interest, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         return control(EPOLL_CTL_MOD, handle, uid, interest, trigger);
+      }
+
+      template <PollableSocket S>
+      socket::status_t modify(const S& socket, socket_interest_t interest, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         return modify(socket.handle(), socket.uid(), interest, trigger);
+      }
+
+      template <PollableSocket S>
+      socket::status_t modify(const S& socket, socket_event_t event, socket_trigger_t trigger = socket_trigger_t::edge) noexcept
+      {
+         return modify(socket.handle(), socket.uid(), socket_interest(event), trigger);
+      }
+
+      socket::status_t remove(SOCKET handle) noexcept
+      {
+         if (handle_ == INVALID_EPOLL_HANDLE) return socket::status_t{ WSAEINVAL };
+         if (handle == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         // a non-null event is required by kernels before 2.6.9
+         epoll_event event{};
+         socket::status_t status{ epoll_ctl(handle_, EPOLL_CTL_DEL, handle, &event) };
+         if (status.ok() && size_ > 0) --size_;
+         return status;
+      }
+
+      // also cancels the pending timeout of socket, if any
+      template <PollableSocket S>
+      socket::status_t remove(const S& socket) noexcept
+      {
+         cancel_timeout(socket.uid());
+         return remove(socket.handle());
+      }
+
+      // timeout_ms semantics are the same as socket_t::wait_event
+      // wait succeeds:
+      //    status_t::ok() == true and count > 0 ready events are stored in ready
+      // wait timeout
+      //    status_t::would_block() == true and count == 0
+      // wait fails
+      //    status_t::nok() == true, status_t::would_block() == false and count == 0
+      socket::status_t wait(std::span<socket_ready_t> ready, size_t& count, wait_timeout_t timeout_ms = SOCKET_DEFAULT_EPOLL_WAIT_TIMEOUT_MS) noexcept
+      {
+         count = 0;
+         if (handle_ == INVALID_EPOLL_HANDLE) return socket::status_t{ WSAEINVAL };
+         if (ready.empty()) return socket::status_t{ WSAEINVAL };
+         int max_events = static_cast<int>(std::min(ready.size(), events_.size()));
+         // wake up in time for the next tick while timeouts are pending
+         if (!timers_.empty())
+         {
+            int64_t tick = timers_.next_tick_ms();
+            if (timeout_ms < 0 || tick < timeout_ms) timeout_ms = static_cast<wait_timeout_t>(tick);
+         }
+         int ret = epoll_wait(handle_, events_.data(), max_events, timeout_ms);
+         int64_t now = cached_clock_t::update();
+         if (ret == SOCKET_ERROR)
+         {
+            int error = last_error();
+            if (error != EINTR) return socket::status_t{ error };
+            ret = 0;
+         }
+         for (int i = 0; i < ret; ++i)
+         {
+            ready[i].uid = events_[i].data.u64;
+            ready[i].events = static_cast<unsigned>(events_[i].events);
+            ready[i].timer = timer_kind_t::none;
+         }
+         count = static_cast<size_t>(ret);
+         if (!timers_.empty())
+         {
+            size_t expired{};
+            timers_.expire(std::span<timer_expiry_t>{ expired_ }.first(std::min(expired_.size(), ready.size() - count)), expired, now);
+            for (size_t i = 0; i < expired; ++i)
+            {
+               ready[count++] = socket_ready_t{ expired_[i].uid, 0, expired_[i].kind };
+            }
+         }
+         if (count == 0)
+         {
+            return socket::status_t{ WSAEWOULDBLOCK, status_code_t::want_read };
+         }
+         return socket::status_t{};
+      }
+
+      // arm or re-arm the timeout of uid. It is delivered by wait() as a
+      // socket_ready_t with timeout() true. A uid holds one timeout at a time:
+      // scheduling again, for example after traffic on an idle timer, replaces it
+      bool schedule_timeout(uid_t uid, int64_t timeout_ms, timer_kind_t kind = timer_kind_t::idle) noexcept
+      {
+         return timers_.schedule(uid, timeout_ms, kind);
+      }
+
+      bool schedule_timeout(const socket_t& socket, int64_t timeout_ms, timer_kind_t kind = timer_kind_t::idle) noexcept
+      {
+         return schedule_timeout(socket.uid(), timeout_ms, kind);
+      }
+
+      bool cancel_timeout(uid_t uid) noexcept
+      {
+         return timers_.cancel(uid);
+      }
+
+      bool cancel_timeout(const socket_t& socket) noexcept
+      {
+         return cancel_timeout(socket.uid());
+      }
+
+      socket_timer_wheel_t& timers() noexcept
+      {
+         return timers_;
+      }
+
+      // ready is resized to the number of ready events. The capacity of ready is 
+      // kept between calls to avoid memory allocations in the event loop
+      socket::status_t wait(std::vector<socket_ready_t>& ready, wait_timeout_t timeout_ms = SOCKET_DEFAULT_EPOLL_WAIT_TIMEOUT_MS) noexcept
+      {
+         size_t count{};
+         try
+         {
+            ready.resize(events_.size());
+         }
+         catch (...)
+         {
+            ready.clear();
+            return socket::status_t{ WSAENOBUFS };
+         }
+         socket::status_t status = wait(std::span<socket_ready_t>{ ready }, count, timeout_ms);
+         ready.resize(count);
+         return status;
+      }
+
+      socket::status_t close() noexcept
+      {
+         socket::status_t status;
+         if (handle_ != INVALID_EPOLL_HANDLE)
+         {
+            status = socket::status_t{ epoll_close(handle_) };
+            handle_ = INVALID_EPOLL_HANDLE;
+            size_ = 0;
+         }
+         return status;
+      }
+
+   private:
+      static int last_error() noexcept
+      {
+         return ::WSAGetLastError();
+      }
+
+      static uint32_t epoll_events(socket_interest_t interest, socket_trigger_t trigger) noexcept
+      {
+         uint32_t events = EPOLLRDHUP;
+         if ((interest & socket_interest_t::recv) == socket_interest_t::recv) events |= EPOLLIN;
+         if ((interest & socket_interest_t::send) == socket_interest_t::send) events |= EPOLLOUT;
+#if defined(EPOLLET)
+         if (trigger == socket_trigger_t::edge) events |= EPOLLET;
+#else
+         static_cast<void>(trigger);
+#endif
+         return events;
+      }
+
+      socket::status_t control(int op, SOCKET handle, uid_t uid, socket_interest_t interest, socket_trigger_t trigger) noexcept
+      {
+         if (handle_ == INVALID_EPOLL_HANDLE) return socket::status_t{ WSAEINVAL };
+         if (handle == INVALID_SOCKET) return socket::status_t{ WSAENOTSOCK };
+         epoll_event event{};
+         event.events = epoll_events(interest, trigger);
+         event.data.u64 = uid;
+         return socket::status_t{ epoll_ctl(handle_, op, handle, &event) };
+      }
+   }; // class socket_poller_t
+
    namespace utility {
 
 #if defined(XPLAT_WINSOCK)
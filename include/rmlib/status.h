@@ -30,6 +30,7 @@
 #include <cstring>
 #include <string>
 #include <array>
+#include <type_traits>
 
 #include "rmlib/xplat.h"
 #include "rmlib/utility.h"
@@ -38,11 +39,18 @@ namespace rmlib {
 
    constexpr size_t MAX_REASON_MESSAGE_SIZE = 256;
 
+   /**************************************************************************\
+   * status_base_t
+   * an error code plus an optional reason. Trivially copyable and never
+   * allocates: the reason must be a string with static storage duration,
+   * normally a literal, and the error text is only formatted when reason()
+   * is called
+   \**************************************************************************/
    template <typename T, T OK, T NOK, T(*LAST_ERROR)()>
    class status_base_t
    {
       T errno_{};
-      std::string reason_{};
+      const char* reason_{ nullptr };
 
    public:
       using error_t = T;
@@ -52,12 +60,13 @@ namespace rmlib {
       status_base_t(status_base_t&&) noexcept = default;
       status_base_t& operator=(const status_base_t&) = default;
       status_base_t& operator=(status_base_t&&) noexcept = default;
+      ~status_base_t() = default;
 
       status_base_t(error_t err) noexcept
          : errno_{ err == NOK ? last_error() : err }
       {}
 
-      status_base_t(error_t err, const std::string& reason) noexcept
+      status_base_t(error_t err, const char* reason) noexcept
          : errno_{ err == NOK ? last_error() : err }
          , reason_{ reason }
       {}
@@ -65,7 +74,7 @@ namespace rmlib {
       status_base_t& operator=(error_t err) noexcept
       {
          this->errno_ = (err == NOK) ? last_error() : err;
-         reason_.clear();
+         reason_ = nullptr;
          return *this;
       }
 
@@ -89,16 +98,17 @@ namespace rmlib {
       void clear() noexcept
       {
          this->errno_ = OK;
+         reason_ = nullptr;
       }
 
       status_base_t& reset(error_t err) noexcept
       {
          this->errno_ = (err == NOK) ? last_error() : err;
-         reason_.clear();
+         reason_ = nullptr;
          return *this;
       }
 
-      status_base_t& reset(error_t err, const std::string& reason) noexcept
+      status_base_t& reset(error_t err, const char* reason) noexcept
       {
          this->errno_ = (err == NOK) ? last_error() : err;
          reason_ = reason;
@@ -111,11 +121,11 @@ namespace rmlib {
       }
 
       [[nodiscard]]
-      virtual std::string reason() const noexcept
+      std::string reason() const noexcept
       {
          if (this->errno_ != OK)
          {
-            if (!reason_.empty()) return reason_;
+            if (reason_ && *reason_) return reason_;
             std::array<char, MAX_REASON_MESSAGE_SIZE> buffer{};
             strerror_s(buffer.data(), buffer.size(), this->errno_);
             return buffer.data();
@@ -124,6 +134,13 @@ namespace rmlib {
       }
    }; // class status_base_t
 
-   using status_t = status_base_t<int, 0, -1, []() { return errno; } > ;
+   inline int errno_last_error() noexcept
+   {
+      return errno;
+   }
+
+   using status_t = status_base_t<int, 0, -1, errno_last_error>;
+
+   static_assert(std::is_trivially_copyable_v<status_t>, "status_t must stay trivially copyable");
 
 } // namespace rmlib
\ No newline at end of file
@@ -27,24 +27,188 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <atomic>
+
+#include "rmlib/xplat.h"
+
+#if defined(XPLAT_OS_WINDOWS)
+   #include <windows.h>
+#else
+   #include <time.h>
+#endif
+
+#if defined(XPLAT_CPU_AMD64) || defined(XPLAT_CPU_IX32)
+   #if defined(XPLAT_CC_MSVC)
+      #include <intrin.h>
+   #else
+      #include <x86intrin.h>
+   #endif
+   #define XPLAT_TSC_CLOCK
+#endif
 
 namespace rmlib {
 
-   class timer_t
+   // length of the busy wait used to calibrate the TSC against the steady clock
+   constexpr int64_t TSC_CALIBRATION_NSECS = 10'000'000;
+
+   /**************************************************************************\
+   * clock policies
+   * each policy has a static now() returning monotonic nanoseconds from an
+   * unspecified epoch. Pick by cost against resolution:
+   *   steady_clock_t   std::chrono::steady_clock, full resolution
+   *   coarse_clock_t   CLOCK_MONOTONIC_COARSE, a vDSO read with tick resolution
+   *   tsc_clock_t      calibrated rdtsc, a few cycles, x86 only
+   *   cached_clock_t   process wide value refreshed by the event loop, a load
+   \**************************************************************************/
+   struct steady_clock_t
+   {
+      static int64_t now() noexcept
+      {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+   };
+
+   struct coarse_clock_t
+   {
+      static int64_t now() noexcept
+      {
+#if defined(XPLAT_OS_WINDOWS)
+         return static_cast<int64_t>(::GetTickCount64()) * 1'000'000;
+#elif defined(CLOCK_MONOTONIC_COARSE)
+         timespec ts{};
+         ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+         return static_cast<int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#elif defined(CLOCK_MONOTONIC_RAW_APPROX)
+         return static_cast<int64_t>(::clock_gettime_nsec_np(CLOCK_MONOTONIC_RAW_APPROX));
+#else
+         return steady_clock_t::now();
+#endif
+      }
+   };
+
+   // assumes an invariant TSC, true of every x64 CPU of the last decade. Falls
+   // back to the steady clock on other architectures
+   struct tsc_clock_t
+   {
+      static int64_t now() noexcept
+      {
+#if defined(XPLAT_TSC_CLOCK)
+         const calibration_t& calibration = calibrate();
+         return calibration.base_nsecs + static_cast<int64_t>(static_cast<double>(__rdtsc() - calibration.base_ticks) * calibration.nsecs_per_tick);
+#else
+         return steady_clock_t::now();
+#endif
+      }
+
+      // nanoseconds per TSC tick, 0 when there is no TSC
+      static double nsecs_per_tick() noexcept
+      {
+#if defined(XPLAT_TSC_CLOCK)
+         return calibrate().nsecs_per_tick;
+#else
+         return 0.0;
+#endif
+      }
+
+   private:
+#if defined(XPLAT_TSC_CLOCK)
+      struct calibration_t
+      {
+         uint64_t base_ticks{};
+         int64_t base_nsecs{};
+         double nsecs_per_tick{ 1.0 };
+      };
+
+      // measured once per process on first use. Deltas from the base keep the
+      // double product exact well beyond any process lifetime
+      static const calibration_t& calibrate() noexcept
+      {
+         static const calibration_t calibration = []()
+         {
+            calibration_t result;
+            result.base_nsecs = steady_clock_t::now();
+            result.base_ticks = __rdtsc();
+            int64_t nsecs{};
+            uint64_t ticks{};
+            do
+            {
+               nsecs = steady_clock_t::now();
+               ticks = __rdtsc();
+            } while (nsecs - result.base_nsecs < TSC_CALIBRATION_NSECS);
+            if (ticks > result.base_ticks) result.nsecs_per_tick = static_cast<double>(nsecs - result.base_nsecs) / static_cast<double>(ticks - result.base_ticks);
+            return result;
+         }();
+         return calibration;
+      }
+#endif
+   };
+
+   // a coarse "now" shared by the whole process. socket_poller_t::wait()
+   // refreshes it after every wakeup, so timestamping socket activity costs a
+   // single relaxed load. Reads before the first update() take one
+   struct cached_clock_t
+   {
+      static int64_t now() noexcept
+      {
+         int64_t value = storage().load(std::memory_order_relaxed);
+         return value != 0 ? value : update();
+      }
+
+      static int64_t update() noexcept
+      {
+         int64_t value = coarse_clock_t::now();
+         storage().store(value, std::memory_order_relaxed);
+         return value;
+      }
+
+   private:
+      static std::atomic<int64_t>& storage() noexcept
+      {
+         static std::atomic<int64_t> now{ 0 };
+         return now;
+      }
+   };
+
+   template <typename T>
+   concept ClockPolicy = requires
+   {
+      { T::now() } -> std::same_as<int64_t>;
+   };
+
+   template <ClockPolicy Clock>
+   class basic_timer_t
    {
-      std::chrono::time_point<std::chrono::high_resolution_clock> start_time_{ std::chrono::high_resolution_clock::now() };
+      int64_t start_time_{ Clock::now() };
 
    public:
+      using clock_t = Clock;
+
+      // elapsed microseconds
       long long elapsed() const noexcept
       {
-         return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time_).count();
+         return static_cast<long long>((Clock::now() - start_time_) / 1000);
+      }
+
+      long long elapsed_nsecs() const noexcept
+      {
+         return static_cast<long long>(Clock::now() - start_time_);
       }
 
       void reset() noexcept
       {
-         start_time_ = std::chrono::high_resolution_clock::now();
+         start_time_ = Clock::now();
+      }
+
+      // restart from a timestamp already taken, saves a clock read when several
+      // timers are reset together
+      void reset(int64_t now) noexcept
+      {
+         start_time_ = now;
       }
       
-   }; // class timer_t
+   }; // class basic_timer_t
+
+   using timer_t = basic_timer_t<steady_clock_t>;
    
 } // namespace rmlib::time
@@ -0,0 +1,327 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <array>
+#include <span>
+#include <unordered_map>
+#include <algorithm>
+
+#include "rmlib/time.h"
+
+namespace rmlib {
+
+   // default timer wheel resolution in milliseconds
+   constexpr int64_t TIMER_WHEEL_DEFAULT_TICK_MS = 10;
+
+   // each wheel level has 2^TIMER_WHEEL_SLOT_BITS slots. Four levels of 64 slots
+   // span 2^24 ticks, about 46 hours at the default tick. Longer timeouts are
+   // clamped to the span
+   constexpr unsigned TIMER_WHEEL_SLOT_BITS = 6;
+   constexpr unsigned TIMER_WHEEL_LEVELS = 4;
+
+   enum class timer_kind_t : uint8_t
+   {
+        none = 0
+      , idle         // no traffic for too long
+      , connect      // non blocking connect did not complete
+      , handshake    // TLS handshake did not complete
+      , user         // application defined
+   };
+
+   struct timer_expiry_t
+   {
+      uint64_t uid{};
+      timer_kind_t kind{ timer_kind_t::none };
+   };
+
+   /**************************************************************************\
+   * timer_wheel_t
+   * hierarchical timing wheel holding at most one timeout per uid, normally
+   * socket_t::uid(). schedule, reschedule and cancel are O(1); expire() costs
+   * one step per elapsed tick plus one per expired timer, independent of how
+   * many timers are pending. Timers fire on tick boundaries, up to one tick
+   * late. Entries live in a pooled node table, so rescheduling a pending
+   * timer never allocates. Not thread safe, owned by one event loop
+   \**************************************************************************/
+   template <ClockPolicy Clock = coarse_clock_t>
+   class basic_timer_wheel_t
+   {
+      static constexpr uint32_t SLOTS = 1u << TIMER_WHEEL_SLOT_BITS;
+      static constexpr uint32_t SLOT_MASK = SLOTS - 1;
+      static constexpr uint32_t NIL = UINT32_MAX;
+      static constexpr uint32_t EXPIRED_LIST = SLOTS * TIMER_WHEEL_LEVELS;
+      static constexpr uint64_t MAX_TICKS = (1ull << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+      struct node_t
+      {
+         uint64_t uid{};
+         uint64_t expiry{};
+         uint32_t prev{ NIL };
+         uint32_t next{ NIL };
+         uint32_t list{ NIL };
+         timer_kind_t kind{ timer_kind_t::none };
+      };
+
+      int64_t tick_nsecs_;
+      int64_t origin_;
+      uint64_t current_{};
+      std::vector<node_t> nodes_{};
+      uint32_t free_{ NIL };
+      std::array<uint32_t, EXPIRED_LIST + 1> heads_{};
+      std::unordered_map<uint64_t, uint32_t> index_{};
+
+   public:
+      explicit basic_timer_wheel_t(int64_t tick_ms = TIMER_WHEEL_DEFAULT_TICK_MS) noexcept
+         : tick_nsecs_{ std::max<int64_t>(tick_ms, 1) * 1'000'000 }
+         , origin_{ Clock::now() }
+      {
+         heads_.fill(NIL);
+      }
+
+      basic_timer_wheel_t(const basic_timer_wheel_t&) = delete;
+      basic_timer_wheel_t(basic_timer_wheel_t&&) noexcept = default;
+      basic_timer_wheel_t& operator=(const basic_timer_wheel_t&) = delete;
+      basic_timer_wheel_t& operator=(basic_timer_wheel_t&&) noexcept = default;
+      ~basic_timer_wheel_t() = default;
+
+      // pre-size the node table and index for the expected number of timers
+      void reserve(size_t timers) noexcept
+      {
+         try
+         {
+            nodes_.reserve(timers);
+            index_.reserve(timers);
+         }
+         catch (...) {}
+      }
+
+      size_t size() const noexcept
+      {
+         return index_.size();
+      }
+
+      bool empty() const noexcept
+      {
+         return index_.empty();
+      }
+
+      int64_t tick_ms() const noexcept
+      {
+         return tick_nsecs_ / 1'000'000;
+      }
+
+      // (re)arm the timer of uid to fire after timeout_ms. A pending timer of
+      // the same uid is replaced, whatever its kind
+      bool schedule(uint64_t uid, int64_t timeout_ms, timer_kind_t kind = timer_kind_t::idle) noexcept
+      {
+         // timeouts count from now, not from the last expire()
+         advance(Clock::now());
+         uint32_t index{};
+         if (auto it = index_.find(uid); it != index_.end())
+         {
+            index = it->second;
+            unlink(index);
+         }
+         else
+         {
+            index = allocate();
+            if (index == NIL) return false;
+            try
+            {
+               index_.emplace(uid, index);
+            }
+            catch (...)
+            {
+               release(index);
+               return false;
+            }
+         }
+         // round up so a timer never fires early
+         int64_t ticks = (std::max<int64_t>(timeout_ms, 0) * 1'000'000 + tick_nsecs_ - 1) / tick_nsecs_;
+         node_t& node = nodes_[index];
+         node.uid = uid;
+         node.kind = kind;
+         node.expiry = current_ + std::clamp<uint64_t>(static_cast<uint64_t>(ticks), 1, MAX_TICKS);
+         place(index);
+         return true;
+      }
+
+      // returns false when uid had no pending timer
+      bool cancel(uint64_t uid) noexcept
+      {
+         auto it = index_.find(uid);
+         if (it == index_.end()) return false;
+         uint32_t index = it->second;
+         index_.erase(it);
+         unlink(index);
+         release(index);
+         return true;
+      }
+
+      bool contains(uint64_t uid) const noexcept
+      {
+         return index_.find(uid) != index_.end();
+      }
+
+      // milliseconds until the next tick boundary, a bound for the poll timeout
+      int64_t next_tick_ms(int64_t now = Clock::now()) const noexcept
+      {
+         int64_t next = origin_ + static_cast<int64_t>(current_ + 1) * tick_nsecs_;
+         return std::max<int64_t>((next - now + 999'999) / 1'000'000, 0);
+      }
+
+      // advance the wheel to now and copy out expired timers. Expired timers
+      // that do not fit in expired are kept for the next call
+      void expire(std::span<timer_expiry_t> expired, size_t& count, int64_t now = Clock::now()) noexcept
+      {
+         count = 0;
+         advance(now);
+         while (count < expired.size() && heads_[EXPIRED_LIST] != NIL)
+         {
+            uint32_t index = heads_[EXPIRED_LIST];
+            node_t& node = nodes_[index];
+            expired[count++] = timer_expiry_t{ node.uid, node.kind };
+            index_.erase(node.uid);
+            unlink(index);
+            release(index);
+         }
+      }
+
+   private:
+      void advance(int64_t now) noexcept
+      {
+         if (now < origin_) return;
+         const uint64_t target = static_cast<uint64_t>(now - origin_) / static_cast<uint64_t>(tick_nsecs_);
+         while (current_ < target)
+         {
+            if (index_.empty())
+            {
+               current_ = target;
+               break;
+            }
+            ++current_;
+            // on a level wrap pull the next slot of the level above down
+            if ((current_ & SLOT_MASK) == 0)
+            {
+               for (unsigned level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+               {
+                  uint32_t slot = static_cast<uint32_t>(current_ >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+                  cascade(level * SLOTS + slot);
+                  if (slot != 0) break;
+               }
+            }
+            uint32_t list = static_cast<uint32_t>(current_ & SLOT_MASK);
+            while (heads_[list] != NIL)
+            {
+               uint32_t index = heads_[list];
+               unlink(index);
+               push(EXPIRED_LIST, index);
+            }
+         }
+      }
+
+      void cascade(uint32_t list) noexcept
+      {
+         uint32_t index = heads_[list];
+         heads_[list] = NIL;
+         while (index != NIL)
+         {
+            uint32_t next = nodes_[index].next;
+            nodes_[index].list = NIL;
+            place(index);
+            index = next;
+         }
+      }
+
+      void place(uint32_t index) noexcept
+      {
+         node_t& node = nodes_[index];
+         uint64_t delta = node.expiry > current_ ? node.expiry - current_ : 0;
+         if (delta == 0)
+         {
+            push(EXPIRED_LIST, index);
+            return;
+         }
+         unsigned level = 0;
+         while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (1ull << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) ++level;
+         uint32_t slot = static_cast<uint32_t>(node.expiry >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+         push(level * SLOTS + slot, index);
+      }
+
+      void push(uint32_t list, uint32_t index) noexcept
+      {
+         node_t& node = nodes_[index];
+         node.list = list;
+         node.prev = NIL;
+         node.next = heads_[list];
+         if (node.next != NIL) nodes_[node.next].prev = index;
+         heads_[list] = index;
+      }
+
+      void unlink(uint32_t index) noexcept
+      {
+         node_t& node = nodes_[index];
+         if (node.list == NIL) return;
+         if (node.prev != NIL) nodes_[node.prev].next = node.next;
+         else heads_[node.list] = node.next;
+         if (node.next != NIL) nodes_[node.next].prev = node.prev;
+         node.prev = node.next = node.list = NIL;
+      }
+
+      uint32_t allocate() noexcept
+      {
+         if (free_ != NIL)
+         {
+            uint32_t index = free_;
+            free_ = nodes_[index].next;
+            nodes_[index] = node_t{};
+            return index;
+         }
+         try
+         {
+            nodes_.emplace_back();
+         }
+         catch (...)
+         {
+            return NIL;
+         }
+         return static_cast<uint32_t>(nodes_.size() - 1);
+      }
+
+      void release(uint32_t index) noexcept
+      {
+         nodes_[index].next = free_;
+         free_ = index;
+      }
+   }; // class basic_timer_wheel_t
+
+   using timer_wheel_t = basic_timer_wheel_t<coarse_clock_t>;
+
+} // namespace rmlib
@@ -29,6 +29,31 @@
 #include <concepts>
 #include <thread>
 #include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <bit>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "rmlib/xplat.h"
+
+#if defined(XPLAT_OS_LINUX)
+   #include <pthread.h>
+   #include <sched.h>
+#endif
+
+#if defined(XPLAT_CPU_AMD64) || defined(XPLAT_CPU_IX32)
+   #if defined(XPLAT_CC_MSVC)
+      #include <intrin.h>
+   #else
+      #include <immintrin.h>
+   #endif
+#elif defined(XPLAT_CPU_ARM) && defined(XPLAT_CC_MSVC)
+   #include <intrin.h>
+#endif
 
 namespace rmlib {
 
@@ -54,6 +79,43 @@ namespace rmlib {
       { a.clear() } -> std::same_as<void>;
    } && sizeof(typename T::value_type) == 1;
    
+   // define a concept to allow file objects that expose the native OS file handle
+   // of an open file, such as fstream_t and llfio_t
+   template<typename T>
+   concept NativeFileHandle = requires(T a)
+   {
+      { a.native_handle() } -> std::same_as<HANDLE>;
+   };
+
+   // pin the calling thread to one cpu. Returns false where thread affinity
+   // is not supported (macOS) or cpu is out of range
+   inline bool set_thread_affinity(unsigned cpu) noexcept
+   {
+#if defined(XPLAT_OS_LINUX)
+      if (cpu >= CPU_SETSIZE) return false;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#elif defined(XPLAT_OS_WINDOWS)
+      if (cpu >= 64) return false;
+      return ::SetThreadAffinityMask(::GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#else
+      (void)cpu;
+      return false;
+#endif
+   }
+
+   // access pattern hints for files and mapped memory
+   enum class advice_t
+   {
+        normal        // default read ahead
+      , sequential    // aggressive read ahead, pages may be dropped after use
+      , random        // no read ahead
+      , willneed      // start reading the range in now
+      , dontneed      // the range will not be needed soon
+   };
+
    inline uint32_t low32(uint64_t value) noexcept
    {
       return static_cast<uint32_t>(value & 0xffffffffull);
@@ -70,9 +132,75 @@ namespace rmlib {
       return static_cast<uint64_t>((hv << 32) | low);
    }
 
-   class spin_lock_t 
+   // small dense number of the calling thread, in order of first call. Used to
+   // spread threads over the shards of sharded structures
+   inline size_t thread_ordinal() noexcept
    {
-      std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+      static std::atomic<size_t> next{ 0 };
+      thread_local const size_t ordinal = next.fetch_add(1, std::memory_order_relaxed);
+      return ordinal;
+   }
+
+   // destructive interference size of current x64 and ARM cores. Used instead of
+   // std::hardware_destructive_interference_size, which GCC warns is not ABI stable
+   constexpr size_t CACHE_LINE_SIZE = 64;
+
+   // pause instructions a spinning thread issues between lock probes, doubled on
+   // every failed probe up to SPIN_MAX_PAUSES, after which the thread yields
+   constexpr unsigned SPIN_MAX_PAUSES = 64;
+
+   // backoff rounds a blocking ring wait spins before it parks the thread
+   constexpr unsigned RING_WAIT_SPINS = 8;
+
+   // tell the CPU this is a spin-wait loop: saves power, frees pipeline resources
+   // for the sibling hyperthread and avoids a memory order violation on exit
+   inline void cpu_relax() noexcept
+   {
+#if defined(XPLAT_CPU_AMD64) || defined(XPLAT_CPU_IX32)
+      _mm_pause();
+#elif defined(XPLAT_CPU_ARM) && defined(XPLAT_CC_MSVC)
+      __yield();
+#elif defined(XPLAT_CPU_ARM)
+      asm volatile("yield" ::: "memory");
+#else
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+   }
+
+   // bounded exponential backoff for spin loops
+   class spin_backoff_t
+   {
+      unsigned pauses_{ 1 };
+
+   public:
+      void pause() noexcept
+      {
+         if (pauses_ <= SPIN_MAX_PAUSES)
+         {
+            for (unsigned i = 0; i < pauses_; ++i) cpu_relax();
+            pauses_ <<= 1;
+         }
+         else
+         {
+            std::this_thread::yield();
+         }
+      }
+
+      void reset() noexcept
+      {
+         pauses_ = 1;
+      }
+   };
+
+   /**************************************************************************\
+   * spin_lock_t
+   * test and test-and-set lock. Waiters spin on a plain load, which stays in
+   * their own cache, and only attempt the exchange once the lock looks free.
+   * Padded to a cache line so arrays of locks do not false share
+   \**************************************************************************/
+   class alignas(CACHE_LINE_SIZE) spin_lock_t 
+   {
+      std::atomic<bool> locked_{ false };
    
    public:
       spin_lock_t() = default;
@@ -83,15 +211,143 @@ namespace rmlib {
 
       void lock() noexcept
       {
-         while (flag_.test_and_set(std::memory_order_acquire)) 
+         spin_backoff_t backoff;
+         while (locked_.exchange(true, std::memory_order_acquire))
+         {
+            while (locked_.load(std::memory_order_relaxed)) backoff.pause();
+         }
+      }
+
+      [[nodiscard]]
+      bool try_lock() noexcept
+      {
+         return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+      }
+
+      void unlock() noexcept
+      {
+         locked_.store(false, std::memory_order_release);
+      }
+   };
+
+   /**************************************************************************\
+   * ticket_lock_t
+   * fair FIFO spin lock, threads acquire it in arrival order. Waiters far
+   * from the head of the queue yield straight away, the others back off
+   \**************************************************************************/
+   class alignas(CACHE_LINE_SIZE) ticket_lock_t
+   {
+      std::atomic<uint32_t> next_{ 0 };
+      std::atomic<uint32_t> serving_{ 0 };
+
+   public:
+      ticket_lock_t() = default;
+      ticket_lock_t(const ticket_lock_t&) = delete;
+      ticket_lock_t(ticket_lock_t&&) noexcept = delete;
+      ticket_lock_t& operator=(const ticket_lock_t&) = delete;
+      ticket_lock_t& operator=(ticket_lock_t&&) noexcept = delete;
+
+      void lock() noexcept
+      {
+         const uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+         spin_backoff_t backoff;
+         while (true)
          {
-            std::this_thread::yield(); // Spin until the lock is acquired
+            const uint32_t serving = serving_.load(std::memory_order_acquire);
+            if (serving == ticket) return;
+            // the next holder may be waiting for a CPU, so near waiters must
+            // also end up yielding or a handoff can cost a whole time slice
+            if (ticket - serving > SPIN_MAX_PAUSES / 8) std::this_thread::yield();
+            else backoff.pause();
          }
       }
 
+      [[nodiscard]]
+      bool try_lock() noexcept
+      {
+         uint32_t serving = serving_.load(std::memory_order_acquire);
+         uint32_t expected = serving;
+         return next_.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+      }
+
       void unlock() noexcept
       {
-         flag_.clear(std::memory_order_release);
+         // only the holder writes serving_
+         serving_.store(serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      }
+   };
+
+   /**************************************************************************\
+   * rw_spin_lock_t
+   * reader-writer spin lock with writer preference: a waiting writer stops new
+   * readers from entering so a steady stream of readers cannot starve it. Has
+   * the lock()/lock_shared() names of std::shared_mutex, so std::unique_lock
+   * and std::shared_lock work with it
+   \**************************************************************************/
+   class alignas(CACHE_LINE_SIZE) rw_spin_lock_t
+   {
+      static constexpr uint32_t WRITER = 0x01;
+      static constexpr uint32_t WRITER_PENDING = 0x02;
+      static constexpr uint32_t READER = 0x04;
+
+      std::atomic<uint32_t> state_{ 0 };
+
+   public:
+      rw_spin_lock_t() = default;
+      rw_spin_lock_t(const rw_spin_lock_t&) = delete;
+      rw_spin_lock_t(rw_spin_lock_t&&) noexcept = delete;
+      rw_spin_lock_t& operator=(const rw_spin_lock_t&) = delete;
+      rw_spin_lock_t& operator=(rw_spin_lock_t&&) noexcept = delete;
+
+      void lock() noexcept
+      {
+         spin_backoff_t backoff;
+         while (true)
+         {
+            uint32_t state = state_.load(std::memory_order_relaxed);
+            if ((state & ~WRITER_PENDING) == 0)
+            {
+               if (state_.compare_exchange_weak(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed)) return;
+               continue;
+            }
+            if (!(state & WRITER_PENDING)) state_.fetch_or(WRITER_PENDING, std::memory_order_relaxed);
+            backoff.pause();
+         }
+      }
+
+      [[nodiscard]]
+      bool try_lock() noexcept
+      {
+         uint32_t state = state_.load(std::memory_order_relaxed);
+         return (state & ~WRITER_PENDING) == 0 && state_.compare_exchange_strong(state, WRITER, std::memory_order_acquire, std::memory_order_relaxed);
+      }
+
+      void unlock() noexcept
+      {
+         state_.fetch_and(~WRITER, std::memory_order_release);
+      }
+
+      void lock_shared() noexcept
+      {
+         spin_backoff_t backoff;
+         while (!try_lock_shared()) backoff.pause();
+      }
+
+      [[nodiscard]]
+      bool try_lock_shared() noexcept
+      {
+         // racing readers only retry, a writer makes it fail
+         uint32_t state = state_.load(std::memory_order_relaxed);
+         while (!(state & (WRITER | WRITER_PENDING)))
+         {
+            if (state_.compare_exchange_weak(state, state + READER, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+         }
+         return false;
+      }
+
+      void unlock_shared() noexcept
+      {
+         state_.fetch_sub(READER, std::memory_order_release);
       }
    };
 
@@ -118,4 +374,349 @@ namespace rmlib {
       }
    };
 
+   /**************************************************************************\
+   * ring_signal_t
+   * blocking waits of the ring queues. A waiter spins for a few backoff
+   * rounds, then parks on an epoch with std::atomic::wait. The notifying side
+   * pays a fence and a load of the waiter count, it only makes the wake
+   * system call while a thread is parked
+   \**************************************************************************/
+   class alignas(CACHE_LINE_SIZE) ring_signal_t
+   {
+      std::atomic<uint32_t> epoch_{ 0 };
+      std::atomic<uint32_t> waiters_{ 0 };
+
+   public:
+      void notify() noexcept
+      {
+         // pairs with the fence in wait(), either the waiter sees the update
+         // of the ring or this sees the waiter
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         if (waiters_.load(std::memory_order_relaxed) == 0) return;
+         epoch_.fetch_add(1, std::memory_order_release);
+         epoch_.notify_all();
+      }
+
+      // block until attempt() succeeds
+      template <typename F>
+      void wait(F&& attempt) noexcept
+      {
+         spin_backoff_t backoff;
+         for (unsigned i = 0; i < RING_WAIT_SPINS; ++i)
+         {
+            if (attempt()) return;
+            backoff.pause();
+         }
+         while (true)
+         {
+            const uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            waiters_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const bool done = attempt();
+            if (!done) epoch_.wait(epoch, std::memory_order_acquire);
+            waiters_.fetch_sub(1, std::memory_order_relaxed);
+            if (done) return;
+         }
+      }
+   };
+
+   // stands in for ring_signal_t in rings built without blocking waits
+   struct ring_no_signal_t
+   {
+      void notify() noexcept {}
+   };
+
+   template <typename T>
+   concept RingElement = std::is_nothrow_default_constructible_v<T> && std::is_nothrow_move_assignable_v<T>;
+
+   /**************************************************************************\
+   * spsc_ring_t
+   * bounded single producer, single consumer queue. Head and tail live on
+   * their own cache lines and each side keeps a private copy of the other's
+   * index, so it only reads the shared line when the ring looks full or
+   * empty. Batch push and pop publish the whole batch with one store. With
+   * Blocking, push_wait() and pop_wait() park the thread when the ring is
+   * full or empty. Capacity is rounded up to a power of two; it is zero when
+   * the slots could not be allocated, and every push then fails
+   \**************************************************************************/
+   template <RingElement T, bool Blocking = false>
+   class spsc_ring_t
+   {
+      using signal_t = std::conditional_t<Blocking, ring_signal_t, ring_no_signal_t>;
+
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };   // written by the consumer
+      size_t cached_tail_{ 0 };
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };   // written by the producer
+      size_t cached_head_{ 0 };
+      alignas(CACHE_LINE_SIZE) size_t capacity_{};
+      size_t mask_{};
+      std::unique_ptr<T[]> slots_{};
+      [[no_unique_address]] signal_t not_empty_{};
+      [[no_unique_address]] signal_t not_full_{};
+
+   public:
+      explicit spsc_ring_t(size_t capacity) noexcept
+      {
+         capacity = std::bit_ceil(std::max<size_t>(capacity, 1));
+         slots_.reset(new (std::nothrow) T[capacity]);
+         if (slots_)
+         {
+            capacity_ = capacity;
+            mask_ = capacity - 1;
+         }
+      }
+
+      spsc_ring_t(const spsc_ring_t&) = delete;
+      spsc_ring_t(spsc_ring_t&&) = delete;
+      spsc_ring_t& operator=(const spsc_ring_t&) = delete;
+      spsc_ring_t& operator=(spsc_ring_t&&) = delete;
+      ~spsc_ring_t() = default;
+
+      // producer only. item is left untouched when the ring is full
+      [[nodiscard]]
+      bool push(T&& item) noexcept
+      {
+         const size_t tail = tail_.load(std::memory_order_relaxed);
+         if (tail - cached_head_ >= capacity_)
+         {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ >= capacity_) return false;
+         }
+         slots_[tail & mask_] = std::move(item);
+         tail_.store(tail + 1, std::memory_order_release);
+         not_empty_.notify();
+         return true;
+      }
+
+      // producer only. Moves the leading items that fit, returns their count
+      size_t push(std::span<T> items) noexcept
+      {
+         const size_t tail = tail_.load(std::memory_order_relaxed);
+         if (capacity_ - (tail - cached_head_) < items.size()) cached_head_ = head_.load(std::memory_order_acquire);
+         const size_t count = std::min(items.size(), capacity_ - (tail - cached_head_));
+         if (count == 0) return 0;
+         for (size_t i = 0; i < count; ++i) slots_[(tail + i) & mask_] = std::move(items[i]);
+         tail_.store(tail + count, std::memory_order_release);
+         not_empty_.notify();
+         return count;
+      }
+
+      // consumer only
+      [[nodiscard]]
+      bool pop(T& item) noexcept
+      {
+         const size_t head = head_.load(std::memory_order_relaxed);
+         if (head == cached_tail_)
+         {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) return false;
+         }
+         item = std::move(slots_[head & mask_]);
+         head_.store(head + 1, std::memory_order_release);
+         not_full_.notify();
+         return true;
+      }
+
+      // consumer only. Fills the front of items, returns the count
+      size_t pop(std::span<T> items) noexcept
+      {
+         const size_t head = head_.load(std::memory_order_relaxed);
+         if (cached_tail_ - head < items.size()) cached_tail_ = tail_.load(std::memory_order_acquire);
+         const size_t count = std::min(items.size(), cached_tail_ - head);
+         if (count == 0) return 0;
+         for (size_t i = 0; i < count; ++i) items[i] = std::move(slots_[(head + i) & mask_]);
+         head_.store(head + count, std::memory_order_release);
+         not_full_.notify();
+         return count;
+      }
+
+      void push_wait(T&& item) noexcept requires Blocking
+      {
+         not_full_.wait([&]() noexcept { return push(std::move(item)); });
+      }
+
+      void pop_wait(T& item) noexcept requires Blocking
+      {
+         not_empty_.wait([&]() noexcept { return pop(item); });
+      }
+
+      // exact only on the producer or consumer thread, a snapshot elsewhere
+      size_t size() const noexcept
+      {
+         const size_t head = head_.load(std::memory_order_acquire);
+         return tail_.load(std::memory_order_acquire) - head;
+      }
+
+      bool empty() const noexcept
+      {
+         return size() == 0;
+      }
+
+      size_t capacity() const noexcept
+      {
+         return capacity_;
+      }
+   }; // class spsc_ring_t
+
+   /**************************************************************************\
+   * mpmc_ring_t
+   * bounded multi producer, multi consumer queue after Dmitry Vyukov. Every
+   * slot carries a sequence number that tells producers and consumers whose
+   * turn it is, so a push or pop costs one compare-exchange on the shared
+   * index and there is no lock to be preempted while holding it. Batch push
+   * and pop claim slots one at a time but notify waiters once. Capacity is
+   * rounded up to a power of two of at least 2
+   \**************************************************************************/
+   template <RingElement T, bool Blocking = false>
+   class mpmc_ring_t
+   {
+      using signal_t = std::conditional_t<Blocking, ring_signal_t, ring_no_signal_t>;
+
+      struct slot_t
+      {
+         std::atomic<size_t> sequence{ 0 };
+         T value{};
+      };
+
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };   // next push
+      alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };   // next pop
+      alignas(CACHE_LINE_SIZE) size_t capacity_{};
+      size_t mask_{};
+      std::unique_ptr<slot_t[]> slots_{};
+      [[no_unique_address]] signal_t not_empty_{};
+      [[no_unique_address]] signal_t not_full_{};
+
+   public:
+      explicit mpmc_ring_t(size_t capacity) noexcept
+      {
+         // one slot would mistake a full ring for an empty one
+         capacity = std::bit_ceil(std::max<size_t>(capacity, 2));
+         slots_.reset(new (std::nothrow) slot_t[capacity]);
+         if (slots_)
+         {
+            capacity_ = capacity;
+            mask_ = capacity - 1;
+            for (size_t i = 0; i < capacity; ++i) slots_[i].sequence.store(i, std::memory_order_relaxed);
+         }
+      }
+
+      mpmc_ring_t(const mpmc_ring_t&) = delete;
+      mpmc_ring_t(mpmc_ring_t&&) = delete;
+      mpmc_ring_t& operator=(const mpmc_ring_t&) = delete;
+      mpmc_ring_t& operator=(mpmc_ring_t&&) = delete;
+      ~mpmc_ring_t() = default;
+
+      // item is left untouched when the ring is full
+      [[nodiscard]]
+      bool push(T&& item) noexcept
+      {
+         if (!enqueue(item)) return false;
+         not_empty_.notify();
+         return true;
+      }
+
+      // moves the leading items that fit, returns their count
+      size_t push(std::span<T> items) noexcept
+      {
+         size_t count{};
+         while (count < items.size() && enqueue(items[count])) ++count;
+         if (count > 0) not_empty_.notify();
+         return count;
+      }
+
+      [[nodiscard]]
+      bool pop(T& item) noexcept
+      {
+         if (!dequeue(item)) return false;
+         not_full_.notify();
+         return true;
+      }
+
+      // fills the front of items, returns the count
+      size_t pop(std::span<T> items) noexcept
+      {
+         size_t count{};
+         while (count < items.size() && dequeue(items[count])) ++count;
+         if (count > 0) not_full_.notify();
+         return count;
+      }
+
+      void push_wait(T&& item) noexcept requires Blocking
+      {
+         not_full_.wait([&]() noexcept { return push(std::move(item)); });
+      }
+
+      void pop_wait(T& item) noexcept requires Blocking
+      {
+         not_empty_.wait([&]() noexcept { return pop(item); });
+      }
+
+      // a snapshot while other threads push or pop
+      size_t size() const noexcept
+      {
+         const size_t head = head_.load(std::memory_order_acquire);
+         const size_t tail = tail_.load(std::memory_order_acquire);
+         return tail > head ? std::min(tail - head, capacity_) : 0;
+      }
+
+      bool empty() const noexcept
+      {
+         return size() == 0;
+      }
+
+      size_t capacity() const noexcept
+      {
+         return capacity_;
+      }
+
+   private:
+      bool enqueue(T& item) noexcept
+      {
+         if (!slots_) return false;
+         size_t position = tail_.load(std::memory_order_relaxed);
+         while (true)
+         {
+            slot_t& slot = slots_[position & mask_];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t turn = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (turn == 0)
+            {
+               if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+               {
+                  slot.value = std::move(item);
+                  slot.sequence.store(position + 1, std::memory_order_release);
+                  return true;
+               }
+            }
+            // the slot still holds an item from the previous lap
+            else if (turn < 0) return false;
+            else position = tail_.load(std::memory_order_relaxed);
+         }
+      }
+
+      bool dequeue(T& item) noexcept
+      {
+         if (!slots_) return false;
+         size_t position = head_.load(std::memory_order_relaxed);
+         while (true)
+         {
+            slot_t& slot = slots_[position & mask_];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t turn = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (turn == 0)
+            {
+               if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+               {
+                  item = std::move(slot.value);
+                  slot.sequence.store(position + capacity_, std::memory_order_release);
+                  return true;
+               }
+            }
+            // not pushed yet
+            else if (turn < 0) return false;
+            else position = head_.load(std::memory_order_relaxed);
+         }
+      }
+   }; // class mpmc_ring_t
+
 } // namespace rmlib
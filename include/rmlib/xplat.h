@@ -164,6 +164,14 @@
 
    using SOCKET = int;
    using HANDLE = int;
+
+   #include <unistd.h>
+
+   inline bool file_exists(const char* filepath) noexcept
+   {
+      if (!filepath) return false;
+      return access(filepath, F_OK) != -1;
+   }
 #endif
 
 #if defined(XPLAT_OS_WINDOWS)
@@ -173,6 +181,13 @@
 
    using off64_t = long long;
 
+   inline bool file_exists(const char* filepath) noexcept
+   {
+      if (!filepath) return false;
+      DWORD fileAttributes = GetFileAttributes(filepath);
+      return (fileAttributes != INVALID_FILE_ATTRIBUTES && !(fileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+   }
+
    inline std::string get_windows_error_message(DWORD dwError) noexcept
    {
       LPVOID lpMsgBuf;
@@ -0,0 +1,195 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+
+#include "rmlib/aio.h"
+
+using namespace rmlib;
+
+namespace aio_ut {
+
+   const char* filename{ "rmlib-aio-ut.bin" };
+   constexpr size_t block_size{ 4096 };
+   constexpr size_t blocks{ 64 };
+
+   // write every block, flush, then read them back in reverse order through the queue
+   void write_read_blocks(aio::queue_t& queue, llfio_t& file, bool registered) noexcept
+   {
+      aligned_buffer_t output(block_size * blocks);
+      aligned_buffer_t input(block_size * blocks);
+      for (size_t i = 0; i < output.size(); ++i) output.data()[i] = static_cast<char>('a' + (i / block_size) % 26);
+
+      HANDLE handle = file.handle();
+      if (registered)
+      {
+         std::span<char> buffers[]{ { output.data(), output.size() }, { input.data(), input.size() } };
+         REQUIRE(queue.register_buffers(buffers).ok());
+         REQUIRE(queue.register_files(std::span<const HANDLE>(&handle, 1)).ok());
+      }
+
+      std::vector<aio::request_t> requests;
+      for (size_t i = 0; i < blocks; ++i)
+      {
+         requests.push_back(aio::write(file, output.data() + i * block_size, block_size, static_cast<off64_t>(i * block_size), i));
+         if (registered)
+         {
+            requests.back().buffer_index = 0;
+            requests.back().file_index = 0;
+         }
+      }
+      size_t submitted{};
+      REQUIRE(queue.submit(requests, submitted).ok());
+      REQUIRE(submitted == blocks);
+
+      std::vector<aio::completion_t> completions(blocks);
+      std::vector<char> seen(blocks);
+      size_t reaped{};
+      while (reaped < blocks)
+      {
+         size_t count{};
+         REQUIRE(queue.reap(completions, 1, count).ok());
+         REQUIRE(count > 0);
+         for (size_t i = 0; i < count; ++i)
+         {
+            REQUIRE(completions[i].status.ok());
+            REQUIRE(completions[i].bytes == block_size);
+            REQUIRE(completions[i].user_data < blocks);
+            seen[completions[i].user_data] = 1;
+         }
+         reaped += count;
+      }
+      REQUIRE(std::count(seen.begin(), seen.end(), 1) == blocks);
+      REQUIRE(queue.in_flight() == 0);
+
+      size_t count{};
+      REQUIRE(queue.submit(aio::datasync(file, blocks)).ok());
+      REQUIRE(queue.reap(completions, 1, count).ok());
+      REQUIRE(count == 1);
+      REQUIRE(completions[0].user_data == blocks);
+      REQUIRE(completions[0].status.ok());
+
+      requests.clear();
+      for (size_t i = blocks; i-- > 0;)
+      {
+         requests.push_back(aio::read(file, input.data() + i * block_size, block_size, static_cast<off64_t>(i * block_size), i));
+         if (registered)
+         {
+            requests.back().buffer_index = 1;
+            requests.back().file_index = 0;
+         }
+      }
+      REQUIRE(queue.submit(requests, submitted).ok());
+      REQUIRE(submitted == blocks);
+      reaped = 0;
+      while (reaped < blocks)
+      {
+         REQUIRE(queue.reap(completions, blocks - reaped, count).ok());
+         for (size_t i = 0; i < count; ++i)
+         {
+            REQUIRE(completions[i].status.ok());
+            REQUIRE(completions[i].bytes == block_size);
+         }
+         reaped += count;
+      }
+      REQUIRE(std::memcmp(input.data(), output.data(), output.size()) == 0);
+
+      // short read past the end of file
+      REQUIRE(queue.submit(aio::read(file, input.data(), block_size, static_cast<off64_t>(blocks * block_size - 100), 0)).ok());
+      REQUIRE(queue.reap(completions, 1, count).ok());
+      REQUIRE(count == 1);
+      REQUIRE(completions[0].status.ok());
+      REQUIRE(completions[0].bytes == 100);
+
+      if (registered)
+      {
+         REQUIRE(queue.register_buffers({}).ok());
+         REQUIRE(queue.register_files({}).ok());
+      }
+   }
+
+} // namespace aio_ut
+
+TEST_CASE("aio::queue_t class unit tests", "[aio]")
+{
+   using namespace aio_ut;
+   llfio_t file;
+   file.remove(filename);
+   REQUIRE(file.open(filename, llfio_t::mode_t::create_always, llfio_t::access_t::read_write, llfio_t::async).ok());
+
+   SECTION("native backend")
+   {
+      aio::queue_t queue;
+      REQUIRE(queue.status().ok());
+      REQUIRE(queue.backend() != aio::backend_t::automatic);
+      write_read_blocks(queue, file, false);
+   }
+   SECTION("native backend with registered buffers and files")
+   {
+      aio::queue_t queue;
+      REQUIRE(queue.status().ok());
+      write_read_blocks(queue, file, true);
+   }
+   SECTION("thread pool backend")
+   {
+      aio::queue_t queue(AIO_DEFAULT_QUEUE_DEPTH, aio::backend_t::thread_pool, 2);
+      REQUIRE(queue.status().ok());
+      REQUIRE(queue.backend() == aio::backend_t::thread_pool);
+      write_read_blocks(queue, file, true);
+   }
+   SECTION("queue depth limits a batch")
+   {
+      aio::queue_t queue(4);
+      REQUIRE(queue.status().ok());
+      char buffer[16]{};
+      std::vector<aio::request_t> requests(64, aio::read(file, buffer, sizeof(buffer), 0, 0));
+      size_t submitted{};
+      REQUIRE(queue.submit(requests, submitted).ok());
+      REQUIRE(submitted > 0);
+      REQUIRE(submitted <= requests.size());
+      std::vector<aio::completion_t> completions(requests.size());
+      size_t count{};
+      REQUIRE(queue.reap(completions, requests.size(), count).ok());
+      REQUIRE(count == submitted);
+      REQUIRE(queue.in_flight() == 0);
+   }
+   SECTION("bad handle reports an error completion")
+   {
+      aio::queue_t queue;
+      char buffer[16]{};
+      aio::request_t request = aio::read(file, buffer, sizeof(buffer), 0, 7);
+      request.handle = llfio_t::invalid_handle();
+      REQUIRE(queue.submit(request).ok());
+      aio::completion_t completion;
+      size_t count{};
+      REQUIRE(queue.reap(std::span<aio::completion_t>(&completion, 1), 1, count).ok());
+      REQUIRE(count == 1);
+      REQUIRE(completion.user_data == 7);
+      REQUIRE(completion.status.nok());
+   }
+   file.close();
+   file.remove(filename);
+}
@@ -0,0 +1,220 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include "rmlib/buffer_pool.h"
+#include "rmlib/socket.h"
+#include "loopback.h"
+
+using namespace rmlib;
+
+TEST_CASE("buffer_pool_t size classes", "[buffer-pool]")
+{
+   buffer_pool_t pool;
+   REQUIRE(pool.reserved_bytes() == 0);
+   REQUIRE(buffer_pool_t::size_class(0) == 0);
+   REQUIRE(buffer_pool_t::size_class(1024) == 0);
+   REQUIRE(buffer_pool_t::size_class(1025) == 1);
+   REQUIRE(buffer_pool_t::size_class(buffer_pool_t::max_size()) == BUFFER_POOL_SIZE_CLASSES.size() - 1);
+
+   buffer_t small = pool.acquire(100);
+   REQUIRE(small);
+   REQUIRE(small.empty());
+   REQUIRE(small.capacity() == 1024);
+   REQUIRE(reinterpret_cast<uintptr_t>(small.data()) % 1024 == 0);
+   buffer_t large = pool.acquire(20000);
+   REQUIRE(large.capacity() == 64 * 1024);
+   REQUIRE(pool.reserved_bytes() == 2 * BUFFER_POOL_SLAB_SIZE);
+   REQUIRE(pool.in_use() == 2);
+   REQUIRE_FALSE(pool.acquire(buffer_pool_t::max_size() + 1));
+   REQUIRE(pool.in_use() == 2);
+}
+
+TEST_CASE("buffer_t references and slices", "[buffer-pool]")
+{
+   buffer_pool_t pool;
+   buffer_t buffer = pool.acquire(4096);
+   const size_t free_before = pool.available(buffer_pool_t::size_class(4096));
+   std::memcpy(buffer.tail().data(), "hello world", 11);
+   buffer.resize(11);
+   REQUIRE(std::string(buffer.data(), buffer.size()) == "hello world");
+   REQUIRE(buffer.available() == 4096 - 11);
+   buffer.resize(100000);
+   REQUIRE(buffer.size() == buffer.capacity());
+   buffer.resize(11);
+
+   buffer_t world = buffer.slice(6);
+   REQUIRE(std::string(world.data(), world.size()) == "world");
+   REQUIRE(world.slab_index() == buffer.slab_index());
+   REQUIRE(buffer.use_count() == 2);
+   REQUIRE(buffer.slice(20).empty());
+   // appending to a slice never runs into bytes of the parent
+   buffer_t hello = buffer.slice(0, 5);
+   REQUIRE(hello.capacity() == 5);
+   REQUIRE(hello.tail().empty());
+   hello.resize(11);
+   REQUIRE(hello.size() == 5);
+   REQUIRE(std::string(buffer.data(), buffer.size()) == "hello world");
+   hello.reset();
+   buffer_t copy = buffer;
+   REQUIRE(buffer.use_count() == 3);
+   // nor does appending to a copy, the copy has no free tail
+   REQUIRE(copy.capacity() == copy.size());
+   REQUIRE(copy.tail().empty());
+   std::memcpy(buffer.tail().data(), "AAAA", 4);
+   buffer.resize(15);
+   copy.resize(15);
+   REQUIRE(copy.size() == 11);
+   REQUIRE(std::string(buffer.data(), buffer.size()) == "hello worldAAAA");
+   buffer_t assigned;
+   assigned = buffer;
+   REQUIRE(assigned.capacity() == 15);
+   assigned.reset();
+   buffer.resize(11);
+   buffer.reset();
+   REQUIRE_FALSE(buffer);
+   REQUIRE(copy.use_count() == 2);
+   copy = std::move(world);
+   REQUIRE(copy.use_count() == 1);
+   REQUIRE(pool.in_use() == 1);
+   copy.reset();
+   REQUIRE(pool.in_use() == 0);
+   REQUIRE(pool.available(buffer_pool_t::size_class(4096)) == free_before + 1);
+
+   // the released block is handed out again, no new slab
+   buffer_t again = pool.acquire(4096);
+   REQUIRE(pool.reserved_bytes() == BUFFER_POOL_SLAB_SIZE);
+   REQUIRE(pool.available(buffer_pool_t::size_class(4096)) == free_before);
+}
+
+TEST_CASE("buffer_pool_t reserve and slabs", "[buffer-pool]")
+{
+   buffer_pool_t pool;
+   REQUIRE(pool.reserve(16 * 1024, 40));
+   REQUIRE(pool.available(buffer_pool_t::size_class(16 * 1024)) >= 40);
+   auto slabs = pool.slabs();
+   REQUIRE(slabs.size() == 3);
+   for (auto& slab : slabs)
+   {
+      REQUIRE(slab.size() == BUFFER_POOL_SLAB_SIZE);
+      REQUIRE(reinterpret_cast<uintptr_t>(slab.data()) % BUFFER_POOL_SLAB_ALIGNMENT == 0);
+   }
+   buffer_t buffer = pool.acquire(16 * 1024);
+   REQUIRE(buffer.slab_index() >= 0);
+   REQUIRE(static_cast<size_t>(buffer.slab_index()) < slabs.size());
+   const auto& slab = slabs[static_cast<size_t>(buffer.slab_index())];
+   REQUIRE(buffer.data() >= slab.data());
+   REQUIRE(buffer.data() + buffer.capacity() <= slab.data() + slab.size());
+   REQUIRE(pool.reserved_bytes() == 3 * BUFFER_POOL_SLAB_SIZE);
+}
+
+TEST_CASE("buffer_pool_t from many threads", "[buffer-pool]")
+{
+   constexpr size_t threads = 4;
+   constexpr size_t rounds = 20000;
+   buffer_pool_t pool;
+   std::vector<buffer_t> handoff(threads);
+   std::vector<std::thread> workers;
+   std::atomic<size_t> failures{ 0 };
+   for (size_t t = 0; t < threads; ++t)
+   {
+      workers.emplace_back([&pool, &failures, t]()
+      {
+         std::vector<buffer_t> held;
+         for (size_t i = 0; i < rounds; ++i)
+         {
+            buffer_t buffer = pool.acquire((i % 4 + 1) * 1000);
+            if (!buffer)
+            {
+               failures.fetch_add(1);
+               continue;
+            }
+            std::memset(buffer.data(), static_cast<int>(t), 16);
+            buffer.resize(16);
+            held.push_back(std::move(buffer));
+            if (held.size() > 32)
+            {
+               for (size_t j = 0; j < 16; ++j)
+               {
+                  if (held[j].data()[15] != static_cast<char>(t)) failures.fetch_add(1);
+               }
+               held.erase(held.begin(), held.begin() + 16);
+            }
+         }
+      });
+   }
+   for (auto& worker : workers) worker.join();
+   REQUIRE(failures.load() == 0);
+   REQUIRE(pool.in_use() == 0);
+   // blocks are recycled, the pool stays near the peak working set
+   REQUIRE(pool.reserved_bytes() <= 16 * BUFFER_POOL_SLAB_SIZE);
+}
+
+TEST_CASE("socket_t recv and send with pooled buffers", "[buffer-pool]")
+{
+   buffer_pool_t pool;
+   socket_t server;
+   REQUIRE(server.listen(loopback_address()).ok());
+   socket_t client;
+   REQUIRE(client.connect(server.local_address()).ok());
+   socket_t peer;
+   REQUIRE(server.accept(peer, socket_mode_t::nonblocking).ok());
+
+   // an idle connection gives its buffer back
+   buffer_t buffer;
+   size_t bytes{};
+   REQUIRE(peer.recv(pool, buffer, bytes).would_block());
+   REQUIRE_FALSE(buffer);
+   REQUIRE(pool.in_use() == 0);
+
+   buffer_t message = pool.acquire(1000);
+   std::memset(message.data(), 'x', 1000);
+   message.resize(1000);
+   size_t index{};
+   REQUIRE(client.send(message, index, bytes).ok());
+   REQUIRE(index == message.size());
+
+   while (buffer.size() < message.size())
+   {
+      socket::status_t status = peer.recv(pool, buffer, bytes, 4096);
+      if (status.would_block()) continue;
+      REQUIRE(status.ok());
+      REQUIRE(bytes > 0);
+   }
+   REQUIRE(buffer.capacity() == 4096);
+   REQUIRE(std::memcmp(buffer.data(), message.data(), message.size()) == 0);
+
+   // a full buffer cannot receive more
+   buffer_t full = pool.acquire(1024);
+   full.resize(full.capacity());
+   REQUIRE(peer.recv(full, bytes).nok());
+   REQUIRE(client.disconnect().ok());
+}
@@ -0,0 +1,247 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <string>
+
+#include "rmlib/coroutine.h"
+#include "loopback.h"
+
+using namespace rmlib;
+
+// defined in socket-ut.cpp
+extern const char* tls_cert_file;
+extern const char* tls_key_file;
+bool make_self_signed_certificate() noexcept;
+
+namespace coroutine_ut {
+
+   socket_task_t echo_session(socket_reactor_t& reactor, socket_t client, size_t& served) noexcept
+   {
+      char buffer[1024];
+      socket::status_t status = co_await async_handshake(reactor, client);
+      while (status.ok())
+      {
+         size_t received{};
+         if (status = co_await async_recv(reactor, client, buffer, sizeof(buffer), received); status.nok()) break;
+         size_t sent{};
+         status = co_await async_send(reactor, client, buffer, received, sent);
+      }
+      reactor.detach(client);
+      ++served;
+   }
+
+   socket_task_t echo_server(socket_reactor_t& reactor, socket_t& listener, size_t connections, size_t& served) noexcept
+   {
+      for (size_t i = 0; i < connections; ++i)
+      {
+         socket_t client;
+         if (socket::status_t status = co_await async_accept(reactor, listener, client); status.nok()) break;
+         echo_session(reactor, std::move(client), served);
+      }
+      reactor.detach(listener);
+   }
+
+   socket_task_t echo_client(socket_reactor_t& reactor, tls::context_t* ctx, ip::address_t address, std::string message, size_t& echoed) noexcept
+   {
+      socket_t socket = ctx ? socket_t(*ctx) : socket_t();
+      if (socket::status_t status = co_await async_connect(reactor, socket, address); status.nok()) co_return;
+      size_t sent{};
+      if (socket::status_t status = co_await async_send(reactor, socket, message, sent); status.nok() || sent != message.size()) co_return;
+      std::string reply(message.size(), '\0');
+      size_t index{};
+      while (index < reply.size())
+      {
+         size_t received{};
+         if (socket::status_t status = co_await async_recv(reactor, socket, reply.data() + index, reply.size() - index, received); status.nok() || received == 0) break;
+         index += received;
+      }
+      reactor.detach(socket);
+      if (reply == message) ++echoed;
+   }
+
+   socket_task_t recv_one(socket_reactor_t& reactor, socket_t& socket, socket::status_t& result, bool& done) noexcept
+   {
+      char byte{};
+      size_t received{};
+      result = co_await async_recv(reactor, socket, &byte, 1, received);
+      done = true;
+   }
+
+   socket_task_t connect_one(socket_reactor_t& reactor, socket_t& socket, ip::address_t address, socket::status_t& result, bool& done) noexcept
+   {
+      result = co_await async_connect(reactor, socket, address);
+      done = true;
+   }
+
+} // namespace coroutine_ut
+
+TEST_CASE("coroutine echo over loopback TCP", "[coroutine]")
+{
+   constexpr size_t clients = 100;
+   socket_reactor_t reactor;
+   REQUIRE(reactor.status().ok());
+   socket_t listener;
+   REQUIRE(listener.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+   size_t served{};
+   size_t echoed{};
+   coroutine_ut::echo_server(reactor, listener, clients, served);
+   for (size_t i = 0; i < clients; ++i)
+   {
+      // larger than a socket buffer for some clients so sends also suspend
+      coroutine_ut::echo_client(reactor, nullptr, listener.local_address(), std::string(i % 10 == 0 ? 1'000'000 : 100 + i, static_cast<char>('a' + i % 26)), echoed);
+   }
+   REQUIRE(reactor.waiting() > 0);
+   REQUIRE(reactor.run(1000).ok());
+   REQUIRE(echoed == clients);
+   REQUIRE(served == clients);
+   REQUIRE(reactor.waiting() == 0);
+   REQUIRE(reactor.size() == 0);
+}
+
+TEST_CASE("coroutine echo over loopback TLS", "[coroutine]")
+{
+   constexpr size_t clients = 10;
+   REQUIRE(make_self_signed_certificate());
+   tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+   REQUIRE(server_ctx.status().ok());
+   tls::context_t client_ctx(tls::context_type_t::client);
+   REQUIRE(client_ctx.status().ok());
+   socket_reactor_t reactor;
+   socket_t listener(server_ctx);
+   REQUIRE(listener.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+   size_t served{};
+   size_t echoed{};
+   coroutine_ut::echo_server(reactor, listener, clients, served);
+   for (size_t i = 0; i < clients; ++i)
+   {
+      coroutine_ut::echo_client(reactor, &client_ctx, listener.local_address(), std::string(i == 0 ? 200'000 : 1000, 'x'), echoed);
+   }
+   REQUIRE(reactor.run(1000).ok());
+   REQUIRE(echoed == clients);
+   REQUIRE(served == clients);
+}
+
+TEST_CASE("coroutine TLS accepts are not held up by a stalled handshake", "[coroutine]")
+{
+   constexpr size_t clients = 4;
+   REQUIRE(make_self_signed_certificate());
+   tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+   REQUIRE(server_ctx.status().ok());
+   tls::context_t client_ctx(tls::context_type_t::client);
+   REQUIRE(client_ctx.status().ok());
+   socket_reactor_t reactor;
+   socket_t listener(server_ctx);
+   REQUIRE(listener.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+   size_t served{};
+   size_t echoed{};
+   // first in the backlog, connects over TCP and never sends a ClientHello
+   socket_t stalled;
+   REQUIRE(stalled.connect(listener.local_address()).ok());
+   coroutine_ut::echo_server(reactor, listener, clients + 1, served);
+   for (size_t i = 0; i < clients; ++i)
+   {
+      coroutine_ut::echo_client(reactor, &client_ctx, listener.local_address(), std::string(100, 's'), echoed);
+   }
+   rmlib::timer_t timer;
+   while ((echoed < clients || served < clients) && timer.elapsed() < 5'000'000) reactor.run_once(10);
+   REQUIRE(echoed == clients);
+   REQUIRE(served == clients);
+   // the stalled session ends with its connection
+   stalled.disconnect();
+   REQUIRE(reactor.run(1000).ok());
+   REQUIRE(served == clients + 1);
+}
+
+TEST_CASE("coroutine socket errors and timeouts", "[coroutine]")
+{
+   socket_reactor_t reactor;
+
+   SECTION("connect to a closed port fails")
+   {
+      ip::address_t address;
+      {
+         socket_t listener;
+         REQUIRE(listener.listen(loopback_address()).ok());
+         address = listener.local_address();
+      }
+      socket_t socket;
+      socket::status_t result;
+      bool done{ false };
+      coroutine_ut::connect_one(reactor, socket, address, result, done);
+      REQUIRE(reactor.run(1000).ok());
+      REQUIRE(done);
+      REQUIRE(result.nok());
+      REQUIRE(!result.would_block());
+      REQUIRE(socket.state() == socket_state_t::idle);
+   }
+   SECTION("a timeout completes the waiting operation")
+   {
+      socket_t listener;
+      REQUIRE(listener.listen(loopback_address()).ok());
+      socket_t client;
+      REQUIRE(client.connect(listener.local_address()).ok());
+      socket_t peer;
+      REQUIRE(listener.accept(peer, socket_mode_t::nonblocking).ok());
+      socket::status_t result;
+      bool done{ false };
+      coroutine_ut::recv_one(reactor, peer, result, done);
+      REQUIRE(!done);
+      REQUIRE(reactor.schedule_timeout(peer, 20));
+      REQUIRE(reactor.detach(peer).nok());
+      REQUIRE(reactor.run(1000).ok());
+      REQUIRE(done);
+      REQUIRE(result.error() == WSAETIMEDOUT);
+      REQUIRE(reactor.detach(peer).ok());
+      REQUIRE(client.disconnect().ok());
+   }
+   SECTION("one waiter per direction")
+   {
+      socket_t listener;
+      REQUIRE(listener.listen(loopback_address()).ok());
+      socket_t client;
+      REQUIRE(client.connect(listener.local_address()).ok());
+      socket_t peer;
+      REQUIRE(listener.accept(peer, socket_mode_t::nonblocking).ok());
+      socket::status_t first;
+      socket::status_t second;
+      bool first_done{ false };
+      bool second_done{ false };
+      coroutine_ut::recv_one(reactor, peer, first, first_done);
+      coroutine_ut::recv_one(reactor, peer, second, second_done);
+      REQUIRE(!first_done);
+      REQUIRE(second_done);
+      REQUIRE(second.error() == WSAEALREADY);
+      size_t index{};
+      size_t sent{};
+      REQUIRE(client.send("z", 1, index, sent).ok());
+      REQUIRE(reactor.run(1000).ok());
+      REQUIRE(first_done);
+      REQUIRE(first.ok());
+      REQUIRE(reactor.detach(peer).ok());
+      REQUIRE(client.disconnect().ok());
+   }
+}
@@ -0,0 +1,244 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <vector>
+#include <string>
+#include <array>
+#include <cstring>
+
+#include "rmlib/datagram.h"
+#include "loopback.h"
+
+using namespace rmlib;
+
+namespace datagram_ut {
+
+   // receive until count datagrams arrived or the socket has nothing more
+   size_t recv_all(datagram_socket_t& socket, std::span<datagram_t> messages, size_t count, size_t& calls) noexcept
+   {
+      size_t total{};
+      calls = 0;
+      while (total < count)
+      {
+         size_t received{};
+         socket::status_t status = socket.recv_many(messages.subspan(total), received);
+         if (status.would_block())
+         {
+            if (socket.wait_event(socket_event_t::recv_ready, 1000).nok()) break;
+            continue;
+         }
+         if (status.nok()) break;
+         ++calls;
+         total += received;
+      }
+      return total;
+   }
+
+} // namespace datagram_ut
+
+TEST_CASE("datagram_socket_t single datagrams", "[datagram]")
+{
+   datagram_socket_t server;
+   REQUIRE(server.bind(loopback_address()).ok());
+   REQUIRE(server.is_open());
+   REQUIRE(server.uid() != 0);
+   const ip::address_t server_address = server.local_address();
+   REQUIRE(server_address.port() != 0);
+
+   datagram_socket_t client;
+   size_t bytes{};
+   REQUIRE(client.send("no peer", 7, bytes).nok());
+   REQUIRE(client.connect(server_address).ok());
+   REQUIRE(client.is_connected());
+   REQUIRE(client.uid() != server.uid());
+   REQUIRE(client.send("hello", 5, bytes).ok());
+   REQUIRE(bytes == 5);
+
+   std::array<char, 64> buffer{};
+   ip::address_t from;
+   REQUIRE(server.recv_from(buffer.data(), buffer.size(), from, bytes).ok());
+   REQUIRE(std::string(buffer.data(), bytes) == "hello");
+   REQUIRE(from == client.local_address());
+
+   // reply to the source address
+   REQUIRE(server.send_to("world", 5, from, bytes).ok());
+   REQUIRE(client.recv(buffer.data(), buffer.size(), bytes).ok());
+   REQUIRE(std::string(buffer.data(), bytes) == "world");
+
+   // moved sockets keep their handle and uid
+   const rmlib::uid_t uid = client.uid();
+   datagram_socket_t moved{ std::move(client) };
+   REQUIRE(moved.uid() == uid);
+   REQUIRE_FALSE(client.is_open());
+   REQUIRE(moved.close().ok());
+   REQUIRE(moved.send("closed", 6, bytes).nok());
+}
+
+TEST_CASE("datagram_socket_t nonblocking and poller", "[datagram]")
+{
+   datagram_socket_t server;
+   REQUIRE(server.bind(loopback_address(), socket_mode_t::nonblocking).ok());
+   REQUIRE(server.mode() == socket_mode_t::nonblocking);
+   std::array<char, 64> buffer{};
+   size_t bytes{};
+   ip::address_t from;
+   REQUIRE(server.recv_from(buffer.data(), buffer.size(), from, bytes).would_block());
+   std::array<datagram_t, 4> messages{};
+   size_t count{};
+   REQUIRE(server.recv_many(messages, count).would_block());
+   REQUIRE(count == 0);
+   REQUIRE(server.wait_event(socket_event_t::recv_ready, SOCKET_WAIT_NEVER).would_block());
+
+   socket_poller_t poller;
+   REQUIRE(poller.add(server, socket_interest_t::recv).ok());
+   std::vector<socket_ready_t> ready;
+   REQUIRE(poller.wait(ready, SOCKET_WAIT_NEVER).would_block());
+
+   datagram_socket_t client;
+   REQUIRE(client.open(AF_INET).ok());
+   REQUIRE(client.send_to("ping", 4, server.local_address(), bytes).ok());
+   REQUIRE(poller.wait(ready, 1000).ok());
+   REQUIRE(ready.size() == 1);
+   REQUIRE(ready[0].uid == server.uid());
+   REQUIRE(ready[0].recv_ready());
+   REQUIRE(server.recv_from(buffer.data(), buffer.size(), from, bytes).ok());
+   REQUIRE(std::string(buffer.data(), bytes) == "ping");
+   REQUIRE(poller.remove(server).ok());
+}
+
+TEST_CASE("datagram_socket_t batches", "[datagram]")
+{
+   constexpr size_t datagrams = 200;
+   datagram_socket_t server;
+   REQUIRE(server.bind(loopback_address(), socket_mode_t::nonblocking, datagram_options_t{ .recv_buffer = 1 << 20 }).ok());
+   datagram_socket_t client;
+   REQUIRE(client.connect(server.local_address()).ok());
+
+   std::vector<std::string> payloads;
+   std::vector<datagram_t> out(datagrams);
+   for (size_t i = 0; i < datagrams; ++i) payloads.push_back("datagram " + std::to_string(i));
+   for (size_t i = 0; i < datagrams; ++i) out[i].buffer = std::span<char>(payloads[i]);
+
+   size_t sent{}, calls{};
+   while (sent < datagrams)
+   {
+      size_t count{};
+      REQUIRE(client.send_many(std::span<const datagram_t>(out).subspan(sent), count).ok());
+      REQUIRE(count > 0);
+      REQUIRE(count <= DATAGRAM_MAX_BATCH);
+      sent += count;
+      ++calls;
+   }
+   REQUIRE(calls >= datagrams / DATAGRAM_MAX_BATCH);
+
+   std::vector<std::array<char, 64>> buffers(datagrams);
+   std::vector<datagram_t> in(datagrams);
+   for (size_t i = 0; i < datagrams; ++i) in[i].buffer = buffers[i];
+   REQUIRE(datagram_ut::recv_all(server, in, datagrams, calls) == datagrams);
+   REQUIRE(calls < datagrams);
+   for (size_t i = 0; i < datagrams; ++i)
+   {
+      REQUIRE(std::string(in[i].buffer.data(), in[i].size) == payloads[i]);
+      REQUIRE(in[i].address == client.local_address());
+      REQUIRE_FALSE(in[i].truncated);
+   }
+
+   // datagrams larger than the buffer are cut and flagged
+   std::string large(100, 'x');
+   size_t bytes{};
+   REQUIRE(client.send(large.data(), large.size(), bytes).ok());
+   std::array<char, 10> small{};
+   datagram_t message{ small };
+   REQUIRE(datagram_ut::recv_all(server, std::span<datagram_t>(&message, 1), 1, calls) == 1);
+   REQUIRE(message.size == small.size());
+   REQUIRE(message.truncated);
+}
+
+TEST_CASE("datagram_socket_t segmentation offload", "[datagram]")
+{
+   constexpr size_t segment = 1000;
+   datagram_socket_t server;
+   REQUIRE(server.bind(loopback_address(), socket_mode_t::nonblocking).ok());
+   datagram_socket_t client;
+   REQUIRE(client.connect(server.local_address()).ok());
+
+   // one send of 10 segments arrives as 10 datagrams
+   std::string payload(10 * segment - 300, '\0');
+   for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>('a' + i / segment);
+   datagram_t message{ std::span<char>(payload) };
+   message.segment_size = segment;
+   size_t count{};
+   REQUIRE(client.send_many(std::span<const datagram_t>(&message, 1), count).ok());
+   REQUIRE(count == 1);
+
+   std::vector<std::array<char, segment>> buffers(10);
+   std::vector<datagram_t> in(10);
+   for (size_t i = 0; i < in.size(); ++i) in[i].buffer = buffers[i];
+   size_t calls{};
+   REQUIRE(datagram_ut::recv_all(server, in, in.size(), calls) == in.size());
+   for (size_t i = 0; i < in.size(); ++i)
+   {
+      REQUIRE(in[i].size == (i < 9 ? segment : segment - 300));
+      REQUIRE(in[i].buffer[0] == static_cast<char>('a' + i));
+   }
+
+#if defined(XPLAT_MMSG)
+   // with GRO the segments may come back coalesced, they always add up
+   datagram_socket_t gro;
+   REQUIRE(gro.bind(loopback_address(), socket_mode_t::nonblocking, datagram_options_t{ .gro = true }).ok());
+   REQUIRE(gro.is_gro());
+   datagram_socket_t sender;
+   REQUIRE(sender.connect(gro.local_address()).ok());
+   REQUIRE(sender.send_many(std::span<const datagram_t>(&message, 1), count).ok());
+   std::vector<char> storage(DATAGRAM_GRO_BUFFER_SIZE);
+   datagram_t coalesced{ std::span<char>(storage) };
+   size_t received{};
+   while (received < payload.size())
+   {
+      REQUIRE(datagram_ut::recv_all(gro, std::span<datagram_t>(&coalesced, 1), 1, calls) == 1);
+      if (coalesced.segment_size > 0) REQUIRE(coalesced.segment_size == segment);
+      REQUIRE(std::memcmp(coalesced.buffer.data(), payload.data() + received, coalesced.size) == 0);
+      received += coalesced.size;
+   }
+   REQUIRE(received == payload.size());
+#endif
+
+   // too many segments or too large a payload ends the batch
+   std::string many((DATAGRAM_MAX_SEGMENTS + 1) * 10, 'm');
+   std::vector<char> huge(DATAGRAM_MAX_PAYLOAD + 1);
+   std::array<datagram_t, 3> batch{ message, datagram_t{ std::span<char>(many) }, datagram_t{ std::span<char>(huge) } };
+   batch[1].segment_size = 10;
+   REQUIRE(client.send_many(batch, count).ok());
+   REQUIRE(count == 1);
+   REQUIRE(client.send_many(std::span<const datagram_t>(batch).subspan(1), count).error() == WSAEMSGSIZE);
+   REQUIRE(count == 0);
+   batch[1].segment_size = 20;
+   REQUIRE(client.send_many(std::span<const datagram_t>(batch).subspan(1), count).ok());
+   REQUIRE(count == 1);
+   REQUIRE(client.send_many(std::span<const datagram_t>(batch).subspan(2), count).error() == WSAEMSGSIZE);
+   REQUIRE(count == 0);
+}
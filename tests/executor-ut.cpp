@@ -0,0 +1,292 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "rmlib/executor.h"
+
+using namespace rmlib;
+
+namespace executor_ut {
+
+   struct counted_work_t : executor_work_t
+   {
+      std::atomic<size_t>* counter{ nullptr };
+
+      static void run(executor_work_t& work) noexcept
+      {
+         static_cast<counted_work_t&>(work).counter->fetch_add(1, std::memory_order_relaxed);
+      }
+   };
+
+   struct fan_out_t
+   {
+      executor_t* executor{ nullptr };
+      std::atomic<size_t>* counter{ nullptr };
+
+      // each call spawns two children until depth reaches zero
+      void spawn(unsigned depth) const noexcept
+      {
+         counter->fetch_add(1, std::memory_order_relaxed);
+         if (depth == 0) return;
+         fan_out_t self = *this;
+         executor->post([self, depth]() { self.spawn(depth - 1); });
+         executor->post([self, depth]() { self.spawn(depth - 1); });
+      }
+   };
+
+} // namespace executor_ut
+
+TEST_CASE("work_stealing_deque_t single thread", "[executor]")
+{
+   SECTION("owner pops newest first")
+   {
+      work_stealing_deque_t<uintptr_t> deque(4);
+      REQUIRE(deque.empty());
+      for (uintptr_t i = 1; i <= 3; ++i) REQUIRE(deque.push(i));
+      uintptr_t item{};
+      REQUIRE(deque.pop(item));
+      REQUIRE(item == 3);
+      REQUIRE(deque.size() == 2);
+      REQUIRE(deque.pop(item));
+      REQUIRE(item == 2);
+      REQUIRE(deque.pop(item));
+      REQUIRE(item == 1);
+      REQUIRE_FALSE(deque.pop(item));
+      REQUIRE(deque.empty());
+   }
+   SECTION("thieves steal oldest first")
+   {
+      work_stealing_deque_t<uintptr_t> deque(4);
+      for (uintptr_t i = 1; i <= 3; ++i) REQUIRE(deque.push(i));
+      uintptr_t item{};
+      REQUIRE(deque.steal(item));
+      REQUIRE(item == 1);
+      REQUIRE(deque.pop(item));
+      REQUIRE(item == 3);
+      REQUIRE(deque.steal(item));
+      REQUIRE(item == 2);
+      REQUIRE_FALSE(deque.steal(item));
+   }
+   SECTION("push grows the buffer and keeps the items")
+   {
+      work_stealing_deque_t<uintptr_t> deque(2);
+      REQUIRE(deque.capacity() == 2);
+      uintptr_t item{};
+      // move top away from zero so the copy has to wrap
+      REQUIRE(deque.push(0));
+      REQUIRE(deque.steal(item));
+      for (uintptr_t i = 1; i <= 100; ++i) REQUIRE(deque.push(i));
+      REQUIRE(deque.capacity() >= 100);
+      REQUIRE(deque.size() == 100);
+      for (uintptr_t i = 1; i <= 100; ++i)
+      {
+         REQUIRE(deque.steal(item));
+         REQUIRE(item == i);
+      }
+      REQUIRE(deque.empty());
+   }
+}
+
+TEST_CASE("work_stealing_deque_t concurrent steal", "[executor]")
+{
+   constexpr uintptr_t items = 100'000;
+   constexpr size_t thieves = 3;
+   work_stealing_deque_t<uintptr_t> deque(16);
+   std::vector<std::atomic<uint8_t>> seen(items + 1);
+   std::atomic<bool> done{ false };
+   std::atomic<size_t> stolen{ 0 };
+   std::vector<std::thread> threads;
+   for (size_t t = 0; t < thieves; ++t)
+   {
+      threads.emplace_back([&]()
+      {
+         uintptr_t item{};
+         while (!done.load(std::memory_order_acquire) || !deque.empty())
+         {
+            if (deque.steal(item))
+            {
+               seen[item].fetch_add(1, std::memory_order_relaxed);
+               stolen.fetch_add(1, std::memory_order_relaxed);
+            }
+            else std::this_thread::yield();
+         }
+      });
+   }
+   size_t popped{};
+   uintptr_t item{};
+   for (uintptr_t i = 1; i <= items; ++i)
+   {
+      REQUIRE(deque.push(i));
+      // pop every other push so owner and thieves race for the last item
+      if (i % 2 == 0 && deque.pop(item))
+      {
+         seen[item].fetch_add(1, std::memory_order_relaxed);
+         ++popped;
+      }
+   }
+   while (deque.pop(item))
+   {
+      seen[item].fetch_add(1, std::memory_order_relaxed);
+      ++popped;
+   }
+   done.store(true, std::memory_order_release);
+   for (auto& thread : threads) thread.join();
+   REQUIRE(popped + stolen.load() == items);
+   size_t duplicates{};
+   for (uintptr_t i = 1; i <= items; ++i)
+   {
+      if (seen[i].load() != 1) ++duplicates;
+   }
+   REQUIRE(duplicates == 0);
+}
+
+TEST_CASE("executor_t runs posted work", "[executor]")
+{
+   SECTION("external posts with embedded work items")
+   {
+      constexpr size_t items = 100'000;
+      std::atomic<size_t> counter{ 0 };
+      std::vector<executor_ut::counted_work_t> work(items);
+      {
+         executor_t executor(executor_options_t{ .threads = 4 });
+         REQUIRE(executor.status().ok());
+         REQUIRE(executor.size() == 4);
+         REQUIRE(executor.current_worker() == executor.size());
+         for (auto& item : work)
+         {
+            item.execute = &executor_ut::counted_work_t::run;
+            item.counter = &counter;
+            REQUIRE(executor.post(item));
+         }
+         executor.shutdown();
+         REQUIRE(counter.load() == items);
+         // no more work after shutdown
+         REQUIRE_FALSE(executor.post([]() {}));
+      }
+   }
+   SECTION("work posted by workers runs before shutdown returns")
+   {
+      std::atomic<size_t> counter{ 0 };
+      executor_t executor(executor_options_t{ .threads = 3 });
+      executor_ut::fan_out_t root{ &executor, &counter };
+      REQUIRE(executor.post([root]() { root.spawn(14); }));
+      executor.shutdown();
+      REQUIRE(counter.load() == (1u << 15) - 1);
+   }
+   SECTION("the destructor drains the queues")
+   {
+      std::atomic<size_t> counter{ 0 };
+      {
+         executor_t executor(executor_options_t{ .threads = 2 });
+         for (size_t i = 0; i < 1000; ++i) REQUIRE(executor.post([&counter]() { counter.fetch_add(1); }));
+      }
+      REQUIRE(counter.load() == 1000);
+   }
+}
+
+TEST_CASE("executor_t worker affinity", "[executor]")
+{
+   SECTION("post_to runs on the chosen worker without stealing")
+   {
+      // a single worker pool has no thief to take the work elsewhere
+      executor_t executor(executor_options_t{ .threads = 1, .pin_threads = true });
+      std::atomic<size_t> wrong{ 0 };
+      std::atomic<size_t> counter{ 0 };
+      for (size_t i = 0; i < 100; ++i)
+      {
+         REQUIRE(executor.post_to(0, [&]()
+         {
+            if (executor.current_worker() != 0) wrong.fetch_add(1);
+            counter.fetch_add(1);
+         }));
+      }
+      REQUIRE_FALSE(executor.post_to(1, []() {}));
+      executor.shutdown();
+      REQUIRE(counter.load() == 100);
+      REQUIRE(wrong.load() == 0);
+   }
+   SECTION("current_worker inside the pool")
+   {
+      executor_t executor(executor_options_t{ .threads = 4 });
+      std::vector<std::atomic<size_t>> workers(executor.size());
+      for (size_t i = 0; i < 1000; ++i)
+      {
+         REQUIRE(executor.post([&]()
+         {
+            size_t worker = executor.current_worker();
+            if (worker < workers.size()) workers[worker].fetch_add(1);
+         }));
+      }
+      executor.shutdown();
+      size_t total{};
+      for (auto& count : workers) total += count.load();
+      REQUIRE(total == 1000);
+   }
+   SECTION("worker_for is stable and spreads keys")
+   {
+      executor_t executor(executor_options_t{ .threads = 4 });
+      std::vector<size_t> hits(executor.size());
+      for (uint64_t uid = 1; uid <= 1000; ++uid)
+      {
+         size_t worker = executor.worker_for(uid);
+         REQUIRE(worker < executor.size());
+         REQUIRE(executor.worker_for(uid) == worker);
+         ++hits[worker];
+      }
+      for (size_t count : hits) REQUIRE(count > 100);
+   }
+}
+
+TEST_CASE("executor_t poll hook", "[executor]")
+{
+   std::atomic<size_t> polls{ 0 };
+   std::atomic<size_t> idle_polls{ 0 };
+   std::atomic<size_t> counter{ 0 };
+   executor_options_t options{ .threads = 2, .spin = 1 };
+   options.poll = [&](size_t worker, int64_t timeout_ms)
+   {
+      if (worker >= 2) return;
+      polls.fetch_add(1);
+      if (timeout_ms > 0)
+      {
+         idle_polls.fetch_add(1);
+         std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+      }
+   };
+   executor_t executor(options);
+   for (size_t i = 0; i < 1000; ++i) REQUIRE(executor.post([&counter]() { counter.fetch_add(1); }));
+   // idle workers keep polling
+   for (size_t retry = 0; retry < 500 && idle_polls.load() < 4; ++retry) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+   executor.shutdown();
+   REQUIRE(counter.load() == 1000);
+   REQUIRE(idle_polls.load() >= 4);
+   REQUIRE(polls.load() >= idle_polls.load());
+}
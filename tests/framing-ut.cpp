@@ -0,0 +1,258 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "rmlib/framing.h"
+
+using namespace rmlib;
+
+namespace framing_ut {
+
+   // hands out data in chunks of at most chunk bytes, then would block or,
+   // with close, reports an orderly shutdown
+   struct chunk_source_t
+   {
+      std::string data{};
+      size_t chunk{ 1 };
+      bool close{ false };
+      size_t position{};
+      size_t calls{};
+
+      socket::status_t recv(char* buffer, size_t len, size_t& bytes_received) noexcept
+      {
+         ++calls;
+         bytes_received = std::min({ len, chunk, data.size() - position });
+         if (bytes_received == 0) return close ? socket::status_t{ 0, status_code_t::closing } : socket::status_t{ WSAEWOULDBLOCK, status_code_t::want_read };
+         std::memcpy(buffer, data.data() + position, bytes_received);
+         position += bytes_received;
+         return socket::status_t{};
+      }
+   };
+
+   std::vector<std::string> read_all(framed_reader_t& reader, chunk_source_t& source) noexcept
+   {
+      std::vector<std::string> frames;
+      std::string_view frame;
+      while (reader.read(source, frame).ok()) frames.emplace_back(frame);
+      return frames;
+   }
+
+   std::string prefixed(const std::string& payload, unsigned bytes, bool big_endian) noexcept
+   {
+      std::string frame;
+      for (unsigned i = 0; i < bytes; ++i)
+      {
+         const unsigned shift = 8 * (big_endian ? bytes - 1 - i : i);
+         frame.push_back(static_cast<char>((static_cast<uint64_t>(payload.size()) >> shift) & 0xff));
+      }
+      return frame + payload;
+   }
+
+} // namespace framing_ut
+
+TEST_CASE("framing find_byte kernels", "[framing]")
+{
+   std::mt19937 random(7);
+   std::string data(300, '\0');
+   for (char& c : data) c = static_cast<char>('a' + random() % 26);
+   for (size_t position : { size_t{ 0 }, size_t{ 1 }, size_t{ 15 }, size_t{ 16 }, size_t{ 31 }, size_t{ 32 }, size_t{ 33 }, size_t{ 200 }, size_t{ 299 } })
+   {
+      std::string haystack = data;
+      haystack[position] = '\n';
+      for (size_t offset = 0; offset <= position; offset += 7)
+      {
+         for (size_t size : { position - offset, position - offset + 1, haystack.size() - offset })
+         {
+            const size_t expected = size > position - offset ? position - offset : size;
+            REQUIRE(framing::find_byte_scalar(haystack.data() + offset, size, '\n') == expected);
+            REQUIRE(framing::find_byte(haystack.data() + offset, size, '\n') == expected);
+#if defined(XPLAT_SIMD_SSE2)
+            REQUIRE(framing::find_byte_sse2(haystack.data() + offset, size, '\n') == expected);
+#endif
+#if defined(XPLAT_SIMD_AVX2)
+            REQUIRE(framing::find_byte_avx2(haystack.data() + offset, size, '\n') == expected);
+#endif
+#if defined(XPLAT_SIMD_NEON)
+            REQUIRE(framing::find_byte_neon(haystack.data() + offset, size, '\n') == expected);
+#endif
+         }
+      }
+   }
+   // bytes with the high bit set compare like any other
+   const std::string high("\x01\x80\xff\x7f", 4);
+   REQUIRE(framing::find_byte(high.data(), high.size(), '\xff') == 2);
+   REQUIRE(framing::find_byte(high.data(), 0, '\x01') == 0);
+}
+
+TEST_CASE("framed_reader_t delimited frames", "[framing]")
+{
+   SECTION("frames split across any chunk size")
+   {
+      for (size_t chunk : { 1, 3, 7, 64, 100000 })
+      {
+         framed_reader_t reader;
+         framing_ut::chunk_source_t source{ "alpha\nbeta\n\ngamma delta\nincomplete", chunk };
+         const auto frames = framing_ut::read_all(reader, source);
+         REQUIRE(frames == std::vector<std::string>{ "alpha", "beta", "", "gamma delta" });
+         REQUIRE(reader.pending() == std::string("incomplete").size());
+      }
+   }
+   SECTION("custom delimiter")
+   {
+      framed_reader_t reader(frame_options_t{ .delimiter = '\0' });
+      framing_ut::chunk_source_t source{ std::string("one\0two\0", 8), 5 };
+      REQUIRE(framing_ut::read_all(reader, source) == std::vector<std::string>{ "one", "two" });
+      REQUIRE(reader.pending() == 0);
+   }
+   SECTION("crlf keeps bare line feeds")
+   {
+      framed_reader_t reader(frame_options_t{ .format = frame_format_t::crlf });
+      framing_ut::chunk_source_t source{ "GET / HTTP/1.1\r\nHost: a\nb\r\n\r\n\n\r\n", 1 };
+      REQUIRE(framing_ut::read_all(reader, source) == std::vector<std::string>{ "GET / HTTP/1.1", "Host: a\nb", "", "\n" });
+   }
+   SECTION("next returns every buffered frame without I/O")
+   {
+      framed_reader_t reader;
+      framing_ut::chunk_source_t source{ "a\nbb\nccc\n", 1000 };
+      REQUIRE(reader.fill(source).ok());
+      std::vector<std::string_view> frames;
+      std::string_view frame;
+      while (reader.next(frame)) frames.push_back(frame);
+      // all views are still valid
+      REQUIRE(frames.size() == 3);
+      REQUIRE(frames[0] == "a");
+      REQUIRE(frames[1] == "bb");
+      REQUIRE(frames[2] == "ccc");
+      REQUIRE(source.calls == 1);
+   }
+   SECTION("a long frame is scanned once")
+   {
+      framed_reader_t reader;
+      std::string line(50000, 'x');
+      framing_ut::chunk_source_t source{ line + "\n", 100 };
+      const auto frames = framing_ut::read_all(reader, source);
+      REQUIRE(frames.size() == 1);
+      REQUIRE(frames[0] == line);
+   }
+   SECTION("frames longer than max_frame fail")
+   {
+      framed_reader_t reader(frame_options_t{ .max_frame = 8, .buffer_size = 16 });
+      framing_ut::chunk_source_t source{ "12345678\n123456789\n", 4 };
+      std::string_view frame;
+      REQUIRE(reader.read(source, frame).ok());
+      REQUIRE(frame == "12345678");
+      socket::status_t status = reader.read(source, frame);
+      REQUIRE(status.nok());
+      REQUIRE(status.error() == WSAEMSGSIZE);
+      REQUIRE(reader.read(source, frame).error() == WSAEMSGSIZE);
+      reader.reset();
+      REQUIRE(reader.pending() == 0);
+   }
+   SECTION("the source status is passed through")
+   {
+      framed_reader_t reader;
+      framing_ut::chunk_source_t source{ "last\npartial", 3, true };
+      std::string_view frame;
+      REQUIRE(reader.read(source, frame).ok());
+      REQUIRE(frame == "last");
+      socket::status_t status = reader.read(source, frame);
+      REQUIRE(status.code() == status_code_t::closing);
+   }
+   SECTION("a moved from reader is empty")
+   {
+      framed_reader_t reader;
+      framing_ut::chunk_source_t source{ "a\npartial", 1000 };
+      std::string_view frame;
+      REQUIRE(reader.read(source, frame).ok());
+      framed_reader_t moved{ std::move(reader) };
+      REQUIRE(reader.capacity() == 0);
+      REQUIRE(reader.pending() == 0);
+      REQUIRE_FALSE(reader.next(frame));
+      REQUIRE(reader.fill(source).error() == WSAENOBUFS);
+      REQUIRE(moved.pending() == std::string("partial").size());
+      framed_reader_t assigned;
+      assigned = std::move(moved);
+      REQUIRE(moved.capacity() == 0);
+      REQUIRE(moved.pending() == 0);
+      REQUIRE(assigned.pending() == std::string("partial").size());
+   }
+}
+
+TEST_CASE("framed_reader_t length prefixed frames", "[framing]")
+{
+   for (unsigned bytes : { 1u, 2u, 4u, 8u })
+   {
+      for (bool big_endian : { true, false })
+      {
+         const std::vector<std::string> payloads{ "", "x", std::string(200, 'y'), "hello world" };
+         std::string stream;
+         for (const auto& payload : payloads) stream += framing_ut::prefixed(payload, bytes, big_endian);
+         framed_reader_t reader(frame_options_t{ .format = frame_format_t::length_prefix, .prefix_bytes = bytes, .big_endian = big_endian });
+         framing_ut::chunk_source_t source{ stream, 3 };
+         REQUIRE(framing_ut::read_all(reader, source) == payloads);
+         REQUIRE(reader.pending() == 0);
+      }
+   }
+   SECTION("a length above max_frame fails before the payload arrives")
+   {
+      framed_reader_t reader(frame_options_t{ .format = frame_format_t::length_prefix, .prefix_bytes = 2, .max_frame = 100 });
+      framing_ut::chunk_source_t source{ framing_ut::prefixed(std::string(101, 'z'), 2, true), 2 };
+      std::string_view frame;
+      REQUIRE(reader.read(source, frame).error() == WSAEMSGSIZE);
+      REQUIRE(source.position == 2);
+   }
+}
+
+TEST_CASE("framed_reader_t over socket_t", "[framing]")
+{
+   ip::address_list_t list;
+   REQUIRE(ip::address_resolution("127.0.0.1", "0", list, ip::resolution_type_t::passive).ok());
+   socket_t server;
+   REQUIRE(server.listen(list[0]).ok());
+   socket_t client;
+   REQUIRE(client.connect(server.local_address()).ok());
+   socket_t peer;
+   REQUIRE(server.accept(peer).ok());
+
+   std::string lines;
+   for (size_t i = 0; i < 1000; ++i) lines += "line " + std::to_string(i) + "\r\n";
+   size_t index{}, bytes{};
+   while (index < lines.size()) REQUIRE(client.send(lines, index, bytes).ok());
+
+   framed_reader_t reader(frame_options_t{ .format = frame_format_t::crlf });
+   std::string_view frame;
+   for (size_t i = 0; i < 1000; ++i)
+   {
+      REQUIRE(reader.read(peer, frame).ok());
+      REQUIRE(frame == "line " + std::to_string(i));
+   }
+   REQUIRE(client.disconnect().ok());
+   REQUIRE(reader.read(peer, frame).code() == status_code_t::closing);
+}
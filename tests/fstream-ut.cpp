@@ -25,16 +25,163 @@
 *  If not, see https://opensource.org/licenses/MIT.
 \*****************************************************************************/
 #include <catch.hpp>
+#include <thread>
 
 #include "rmlib/fstream.h"
 
 using namespace rmlib;
 
+namespace fstream_ut {
+
+   const char* filename{ "rmlib-fstream-ut.bin" };
+
+   std::string make_content(size_t size) noexcept
+   {
+      std::string content(size, '\0');
+      for (size_t i = 0; i < size; ++i) content[i] = static_cast<char>('a' + (i % 26));
+      return content;
+   }
+
+} // namespace fstream_ut
+
 TEST_CASE("fstream_t class unit tests", "[fstream]")
 {
    SECTION("")
    {
       REQUIRE(true);
    }
+   SECTION("size and positional I/O leave the stream position alone")
+   {
+      using namespace fstream_ut;
+      const std::string content = make_content(10000);
+      fstream_t file;
+      file.remove(filename);
+      size_t bytes{};
+      REQUIRE(file.open(filename, fstream_t::mode_t::create_new).ok());
+      REQUIRE(file.write(content, bytes).ok());
+      // buffered writes are counted
+      REQUIRE(file.size() == content.size());
+      REQUIRE(file.seek(100, fstream_t::whence_t::begin).ok());
+      REQUIRE(file.size() == content.size());
+      REQUIRE(file.tell() == 100);
+      std::string buffer;
+      REQUIRE(file.read_at(buffer, 50, 5000, bytes).ok());
+      REQUIRE(buffer == content.substr(5000, 50));
+      REQUIRE(file.read_at(buffer, 100, 9950, bytes).ok());
+      REQUIRE(bytes == 50);
+      REQUIRE(file.write_at(std::string("RMLIB"), 200, bytes).ok());
+      REQUIRE(bytes == 5);
+      REQUIRE(file.tell() == 100);
+      REQUIRE(file.read(buffer, 10, bytes).ok());
+      REQUIRE(buffer == content.substr(100, 10));
+      REQUIRE(file.read_at(buffer, 5, 200, bytes).ok());
+      REQUIRE(buffer == "RMLIB");
+      file.close();
+      REQUIRE(file.read_at(buffer, 5, 200, bytes).error() == EBADF);
+      REQUIRE(file.size() == 0);
+      file.remove(filename);
+   }
+   SECTION("threads share one stream")
+   {
+      using namespace fstream_ut;
+      constexpr size_t segment_size{ 4096 };
+      constexpr size_t segments{ 16 };
+      const std::string content = make_content(segment_size * segments);
+      fstream_t file;
+      file.remove(filename);
+      size_t bytes{};
+      REQUIRE(file.open(filename, fstream_t::mode_t::create_new).ok());
+      REQUIRE(file.write(content, bytes).ok());
+      file.flush();
+      fstream_t reader;
+      REQUIRE(reader.open(filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read).ok());
+      REQUIRE(reader.write_at(content, 0, bytes).error() == EBADF);
+      std::vector<std::thread> threads;
+      std::vector<char> results(segments);
+      for (size_t i = 0; i < segments; ++i)
+      {
+         threads.emplace_back([&reader, &content, &results, i]()
+         {
+            std::string buffer;
+            size_t count{};
+            results[i] = reader.size() == content.size() &&
+                         reader.read_at(buffer, segment_size, static_cast<off64_t>(i * segment_size), count).ok() &&
+                         buffer == content.substr(i * segment_size, segment_size);
+         });
+      }
+      for (auto& thread : threads) thread.join();
+      for (size_t i = 0; i < segments; ++i) REQUIRE(results[i]);
+      REQUIRE(reader.tell() == 0);
+      fstream_t moved{ std::move(reader) };
+      REQUIRE(moved.size() == content.size());
+      REQUIRE(reader.size() == 0);
+      moved.close();
+      file.close();
+      file.remove(filename);
+   }
+   SECTION("buffering, hints and group commit")
+   {
+      using namespace fstream_ut;
+      fstream_t file;
+      file.remove(filename);
+      fstream_options_t options;
+      options.buffer_size = 64 * 1024;
+      options.advice = advice_t::sequential;
+      options.flush_bytes = 1000;
+      REQUIRE(file.open(filename, fstream_t::mode_t::create_new, fstream_t::access_t::read_write, options).ok());
+      fstream_t reader;
+      REQUIRE(reader.open(filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read).ok());
+      size_t bytes{};
+      const std::string record = make_content(100);
+      for (size_t i = 0; i < 9; ++i) REQUIRE(file.write(record, bytes).ok());
+      REQUIRE(file.pending_bytes() == 900);
+      // still in the stdio buffer
+      REQUIRE(reader.size() == 0);
+      REQUIRE(file.write(record, bytes).ok());
+      REQUIRE(file.pending_bytes() == 0);
+      REQUIRE(reader.size() == 1000);
+      REQUIRE(file.write(record, bytes).ok());
+      REQUIRE(file.commit().ok());
+      REQUIRE(reader.size() == 1100);
+      REQUIRE(reader.advise(advice_t::willneed).ok());
+      REQUIRE(reader.advise(advice_t::random, 0, 100).ok());
+      file.close();
+      reader.close();
+      REQUIRE(file.commit().error() == EBADF);
+
+      // the stdio buffer grows to flush_bytes, so nothing reaches the OS early
+      options = fstream_options_t{};
+      options.flush_bytes = 64 * 1024;
+      REQUIRE(file.open(filename, fstream_t::mode_t::create_always, fstream_t::access_t::write, options).ok());
+      REQUIRE(reader.open(filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read).ok());
+      const std::string large = make_content(1000);
+      for (size_t i = 0; i < 60; ++i) REQUIRE(file.write(large, bytes).ok());
+      REQUIRE(reader.size() == 0);
+      REQUIRE(file.commit().ok());
+      REQUIRE(reader.size() == 60000);
+      file.close();
+      reader.close();
+
+      // caller supplied buffer, synchronous group commit
+      std::vector<char> buffer(8192);
+      options = fstream_options_t{};
+      options.buffer = buffer;
+      options.flush_bytes = 4096;
+      options.flush_sync = true;
+      REQUIRE(file.open(filename, fstream_t::mode_t::create_always, fstream_t::access_t::write, options).ok());
+      for (size_t i = 0; i < 41; ++i) REQUIRE(file.write(record, bytes).ok());
+      REQUIRE(file.pending_bytes() == 0);
+      REQUIRE(file.size() == 4100);
+      file.close();
+
+      options = fstream_options_t{};
+      options.buffering = fstream_buffering_t::none;
+      REQUIRE(file.open(filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read, options).ok());
+      std::string input;
+      REQUIRE(file.read(input, 100, bytes).ok());
+      REQUIRE(input == record);
+      file.close();
+      file.remove(filename);
+   }
 }
 
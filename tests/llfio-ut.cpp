@@ -25,16 +25,117 @@
 *  If not, see https://opensource.org/licenses/MIT.
 \*****************************************************************************/
 #include <catch.hpp>
+#include <thread>
 
 #include "rmlib/llfio.h"
 
 using namespace rmlib;
 
+namespace llfio_ut {
+
+   const char* filename{ "rmlib-llfio-ut.bin" };
+
+   std::string make_content(size_t size, char first = 'a') noexcept
+   {
+      std::string content(size, '\0');
+      for (size_t i = 0; i < size; ++i) content[i] = static_cast<char>(first + (i % 26));
+      return content;
+   }
+
+} // namespace llfio_ut
+
 TEST_CASE("llfio_t class unit tests", "[llfio]")
 {
-   SECTION("")
+   using namespace llfio_ut;
+   llfio_t file;
+   file.remove(filename);
+
+   SECTION("open and close")
    {
-      REQUIRE(true);
+      REQUIRE(!file.is_open());
+      REQUIRE(file.open(filename).nok());
+      REQUIRE(file.open(filename, llfio_t::mode_t::create_new, llfio_t::access_t::read).error() == EINVAL);
+      REQUIRE(file.open(filename, llfio_t::mode_t::create_new).ok());
+      REQUIRE(file.is_open());
+      REQUIRE(!file.is_direct());
+      REQUIRE(file.exists(filename));
+      REQUIRE(file.close().ok());
+      REQUIRE(!file.is_open());
+      REQUIRE(file.open(filename, llfio_t::mode_t::create_new).error() == EEXIST);
+      REQUIRE(file.open(filename, llfio_t::mode_t::open_existing, llfio_t::access_t::read).ok());
+      llfio_t other{ std::move(file) };
+      REQUIRE(other.is_open());
+      REQUIRE(!file.is_open());
    }
+   SECTION("positional write_at and read_at")
+   {
+      const std::string content = make_content(10000);
+      size_t bytes{};
+      REQUIRE(file.open(filename, llfio_t::mode_t::create_always).ok());
+      REQUIRE(file.write_at(content, 100, bytes).ok());
+      REQUIRE(bytes == content.size());
+      REQUIRE(file.size() == content.size() + 100);
+      std::string buffer;
+      REQUIRE(file.read_at(buffer, 50, 100, bytes).ok());
+      REQUIRE(buffer == content.substr(0, 50));
+      REQUIRE(file.read_at(buffer, 50, 5000, bytes).ok());
+      REQUIRE(buffer == content.substr(4900, 50));
+      // short read at the end of file
+      REQUIRE(file.read_at(buffer, 1000, 9600, bytes).ok());
+      REQUIRE(bytes == 500);
+      REQUIRE(buffer == content.substr(9500));
+      REQUIRE(file.read_at(buffer, 10, 20000, bytes).ok());
+      REQUIRE(bytes == 0);
+      REQUIRE(file.datasync().ok());
+      REQUIRE(file.sync().ok());
+      REQUIRE(file.truncate(100).ok());
+      REQUIRE(file.size() == 100);
+   }
+   SECTION("threads share one handle without seek races")
+   {
+      constexpr size_t block_size{ 4096 };
+      constexpr size_t blocks{ 16 };
+      REQUIRE(file.open(filename, llfio_t::mode_t::create_always).ok());
+      std::vector<std::thread> threads;
+      std::vector<char> results(blocks);
+      for (size_t i = 0; i < blocks; ++i)
+      {
+         threads.emplace_back([&file, &results, i]()
+         {
+            std::string block = make_content(block_size, static_cast<char>('a' + i));
+            size_t bytes{};
+            std::string buffer;
+            results[i] = file.write_at(block, static_cast<off64_t>(i * block_size), bytes).ok() &&
+                         file.read_at(buffer, block_size, static_cast<off64_t>(i * block_size), bytes).ok() && 
+                         buffer == block;
+         });
+      }
+      for (auto& thread : threads) thread.join();
+      for (size_t i = 0; i < blocks; ++i) REQUIRE(results[i]);
+      REQUIRE(file.size() == block_size * blocks);
+   }
+   SECTION("direct I/O with aligned buffers")
+   {
+      aligned_buffer_t buffer(LLFIO_DIRECT_ALIGNMENT + 1);
+      REQUIRE(buffer.size() == 2 * LLFIO_DIRECT_ALIGNMENT);
+      REQUIRE(reinterpret_cast<uintptr_t>(buffer.data()) % LLFIO_DIRECT_ALIGNMENT == 0);
+      if (status_t status = file.open(filename, llfio_t::mode_t::create_always, llfio_t::access_t::read_write, llfio_t::direct); status.nok())
+      {
+         // some file systems, such as older tmpfs, do not support direct I/O
+         REQUIRE(status.error() == EINVAL);
+         return;
+      }
+      REQUIRE(file.is_direct());
+      const std::string content = make_content(buffer.size());
+      std::memcpy(buffer.data(), content.data(), content.size());
+      size_t bytes{};
+      REQUIRE(file.write_at(buffer, 0, bytes).ok());
+      REQUIRE(bytes == buffer.size());
+      aligned_buffer_t input(buffer.size());
+      REQUIRE(file.read_at(input.data(), input.size(), 0, bytes).ok());
+      REQUIRE(bytes == input.size());
+      REQUIRE(std::memcmp(input.data(), content.data(), content.size()) == 0);
+   }
+   file.close();
+   file.remove(filename);
 }
-
@@ -0,0 +1,57 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#pragma once
+
+#include <string>
+
+#include "rmlib/socket.h"
+
+// loopback helpers shared by the socket, coroutine, datagram, buffer pool
+// and metrics tests
+
+// numeric loopback address, port "0" lets listen() and bind() pick a free port
+inline rmlib::ip::address_t loopback_address(const std::string& port = "0") noexcept
+{
+   rmlib::ip::address_list_t list;
+   if (rmlib::socket::status_t status = rmlib::ip::address_resolution("127.0.0.1", port, list, rmlib::ip::resolution_type_t::passive); status.ok() && !list.empty())
+   {
+      return list[0];
+   }
+   return rmlib::ip::address_t{};
+}
+
+// listening sockets bind to an ephemeral port, retrieve the port chosen by the OS
+inline rmlib::ip::address_t bound_address(const rmlib::socket_t& socket) noexcept
+{
+   sockaddr name{};
+   socklen_t namelen{ sizeof(name) };
+   if (::getsockname(socket.handle(), &name, &namelen) == 0)
+   {
+      return rmlib::ip::address_t(name, namelen);
+   }
+   return rmlib::ip::address_t{};
+}
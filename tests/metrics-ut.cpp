@@ -0,0 +1,268 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <array>
+
+#include "rmlib/metrics.h"
+#include "rmlib/socket.h"
+#include "rmlib/fstream.h"
+#include "loopback.h"
+
+using namespace rmlib;
+
+namespace metrics_ut {
+
+   const char* filename{ "rmlib-metrics-ut.bin" };
+
+   static_assert(std::is_empty_v<null_metrics_t::counters_t>);
+   static_assert(io_metrics_policy_t::enabled, "tests build with RMLIB_IO_METRICS=rmlib::process_metrics_t");
+
+   io_op_snapshot_t op_snapshot(io_op_t op) noexcept
+   {
+      metrics_snapshot_t snapshot;
+      io_metrics_t::instance().snapshot(snapshot);
+      return snapshot[op];
+   }
+
+} // namespace metrics_ut
+
+TEST_CASE("histogram bucket math", "[metrics]")
+{
+   SECTION("small values are exact")
+   {
+      for (uint64_t value = 0; value < HISTOGRAM_SUB_BUCKETS; ++value)
+      {
+         REQUIRE(histogram_bucket(value) == value);
+         REQUIRE(histogram_bucket_lower(value) == value);
+         REQUIRE(histogram_bucket_upper(value) == value);
+      }
+   }
+   SECTION("every value falls inside its bucket bounds")
+   {
+      for (uint64_t value : std::array<uint64_t, 10>{ 16ull, 17ull, 31ull, 32ull, 33ull, 1000ull, 65535ull, 1'000'000ull, 123'456'789ull, HISTOGRAM_MAX_VALUE })
+      {
+         const size_t bucket = histogram_bucket(value);
+         REQUIRE(bucket < HISTOGRAM_BUCKETS);
+         REQUIRE(histogram_bucket_lower(bucket) <= value);
+         REQUIRE(histogram_bucket_upper(bucket) >= value);
+         // relative error bound of the log-linear layout
+         REQUIRE(histogram_bucket_upper(bucket) - histogram_bucket_lower(bucket) <= value / HISTOGRAM_SUB_BUCKETS);
+      }
+   }
+   SECTION("buckets are contiguous")
+   {
+      for (size_t bucket = 1; bucket < HISTOGRAM_BUCKETS; ++bucket)
+      {
+         REQUIRE(histogram_bucket_lower(bucket) == histogram_bucket_upper(bucket - 1) + 1);
+      }
+      REQUIRE(histogram_bucket_upper(HISTOGRAM_BUCKETS - 1) == HISTOGRAM_MAX_VALUE);
+   }
+   SECTION("large values are clamped")
+   {
+      REQUIRE(histogram_bucket(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+   }
+}
+
+TEST_CASE("histogram_t percentiles", "[metrics]")
+{
+   histogram_t histogram;
+   histogram_snapshot_t snapshot;
+   histogram.snapshot(snapshot);
+   REQUIRE(snapshot.count == 0);
+   REQUIRE(snapshot.percentile(50) == 0);
+   REQUIRE(snapshot.mean() == 0.0);
+
+   for (uint64_t value = 1; value <= 1000; ++value) histogram.record(value);
+   histogram.snapshot(snapshot);
+   REQUIRE(snapshot.count == 1000);
+   REQUIRE(snapshot.sum == 500500);
+   REQUIRE(snapshot.max == 1000);
+   REQUIRE(snapshot.mean() == Approx(500.5));
+   // percentiles report the bucket upper bound, within 1/16 of the exact value
+   REQUIRE(snapshot.percentile(50) >= 500);
+   REQUIRE(snapshot.percentile(50) <= 500 + 500 / HISTOGRAM_SUB_BUCKETS);
+   REQUIRE(snapshot.percentile(99) >= 990);
+   REQUIRE(snapshot.percentile(99) <= 1000);
+   REQUIRE(snapshot.percentile(100) == 1000);
+   REQUIRE(snapshot.percentile(0) == 1);
+
+   histogram.reset();
+   histogram.snapshot(snapshot);
+   REQUIRE(snapshot.count == 0);
+   REQUIRE(snapshot.max == 0);
+}
+
+TEST_CASE("sharded counters and histograms from many threads", "[metrics]")
+{
+   constexpr size_t threads = 4;
+   constexpr uint64_t per_thread = 10000;
+   sharded_counter_t counter;
+   histogram_t histogram;
+   std::vector<std::thread> workers;
+   for (size_t i = 0; i < threads; ++i)
+   {
+      workers.emplace_back([&, i]() {
+         for (uint64_t n = 0; n < per_thread; ++n)
+         {
+            counter.add();
+            histogram.record(i * 100 + 1);
+         }
+      });
+   }
+   for (auto& worker : workers) worker.join();
+   REQUIRE(counter.value() == threads * per_thread);
+   histogram_snapshot_t snapshot;
+   histogram.snapshot(snapshot);
+   REQUIRE(snapshot.count == threads * per_thread);
+   REQUIRE(snapshot.max == (threads - 1) * 100 + 1);
+   counter.reset();
+   REQUIRE(counter.value() == 0);
+}
+
+TEST_CASE("io_result classification", "[metrics]")
+{
+   REQUIRE(io_result(socket::status_t{}, 10, 10) == io_result_t::ok);
+   REQUIRE(io_result(socket::status_t{}, 10, 4) == io_result_t::partial);
+   REQUIRE(io_result(socket::status_t{}, 0, 4) == io_result_t::ok);
+   REQUIRE(io_result(socket::status_t{ WSAEWOULDBLOCK, status_code_t::want_read }, 10, 0) == io_result_t::would_block);
+   REQUIRE(io_result(socket::status_t{ WSAENOTCONN }, 10, 0) == io_result_t::error);
+   REQUIRE(io_result(status_t(EBADF), 10, 0) == io_result_t::error);
+   REQUIRE(std::string(to_string(io_op_t::tls_handshake)) == "tls_handshake");
+}
+
+TEST_CASE("socket_t send and receive metrics", "[metrics]")
+{
+   const io_op_snapshot_t send_before = metrics_ut::op_snapshot(io_op_t::tcp_send);
+   const io_op_snapshot_t recv_before = metrics_ut::op_snapshot(io_op_t::tcp_recv);
+   const io_op_snapshot_t accept_before = metrics_ut::op_snapshot(io_op_t::accept);
+
+   socket_t server;
+   REQUIRE(server.listen(loopback_address()).ok());
+   socket_t client;
+   REQUIRE(client.connect(server.local_address()).ok());
+   socket_t peer;
+   REQUIRE(server.accept(peer, socket_mode_t::nonblocking).ok());
+
+   // nothing to read on a nonblocking socket is counted but not timed
+   char buffer[256];
+   size_t bytes{};
+   REQUIRE(peer.recv(buffer, sizeof(buffer), bytes).would_block());
+   REQUIRE(peer.counters().read_would_block == 1);
+
+   const std::string message(1000, 'x');
+   size_t index{};
+   REQUIRE(client.send(message.data(), message.size(), index, bytes).ok());
+   REQUIRE(index == message.size());
+   std::string received;
+   while (received.size() < message.size())
+   {
+      socket::status_t status = peer.recv(buffer, sizeof(buffer), bytes);
+      if (status.would_block()) continue;
+      REQUIRE(status.ok());
+      REQUIRE(bytes > 0);
+      received.append(buffer, bytes);
+   }
+   REQUIRE(received == message);
+
+   REQUIRE(client.counters().writes >= 1);
+   REQUIRE(client.counters().bytes_written == message.size());
+   REQUIRE(client.counters().write_errors == 0);
+   REQUIRE(client.counters().reads == 0);
+   REQUIRE(peer.counters().bytes_read == message.size());
+   REQUIRE(peer.counters().reads >= 4);
+   REQUIRE(peer.counters().writes == 0);
+   REQUIRE(peer.counters().read_errors == 0);
+
+   const io_op_snapshot_t send_after = metrics_ut::op_snapshot(io_op_t::tcp_send);
+   const io_op_snapshot_t recv_after = metrics_ut::op_snapshot(io_op_t::tcp_recv);
+   REQUIRE(send_after.bytes - send_before.bytes == message.size());
+   REQUIRE(send_after.calls - send_before.calls == client.counters().writes);
+   REQUIRE(recv_after.bytes - recv_before.bytes == message.size());
+   REQUIRE(recv_after.would_block - recv_before.would_block == peer.counters().read_would_block);
+   REQUIRE(recv_after.latency.count - recv_before.latency.count == peer.counters().reads - peer.counters().read_would_block);
+   REQUIRE(metrics_ut::op_snapshot(io_op_t::accept).calls - accept_before.calls == 1);
+
+   // counters move with the socket
+   socket_t moved{ std::move(peer) };
+   REQUIRE(moved.counters().bytes_read == message.size());
+   REQUIRE(client.disconnect().ok());
+}
+
+TEST_CASE("fstream_t metrics", "[metrics]")
+{
+   std::remove(metrics_ut::filename);
+   const io_op_snapshot_t write_before = metrics_ut::op_snapshot(io_op_t::file_write);
+   const std::string content(4096, 'm');
+   {
+      fstream_t file;
+      REQUIRE(file.open(metrics_ut::filename, fstream_t::mode_t::create_new).ok());
+      size_t bytes{};
+      REQUIRE(file.write(content, bytes).ok());
+      REQUIRE(file.write_at(content.data(), 100, 0, bytes).ok());
+      REQUIRE(file.counters().writes == 2);
+      REQUIRE(file.counters().bytes_written == content.size() + 100);
+      REQUIRE(file.close().ok());
+   }
+   REQUIRE(metrics_ut::op_snapshot(io_op_t::file_write).calls - write_before.calls == 2);
+   {
+      fstream_t file;
+      REQUIRE(file.open(metrics_ut::filename, fstream_t::mode_t::open_existing, fstream_t::access_t::read).ok());
+      std::string data;
+      size_t bytes{};
+      REQUIRE(file.read(data, content.size() * 2, bytes).ok());
+      REQUIRE(bytes == content.size());
+      REQUIRE(file.read_at(data, 10, 0, bytes).ok());
+      REQUIRE(file.counters().reads == 2);
+      REQUIRE(file.counters().bytes_read == content.size() + 10);
+      REQUIRE(file.counters().read_errors == 0);
+      // read_at from many threads records into the same counters
+      constexpr size_t threads_count{ 8 };
+      constexpr size_t reads_per_thread{ 1000 };
+      std::vector<std::thread> threads;
+      for (size_t i = 0; i < threads_count; ++i)
+      {
+         threads.emplace_back([&file]()
+         {
+            char buffer[16];
+            size_t count{};
+            for (size_t j = 0; j < reads_per_thread; ++j) file.read_at(buffer, sizeof(buffer), static_cast<off64_t>(j), count);
+         });
+      }
+      for (auto& thread : threads) thread.join();
+      REQUIRE(file.counters().reads == 2 + threads_count * reads_per_thread);
+      REQUIRE(file.counters().bytes_read == content.size() + 10 + threads_count * reads_per_thread * 16);
+      REQUIRE(file.counters().read_errors == 0);
+      // failed operations count as errors
+      REQUIRE(file.write(content, bytes).nok());
+      REQUIRE(file.counters().write_errors == 1);
+   }
+   std::remove(metrics_ut::filename);
+}
@@ -0,0 +1,114 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+
+#include "rmlib/llfio.h"
+#include "rmlib/mmap.h"
+
+using namespace rmlib;
+
+namespace mmap_ut {
+
+   const char* filename{ "rmlib-mmap-ut.bin" };
+
+   std::string make_content(size_t size) noexcept
+   {
+      std::string content(size, '\0');
+      for (size_t i = 0; i < size; ++i) content[i] = static_cast<char>('a' + (i % 26));
+      return content;
+   }
+
+   std::string to_string(std::span<const std::byte> data) noexcept
+   {
+      return std::string(reinterpret_cast<const char*>(data.data()), data.size());
+   }
+
+} // namespace mmap_ut
+
+TEST_CASE("mapped_file_t class unit tests", "[mmap]")
+{
+   using namespace mmap_ut;
+   const std::string content = make_content(100000);
+   llfio_t file;
+   file.remove(filename);
+   size_t bytes{};
+   REQUIRE(file.open(filename, llfio_t::mode_t::create_always).ok());
+   REQUIRE(file.write_at(content, 0, bytes).ok());
+   mapped_file_t mapped;
+
+   SECTION("map the entire file read only")
+   {
+      REQUIRE(!mapped.is_mapped());
+      REQUIRE(mapped.map(filename).ok());
+      REQUIRE(mapped.is_mapped());
+      REQUIRE(!mapped.is_writable());
+      REQUIRE(mapped.size() == content.size());
+      REQUIRE(to_string(mapped.data()) == content);
+      REQUIRE(mapped.writable_data().empty());
+      REQUIRE(mapped.advise(advice_t::sequential).ok());
+      REQUIRE(mapped.advise(advice_t::willneed).ok());
+      REQUIRE(mapped.sync().error() == EACCES);
+      mapped_file_t other{ std::move(mapped) };
+      REQUIRE(other.is_mapped());
+      other.unmap();
+      REQUIRE(!other.is_mapped());
+   }
+   SECTION("map a sub-range at an unaligned offset")
+   {
+      REQUIRE(mapped.map(file, mapped_file_t::access_t::read, 5001, 20000).ok());
+      REQUIRE(mapped.size() == 20000);
+      REQUIRE(to_string(mapped.data()) == content.substr(5001, 20000));
+      mapped_view_t view = mapped.view(100, 50);
+      REQUIRE(view.size() == 50);
+      REQUIRE(to_string(view.data()) == content.substr(5101, 50));
+      REQUIRE(view.advise(advice_t::random).ok());
+      REQUIRE(to_string(view.subview(10, 5).data()) == content.substr(5111, 5));
+      REQUIRE(view.subview(40).size() == 10);
+      REQUIRE(view.subview(100).empty());
+   }
+   SECTION("writable map and sync")
+   {
+      REQUIRE(mapped.map(filename, mapped_file_t::access_t::read_write).ok());
+      REQUIRE(mapped.is_writable());
+      mapped_view_t view = mapped.view(70000, 4);
+      REQUIRE(view.is_writable());
+      std::memcpy(view.writable_data().data(), "RMLB", 4);
+      REQUIRE(view.sync().ok());
+      REQUIRE(mapped.sync().ok());
+      std::string buffer;
+      REQUIRE(file.read_at(buffer, 4, 70000, bytes).ok());
+      REQUIRE(buffer == "RMLB");
+   }
+   SECTION("map errors")
+   {
+      REQUIRE(mapped.map("rmlib-mmap-ut-missing.bin").error() == ENOENT);
+      REQUIRE(!mapped.is_mapped());
+   }
+   mapped.unmap();
+   file.close();
+   file.remove(filename);
+}
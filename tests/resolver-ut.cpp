@@ -0,0 +1,250 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "rmlib/resolver.h"
+
+using namespace rmlib;
+
+namespace resolver_ut {
+
+   // hand driven clock so cache expiry is deterministic
+   struct manual_clock_t
+   {
+      static int64_t& value() noexcept
+      {
+         static int64_t now{ 1'000'000'000 };
+         return now;
+      }
+
+      static int64_t now() noexcept
+      {
+         return value();
+      }
+
+      static void advance_ms(int64_t ms) noexcept
+      {
+         value() += ms * 1'000'000;
+      }
+   };
+
+   // answers every name with the loopback address, except names ending in
+   // .invalid, and counts the lookups that reach getaddrinfo
+   struct counting_info_t : public ip::info_t
+   {
+      static std::atomic<int>& calls() noexcept
+      {
+         static std::atomic<int> count{ 0 };
+         return count;
+      }
+
+      static int getaddrinfo(const char* host, const char* port, const ADDRINFOA* hints, PADDRINFOA* results) noexcept
+      {
+         ++calls();
+         std::string_view name{ host };
+         if (name.size() >= 8 && name.substr(name.size() - 8) == ".invalid")
+         {
+            *results = nullptr;
+            return EAI_NONAME;
+         }
+         return ip::info_t::getaddrinfo("127.0.0.1", port, hints, results);
+      }
+   };
+
+   using resolver_t = ip::basic_resolver_t<counting_info_t, manual_clock_t>;
+
+   // poll until count resolutions have been collected
+   std::vector<ip::resolution_t> collect(resolver_t& resolver, size_t count) noexcept
+   {
+      std::vector<ip::resolution_t> collected;
+      std::vector<ip::resolution_t> completions;
+      rmlib::timer_t timer;
+      while (collected.size() < count && timer.elapsed() < 5'000'000)
+      {
+         resolver.poll(completions);
+         for (auto& completion : completions) collected.push_back(std::move(completion));
+         if (collected.size() < count) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      std::sort(collected.begin(), collected.end(), [](const auto& lhs, const auto& rhs) { return lhs.user_data < rhs.user_data; });
+      return collected;
+   }
+
+} // namespace resolver_ut
+
+using namespace resolver_ut;
+
+TEST_CASE("Test resolver_cache_t", "[resolver-cache]")
+{
+   ip::basic_resolver_cache_t<manual_clock_t> cache(2);
+   ip::address_list_t list;
+   REQUIRE(ip::address_resolution("127.0.0.1", "80", list).ok());
+   const std::string a = cache.key("a", "80", ip::resolution_type_t::normal);
+   const std::string b = cache.key("b", "80", ip::resolution_type_t::normal);
+   const std::string c = cache.key("c", "80", ip::resolution_type_t::normal);
+   REQUIRE(a != cache.key("a", "80", ip::resolution_type_t::passive));
+
+   SECTION("entries expire after their ttl")
+   {
+      cache.store(a, list, socket::status_t{}, 100);
+      ip::address_list_t found;
+      socket::status_t status{ WSAEINVAL };
+      REQUIRE(cache.find(a, found, status));
+      REQUIRE(status.ok());
+      REQUIRE(found.size() == list.size());
+      REQUIRE(found[0].port() == 80);
+      manual_clock_t::advance_ms(100);
+      REQUIRE(!cache.find(a, found, status));
+      REQUIRE(cache.size() == 0);
+      cache.store(a, list, socket::status_t{}, 0);
+      REQUIRE(cache.size() == 0);
+   }
+   SECTION("least recently used entry is evicted")
+   {
+      cache.store(a, list, socket::status_t{}, 1000);
+      cache.store(b, list, socket::status_t{}, 1000);
+      ip::address_list_t found;
+      socket::status_t status;
+      REQUIRE(cache.find(a, found, status));
+      cache.store(c, list, socket::status_t{}, 1000);
+      REQUIRE(cache.size() == 2);
+      REQUIRE(cache.find(a, found, status));
+      REQUIRE(!cache.find(b, found, status));
+      REQUIRE(cache.find(c, found, status));
+      cache.remove(a);
+      REQUIRE(!cache.find(a, found, status));
+      cache.clear();
+      REQUIRE(cache.size() == 0);
+   }
+   SECTION("negative entries keep their status")
+   {
+      cache.store(a, ip::address_list_t{}, socket::status_t{ EAI_NONAME }, 100);
+      ip::address_list_t found;
+      socket::status_t status;
+      REQUIRE(cache.find(a, found, status));
+      REQUIRE(status.nok());
+      REQUIRE(status.error() == EAI_NONAME);
+      REQUIRE(found.empty());
+   }
+}
+
+TEST_CASE("Test resolver_t resolve", "[resolver]")
+{
+   ip::resolver_options_t options;
+   options.ttl_ms = 1000;
+   options.negative_ttl_ms = 100;
+   resolver_t resolver(options);
+   counting_info_t::calls() = 0;
+
+   SECTION("positive answers are served from the cache until they expire")
+   {
+      ip::address_list_t list;
+      REQUIRE(resolver.resolve("backend.test", "8080", list).ok());
+      REQUIRE(list.size() > 0);
+      REQUIRE(list[0].port() == 8080);
+      REQUIRE(resolver.resolve("backend.test:8080", list).ok());
+      REQUIRE(counting_info_t::calls() == 1);
+      REQUIRE(resolver.resolve("backend.test", "8081", list).ok());
+      REQUIRE(counting_info_t::calls() == 2);
+      manual_clock_t::advance_ms(1000);
+      REQUIRE(resolver.resolve("backend.test", "8080", list).ok());
+      REQUIRE(counting_info_t::calls() == 3);
+      REQUIRE(resolver.resolve("no-port", list).nok());
+   }
+   SECTION("negative answers are cached for the negative ttl")
+   {
+      ip::address_list_t list;
+      REQUIRE(resolver.resolve("missing.invalid", "80", list).nok());
+      REQUIRE(list.empty());
+      socket::status_t status = resolver.resolve("missing.invalid", "80", list);
+      REQUIRE(status.nok());
+      REQUIRE(status.error() == EAI_NONAME);
+      REQUIRE(counting_info_t::calls() == 1);
+      manual_clock_t::advance_ms(100);
+      REQUIRE(resolver.resolve("missing.invalid", "80", list).nok());
+      REQUIRE(counting_info_t::calls() == 2);
+   }
+}
+
+TEST_CASE("Test resolver_t resolve_async", "[resolver-async]")
+{
+   resolver_t resolver;
+   counting_info_t::calls() = 0;
+   std::vector<ip::resolution_t> completions;
+   resolver.poll(completions);
+   REQUIRE(completions.empty());
+#if defined(XPLAT_OS_LINUX)
+   REQUIRE(resolver.notify_handle() != INVALID_SOCKET);
+#endif
+
+   SECTION("completions are delivered through poll")
+   {
+      REQUIRE(resolver.resolve_async("one.test", "80", 1).ok());
+      REQUIRE(resolver.resolve_async("two.test:81", 2).ok());
+      REQUIRE(resolver.resolve_async("bad.invalid", "82", 3).ok());
+      REQUIRE(resolver.resolve_async("no-port", 4).nok());
+      auto collected = collect(resolver, 3);
+      REQUIRE(collected.size() == 3);
+      REQUIRE(collected[0].user_data == 1);
+      REQUIRE(collected[0].status.ok());
+      REQUIRE(collected[0].addresses[0].port() == 80);
+      REQUIRE(collected[1].addresses[0].port() == 81);
+      REQUIRE(collected[2].status.nok());
+      REQUIRE(collected[2].addresses.empty());
+      REQUIRE(resolver.pending() == 0);
+
+      // answered from the cache without another lookup
+      REQUIRE(resolver.resolve_async("one.test", "80", 5).ok());
+      REQUIRE(resolver.pending() == 1);
+      collected = collect(resolver, 1);
+      REQUIRE(collected.size() == 1);
+      REQUIRE(collected[0].user_data == 5);
+      REQUIRE(collected[0].status.ok());
+      REQUIRE(counting_info_t::calls() == 3);
+   }
+#if defined(XPLAT_OS_LINUX)
+   SECTION("notify handle wakes the poller")
+   {
+      socket_poller_t poller;
+      REQUIRE(poller.add(resolver.notify_handle(), 42, socket_interest_t::recv).ok());
+      REQUIRE(resolver.resolve_async("three.test", "83", 7).ok());
+      std::vector<socket_ready_t> ready;
+      REQUIRE(poller.wait(ready, 5000).ok());
+      REQUIRE(ready.size() == 1);
+      REQUIRE(ready[0].uid == 42);
+      auto collected = collect(resolver, 1);
+      REQUIRE(collected.size() == 1);
+      REQUIRE(collected[0].user_data == 7);
+      REQUIRE(poller.wait(ready, 0).would_block());
+   }
+#endif
+}
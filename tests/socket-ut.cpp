@@ -25,7 +25,16 @@
 *  If not, see https://opensource.org/licenses/MIT.
 \*****************************************************************************/
 #include <catch.hpp>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <openssl/pem.h>
+#include <openssl/ec.h>
 #include "rmlib/socket.h"
+#include "rmlib/connection_pool.h"
+#include "rmlib/fstream.h"
+#include "loopback.h"
 
 using namespace rmlib;
 
@@ -247,3 +256,1156 @@ TEST_CASE("Test TLS echo client - blocking - small buffer", "[tls-echo-cli-blk-s
 	REQUIRE(send_buffer == recv_buffer);
 	REQUIRE(socket.disconnect().ok());
 }
+
+TEST_CASE("Test socket_poller_t - loopback", "[socket-poller]")
+{
+	socket_poller_t poller;
+	REQUIRE(poller.status().ok());
+	REQUIRE(poller.empty());
+
+	socket_t server;
+	REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+	REQUIRE(poller.add(server, socket_event_t::accept_ready).ok());
+	REQUIRE(poller.size() == 1);
+
+	std::vector<socket_ready_t> ready;
+	REQUIRE(poller.wait(ready, SOCKET_WAIT_NEVER).would_block());
+	REQUIRE(ready.empty());
+
+	socket_t client;
+	REQUIRE(client.connect(bound_address(server)).ok());
+	REQUIRE(poller.wait(ready, 1000).ok());
+	REQUIRE(ready.size() == 1);
+	REQUIRE(ready[0].uid == server.uid());
+	REQUIRE(ready[0].accept_ready());
+
+	socket_t peer;
+	REQUIRE(server.accept(peer, socket_mode_t::nonblocking).ok());
+	REQUIRE(peer.uid() != 0);
+	REQUIRE(peer.uid() != server.uid());
+	REQUIRE(poller.add(peer, socket_interest_t::recv).ok());
+	REQUIRE(poller.wait(ready, SOCKET_WAIT_NEVER).would_block());
+
+	std::string msg{ "hello reactor" };
+	size_t index{};
+	size_t bytes_sent{};
+	REQUIRE(client.send(msg, index, bytes_sent).ok());
+	REQUIRE(bytes_sent == msg.size());
+	REQUIRE(poller.wait(ready, 1000).ok());
+	REQUIRE(ready.size() == 1);
+	REQUIRE(ready[0].uid == peer.uid());
+	REQUIRE(ready[0].recv_ready());
+	REQUIRE(!ready[0].closing());
+
+	std::string buffer;
+	size_t bytes_received{};
+	REQUIRE(peer.recv(buffer, bytes_received).ok());
+	REQUIRE(buffer == msg);
+	// edge triggered: no new data, no new event
+	REQUIRE(poller.wait(ready, SOCKET_WAIT_NEVER).would_block());
+
+	REQUIRE(client.disconnect().ok());
+	REQUIRE(poller.wait(ready, 1000).ok());
+	REQUIRE(ready.size() == 1);
+	REQUIRE(ready[0].closing());
+
+	REQUIRE(poller.remove(peer).ok());
+	REQUIRE(poller.remove(server).ok());
+	REQUIRE(poller.empty());
+	REQUIRE(poller.remove(peer).nok());
+}
+
+TEST_CASE("Test socket_poller_t timeouts - loopback", "[socket-poller-timeout]")
+{
+	socket_poller_t poller(SOCKET_DEFAULT_POLLER_MAX_EVENTS, 5);
+	REQUIRE(poller.status().ok());
+
+	socket_t server;
+	REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+	REQUIRE(poller.add(server, socket_event_t::accept_ready).ok());
+	REQUIRE(poller.schedule_timeout(server, 30, timer_kind_t::idle));
+	REQUIRE(poller.schedule_timeout(12345, 1000, timer_kind_t::handshake));
+	REQUIRE(poller.cancel_timeout(12345));
+	REQUIRE(!poller.cancel_timeout(12345));
+
+	// the timeout arrives from the same wait() as socket events
+	std::vector<socket_ready_t> ready;
+	rmlib::timer_t timer;
+	while (ready.empty() && timer.elapsed() < 2'000'000)
+	{
+		socket::status_t status = poller.wait(ready, 1000);
+		REQUIRE((status.ok() || status.would_block()));
+	}
+	REQUIRE(timer.elapsed() >= 25'000);
+	REQUIRE(timer.elapsed() < 1'000'000);
+	REQUIRE(ready.size() == 1);
+	REQUIRE(ready[0].uid == server.uid());
+	REQUIRE(ready[0].timeout());
+	REQUIRE(ready[0].timer == timer_kind_t::idle);
+	REQUIRE(!ready[0].recv_ready());
+	REQUIRE(poller.timers().empty());
+
+	REQUIRE(poller.schedule_timeout(server, 20, timer_kind_t::connect));
+	socket_t client;
+	REQUIRE(client.connect(bound_address(server)).ok());
+	REQUIRE(poller.wait(ready, 1000).ok());
+	REQUIRE(ready.size() == 1);
+	REQUIRE(ready[0].accept_ready());
+	REQUIRE(!ready[0].timeout());
+	REQUIRE(poller.cancel_timeout(server));
+	REQUIRE(poller.wait(ready, 50).would_block());
+
+	// removing a socket drops its pending timeout
+	REQUIRE(poller.schedule_timeout(server, 20, timer_kind_t::idle));
+	REQUIRE(poller.remove(server).ok());
+	REQUIRE(poller.timers().empty());
+	REQUIRE(poller.wait(ready, 50).would_block());
+	REQUIRE(ready.empty());
+}
+
+// connect a client to a loopback listening socket and accept the peer
+bool loopback_pair(socket_t& server, socket_t& client, socket_t& peer, socket_mode_t mode = socket_mode_t::blocking) noexcept
+{
+	if (server.listen(loopback_address(), mode).nok()) return false;
+	if (client.connect(bound_address(server), mode).nok()) return false;
+	if (server.wait_event(socket_event_t::accept_ready, 1000).nok()) return false;
+	return server.accept(peer, mode).ok();
+}
+
+TEST_CASE("Test socket_t zero copy recv - loopback", "[socket-recv-into]")
+{
+	socket_t server;
+	socket_t client;
+	socket_t peer;
+	REQUIRE(loopback_pair(server, client, peer));
+	std::string msg(KBytes(64), 'x');
+	size_t bytes_sent{};
+	REQUIRE(send_msg(client, msg, bytes_sent).ok());
+	REQUIRE(bytes_sent == msg.size());
+
+	SECTION("recv_into() caller owned buffer")
+	{
+		std::vector<char> buffer(msg.size());
+		size_t received{};
+		while (received < buffer.size())
+		{
+			size_t count{};
+			REQUIRE(peer.recv_into(std::span<char>{ buffer }.subspan(received), count).ok());
+			received += count;
+		}
+		REQUIRE(std::string(buffer.data(), buffer.size()) == msg);
+	}
+	SECTION("recv() appends in place to the container tail")
+	{
+		std::string buffer{ "prefix" };
+		size_t received{};
+		while (received < msg.size())
+		{
+			size_t count{};
+			REQUIRE(peer.recv<KBytes(4)>(buffer, count).ok());
+			REQUIRE(count <= KBytes(4));
+			received += count;
+			REQUIRE(buffer.size() == received + 6);
+		}
+		REQUIRE(buffer == "prefix" + msg);
+	}
+}
+
+TEST_CASE("Test socket_t vectored send and recv - loopback", "[socket-vectored]")
+{
+	socket_t server;
+	socket_t client;
+	socket_t peer;
+	REQUIRE(loopback_pair(server, client, peer));
+	const std::string header{ "HEADER:" };
+	const std::string body(KBytes(8), 'b');
+	const std::string trailer{ ":TRAILER" };
+	const std::string expected = header + body + trailer;
+
+	SECTION("send header, body and trailer in one call")
+	{
+		std::array<std::span<const char>, 3> buffers{ std::span<const char>{ header }, std::span<const char>{ body }, std::span<const char>{ trailer } };
+		size_t index{};
+		size_t bytes_sent{};
+		while (index < expected.size())
+		{
+			REQUIRE(client.send(buffers, index, bytes_sent).ok());
+		}
+		REQUIRE(index == expected.size());
+		REQUIRE(client.send(buffers, index, bytes_sent).ok());
+		REQUIRE(bytes_sent == 0);
+
+		std::string head(header.size(), '\0');
+		std::string rest(body.size() + trailer.size(), '\0');
+		std::array<std::span<char>, 2> parts{ std::span<char>{ head }, std::span<char>{ rest } };
+		size_t received{};
+		while (received < expected.size())
+		{
+			std::array<std::span<char>, 2> remaining{ parts };
+			size_t offset{ received };
+			for (auto& part : remaining)
+			{
+				size_t skip = std::min(offset, part.size());
+				part = part.subspan(skip);
+				offset -= skip;
+			}
+			size_t count{};
+			REQUIRE(peer.recv(remaining, count).ok());
+			received += count;
+		}
+		REQUIRE(head + rest == expected);
+	}
+	SECTION("resume a vectored send from the middle of a buffer")
+	{
+		std::vector<std::span<const char>> buffers{ std::span<const char>{ header }, std::span<const char>{ body }, std::span<const char>{ trailer } };
+		size_t index{ header.size() + 10 };
+		size_t bytes_sent{};
+		while (index < expected.size())
+		{
+			REQUIRE(client.send(buffers, index, bytes_sent).ok());
+		}
+		std::string buffer;
+		while (buffer.size() < expected.size() - header.size() - 10)
+		{
+			size_t count{};
+			REQUIRE(peer.recv(buffer, count).ok());
+		}
+		REQUIRE(buffer == expected.substr(header.size() + 10));
+	}
+}
+
+TEST_CASE("Test socket_t ownership", "[socket-ownership]")
+{
+	static_assert(!std::is_copy_constructible_v<socket_t>);
+	static_assert(std::is_nothrow_move_constructible_v<socket_t>);
+	static_assert(std::is_nothrow_copy_constructible_v<shared_socket_t>);
+
+	socket_t server;
+	socket_t client;
+	socket_t peer;
+	REQUIRE(loopback_pair(server, client, peer));
+
+	SECTION("moving a socket_t transfers the connection")
+	{
+		rmlib::uid_t uid{ peer.uid() };
+		socket_t other{ std::move(peer) };
+		REQUIRE(peer.handle() == INVALID_SOCKET);
+		REQUIRE(peer.state() == socket_state_t::idle);
+		REQUIRE(other.uid() == uid);
+		REQUIRE(other.state() == socket_state_t::connected);
+	}
+	SECTION("shared_socket_t is shared across threads and closed by the last owner")
+	{
+		shared_socket_t shared{ std::move(peer) };
+		REQUIRE(shared);
+		REQUIRE(shared.use_count() == 1);
+		const std::string msg{ "from worker thread" };
+		{
+			shared_socket_t copy{ shared };
+			REQUIRE(shared.use_count() == 2);
+			std::thread worker([owner = std::move(copy), &msg]() mutable
+			{
+				size_t bytes_sent{};
+				send_msg(*owner, msg, bytes_sent);
+				owner.reset();
+			});
+			worker.join();
+		}
+		REQUIRE(shared.use_count() == 1);
+		REQUIRE(shared->state() == socket_state_t::connected);
+		std::string buffer;
+		size_t bytes_received{};
+		REQUIRE(recv_msg(client, buffer, msg.size(), bytes_received).ok());
+		REQUIRE(buffer == msg);
+		shared.reset();
+		REQUIRE(!shared);
+		REQUIRE(shared.use_count() == 0);
+		// peer closed by the last owner
+		REQUIRE(client.wait_event(socket_event_t::recv_ready, 1000).ok());
+		size_t count{};
+		REQUIRE(client.recv(buffer, count).code() == status_code_t::closing);
+	}
+}
+
+void remove_file(const char* filename) noexcept
+{
+	fstream_t file;
+	file.remove(filename);
+}
+
+const char* tls_cert_file{ "rmlib-ut-cert.pem" };
+const char* tls_key_file{ "rmlib-ut-key.pem" };
+
+// write a self-signed certificate and private key for loopback TLS tests
+bool make_self_signed_certificate() noexcept
+{
+	bool ok{ false };
+	EVP_PKEY* pkey{ nullptr };
+	X509* cert{ nullptr };
+	if (EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr); pctx)
+	{
+		if (EVP_PKEY_keygen_init(pctx) == 1 && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) == 1)
+		{
+			EVP_PKEY_keygen(pctx, &pkey);
+		}
+		EVP_PKEY_CTX_free(pctx);
+	}
+	if (pkey && (cert = X509_new()) != nullptr)
+	{
+		X509_set_version(cert, 2);
+		ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+		X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+		X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+		X509_set_pubkey(cert, pkey);
+		X509_NAME* name = X509_get_subject_name(cert);
+		X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+		X509_set_issuer_name(cert, name);
+		if (X509_sign(cert, pkey, EVP_sha256()) > 0)
+		{
+			FILE* cert_file = fopen(tls_cert_file, "wb");
+			FILE* key_file = fopen(tls_key_file, "wb");
+			ok = cert_file && key_file && PEM_write_X509(cert_file, cert) == 1 && PEM_write_PrivateKey(key_file, pkey, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+			if (cert_file) fclose(cert_file);
+			if (key_file) fclose(key_file);
+		}
+	}
+	X509_free(cert);
+	EVP_PKEY_free(pkey);
+	return ok;
+}
+
+// blocking TLS echo server that accepts a number of connections
+void tls_echo_server(socket_t& server, size_t connections) noexcept
+{
+	for (size_t i = 0; i < connections; ++i)
+	{
+		socket_t peer;
+		if (server.wait_event(socket_event_t::accept_ready, 5000).nok()) return;
+		if (server.accept(peer).nok()) continue;
+		std::string buffer;
+		size_t count{};
+		while (peer.recv(buffer, count).ok())
+		{
+			if (buffer.find('\n') != std::string::npos)
+			{
+				size_t bytes_sent{};
+				send_msg(peer, buffer, bytes_sent);
+				break;
+			}
+		}
+		// wait for the client to close first
+		peer.recv(buffer, count);
+		peer.disconnect();
+	}
+}
+
+// connect, echo a line and disconnect. Returns true if the session was resumed
+bool tls_echo_client(tls::context_t& ctx, const ip::address_t& address, bool& resumed) noexcept
+{
+	socket_t client(ctx);
+	if (client.connect(address).nok()) return false;
+	resumed = client.is_resumed();
+	const std::string msg{ "resume me\n" };
+	size_t bytes_sent{};
+	if (send_msg(client, msg, bytes_sent).nok()) return false;
+	std::string buffer;
+	size_t bytes_received{};
+	if (recv_msg(client, buffer, msg.size(), bytes_received).nok()) return false;
+	client.disconnect();
+	return buffer == msg;
+}
+
+TEST_CASE("Test TLS session resumption - loopback", "[tls-resumption]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+	REQUIRE(client_ctx.enable_session_cache(16).ok());
+	REQUIRE(client_ctx.session_cache()->size() == 0);
+	REQUIRE(server_ctx.enable_session_cache().nok());
+	REQUIRE(client_ctx.rotate_ticket_key().nok());
+
+	SECTION("second connection resumes the session of the first")
+	{
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 2);
+		bool resumed{ true };
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(!resumed);
+		REQUIRE(client_ctx.session_cache()->size() == 1);
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(resumed);
+		thread.join();
+	}
+	SECTION("tickets survive one key rotation but not two")
+	{
+		REQUIRE(server_ctx.rotate_ticket_key().ok());
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 4);
+		bool resumed{ true };
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(!resumed);
+		REQUIRE(server_ctx.rotate_ticket_key().ok());
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(resumed);
+		REQUIRE(server_ctx.rotate_ticket_key().ok());
+		REQUIRE(server_ctx.rotate_ticket_key().ok());
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(!resumed);
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(resumed);
+		thread.join();
+	}
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+const char* send_file_name{ "rmlib-ut-send-file.bin" };
+
+std::string make_send_file(size_t size) noexcept
+{
+	std::string content(size, '\0');
+	for (size_t i = 0; i < size; ++i) content[i] = static_cast<char>('a' + (i % 26));
+	fstream_t file;
+	size_t bytes_written{};
+	if (file.open(send_file_name, fstream_t::mode_t::create_always, fstream_t::access_t::write).ok())
+	{
+		file.write(content, bytes_written);
+	}
+	return content;
+}
+
+// send a whole file, starting at offset, with socket_t::send_file
+socket::status_t send_whole_file(socket_t& socket, HANDLE file, off64_t offset, size_t length) noexcept
+{
+	socket::status_t status;
+	size_t sent{};
+	while (status.ok() && sent < length)
+	{
+		size_t count{};
+		if (status = socket.send_file(file, offset + sent, length - sent, count); status.would_block())
+		{
+			wait_event(socket, status);
+			status.clear();
+		}
+		if (status.ok() && count == 0) break;
+		sent += count;
+	}
+	return status;
+}
+
+TEST_CASE("Test socket_t send_file - loopback", "[socket-send-file]")
+{
+	const std::string content = make_send_file(KBytes(100) + 7);
+	fstream_t file;
+	REQUIRE(file.open(send_file_name, fstream_t::mode_t::open_existing, fstream_t::access_t::read).ok());
+	HANDLE fd = file.native_handle();
+
+	SECTION("TCP socket")
+	{
+		socket_t server;
+		socket_t client;
+		socket_t peer;
+		REQUIRE(loopback_pair(server, client, peer));
+		std::string buffer;
+		size_t bytes_received{};
+		std::thread thread([&]() { recv_msg(client, buffer, content.size() - 100, bytes_received); });
+		REQUIRE(send_whole_file(peer, fd, 100, content.size() - 100).ok());
+		thread.join();
+		REQUIRE(buffer == content.substr(100));
+		// at end of file nothing is sent
+		size_t count{ 1 };
+		REQUIRE(peer.send_file(fd, content.size(), 10, count).ok());
+		REQUIRE(count == 0);
+	}
+	SECTION("TLS socket with kernel TLS enabled")
+	{
+		REQUIRE(make_self_signed_certificate());
+		tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+		tls::context_t client_ctx(tls::context_type_t::client);
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+		REQUIRE(server_ctx.enable_ktls().ok());
+#endif
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::string buffer;
+		std::thread thread([&]()
+		{
+			socket_t client(client_ctx);
+			size_t bytes_received{};
+			if (client.connect(address).ok())
+			{
+				recv_msg(client, buffer, content.size(), bytes_received);
+			}
+			client.disconnect();
+		});
+		socket_t peer;
+		REQUIRE(server.accept(peer).ok());
+		REQUIRE(peer.state() == socket_state_t::connected);
+		REQUIRE(send_whole_file(peer, fd, 0, content.size()).ok());
+		thread.join();
+		REQUIRE(buffer == content);
+		remove_file(tls_cert_file);
+		remove_file(tls_key_file);
+	}
+	SECTION("resumable send_file() of an fstream_t")
+	{
+		socket_t server;
+		socket_t client;
+		socket_t peer;
+		REQUIRE(loopback_pair(server, client, peer, socket_mode_t::nonblocking));
+		std::string buffer;
+		size_t bytes_received{};
+		std::thread thread([&]() { recv_msg(client, buffer, content.size() - 10, bytes_received); });
+		socket::status_t status;
+		size_t index{};
+		while (status.ok() && index < content.size() - 10)
+		{
+			size_t count{};
+			if (status = peer.send_file(file, 10, content.size() - 10, index, count); status.would_block())
+			{
+				wait_event(peer, status);
+				status.clear();
+			}
+		}
+		thread.join();
+		REQUIRE(status.ok());
+		REQUIRE(index == content.size() - 10);
+		REQUIRE(buffer == content.substr(10));
+		// the file ends before offset + length
+		size_t count{};
+		index = 0;
+		REQUIRE(peer.send_file(file, content.size(), 10, index, count).nok());
+		REQUIRE(index == 0);
+	}
+	file.close();
+	remove_file(send_file_name);
+}
+
+TEST_CASE("Test socket_listener_group_t - loopback", "[socket-listener-group]")
+{
+	constexpr size_t shards{ 4 };
+	constexpr size_t clients{ 40 };
+	socket_listener_group_t group;
+	REQUIRE(group.listen(loopback_address(), shards, socket_mode_t::nonblocking).ok());
+	REQUIRE(group.size() == shards);
+	REQUIRE(group.address().port() != 0);
+	REQUIRE(group.listen(loopback_address(), shards).nok());
+	for (size_t i = 0; i < shards; ++i)
+	{
+		REQUIRE(group[i].state() == socket_state_t::listening);
+		REQUIRE(group[i].local_address().port() == group.address().port());
+	}
+#if defined(SO_INCOMING_CPU)
+	const int cpus[]{ 0 };
+	REQUIRE(group.set_incoming_cpus(cpus).ok());
+#endif
+
+	std::vector<socket_t> connections(clients);
+	for (auto& client : connections) REQUIRE(client.connect(group.address()).ok());
+
+	// every connection is accepted exactly once, spread over the shards
+	std::vector<size_t> accepted(shards);
+	size_t total{};
+	rmlib::timer_t timer;
+	while (total < clients && timer.elapsed() < 2'000'000)
+	{
+		for (size_t i = 0; i < group.size(); ++i)
+		{
+			socket_t peer;
+			if (group[i].accept(peer, socket_mode_t::nonblocking).ok())
+			{
+				++accepted[i];
+				++total;
+			}
+		}
+	}
+	REQUIRE(total == clients);
+#if defined(SO_REUSEPORT)
+	REQUIRE(group.is_sharded());
+	REQUIRE(std::count_if(accepted.begin(), accepted.end(), [](size_t n) { return n > 0; }) > 1);
+#endif
+	group.close();
+	REQUIRE(group.empty());
+}
+
+TEST_CASE("Test set_thread_affinity", "[thread-affinity]")
+{
+	bool pinned{ false };
+	std::thread worker([&pinned]() { pinned = set_thread_affinity(0); });
+	worker.join();
+#if defined(XPLAT_OS_LINUX) || defined(XPLAT_OS_WINDOWS)
+	REQUIRE(pinned);
+#endif
+	std::thread bad([&pinned]() { pinned = set_thread_affinity(100000); });
+	bad.join();
+	REQUIRE(!pinned);
+}
+
+TEST_CASE("Test socket_t accept_many - loopback", "[socket-accept-many]")
+{
+	constexpr size_t clients{ 8 };
+	socket_t server;
+	REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+	ip::address_t address{ bound_address(server) };
+
+	SECTION("empty backlog would block")
+	{
+		socket_t peers[2];
+		size_t accepted{ 1 };
+		socket::status_t status = server.accept_many(peers, accepted);
+		REQUIRE(status.would_block());
+		REQUIRE(accepted == 0);
+		socket_t idle;
+		REQUIRE(idle.accept_many(peers, accepted).nok());
+	}
+	SECTION("backlog is drained in batches")
+	{
+		std::vector<socket_t> connections(clients);
+		for (auto& client : connections) REQUIRE(client.connect(address).ok());
+		std::vector<socket_t> peers(clients);
+		size_t total{};
+		rmlib::timer_t timer;
+		while (total < clients && timer.elapsed() < 2'000'000)
+		{
+			size_t accepted{};
+			std::span<socket_t> batch(peers.data() + total, std::min<size_t>(3, clients - total));
+			if (server.accept_many(batch, accepted).ok())
+			{
+				REQUIRE(accepted <= batch.size());
+				total += accepted;
+			}
+		}
+		REQUIRE(total == clients);
+		for (auto& peer : peers)
+		{
+			REQUIRE(peer.state() == socket_state_t::connected);
+			REQUIRE(!peer.is_handshaking());
+		}
+		size_t accepted{};
+		REQUIRE(server.accept_many(peers, accepted).would_block());
+	}
+}
+
+TEST_CASE("Test socket_t nonblocking TLS handshake - loopback", "[tls-handshake]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+
+	socket_t server(server_ctx);
+	REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+	ip::address_t address{ bound_address(server) };
+	bool connected{ false };
+	std::thread thread([&client_ctx, &address, &connected]() {
+		socket_t client(client_ctx);
+		if (client.connect(address).ok())
+		{
+			connected = true;
+			// hold the connection until the server closes it
+			std::string buffer;
+			size_t count{};
+			client.recv(buffer, count);
+		}
+	});
+
+	socket_t peers[1];
+	size_t accepted{};
+	rmlib::timer_t timer;
+	while (accepted == 0 && timer.elapsed() < 2'000'000)
+	{
+		if (server.wait_event(socket_event_t::accept_ready, 100).ok()) server.accept_many(peers, accepted);
+	}
+	REQUIRE(accepted == 1);
+	socket_t& peer = peers[0];
+	socket::status_t status;
+	while (peer.is_handshaking() && timer.elapsed() < 4'000'000)
+	{
+		if (status = peer.handshake(); status.would_block())
+		{
+			wait_event(peer, status);
+		}
+		else
+		{
+			REQUIRE(status.ok());
+		}
+	}
+	REQUIRE(peer.state() == socket_state_t::connected);
+	REQUIRE(peer.handshake().ok());
+	peer.disconnect();
+	thread.join();
+	REQUIRE(connected);
+	socket_t idle;
+	REQUIRE(idle.handshake().nok());
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+// move the ciphertext produced by one engine to the other
+void pump(tls::engine_t& from, tls::engine_t& to) noexcept
+{
+	std::span<const char> ciphertext = from.outbound();
+	if (!ciphertext.empty() && to.feed(ciphertext).ok()) from.consume(ciphertext.size());
+}
+
+TEST_CASE("Test tls::engine_t - memory", "[tls-engine]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+	tls::engine_t client;
+	tls::engine_t server;
+	REQUIRE(client.handshake().nok());
+	REQUIRE(client.open(client_ctx).ok());
+	REQUIRE(server.open(server_ctx).ok());
+
+	for (int i = 0; i < 10 && !(client.is_connected() && server.is_connected()); ++i)
+	{
+		socket::status_t status = client.handshake();
+		REQUIRE((status.ok() || status.want_read()));
+		pump(client, server);
+		status = server.handshake();
+		REQUIRE((status.ok() || status.want_read()));
+		pump(server, client);
+	}
+	REQUIRE(client.is_connected());
+	REQUIRE(server.is_connected());
+
+	SECTION("records are exchanged through the caller")
+	{
+		const std::string msg(KBytes(40), 'e');
+		size_t written{};
+		REQUIRE(client.write(msg.data(), msg.size(), written).ok());
+		REQUIRE(written == msg.size());
+		// several records wait in one buffer, ready for a single send
+		REQUIRE(client.outbound().size() > 2 * SOCKET_TLS_MAX_RECORD_SIZE);
+		std::span<const char> ciphertext = client.outbound();
+		std::span<char> inbound = server.inbound(ciphertext.size());
+		REQUIRE(inbound.size() >= ciphertext.size());
+		std::memcpy(inbound.data(), ciphertext.data(), ciphertext.size());
+		server.commit(ciphertext.size());
+		client.consume(ciphertext.size());
+		REQUIRE(client.outbound().empty());
+
+		std::string received;
+		std::array<char, KBytes(16)> buffer;
+		socket::status_t status;
+		size_t count{};
+		while ((status = server.read(buffer.data(), buffer.size(), count)).ok()) received.append(buffer.data(), count);
+		REQUIRE(status.want_read());
+		REQUIRE(received == msg);
+	}
+	SECTION("engines move to another thread")
+	{
+		const std::string msg{ "encrypted elsewhere" };
+		std::thread thread([&client, &msg]() {
+			tls::engine_t engine{ std::move(client) };
+			size_t written{};
+			engine.write(msg.data(), msg.size(), written);
+			client = std::move(engine);
+		});
+		thread.join();
+		pump(client, server);
+		std::array<char, 64> buffer;
+		size_t count{};
+		REQUIRE(server.read(buffer.data(), buffer.size(), count).ok());
+		REQUIRE(std::string(buffer.data(), count) == msg);
+	}
+	SECTION("close_notify reads as closing")
+	{
+		REQUIRE(client.shutdown().ok());
+		pump(client, server);
+		std::array<char, 64> buffer;
+		size_t count{};
+		socket::status_t status = server.read(buffer.data(), buffer.size(), count);
+		REQUIRE(status.code() == status_code_t::closing);
+	}
+	client.close();
+	REQUIRE(!client.is_open());
+	REQUIRE(client.outbound().empty());
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+TEST_CASE("Test TLS memory BIO mode - loopback", "[tls-memory-bio]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+	REQUIRE(client_ctx.memory_bio_size() == 0);
+	REQUIRE(client_ctx.enable_memory_bio().ok());
+	REQUIRE(client_ctx.memory_bio_size() == tls::TLS_DEFAULT_BIO_BUFFER_SIZE);
+
+	SECTION("memory BIO client against a direct server")
+	{
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 1);
+		socket_t client(client_ctx);
+		REQUIRE(client.connect(address).ok());
+		REQUIRE(client.memory_bio_active());
+		REQUIRE(!client.ktls_send_active());
+		// the records of a vectored send leave in one syscall
+		const std::string header{ "HEADER:" };
+		const std::string body(KBytes(40), 'b');
+		const std::string trailer{ ":TRAILER\n" };
+		const std::string expected = header + body + trailer;
+		std::array<std::span<const char>, 3> buffers{ std::span<const char>{ header }, std::span<const char>{ body }, std::span<const char>{ trailer } };
+		size_t index{};
+		size_t bytes_sent{};
+		REQUIRE(client.send(buffers, index, bytes_sent).ok());
+		REQUIRE(bytes_sent > 2 * SOCKET_TLS_MAX_RECORD_SIZE);
+		while (index < expected.size())
+		{
+			REQUIRE(client.send(buffers, index, bytes_sent).ok());
+		}
+		REQUIRE(client.pending_send() == 0);
+		std::string buffer;
+		size_t bytes_received{};
+		REQUIRE(recv_msg(client, buffer, expected.size(), bytes_received).ok());
+		REQUIRE(buffer == expected);
+		client.disconnect();
+		thread.join();
+	}
+	SECTION("large sends keep the outbound buffer at its capacity")
+	{
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 1);
+		socket_t client(client_ctx);
+		REQUIRE(client.connect(address).ok());
+		REQUIRE(client.send_buffer_capacity() == tls::TLS_DEFAULT_BIO_BUFFER_SIZE);
+		const std::string body(MBytes(1), 'l');
+		size_t bytes_sent{};
+		REQUIRE(send_msg(client, body, bytes_sent).ok());
+		REQUIRE(client.send_buffer_capacity() == tls::TLS_DEFAULT_BIO_BUFFER_SIZE);
+		const std::string trailer{ "\n" };
+		std::array<std::span<const char>, 2> buffers{ std::span<const char>{ body }, std::span<const char>{ trailer } };
+		size_t index{};
+		while (index < body.size() + trailer.size())
+		{
+			REQUIRE(client.send(buffers, index, bytes_sent).ok());
+			REQUIRE(client.send_buffer_capacity() == tls::TLS_DEFAULT_BIO_BUFFER_SIZE);
+		}
+		std::string buffer;
+		size_t bytes_received{};
+		REQUIRE(recv_msg(client, buffer, 2 * body.size() + trailer.size(), bytes_received).ok());
+		REQUIRE(buffer.size() == 2 * body.size() + trailer.size());
+		client.disconnect();
+		thread.join();
+	}
+	SECTION("memory BIO server resumes sessions of a memory BIO client")
+	{
+		REQUIRE(server_ctx.enable_memory_bio(KBytes(16)).ok());
+		REQUIRE(client_ctx.enable_session_cache(16).ok());
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address()).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 2);
+		bool resumed{ true };
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(!resumed);
+		REQUIRE(client_ctx.session_cache()->size() == 1);
+		REQUIRE(tls_echo_client(client_ctx, address, resumed));
+		REQUIRE(resumed);
+		thread.join();
+	}
+	SECTION("nonblocking memory BIO handshake")
+	{
+		REQUIRE(server_ctx.enable_memory_bio().ok());
+		socket_t server(server_ctx);
+		REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking).ok());
+		ip::address_t address{ bound_address(server) };
+		std::thread thread(tls_echo_server, std::ref(server), 1);
+		socket_t client(client_ctx);
+		socket::status_t status = client.begin_connect(address);
+		rmlib::timer_t timer;
+		while (client.is_handshaking() && timer.elapsed() < 4'000'000)
+		{
+			if (status.would_block()) wait_event(client, status);
+			else REQUIRE(status.ok());
+			status = client.handshake();
+		}
+		REQUIRE(client.state() == socket_state_t::connected);
+		const std::string msg{ "nonblocking\n" };
+		size_t bytes_sent{};
+		REQUIRE(send_msg(client, msg, bytes_sent).ok());
+		std::string buffer;
+		size_t bytes_received{};
+		REQUIRE(recv_msg(client, buffer, msg.size(), bytes_received).ok());
+		REQUIRE(buffer == msg);
+		client.disconnect();
+		thread.join();
+	}
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+// connect, echo a line and disconnect with the same socket_t
+bool tls_echo_once(socket_t& client, const ip::address_t& address) noexcept
+{
+	if (client.connect(address).nok()) return false;
+	const std::string msg{ "reconnect\n" };
+	size_t bytes_sent{};
+	if (send_msg(client, msg, bytes_sent).nok()) return false;
+	std::string buffer;
+	size_t bytes_received{};
+	if (recv_msg(client, buffer, msg.size(), bytes_received).nok()) return false;
+	client.disconnect();
+	return buffer == msg;
+}
+
+TEST_CASE("Test socket_t TLS reconnect handshake metrics - loopback", "[tls-reconnect]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+	socket_t server(server_ctx);
+	REQUIRE(server.listen(loopback_address()).ok());
+	ip::address_t address{ bound_address(server) };
+	std::thread thread(tls_echo_server, std::ref(server), 2);
+
+	socket_t client(client_ctx);
+	REQUIRE(tls_echo_once(client, address));
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	REQUIRE(tls_echo_once(client, address));
+	// the second handshake is timed from the second connect, not the first
+	REQUIRE(client.counters().handshake_nsecs > 0);
+	REQUIRE(client.counters().handshake_nsecs < 200'000'000);
+	thread.join();
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+// accept connections and hold them open until stop is set. Setting drop
+// closes every connection held so far
+void holding_server(socket_t& server, std::atomic<bool>& stop, std::atomic<bool>& drop, std::atomic<size_t>& accepted) noexcept
+{
+	std::vector<socket_t> peers;
+	while (!stop)
+	{
+		if (drop)
+		{
+			for (auto& peer : peers) peer.disconnect();
+			peers.clear();
+			drop = false;
+		}
+		if (server.wait_event(socket_event_t::accept_ready, 10).ok())
+		{
+			socket_t peer;
+			if (server.accept(peer).ok())
+			{
+				peers.push_back(std::move(peer));
+				++accepted;
+			}
+		}
+	}
+}
+
+// wait for the holding server to accept count connections, then to close them
+void drop_connections(std::atomic<bool>& drop, const std::atomic<size_t>& accepted, size_t count) noexcept
+{
+	rmlib::timer_t timer;
+	while (accepted < count && timer.elapsed() < 2'000'000) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	drop = true;
+	while (drop && timer.elapsed() < 2'000'000) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+TEST_CASE("Test connection_pool_t - loopback", "[connection-pool]")
+{
+	socket_t server;
+	REQUIRE(server.listen(loopback_address()).ok());
+	ip::address_t address{ bound_address(server) };
+	REQUIRE(address == bound_address(server));
+	REQUIRE(address.hash() == bound_address(server).hash());
+	REQUIRE(!(address == ip::address_t{}));
+	std::atomic<bool> stop{ false };
+	std::atomic<bool> drop{ false };
+	std::atomic<size_t> accepted{ 0 };
+	std::thread thread(holding_server, std::ref(server), std::ref(stop), std::ref(drop), std::ref(accepted));
+
+	SECTION("released connections are reused")
+	{
+		connection_pool_options_t options;
+		options.socket.no_delay = true;
+		connection_pool_t pool(options);
+		socket_t connection;
+		REQUIRE(pool.acquire(address, connection).ok());
+		REQUIRE(pool.leased_count(address) == 1);
+		const rmlib::uid_t uid = connection.uid();
+		pool.release(address, std::move(connection));
+		REQUIRE(pool.idle_count(address) == 1);
+		REQUIRE(pool.leased_count(address) == 0);
+		REQUIRE(pool.acquire(address, connection).ok());
+		REQUIRE(connection.uid() == uid);
+		REQUIRE(pool.idle_count(address) == 0);
+		pool.release(address, std::move(connection), false);
+		REQUIRE(pool.idle_count(address) == 0);
+		REQUIRE(pool.leased_count(address) == 0);
+	}
+	SECTION("max_connections limits leases")
+	{
+		connection_pool_options_t options;
+		options.max_connections = 2;
+		connection_pool_t pool(options);
+		socket_t a, b, c;
+		REQUIRE(pool.acquire(address, a).ok());
+		REQUIRE(pool.acquire(address, b).ok());
+		socket::status_t status = pool.acquire(address, c);
+		REQUIRE(status.nok());
+		REQUIRE(status.error() == WSAENOBUFS);
+		pool.release(address, std::move(a));
+		REQUIRE(pool.acquire(address, c).ok());
+		pool.release(address, std::move(b));
+		pool.release(address, std::move(c));
+		REQUIRE(pool.idle_count(address) == 2);
+	}
+	SECTION("connections closed by the server fail the health check")
+	{
+		connection_pool_t pool;
+		socket_t connection;
+		REQUIRE(pool.acquire(address, connection).ok());
+		const rmlib::uid_t uid = connection.uid();
+		pool.release(address, std::move(connection));
+		drop_connections(drop, accepted, 1);
+		REQUIRE(pool.acquire(address, connection).ok());
+		REQUIRE(connection.uid() != uid);
+		REQUIRE(connection.is_reusable());
+		pool.release(address, std::move(connection));
+	}
+	SECTION("prewarm and idle eviction")
+	{
+		connection_pool_options_t options;
+		options.min_idle = 1;
+		options.idle_timeout_ms = 20;
+		connection_pool_t pool(options);
+		REQUIRE(pool.prewarm(address).ok());
+		REQUIRE(pool.idle_count(address) == 1);
+		REQUIRE(pool.prewarm(address, 3).ok());
+		REQUIRE(pool.idle_count(address) == 3);
+		REQUIRE(pool.leased_count(address) == 0);
+		REQUIRE(pool.evict_idle() == 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		REQUIRE(pool.evict_idle() == 2);
+		REQUIRE(pool.idle_count(address) == 1);
+		pool.clear();
+		REQUIRE(pool.idle_count(address) == 0);
+	}
+	stop = true;
+	thread.join();
+}
+
+TEST_CASE("Test connection_pool_t TLS - loopback", "[connection-pool-tls]")
+{
+	REQUIRE(make_self_signed_certificate());
+	tls::context_t server_ctx(tls::context_type_t::server, tls_cert_file, tls_key_file);
+	REQUIRE(server_ctx.status().ok());
+	tls::context_t client_ctx(tls::context_type_t::client);
+	REQUIRE(client_ctx.status().ok());
+	socket_t server(server_ctx);
+	REQUIRE(server.listen(loopback_address()).ok());
+	ip::address_t address{ bound_address(server) };
+	std::atomic<bool> stop{ false };
+	std::atomic<bool> drop{ false };
+	std::atomic<size_t> accepted{ 0 };
+	std::thread thread(holding_server, std::ref(server), std::ref(stop), std::ref(drop), std::ref(accepted));
+
+	connection_pool_t pool(client_ctx);
+	socket_t connection;
+	REQUIRE(pool.acquire(address, connection).ok());
+	REQUIRE(connection.ssl() != nullptr);
+	const rmlib::uid_t uid = connection.uid();
+	pool.release(address, std::move(connection));
+	// session tickets sent after the handshake do not fail the health check
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	REQUIRE(pool.acquire(address, connection).ok());
+	REQUIRE(connection.uid() == uid);
+	pool.release(address, std::move(connection));
+	drop_connections(drop, accepted, 1);
+	REQUIRE(pool.acquire(address, connection).ok());
+	REQUIRE(connection.uid() != uid);
+	pool.release(address, std::move(connection));
+	// let the server finish its side of the handshake before closing
+	rmlib::timer_t timer;
+	while (accepted < 2 && timer.elapsed() < 2'000'000) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	pool.clear();
+	stop = true;
+	thread.join();
+	REQUIRE(accepted == 2);
+	remove_file(tls_cert_file);
+	remove_file(tls_key_file);
+}
+
+int socket_option(const socket_t& socket, int level, int name) noexcept
+{
+	int value{ -1 };
+	socklen_t len{ sizeof(value) };
+	if (::getsockopt(socket.handle(), level, name, reinterpret_cast<char*>(&value), &len) != 0) return -1;
+	return value;
+}
+
+TEST_CASE("Test socket_options_t - loopback", "[socket-options]")
+{
+	REQUIRE(socket_options_t{}.is_default());
+	REQUIRE(!socket_options_t::low_latency().is_default());
+	REQUIRE(socket_options_t::bulk().send_buffer > 0);
+
+	socket_options_t server_options;
+	server_options.no_delay = true;
+	server_options.recv_buffer = static_cast<int>(KBytes(256));
+	server_options.fast_open = true;
+	socket_t server;
+	REQUIRE(server.listen(loopback_address(), socket_mode_t::nonblocking, SOCKET_DEFAULT_LISTEN_BACKLOG, server_options).ok());
+	REQUIRE(socket_option(server, SOL_SOCKET, SO_RCVBUF) >= server_options.recv_buffer);
+#if defined(TCP_FASTOPEN) && defined(XPLAT_OS_LINUX)
+	REQUIRE(socket_option(server, IPPROTO_TCP, TCP_FASTOPEN) == SOCKET_DEFAULT_FAST_OPEN_QUEUE);
+#endif
+	ip::address_t address{ bound_address(server) };
+
+	SECTION("connect and accept apply their options")
+	{
+		socket_t client;
+		REQUIRE(client.connect(address, socket_mode_t::blocking, socket_options_t::low_latency()).ok());
+		REQUIRE(socket_option(client, IPPROTO_TCP, TCP_NODELAY) != 0);
+		socket_options_t accept_options;
+		accept_options.keep_alive = true;
+		socket_t peer;
+		REQUIRE(server.wait_event(socket_event_t::accept_ready, 2000).ok());
+		REQUIRE(server.accept(peer, socket_mode_t::blocking, accept_options).ok());
+		REQUIRE(socket_option(peer, SOL_SOCKET, SO_KEEPALIVE) != 0);
+		// buffer sizes are inherited from the listener
+		REQUIRE(socket_option(peer, SOL_SOCKET, SO_RCVBUF) >= server_options.recv_buffer);
+	}
+	SECTION("set_options retunes a live socket")
+	{
+		socket_t client;
+		REQUIRE(client.connect(address).ok());
+		REQUIRE(socket_option(client, IPPROTO_TCP, TCP_NODELAY) == 0);
+		socket_options_t options;
+		options.no_delay = true;
+		options.send_buffer = static_cast<int>(KBytes(128));
+		REQUIRE(client.set_options(options).ok());
+		REQUIRE(socket_option(client, IPPROTO_TCP, TCP_NODELAY) != 0);
+		REQUIRE(socket_option(client, SOL_SOCKET, SO_SNDBUF) >= options.send_buffer);
+		socket_t idle;
+		REQUIRE(idle.set_options(options).nok());
+	}
+}
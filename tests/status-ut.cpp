@@ -131,5 +131,21 @@ TEST_CASE("rmstatus unit tests", "[rmstatus]")
       REQUIRE(status.error() == ENOENT);
       REQUIRE(status.reason() == "No such file or directory");
    }
+   SECTION("test rmlib::status_t reason literal and layout")
+   {
+      STATIC_REQUIRE(std::is_trivially_copyable_v<status_t>);
+      STATIC_REQUIRE(sizeof(status_t) <= 2 * sizeof(void*));
+      status_t status{ EINVAL, "invalid segment header" };
+      REQUIRE(status.nok());
+      REQUIRE(status.error() == EINVAL);
+      REQUIRE(status.reason() == "invalid segment header");
+      status_t copy = status;
+      REQUIRE(copy.reason() == "invalid segment header");
+      status.reset(ENOENT);
+      REQUIRE(status.reason() == "No such file or directory");
+      status.reset(EIO, "device gone");
+      REQUIRE(status.reason() == "device gone");
+      status.clear();
+      REQUIRE(status.reason() == "No errors detected");
+   }
 }
-
@@ -25,10 +25,67 @@
 *  If not, see https://opensource.org/licenses/MIT.
 \*****************************************************************************/
 #include <catch.hpp>
+#include <thread>
+
+#include "rmlib/time.h"
+
+using namespace rmlib;
+
+namespace time_ut {
+
+   // a timer measures a 20ms sleep within the clock resolution
+   template <ClockPolicy Clock>
+   void check_clock() noexcept
+   {
+      int64_t first = Clock::now();
+      int64_t second = Clock::now();
+      REQUIRE(second >= first);
+      basic_timer_t<Clock> timer;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      REQUIRE(timer.elapsed() >= 15'000);
+      REQUIRE(timer.elapsed() < 5'000'000);
+      REQUIRE(timer.elapsed_nsecs() >= timer.elapsed() * 1000);
+      timer.reset();
+      REQUIRE(timer.elapsed() < 15'000);
+   }
+
+} // namespace time_ut
 
 TEST_CASE("rmtime unit tests", "[rmtime]")
 {
+   using namespace time_ut;
+
    SECTION("")
    {
    }
+   SECTION("steady clock timer")
+   {
+      check_clock<steady_clock_t>();
+      rmlib::timer_t timer;
+      timer.reset(steady_clock_t::now() - 1'000'000);
+      REQUIRE(timer.elapsed() >= 1000);
+   }
+   SECTION("coarse clock timer")
+   {
+      check_clock<coarse_clock_t>();
+   }
+   SECTION("tsc clock timer")
+   {
+#if defined(XPLAT_TSC_CLOCK)
+      REQUIRE(tsc_clock_t::nsecs_per_tick() > 0.0);
+#endif
+      check_clock<tsc_clock_t>();
+      int64_t tsc = tsc_clock_t::now();
+      int64_t steady = steady_clock_t::now();
+      REQUIRE(std::abs(tsc - steady) < 5'000'000);
+   }
+   SECTION("cached clock only moves on update")
+   {
+      int64_t first = cached_clock_t::update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      REQUIRE(cached_clock_t::now() == first);
+      int64_t second = cached_clock_t::update();
+      REQUIRE(second - first >= 15'000'000);
+      REQUIRE(cached_clock_t::now() == second);
+   }
 }
@@ -0,0 +1,160 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <vector>
+#include <algorithm>
+
+#include "rmlib/timer_wheel.h"
+
+using namespace rmlib;
+
+namespace timer_wheel_ut {
+
+   // hand driven clock so expiry is deterministic
+   struct manual_clock_t
+   {
+      static int64_t& value() noexcept
+      {
+         static int64_t now{ 1'000'000'000 };
+         return now;
+      }
+
+      static int64_t now() noexcept
+      {
+         return value();
+      }
+
+      static void advance_ms(int64_t ms) noexcept
+      {
+         value() += ms * 1'000'000;
+      }
+   };
+
+   using wheel_t = basic_timer_wheel_t<manual_clock_t>;
+
+   std::vector<uint64_t> expire(wheel_t& wheel, size_t max = 1024) noexcept
+   {
+      std::vector<timer_expiry_t> expired(max);
+      size_t count{};
+      wheel.expire(expired, count);
+      std::vector<uint64_t> uids;
+      for (size_t i = 0; i < count; ++i) uids.push_back(expired[i].uid);
+      std::sort(uids.begin(), uids.end());
+      return uids;
+   }
+
+} // namespace timer_wheel_ut
+
+TEST_CASE("timer_wheel_t class unit tests", "[timer-wheel]")
+{
+   using namespace timer_wheel_ut;
+   wheel_t wheel(10);
+   REQUIRE(wheel.empty());
+   REQUIRE(wheel.tick_ms() == 10);
+
+   SECTION("timers fire on the first tick at or after their timeout")
+   {
+      REQUIRE(wheel.schedule(1, 25, timer_kind_t::idle));
+      REQUIRE(wheel.schedule(2, 5, timer_kind_t::connect));
+      REQUIRE(wheel.size() == 2);
+      REQUIRE(wheel.contains(1));
+      REQUIRE(expire(wheel).empty());
+      manual_clock_t::advance_ms(9);
+      REQUIRE(expire(wheel).empty());
+      manual_clock_t::advance_ms(1);
+      std::vector<timer_expiry_t> expired(4);
+      size_t count{};
+      wheel.expire(expired, count);
+      REQUIRE(count == 1);
+      REQUIRE(expired[0].uid == 2);
+      REQUIRE(expired[0].kind == timer_kind_t::connect);
+      manual_clock_t::advance_ms(10);
+      REQUIRE(expire(wheel).empty());
+      manual_clock_t::advance_ms(10);
+      REQUIRE(expire(wheel) == std::vector<uint64_t>{ 1 });
+      REQUIRE(wheel.empty());
+   }
+   SECTION("reschedule and cancel")
+   {
+      REQUIRE(wheel.schedule(7, 50));
+      manual_clock_t::advance_ms(40);
+      REQUIRE(expire(wheel).empty());
+      // traffic on the socket pushes the idle timeout out
+      REQUIRE(wheel.schedule(7, 50));
+      REQUIRE(wheel.size() == 1);
+      manual_clock_t::advance_ms(40);
+      REQUIRE(expire(wheel).empty());
+      REQUIRE(wheel.cancel(7));
+      REQUIRE(!wheel.cancel(7));
+      manual_clock_t::advance_ms(100);
+      REQUIRE(expire(wheel).empty());
+   }
+   SECTION("long timeouts cascade through the levels")
+   {
+      // 1 tick, level 1, level 2 and level 3 distances
+      const std::vector<int64_t> timeouts{ 10, 700, 50'000, 3'000'000, 45'000'000 };
+      for (size_t i = 0; i < timeouts.size(); ++i) REQUIRE(wheel.schedule(i, timeouts[i], timer_kind_t::user));
+      int64_t elapsed{};
+      for (size_t i = 0; i < timeouts.size(); ++i)
+      {
+         manual_clock_t::advance_ms(timeouts[i] - elapsed - 10);
+         REQUIRE(expire(wheel).empty());
+         manual_clock_t::advance_ms(10);
+         REQUIRE(expire(wheel) == std::vector<uint64_t>{ i });
+         elapsed = timeouts[i];
+      }
+      REQUIRE(wheel.empty());
+   }
+   SECTION("many timers and partial delivery")
+   {
+      wheel.reserve(10000);
+      for (uint64_t uid = 1; uid <= 10000; ++uid) REQUIRE(wheel.schedule(uid, static_cast<int64_t>(uid % 100) * 10 + 10));
+      REQUIRE(wheel.size() == 10000);
+      manual_clock_t::advance_ms(500);
+      std::vector<uint64_t> first = expire(wheel, 1000);
+      REQUIRE(first.size() == 1000);
+      std::vector<uint64_t> rest = expire(wheel, 10000);
+      REQUIRE(first.size() + rest.size() == 5000);
+      // expired but not yet delivered timers can still be cancelled
+      REQUIRE(wheel.schedule(20000, 10));
+      manual_clock_t::advance_ms(10);
+      std::vector<timer_expiry_t> none;
+      size_t count{};
+      wheel.expire(none, count);
+      REQUIRE(count == 0);
+      REQUIRE(wheel.cancel(20000));
+      manual_clock_t::advance_ms(1000);
+      REQUIRE(expire(wheel, 10000).size() == 5000);
+      REQUIRE(wheel.empty());
+   }
+   SECTION("next tick bounds the poll timeout")
+   {
+      REQUIRE(wheel.next_tick_ms() <= 10);
+      manual_clock_t::advance_ms(3);
+      REQUIRE(wheel.next_tick_ms() <= 7);
+   }
+}
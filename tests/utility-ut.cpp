@@ -0,0 +1,275 @@
+/*****************************************************************************\
+*  Copyright (c) 2023 Ricardo Machado, Sydney, Australia All rights reserved.
+*
+*  MIT License
+*
+*  Permission is hereby granted, free of charge, to any person obtaining a copy
+*  of this software and associated documentation files (the "Software"), to
+*  deal in the Software without restriction, including without limitation the
+*  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*  sell copies of the Software, and to permit persons to whom the Software is
+*  furnished to do so, subject to the following conditions:
+*
+*  The above copyright notice and this permission notice shall be included in
+*  all copies or substantial portions of the Software.
+*
+*  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*  IN THE SOFTWARE.
+*
+*  You should have received a copy of the MIT License along with this program.
+*  If not, see https://opensource.org/licenses/MIT.
+\*****************************************************************************/
+#include <catch.hpp>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <array>
+
+#include "rmlib/utility.h"
+
+using namespace rmlib;
+
+namespace utility_ut {
+
+   constexpr size_t threads{ 4 };
+   constexpr size_t iterations{ 20000 };
+
+   // every thread bumps a shared plain counter under the lock
+   template <typename L>
+   size_t contended_count(L& lock) noexcept
+   {
+      size_t counter{};
+      std::vector<std::thread> workers;
+      for (size_t i = 0; i < threads; ++i)
+      {
+         workers.emplace_back([&lock, &counter]()
+         {
+            for (size_t j = 0; j < iterations; ++j)
+            {
+               std::lock_guard<L> guard(lock);
+               ++counter;
+            }
+         });
+      }
+      for (auto& worker : workers) worker.join();
+      return counter;
+   }
+
+} // namespace utility_ut
+
+TEST_CASE("spin lock unit tests", "[spin-lock]")
+{
+   using namespace utility_ut;
+
+   SECTION("locks are padded to a cache line")
+   {
+      STATIC_REQUIRE(alignof(spin_lock_t) == CACHE_LINE_SIZE);
+      STATIC_REQUIRE(sizeof(spin_lock_t) == CACHE_LINE_SIZE);
+      STATIC_REQUIRE(sizeof(ticket_lock_t) == CACHE_LINE_SIZE);
+      STATIC_REQUIRE(sizeof(rw_spin_lock_t) == CACHE_LINE_SIZE);
+      spin_lock_t locks[4];
+      REQUIRE(reinterpret_cast<uintptr_t>(&locks[1]) - reinterpret_cast<uintptr_t>(&locks[0]) == CACHE_LINE_SIZE);
+   }
+   SECTION("spin_lock_t")
+   {
+      spin_lock_t lock;
+      REQUIRE(lock.try_lock());
+      REQUIRE(!lock.try_lock());
+      lock.unlock();
+      {
+         spin_guard_t guard(lock);
+         REQUIRE(!lock.try_lock());
+      }
+      REQUIRE(lock.try_lock());
+      lock.unlock();
+      REQUIRE(contended_count(lock) == threads * iterations);
+   }
+   SECTION("ticket_lock_t")
+   {
+      ticket_lock_t lock;
+      REQUIRE(lock.try_lock());
+      REQUIRE(!lock.try_lock());
+      lock.unlock();
+      REQUIRE(contended_count(lock) == threads * iterations);
+      REQUIRE(lock.try_lock());
+      lock.unlock();
+   }
+   SECTION("rw_spin_lock_t")
+   {
+      rw_spin_lock_t lock;
+      REQUIRE(lock.try_lock_shared());
+      REQUIRE(lock.try_lock_shared());
+      REQUIRE(!lock.try_lock());
+      lock.unlock_shared();
+      lock.unlock_shared();
+      REQUIRE(lock.try_lock());
+      REQUIRE(!lock.try_lock_shared());
+      REQUIRE(!lock.try_lock());
+      lock.unlock();
+      REQUIRE(contended_count(lock) == threads * iterations);
+
+      // readers see either none or all of a writer's update
+      size_t first{}, second{};
+      std::atomic<bool> torn{ false };
+      std::vector<std::thread> workers;
+      workers.emplace_back([&]()
+      {
+         for (size_t j = 0; j < iterations; ++j)
+         {
+            std::unique_lock<rw_spin_lock_t> guard(lock);
+            ++first;
+            ++second;
+         }
+      });
+      for (size_t i = 1; i < threads; ++i)
+      {
+         workers.emplace_back([&]()
+         {
+            for (size_t j = 0; j < iterations; ++j)
+            {
+               std::shared_lock<rw_spin_lock_t> guard(lock);
+               if (first != second) torn = true;
+            }
+         });
+      }
+      for (auto& worker : workers) worker.join();
+      REQUIRE(!torn);
+      REQUIRE(first == iterations);
+   }
+}
+
+TEST_CASE("ring queue unit tests", "[ring]")
+{
+   using namespace utility_ut;
+
+   SECTION("spsc_ring_t order, full and empty")
+   {
+      spsc_ring_t<size_t> ring(3);
+      REQUIRE(ring.capacity() == 4);
+      REQUIRE(ring.empty());
+      size_t item{};
+      REQUIRE(!ring.pop(item));
+      for (size_t i = 0; i < 4; ++i) REQUIRE(ring.push(size_t{ i }));
+      REQUIRE(!ring.push(size_t{ 4 }));
+      REQUIRE(ring.size() == 4);
+      for (size_t i = 0; i < 4; ++i)
+      {
+         REQUIRE(ring.pop(item));
+         REQUIRE(item == i);
+      }
+      REQUIRE(!ring.pop(item));
+   }
+   SECTION("spsc_ring_t batches wrap around")
+   {
+      spsc_ring_t<size_t> ring(8);
+      std::array<size_t, 5> in{}, out{};
+      size_t next{}, expected{};
+      for (size_t round = 0; round < 20; ++round)
+      {
+         for (auto& value : in) value = next++;
+         REQUIRE(ring.push(std::span<size_t>(in)) == in.size());
+         REQUIRE(ring.pop(std::span<size_t>(out)) == out.size());
+         for (size_t value : out) REQUIRE(value == expected++);
+      }
+      // a batch larger than the free space is cut short
+      std::array<size_t, 12> big{};
+      REQUIRE(ring.push(std::span<size_t>(big)) == ring.capacity());
+      REQUIRE(ring.pop(std::span<size_t>(big)) == ring.capacity());
+   }
+   SECTION("rings move only types")
+   {
+      spsc_ring_t<std::unique_ptr<int>> spsc(2);
+      mpmc_ring_t<std::unique_ptr<int>> mpmc(2);
+      auto value = std::make_unique<int>(42);
+      REQUIRE(spsc.push(std::move(value)));
+      REQUIRE(!value);
+      REQUIRE(spsc.pop(value));
+      REQUIRE(*value == 42);
+      REQUIRE(mpmc.push(std::move(value)));
+      REQUIRE(mpmc.pop(value));
+      REQUIRE(*value == 42);
+      // a failed push keeps the item
+      REQUIRE(mpmc.push(std::make_unique<int>(1)));
+      REQUIRE(mpmc.push(std::make_unique<int>(2)));
+      REQUIRE(!mpmc.push(std::move(value)));
+      REQUIRE(value);
+   }
+   SECTION("mpmc_ring_t order, full and empty")
+   {
+      mpmc_ring_t<size_t> ring(1);
+      REQUIRE(ring.capacity() == 2);
+      size_t item{};
+      REQUIRE(!ring.pop(item));
+      REQUIRE(ring.push(size_t{ 1 }));
+      REQUIRE(ring.push(size_t{ 2 }));
+      REQUIRE(!ring.push(size_t{ 3 }));
+      REQUIRE(ring.size() == 2);
+      REQUIRE(ring.pop(item));
+      REQUIRE(item == 1);
+      REQUIRE(ring.push(size_t{ 3 }));
+      std::array<size_t, 4> out{};
+      REQUIRE(ring.pop(std::span<size_t>(out)) == 2);
+      REQUIRE(out[0] == 2);
+      REQUIRE(out[1] == 3);
+      REQUIRE(ring.empty());
+   }
+   SECTION("spsc_ring_t blocking handoff between threads")
+   {
+      spsc_ring_t<size_t, true> ring(16);
+      size_t sum{};
+      bool ordered{ true };
+      std::thread consumer([&]()
+      {
+         size_t item{};
+         for (size_t i = 0; i < iterations * threads; ++i)
+         {
+            ring.pop_wait(item);
+            if (item != i) ordered = false;
+            sum += item;
+         }
+      });
+      for (size_t i = 0; i < iterations * threads; ++i) ring.push_wait(size_t{ i });
+      consumer.join();
+      const size_t count = iterations * threads;
+      REQUIRE(ordered);
+      REQUIRE(sum == count * (count - 1) / 2);
+   }
+   SECTION("mpmc_ring_t delivers every item exactly once")
+   {
+      mpmc_ring_t<size_t, true> ring(64);
+      const size_t count = iterations * threads;
+      std::vector<std::atomic<uint8_t>> seen(count);
+      std::vector<std::thread> workers;
+      for (size_t p = 0; p < threads; ++p)
+      {
+         workers.emplace_back([&ring, p]()
+         {
+            for (size_t i = 0; i < iterations; ++i) ring.push_wait(p * iterations + i);
+         });
+      }
+      for (size_t c = 0; c < threads; ++c)
+      {
+         workers.emplace_back([&ring, &seen]()
+         {
+            size_t item{};
+            for (size_t i = 0; i < iterations; ++i)
+            {
+               ring.pop_wait(item);
+               seen[item].fetch_add(1, std::memory_order_relaxed);
+            }
+         });
+      }
+      for (auto& worker : workers) worker.join();
+      size_t wrong{};
+      for (auto& value : seen) if (value.load() != 1) ++wrong;
+      REQUIRE(wrong == 0);
+      REQUIRE(ring.empty());
+   }
+}